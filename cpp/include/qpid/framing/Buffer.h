@@ -29,6 +29,9 @@
 #include <string>
 
 namespace qpid {
+
+template <class T> class BufferRefT;
+
 namespace framing {
 
 struct QPID_COMMON_CLASS_EXTERN OutOfBounds : qpid::Exception {
@@ -43,12 +46,19 @@ class QPID_COMMON_CLASS_EXTERN Buffer
     uint32_t size;
     char* data;
     uint32_t position;
+    const BufferRefT<const char>* shared;
 
   public:
     void checkAvailable(size_t count) { if (count > size - position) throw OutOfBounds(); }
 
     QPID_COMMON_EXTERN Buffer(char* data=0, uint32_t size=0);
 
+    /** Buffer over ref-counted memory: content decoded from it may keep
+     * a reference to the memory instead of copying it out. The reference
+     * must outlive the Buffer.
+     */
+    QPID_COMMON_EXTERN Buffer(const BufferRefT<const char>& memory);
+
     QPID_COMMON_EXTERN void reset();
 
     QPID_COMMON_INLINE_EXTERN uint32_t available() { return size - position; }
@@ -56,6 +66,7 @@ class QPID_COMMON_CLASS_EXTERN Buffer
     QPID_COMMON_INLINE_EXTERN uint32_t getPosition() { return position; }
     QPID_COMMON_INLINE_EXTERN void setPosition(uint32_t p) { position = p; }
     QPID_COMMON_INLINE_EXTERN char* getPointer() { return data; }
+    QPID_COMMON_INLINE_EXTERN const BufferRefT<const char>* getSharedMemory() { return shared; }
 
     QPID_COMMON_EXTERN void putOctet(uint8_t i);
     QPID_COMMON_EXTERN void putShort(uint16_t i);
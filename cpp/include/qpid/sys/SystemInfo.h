@@ -103,6 +103,12 @@ QPID_COMMON_EXTERN std::string getProcessName();
  */
 QPID_COMMON_EXTERN bool threadSafeShutdown();
 
+/**
+ * Restrict the calling thread to running on a single CPU.
+ * Returns false if this is not supported on this platform or fails.
+ */
+QPID_COMMON_EXTERN bool setThreadAffinity(unsigned cpu);
+
 
 }}} // namespace qpid::sys::SystemInfo
 
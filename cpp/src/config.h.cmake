@@ -59,6 +59,7 @@
 #cmakedefine HAVE_COROSYNC_CPG_H ${HAVE_COROSYNC_CPG_H}
 #cmakedefine HAVE_LIBCMAN_H ${HAVE_LIBCMAN_H}
 #cmakedefine HAVE_SYS_SDT_H ${HAVE_SYS_SDT_H}
+#cmakedefine HAVE_LINUX_IO_URING_H ${HAVE_LINUX_IO_URING_H}
 #cmakedefine HAVE_LOG_AUTHPRIV
 #cmakedefine HAVE_LOG_FTP
 
@@ -109,12 +109,17 @@ if (BUILD_LEGACYSTORE)
         qpid/legacystore/StorePlugin.cpp
         qpid/legacystore/BindingDbt.cpp
         qpid/legacystore/BufferValue.cpp
+        qpid/legacystore/ConfigWriter.cpp
+        qpid/legacystore/ContentStore.cpp
         qpid/legacystore/DataTokenImpl.cpp
         qpid/legacystore/IdDbt.cpp
         qpid/legacystore/IdSequence.cpp
         qpid/legacystore/JournalImpl.cpp
+        qpid/legacystore/MessageDataSrc.cpp
         qpid/legacystore/MessageStoreImpl.cpp
         qpid/legacystore/PreparedTransaction.cpp
+        qpid/legacystore/RecoveryPool.cpp
+        qpid/legacystore/SharedJournals.cpp
         qpid/legacystore/TxnCtxt.cpp
     )
 
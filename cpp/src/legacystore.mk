@@ -29,6 +29,8 @@ EXTRA_DIST +=						\
 	qpid/legacystore/BindingDbt.h			\
 	qpid/legacystore/BufferValue.cpp		\
 	qpid/legacystore/BufferValue.h			\
+	qpid/legacystore/ContentStore.cpp		\
+	qpid/legacystore/ContentStore.h			\
 	qpid/legacystore/Cursor.h			\
 	qpid/legacystore/DataTokenImpl.cpp		\
 	qpid/legacystore/DataTokenImpl.h		\
@@ -38,10 +40,16 @@ EXTRA_DIST +=						\
 	qpid/legacystore/IdSequence.h			\
 	qpid/legacystore/JournalImpl.cpp		\
 	qpid/legacystore/JournalImpl.h			\
+	qpid/legacystore/MessageDataSrc.cpp		\
+	qpid/legacystore/MessageDataSrc.h		\
 	qpid/legacystore/MessageStoreImpl.cpp		\
 	qpid/legacystore/MessageStoreImpl.h		\
 	qpid/legacystore/PreparedTransaction.cpp	\
 	qpid/legacystore/PreparedTransaction.h		\
+	qpid/legacystore/RecoveryPool.cpp		\
+	qpid/legacystore/RecoveryPool.h			\
+	qpid/legacystore/SharedJournals.cpp		\
+	qpid/legacystore/SharedJournals.h		\
 	qpid/legacystore/StoreException.h		\
 	qpid/legacystore/StorePlugin.cpp		\
 	qpid/legacystore/TxnCtxt.cpp			\
@@ -51,6 +59,7 @@ EXTRA_DIST +=						\
 	qpid/legacystore/jrnl/aio_callback.h		\
 	qpid/legacystore/jrnl/cvar.cpp			\
 	qpid/legacystore/jrnl/cvar.h			\
+	qpid/legacystore/jrnl/data_src.h		\
 	qpid/legacystore/jrnl/data_tok.cpp		\
 	qpid/legacystore/jrnl/data_tok.h		\
 	qpid/legacystore/jrnl/deq_hdr.h			\
@@ -41,6 +41,9 @@ template <class T> class BufferRefT {
     T* begin() const { return begin_; }
     T* end() const { return end_; }
 
+    /** Number of references to the underlying buffer, 0 if there is none */
+    long refCount() const { return counter ? counter->refCount() : 0; }
+
     /** Return a sub-buffer of the current buffer */
     BufferRefT sub_buffer(T* begin, T* end) {
         assert(begin_ <= begin && begin <= end_);
@@ -50,6 +53,8 @@ template <class T> class BufferRefT {
     }
 
   private:
+    template <class U> friend class BufferRefT;
+
     boost::intrusive_ptr<RefCounted> counter;
     T* begin_;
     T* end_;
@@ -24,6 +24,7 @@
 #include "qpid/framing/AMQFrame.h"
 #include "qpid/framing/Buffer.h"
 #include "qpid/framing/ProtocolInitiation.h"
+#include "qpid/sys/LatencyHistogram.h"
 
 namespace qpid {
 namespace amqp_0_10 {
@@ -41,6 +42,15 @@ void Connection::setInputHandler(std::auto_ptr<sys::ConnectionInputHandler> c) {
 
 size_t  Connection::decode(const char* buffer, size_t size) {
     framing::Buffer in(const_cast<char*>(buffer), size);
+    return decodeFrames(in);
+}
+
+size_t  Connection::decodeShared(const ConstBufferRef& buffer) {
+    framing::Buffer in(buffer);
+    return decodeFrames(in);
+}
+
+size_t  Connection::decodeFrames(framing::Buffer& in) {
     if (isClient && !initialized) {
         //read in protocol header
         framing::ProtocolInitiation pi;
@@ -75,11 +85,15 @@ bool Connection::isClosed() const {
 }
 
 size_t  Connection::encode(char* buffer, size_t size) {
+    bool timed = sys::LatencyStats::isEnabled();
+    sys::AbsTime queued;
     {   // Swap frameQueue data into workQueue to avoid holding lock while we encode.
         Mutex::ScopedLock l(frameQueueLock);
         if (popClosed) return 0; // Can't pop any more frames.
         assert(workQueue.empty());
         workQueue.swap(frameQueue);
+        queued = queuedAt;
+        queuedAt = sys::AbsTime();
     }
     framing::Buffer out(buffer, size);
     if (!isClient && !initialized) {
@@ -113,12 +127,19 @@ size_t  Connection::encode(char* buffer, size_t size) {
         workQueue.clear();
         if (frameQueue.empty() && pushClosed)
             popClosed = true;
+        if (timed) {
+            // Frames sent while encoding are timed from when they were sent
+            if (queued == sys::AbsTime()) queued = queuedAt;
+            if (encoded) sys::LatencyStats::recordSince(sys::LatencyStats::DISPATCH_WRITE, queued);
+            queuedAt = frameQueue.empty() ? sys::AbsTime() : sys::AbsTime::now();
+        }
     }
     return out.getPosition();
 }
 
 void Connection::abort() { output.abort(); }
 void Connection::activateOutput() { output.activateOutput(); }
+void Connection::getWriteCounts(uint64_t& buffers, uint64_t& calls) const { output.getWriteCounts(buffers, calls); }
 
 void  Connection::close() {
     // No more frames can be pushed onto the queue.
@@ -134,8 +155,11 @@ void  Connection::closed() {
 void Connection::send(framing::AMQFrame& f) {
     {
         Mutex::ScopedLock l(frameQueueLock);
-	if (!pushClosed)
+	if (!pushClosed) {
+            if (frameQueue.empty() && queuedAt == sys::AbsTime() && sys::LatencyStats::isEnabled())
+                queuedAt = sys::AbsTime::now();
             frameQueue.push_back(f);
+        }
         buffered += f.encodedSize();
     }
     activateOutput();
@@ -27,6 +27,7 @@
 #include "qpid/sys/ConnectionInputHandler.h"
 #include "qpid/sys/ConnectionOutputHandler.h"
 #include "qpid/sys/Mutex.h"
+#include "qpid/sys/Time.h"
 #include "qpid/broker/BrokerImportExport.h"
 #include <boost/intrusive_ptr.hpp>
 #include <memory>
@@ -55,17 +56,22 @@ class Connection  : public sys::ConnectionCodec,
     bool initialized;
     bool isClient;
     size_t buffered;
+    sys::AbsTime queuedAt;      // When the oldest unencoded frame was sent, if timing
     framing::ProtocolVersion version;
 
+    size_t decodeFrames(framing::Buffer&);
+
   public:
     QPID_BROKER_EXTERN Connection(sys::OutputControl&, const std::string& id, bool isClient);
     QPID_BROKER_EXTERN void setInputHandler(std::auto_ptr<sys::ConnectionInputHandler> c);
     size_t decode(const char* buffer, size_t size);
+    size_t decodeShared(const ConstBufferRef& buffer);
     size_t encode(char* buffer, size_t size);
     bool isClosed() const;
     bool canEncode();
     void abort();
     void activateOutput();
+    void getWriteCounts(uint64_t& buffers, uint64_t& calls) const;
     void closed();              // connection closed by peer.
     void close();               // closing from this end.
     void send(framing::AMQFrame&);
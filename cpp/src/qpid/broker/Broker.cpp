@@ -26,6 +26,7 @@
 #include "qpid/broker/DirectExchange.h"
 #include "qpid/broker/FanOutExchange.h"
 #include "qpid/broker/HeadersExchange.h"
+#include "qpid/broker/LatencyMonitor.h"
 #include "qpid/broker/MessageStoreModule.h"
 #include "qpid/broker/NameGenerator.h"
 #include "qpid/broker/NullMessageStore.h"
@@ -69,9 +70,10 @@
 #include "qpid/framing/reply_exceptions.h"
 #include "qpid/framing/Uuid.h"
 #include "qpid/sys/TransportFactory.h"
+#include "qpid/sys/AsynchIO.h"
+#include "qpid/sys/BufferPool.h"
 #include "qpid/sys/Poller.h"
-#include "qpid/sys/Dispatcher.h"
-#include "qpid/sys/Thread.h"
+#include "qpid/sys/PollerPool.h"
 #include "qpid/sys/Time.h"
 #include "qpid/sys/Timer.h"
 #include "qpid/sys/ConnectionInputHandler.h"
@@ -92,8 +94,7 @@
 using qpid::sys::TransportAcceptor;
 using qpid::sys::TransportConnector;
 using qpid::sys::Poller;
-using qpid::sys::Dispatcher;
-using qpid::sys::Thread;
+using qpid::sys::PollerPool;
 using qpid::framing::FrameHandler;
 using qpid::framing::ChannelId;
 using qpid::management::ManagementAgent;
@@ -123,6 +124,16 @@ Broker::Options::Options(const std::string& name) :
     noDataDir(0),
     port(DEFAULT_PORT),
     workerThreads(5),
+    pollerBatchSize(8),
+    ioShards(1),
+    ioShardPolicy("least-connections"),
+    ioPinThreads(false),
+    ioBackend("default"),
+    ioBuffersMin(1),
+    ioBuffersMax(16),
+    ioBufferPoolIdle(64),
+    timerThreads(1),
+    latencyStats(false),
     connectionBacklog(10),
     enableMgmt(1),
     mgmtPublish(1),
@@ -160,9 +171,20 @@ Broker::Options::Options(const std::string& name) :
     addOptions()
         ("data-dir", optValue(dataDir,"DIR"), "Directory to contain persistent data generated by the broker")
         ("no-data-dir", optValue(noDataDir), "Don't use a data directory.  No persistent configuration will be loaded or stored")
+        ("paging-dir", optValue(pagingDir,"DIR"), "Directory in which paging files will be created for paged queues (defaults to a subdirectory of the data directory)")
         ("port,p", optValue(port,"PORT"), "Tells the broker to listen on PORT")
         ("interface", optValue(listenInterfaces, "<interface name>|<interface address>"), "Which network interfaces to use to listen for incoming connections")
         ("worker-threads", optValue(workerThreads, "N"), "Sets the broker thread pool size")
+        ("poller-batch-size", optValue(pollerBatchSize, "N"), "Maximum number of IO events each worker thread collects from the poller at once (1-64)")
+        ("io-shards", optValue(ioShards, "N"), "Number of independent pollers the worker threads and connections are divided between")
+        ("io-shard-policy", optValue(ioShardPolicy, "round-robin|least-connections"), "How new connections are assigned to an IO shard")
+        ("io-pin-threads", optValue(ioPinThreads, "yes|no"), "Bind each worker thread to its own CPU")
+        ("io-backend", optValue(ioBackend, "default|io_uring"), "Implementation used for network IO on plain TCP connections")
+        ("io-buffers-min", optValue(ioBuffersMin, "N"), "Number of IO buffers a connection keeps while it is quiet (0 keeps none)")
+        ("io-buffers-max", optValue(ioBuffersMax, "N"), "Number of IO buffers a busy connection may grow to")
+        ("io-buffer-pool-idle", optValue(ioBufferPoolIdle, "MB"), "Most memory kept in the shared pool for IO buffers not in use")
+        ("timer-threads", optValue(timerThreads, "N"), "Number of threads firing the broker's timer tasks (heartbeats, management, purging etc.)")
+        ("latency-stats", optValue(latencyStats, "yes|no"), "Record histograms of how long messages spend in each stage of processing")
         ("connection-backlog", optValue(connectionBacklog, "N"), "Sets the connection backlog limit for the server socket")
         ("mgmt-enable,m", optValue(enableMgmt,"yes|no"), "Enable Management")
         ("mgmt-publish", optValue(mgmtPublish,"yes|no"), "Enable Publish of Management Data ('no' implies query-only)")
@@ -204,8 +226,9 @@ framing::FieldTable noReplicateArgs() {
 }
 
 Broker::Broker(const Broker::Options& conf) :
-    poller(new Poller),
-    timer(new qpid::sys::Timer),
+    pollers(new PollerPool(conf.ioShards, conf.pollerBatchSize, PollerPool::getPolicy(conf.ioShardPolicy))),
+    poller(pollers->getPoller(0)),
+    timer(new qpid::sys::Timer(conf.timerThreads)),
     config(conf),
     managementAgent(conf.enableMgmt ? new ManagementAgent(conf.qmf1Support,
                                                           conf.qmf2Support)
@@ -229,6 +252,13 @@ Broker::Broker(const Broker::Options& conf) :
     getKnownBrokers(boost::bind(&Broker::getKnownBrokersImpl, this))
 {
     try {
+    if (!sys::AsynchIO::selectBackend(conf.ioBackend)) {
+        QPID_LOG(warning, "IO backend " << conf.ioBackend << " is not available, using the default");
+    } else if (conf.ioBackend != "default") {
+        QPID_LOG(notice, "Using " << conf.ioBackend << " for network IO");
+    }
+    sys::BufferPool::instance().setConnectionLimits(conf.ioBuffersMin, conf.ioBuffersMax);
+    sys::BufferPool::instance().setMaxIdle(conf.ioBufferPoolIdle*1024*1024);
     if (conf.enableMgmt) {
         QPID_LOG(info, "Management enabled");
         managementAgent->configure(dataDir.isEnabled() ? dataDir.getPath() : string(), conf.mgmtPublish,
@@ -359,6 +389,14 @@ Broker::Broker(const Broker::Options& conf) :
         queueCleaner.start(conf.queueCleanInterval * qpid::sys::TIME_SEC);
     }
 
+    if (conf.latencyStats) {
+        sys::LatencyStats::enable(true);
+        if (conf.enableMgmt)
+            latencyMonitor.reset(new LatencyMonitor(this, managementAgent.get(), *timer,
+                                                    conf.mgmtPubInterval * qpid::sys::TIME_SEC));
+        QPID_LOG(notice, "Recording message latency statistics");
+    }
+
     if (!conf.knownHosts.empty() && conf.knownHosts != knownHostsNone) {
         knownBrokers.push_back(Url(conf.knownHosts));
     }
@@ -409,21 +447,7 @@ void Broker::setStore () {
 void Broker::run() {
     if (config.workerThreads > 0) {
         QPID_LOG(notice, "Broker running");
-        Dispatcher d(poller);
-        int numIOThreads = config.workerThreads;
-        std::vector<Thread> t(numIOThreads-1);
-
-        // Run n-1 io threads
-        for (int i=0; i<numIOThreads-1; ++i)
-            t[i] = Thread(d);
-
-        // Run final thread
-        d.run();
-
-        // Now wait for n-1 io threads to exit
-        for (int i=0; i<numIOThreads-1; ++i) {
-            t[i].join();
-        }
+        pollers->run(config.workerThreads, config.ioPinThreads);
     } else {
         throw Exception((boost::format("Invalid value for worker-threads: %1%") % config.workerThreads).str());
     }
@@ -433,7 +457,7 @@ void Broker::shutdown() {
     // NB: this function must be async-signal safe, it must not
     // call any function that is not async-signal safe.
     // Any unsafe shutdown actions should be done in the destructor.
-    poller->shutdown();
+    pollers->shutdown();
 }
 
 Broker::~Broker() {
@@ -1006,6 +1030,13 @@ Manageable::status_t Broker::setTimestampConfig(const bool receive,
     return Manageable::STATUS_OK;
 }
 
+std::string Broker::getPagingDir()
+{
+    if (!config.pagingDir.empty()) return config.pagingDir;
+    else if (dataDir.isEnabled()) return dataDir.getPath() + "/pq";
+    else return std::string();
+}
+
 void Broker::setLogLevel(const std::string& level)
 {
     QPID_LOG(notice, "Changing log level to " << level);
@@ -55,6 +55,7 @@ namespace sys {
 class TransportAcceptor;
 class TransportConnector;
 class Poller;
+class PollerPool;
 class Timer;
 }
 
@@ -65,6 +66,7 @@ namespace broker {
 class AclModule;
 class ConnectionState;
 class ExpiryPolicy;
+class LatencyMonitor;
 class Message;
 struct QueueSettings;
 static const  uint16_t DEFAULT_PORT=5672;
@@ -92,9 +94,20 @@ class Broker : public sys::Runnable, public Plugin::Target,
 
         bool noDataDir;
         std::string dataDir;
+        std::string pagingDir;
         uint16_t port;
         std::vector<std::string> listenInterfaces;
         int workerThreads;
+        uint32_t pollerBatchSize;
+        uint32_t ioShards;
+        std::string ioShardPolicy;
+        bool ioPinThreads;
+        std::string ioBackend;
+        uint32_t ioBuffersMin;
+        uint32_t ioBuffersMax;
+        size_t ioBufferPoolIdle;
+        uint32_t timerThreads;
+        bool latencyStats;
         int connectionBacklog;
         bool enableMgmt;
         bool mgmtPublish;
@@ -164,6 +177,7 @@ class Broker : public sys::Runnable, public Plugin::Target,
                                             const ConnectionState* context);
     Manageable::status_t setTimestampConfig(const bool receive,
                                             const ConnectionState* context);
+    std::auto_ptr<sys::PollerPool> pollers;
     boost::shared_ptr<sys::Poller> poller;
     std::auto_ptr<sys::Timer> timer;
     Options config;
@@ -185,6 +199,7 @@ class Broker : public sys::Runnable, public Plugin::Target,
     Vhost::shared_ptr            vhostObject;
     System::shared_ptr           systemObject;
     QueueCleaner queueCleaner;
+    std::auto_ptr<LatencyMonitor> latencyMonitor;
     std::vector<Url> knownBrokers;
     std::vector<Url> getKnownBrokersImpl();
     bool deferDeliveryImpl(const std::string& queue,
@@ -232,6 +247,8 @@ class Broker : public sys::Runnable, public Plugin::Target,
     LinkRegistry& getLinks() { return links; }
     DtxManager& getDtxManager() { return dtxManager; }
     DataDir& getDataDir() { return dataDir; }
+    /** Directory for the paging files of paged queues; empty if paging is unavailable */
+    QPID_BROKER_EXTERN std::string getPagingDir();
     Options& getOptions() { return config; }
     ProtocolRegistry& getProtocolRegistry() { return protocolRegistry; }
     ObjectFactoryRegistry& getObjectFactoryRegistry() { return objectFactory; }
@@ -285,6 +302,9 @@ class Broker : public sys::Runnable, public Plugin::Target,
     /** Expose poller so plugins can register their descriptors. */
     QPID_BROKER_EXTERN boost::shared_ptr<sys::Poller> getPoller();
 
+    /** The IO shards connections are spread over, getPoller() is the first */
+    sys::PollerPool& getPollerPool() { return *pollers; }
+
     /** Timer for local tasks affecting only this broker */
     sys::Timer& getTimer() { return *timer; }
 
@@ -99,6 +99,7 @@ Connection::Connection(ConnectionOutputHandler* out_,
     timer(broker_.getTimer()),
     errorListener(0),
     objectId(objectId_),
+    writeCalls(0),
     outboundTracker(*this)
 {
     outboundTracker.wrap(out);
@@ -186,6 +187,22 @@ void Connection::recordFromServer(const framing::AMQFrame& frame)
     }
 }
 
+void Connection::recordWrites()
+{
+    if (mgmtObject != 0)
+    {
+        uint64_t buffers, calls;
+        out.getWriteCounts(buffers, calls);
+        if (calls != writeCalls) {
+            qmf::org::apache::qpid::broker::Connection::PerThreadStats *cStats = mgmtObject->getStatistics();
+            cStats->writeSyscalls += calls - writeCalls;
+            mgmtObject->statisticsUpdated();
+            mgmtObject->set_writesPerSyscall(double(buffers) / calls);
+            writeCalls = calls;
+        }
+    }
+}
+
 void Connection::recordFromClient(const framing::AMQFrame& frame)
 {
     if (mgmtObject != 0)
@@ -325,6 +342,7 @@ void Connection::doIoCallbacks() {
 bool Connection::doOutput() {
     try {
         doIoCallbacks();
+        recordWrites();
         if (mgmtClosing) {
             closed();
             close(connection::CLOSE_CODE_CONNECTION_FORCED, "Closed by Management Request");
@@ -482,6 +500,7 @@ void Connection::OutboundFrameTracker::close() { next->close(); }
 size_t Connection::OutboundFrameTracker::getBuffered() const { return next->getBuffered(); }
 void Connection::OutboundFrameTracker::abort() { next->abort(); }
 void Connection::OutboundFrameTracker::activateOutput() { next->activateOutput(); }
+void Connection::OutboundFrameTracker::getWriteCounts(uint64_t& buffers, uint64_t& calls) const { next->getWriteCounts(buffers, calls); }
 void Connection::OutboundFrameTracker::send(framing::AMQFrame& f)
 {
     next->send(f);
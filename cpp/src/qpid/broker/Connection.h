@@ -111,6 +111,7 @@ class Connection : public sys::ConnectionInputHandler,
     void requestIOProcessing (boost::function0<void>);
     void recordFromServer (const framing::AMQFrame& frame);
     void recordFromClient (const framing::AMQFrame& frame);
+    void recordWrites ();
 
     // gets for configured federation links
     std::string getAuthMechanism();
@@ -177,6 +178,7 @@ class Connection : public sys::ConnectionInputHandler,
     boost::intrusive_ptr<ConnectionTimeoutTask> timeoutTimer;
     ErrorListener* errorListener;
     uint64_t objectId;
+    uint64_t writeCalls;
     framing::FieldTable clientProperties;
 
     /**
@@ -191,6 +193,7 @@ class Connection : public sys::ConnectionInputHandler,
         size_t getBuffered() const;
         void abort();
         void activateOutput();
+        void getWriteCounts(uint64_t& buffers, uint64_t& calls) const;
         void send(framing::AMQFrame&);
         void wrap(sys::ConnectionOutputHandlerPtr&);
       private:
@@ -0,0 +1,66 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/broker/ExpiryIndex.h"
+#include "qpid/broker/Message.h"
+
+namespace qpid {
+namespace broker {
+
+using qpid::sys::AbsTime;
+using qpid::sys::FAR_FUTURE;
+
+void ExpiryIndex::add(const Message& m)
+{
+    if (m.getExpiration() < FAR_FUTURE) {
+        entries.insert(Entry(m.getExpiration(), m.getSequence()));
+    }
+}
+
+void ExpiryIndex::remove(const Message& m)
+{
+    if (m.getExpiration() < FAR_FUTURE) {
+        entries.erase(Entry(m.getExpiration(), m.getSequence()));
+    }
+}
+
+void ExpiryIndex::remove(const Entry& e)
+{
+    entries.erase(e);
+}
+
+void ExpiryIndex::due(AbsTime now, Entries& result) const
+{
+    for (std::set<Entry>::const_iterator i = entries.begin(); i != entries.end() && !(now < i->first); ++i) {
+        result.push_back(*i);
+    }
+}
+
+size_t ExpiryIndex::size() const
+{
+    return entries.size();
+}
+
+bool ExpiryIndex::empty() const
+{
+    return entries.empty();
+}
+
+}} // namespace qpid::broker
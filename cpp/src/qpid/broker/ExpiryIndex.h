@@ -0,0 +1,65 @@
+#ifndef QPID_BROKER_EXPIRYINDEX_H
+#define QPID_BROKER_EXPIRYINDEX_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/framing/SequenceNumber.h"
+#include "qpid/sys/Time.h"
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace qpid {
+namespace broker {
+
+class Message;
+
+/**
+ * Index of the messages on a queue that carry an expiration time,
+ * ordered by that time. Allows expired messages to be found without
+ * scanning the whole queue. As with Messages, all locking is assumed
+ * to be done by the Queue.
+ */
+class ExpiryIndex
+{
+  public:
+    typedef std::pair<sys::AbsTime, framing::SequenceNumber> Entry;
+    typedef std::vector<Entry> Entries;
+
+    /** Record the message if it has an expiration time. */
+    void add(const Message&);
+    /** Forget the message, e.g. when it is dequeued. */
+    void remove(const Message&);
+    void remove(const Entry&);
+    /**
+     * Collect the entries whose expiration time is not later than
+     * the specified time, earliest first. The entries remain in the
+     * index until explicitly removed.
+     */
+    void due(sys::AbsTime now, Entries& result) const;
+    size_t size() const;
+    bool empty() const;
+  private:
+    std::set<Entry> entries;
+};
+}} // namespace qpid::broker
+
+#endif  /*!QPID_BROKER_EXPIRYINDEX_H*/
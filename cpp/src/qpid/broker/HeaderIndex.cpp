@@ -0,0 +1,99 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/broker/HeaderIndex.h"
+#include "qpid/broker/Message.h"
+#include <algorithm>
+
+namespace qpid {
+namespace broker {
+
+using qpid::framing::SequenceNumber;
+
+HeaderIndex::HeaderIndex(const std::vector<std::string>& headers)
+{
+    for (std::vector<std::string>::const_iterator i = headers.begin(); i != headers.end(); ++i) {
+        indexes[*i];
+    }
+}
+
+void HeaderIndex::add(const Message& m)
+{
+    for (Indexes::iterator i = indexes.begin(); i != indexes.end(); ++i) {
+        std::string value = m.getPropertyAsString(i->first);
+        if (!value.empty()) i->second.insert(Entry(value, m.getSequence()));
+    }
+}
+
+void HeaderIndex::remove(const Message& m)
+{
+    for (Indexes::iterator i = indexes.begin(); i != indexes.end(); ++i) {
+        std::string value = m.getPropertyAsString(i->first);
+        if (!value.empty()) i->second.erase(Entry(value, m.getSequence()));
+    }
+}
+
+bool HeaderIndex::isIndexed(const std::string& header) const
+{
+    return indexes.find(header) != indexes.end();
+}
+
+bool HeaderIndex::match(const std::string& header, const std::string& value, Positions& positions) const
+{
+    const Entries* entries = get(header);
+    if (!entries || value.empty()) return false;
+    for (Entries::const_iterator i = entries->lower_bound(Entry(value, 0)); i != entries->end() && i->first == value; ++i) {
+        positions.push_back(i->second);
+    }
+    std::sort(positions.begin(), positions.end());
+    return true;
+}
+
+bool HeaderIndex::prefix(const std::string& header, const std::string& prefix, Positions& positions) const
+{
+    const Entries* entries = get(header);
+    if (!entries) return false;
+    for (Entries::const_iterator i = entries->lower_bound(Entry(prefix, 0));
+         i != entries->end() && i->first.compare(0, prefix.size(), prefix) == 0; ++i) {
+        positions.push_back(i->second);
+    }
+    std::sort(positions.begin(), positions.end());
+    return true;
+}
+
+bool HeaderIndex::range(const std::string& header, const std::string& lower, const std::string& upper, Positions& positions) const
+{
+    const Entries* entries = get(header);
+    if (!entries) return false;
+    for (Entries::const_iterator i = entries->lower_bound(Entry(lower, 0));
+         i != entries->end() && (upper.empty() || i->first <= upper); ++i) {
+        positions.push_back(i->second);
+    }
+    std::sort(positions.begin(), positions.end());
+    return true;
+}
+
+const HeaderIndex::Entries* HeaderIndex::get(const std::string& header) const
+{
+    Indexes::const_iterator i = indexes.find(header);
+    return i == indexes.end() ? 0 : &(i->second);
+}
+
+}} // namespace qpid::broker
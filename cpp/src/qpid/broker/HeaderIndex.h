@@ -0,0 +1,75 @@
+#ifndef QPID_BROKER_HEADERINDEX_H
+#define QPID_BROKER_HEADERINDEX_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/framing/SequenceNumber.h"
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace qpid {
+namespace broker {
+
+class Message;
+
+/**
+ * Secondary indexes over the string values of selected message
+ * headers, allowing the messages on a queue whose header matches a
+ * value, a prefix or a range of values to be located without
+ * scanning the whole queue. As with Messages, all locking is assumed
+ * to be done by the Queue.
+ */
+class HeaderIndex
+{
+  public:
+    typedef std::vector<framing::SequenceNumber> Positions;
+
+    HeaderIndex(const std::vector<std::string>& headers);
+    /** Record the message against each indexed header it carries. */
+    void add(const Message&);
+    /** Forget the message, e.g. when it is dequeued. */
+    void remove(const Message&);
+    bool isIndexed(const std::string& header) const;
+    /**
+     * The following collect the positions of messages whose value for
+     * the specified header matches, in ascending order. They return
+     * false if that header is not indexed. Messages without the header
+     * (or with an empty value for it) are not indexed.
+     */
+    bool match(const std::string& header, const std::string& value, Positions&) const;
+    bool prefix(const std::string& header, const std::string& prefix, Positions&) const;
+    /** An empty upper bound means the range is unbounded above; both bounds are inclusive. */
+    bool range(const std::string& header, const std::string& lower, const std::string& upper, Positions&) const;
+  private:
+    //raw sequence values give a total order within each header value
+    typedef std::pair<std::string, uint32_t> Entry;
+    typedef std::set<Entry> Entries;
+    typedef std::map<std::string, Entries> Indexes;
+    Indexes indexes;
+
+    const Entries* get(const std::string& header) const;
+};
+}} // namespace qpid::broker
+
+#endif  /*!QPID_BROKER_HEADERINDEX_H*/
@@ -0,0 +1,121 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/broker/LatencyMonitor.h"
+
+#include "qpid/management/ManagementAgent.h"
+#include "qpid/sys/Timer.h"
+#include "qmf/org/apache/qpid/broker/ArgsLatencyDump.h"
+
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+namespace qpid {
+namespace broker {
+
+namespace _qmf = qmf::org::apache::qpid::broker;
+using qpid::management::Manageable;
+using qpid::management::Args;
+
+namespace {
+    typedef boost::function0<void> FireFunction;
+    class Task : public sys::TimerTask
+    {
+    public:
+        Task(FireFunction f, sys::Duration duration) : sys::TimerTask(duration, "LatencyMonitor"), fireFunction(f) {}
+        void fire() { fireFunction(); }
+    private:
+        FireFunction fireFunction;
+    };
+}
+
+LatencyMonitor::LatencyMonitor(management::Manageable* parent, management::ManagementAgent* agent,
+                               sys::Timer& t, sys::Duration period) : timer(t)
+{
+    for (int i = 0; i < sys::LatencyStats::STAGES; ++i)
+        stages.push_back(boost::shared_ptr<Stage>(new Stage(sys::LatencyStats::Stage(i), parent, agent)));
+    task = new Task(boost::bind(&LatencyMonitor::fired, this), period);
+    timer.add(task);
+}
+
+LatencyMonitor::~LatencyMonitor()
+{
+    task->cancel();
+}
+
+void LatencyMonitor::fired()
+{
+    for (std::vector<boost::shared_ptr<Stage> >::iterator i = stages.begin(); i != stages.end(); ++i)
+        (*i)->update();
+    task->setupNextFire();
+    timer.add(task);
+}
+
+LatencyMonitor::Stage::Stage(sys::LatencyStats::Stage s, management::Manageable* parent,
+                             management::ManagementAgent* agent) : stage(s)
+{
+    mgmtObject = _qmf::Latency::shared_ptr(new _qmf::Latency(agent, this, parent, sys::LatencyStats::getName(stage)));
+    agent->addObject(mgmtObject);
+    update();
+}
+
+LatencyMonitor::Stage::~Stage()
+{
+    mgmtObject->resourceDestroy();
+}
+
+void LatencyMonitor::Stage::update()
+{
+    sys::LatencyHistogram histogram;
+    sys::LatencyStats::get(stage, histogram);
+    mgmtObject->set_samples(histogram.getCount());
+    mgmtObject->set_minimum(histogram.getMin());
+    mgmtObject->set_maximum(histogram.getMax());
+    mgmtObject->set_mean(histogram.getMean());
+    mgmtObject->set_p50(histogram.getPercentile(50));
+    mgmtObject->set_p90(histogram.getPercentile(90));
+    mgmtObject->set_p99(histogram.getPercentile(99));
+    mgmtObject->set_p999(histogram.getPercentile(99.9));
+}
+
+Manageable::status_t LatencyMonitor::Stage::ManagementMethod(uint32_t methodId, Args& args, std::string&)
+{
+    switch (methodId) {
+      case _qmf::Latency::METHOD_DUMP: {
+        sys::LatencyHistogram histogram;
+        sys::LatencyStats::get(stage, histogram);
+        types::Variant::Map& buckets = dynamic_cast<_qmf::ArgsLatencyDump&>(args).o_buckets;
+        for (uint32_t i = 0; i < sys::LatencyHistogram::Buckets; ++i) {
+            if (histogram.getBucketCount(i))
+                buckets[boost::lexical_cast<std::string>(sys::LatencyHistogram::getBucketLimit(i))] = histogram.getBucketCount(i);
+        }
+        update();
+        return Manageable::STATUS_OK;
+      }
+      case _qmf::Latency::METHOD_RESET:
+        sys::LatencyStats::reset(stage);
+        update();
+        return Manageable::STATUS_OK;
+    }
+    return Manageable::STATUS_UNKNOWN_METHOD;
+}
+
+}} // namespace qpid::broker
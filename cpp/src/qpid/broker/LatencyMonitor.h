@@ -0,0 +1,80 @@
+#ifndef QPID_BROKER_LATENCYMONITOR_H
+#define QPID_BROKER_LATENCYMONITOR_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/management/Manageable.h"
+#include "qpid/sys/LatencyHistogram.h"
+#include "qmf/org/apache/qpid/broker/Latency.h"
+
+#include <boost/intrusive_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace qpid {
+
+namespace management {
+    class ManagementAgent;
+}
+
+namespace sys {
+    class Timer;
+    class TimerTask;
+}
+
+namespace broker {
+
+/**
+ * Publishes the latency histograms recorded by sys::LatencyStats as
+ * management objects, one per stage, refreshed every management publish
+ * interval.
+ */
+class LatencyMonitor
+{
+  public:
+    LatencyMonitor(management::Manageable* parent, management::ManagementAgent* agent,
+                   sys::Timer& timer, sys::Duration period);
+    ~LatencyMonitor();
+
+  private:
+    class Stage : public management::Manageable
+    {
+      public:
+        Stage(sys::LatencyStats::Stage, management::Manageable* parent, management::ManagementAgent* agent);
+        ~Stage();
+        void update();
+        management::ManagementObject::shared_ptr GetManagementObject() const { return mgmtObject; }
+        management::Manageable::status_t ManagementMethod(uint32_t methodId, management::Args& args, std::string& text);
+      private:
+        sys::LatencyStats::Stage stage;
+        qmf::org::apache::qpid::broker::Latency::shared_ptr mgmtObject;
+    };
+
+    std::vector<boost::shared_ptr<Stage> > stages;
+    boost::intrusive_ptr<sys::TimerTask> task;
+    sys::Timer& timer;
+
+    void fired();
+};
+}} // namespace qpid::broker
+
+#endif  /*!QPID_BROKER_LATENCYMONITOR_H*/
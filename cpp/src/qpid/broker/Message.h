@@ -90,12 +90,16 @@ public:
     bool hasExpired() const;
     sys::AbsTime getExpiration() const { return expiration; }
     void setExpiration(sys::AbsTime exp) { expiration = exp; }
+    /** when the message reached its latest stage, if latency stats are enabled */
+    sys::AbsTime getStageTime() const { return stageTime; }
+    void setStageTime(sys::AbsTime t) { stageTime = t; }
     uint64_t getTtl() const;
     bool getTtl(uint64_t) const;
 
     /** set the timestamp delivery property to the current time-of-day */
     QPID_BROKER_EXTERN void setTimestamp();
     QPID_BROKER_EXTERN uint64_t getTimestamp() const;
+    void setTimestamp(uint64_t t) { timestamp = t; }
 
     QPID_BROKER_EXTERN void addAnnotation(const std::string& key, const qpid::types::Variant& value);
     QPID_BROKER_EXTERN bool isExcluded(const std::vector<std::string>& excludes) const;
@@ -141,6 +145,7 @@ public:
     bool isManagementMessage;
     MessageState state;
     qpid::framing::SequenceNumber sequence;
+    qpid::sys::AbsTime stageTime;
 
     void annotationsChanged();
 };
@@ -51,20 +51,46 @@ const std::string MessageGroupManager::qpidSharedGroup("qpid.shared_msg_group");
 const std::string MessageGroupManager::qpidMessageGroupTimestamp("qpid.group_timestamp");
 
 
-/** return an iterator to the message at position, or members.end() if not found */
-MessageGroupManager::GroupState::MessageFifo::iterator
-MessageGroupManager::GroupState::findMsg(const qpid::framing::SequenceNumber &position)
+/** return the state of the message at position, or 0 if it is not tracked */
+MessageGroupManager::MessageState* MessageGroupManager::findMsg(const qpid::framing::SequenceNumber &position)
 {
-    MessageState mState(position);
-    MessageFifo::iterator found = std::lower_bound(members.begin(), members.end(), mState);
-    return (found->position == position) ? found : members.end();
+    if (index.empty() || position < base) return 0;
+    size_t i = position - base;
+    if (i >= index.size() || !index[i].group) return 0;
+    return &index[i];
 }
 
-void MessageGroupManager::unFree( const GroupState& state )
+MessageGroupManager::GroupState* MessageGroupManager::allocate()
 {
-    GroupFifo::iterator pos = freeGroups.find( state.members.front().position );
-    assert( pos != freeGroups.end() && pos->second == &state );
-    freeGroups.erase( pos );
+    if (spareGroups) {
+        GroupState* state = spareGroups;
+        spareGroups = state->next;
+        state->next = 0;
+        return state;
+    }
+    groupPool.push_back(GroupState());
+    return &groupPool.back();
+}
+
+void MessageGroupManager::release( GroupState& state )
+{
+    // strings are cleared rather than replaced so their storage is reused
+    state.group.clear();
+    state.owner.clear();
+    state.acquired = 0;
+    state.total = 0;
+    state.prev = 0;
+    state.next = spareGroups;
+    spareGroups = &state;
+}
+
+void MessageGroupManager::unFree( GroupState& state )
+{
+    assert( state.prev || freeGroups == &state );
+    if (state.prev) state.prev->next = state.next;
+    else freeGroups = state.next;
+    if (state.next) state.next->prev = state.prev;
+    state.prev = state.next = 0;
 }
 
 void MessageGroupManager::own( GroupState& state, const std::string& owner )
@@ -76,66 +102,75 @@ void MessageGroupManager::own( GroupState& state, const std::string& owner )
 void MessageGroupManager::disown( GroupState& state )
 {
     state.owner.clear();
-    assert(state.members.size());
-    assert(freeGroups.find(state.members.front().position) == freeGroups.end());
-    freeGroups[state.members.front().position] = &state;
+    assert(state.total);
+    assert(!state.prev && freeGroups != &state);
+    state.prev = 0;
+    state.next = freeGroups;
+    if (freeGroups) freeGroups->prev = &state;
+    freeGroups = &state;
 }
 
 MessageGroupManager::GroupState& MessageGroupManager::findGroup( const Message& m )
 {
-    uint32_t thisMsg = m.getSequence().getValue();
-    if (cachedGroup && lastMsg == thisMsg) {
-        hits++;
-        return *cachedGroup;
-    }
-
     std::string group = m.getPropertyAsString(groupIdHeader);
     if (group.empty()) group = defaultGroupId; //empty group is reserved
 
-    if (cachedGroup && group == lastGroup) {
-        hits++;
-        lastMsg = thisMsg;
-        return *cachedGroup;
+    GroupState*& found = messageGroups[group];
+    if (!found) {
+        found = allocate();
+        found->group = group;    // new group, assign name
     }
-
-    misses++;
-
-    GroupState& found = messageGroups[group];
-    if (found.group.empty())
-        found.group = group;    // new group, assign name
-    lastMsg = thisMsg;
-    lastGroup = group;
-    cachedGroup = &found;
-    return found;
+    return *found;
 }
 
 
 void MessageGroupManager::enqueued( const Message& m )
 {
-    // @todo KAG optimization - store reference to group state in QueuedMessage
-    // issue: const-ness??
+    const qpid::framing::SequenceNumber position(m.getSequence());
+    // the queue may have been reset to an earlier position (HA replication)
+    while (index.size() && !index.back().group && position <= base + int32_t(index.size() - 1))
+        index.pop_back();
+    if (index.empty()) {
+        base = position;
+    } else if (position <= base + int32_t(index.size() - 1)) {
+        QPID_LOG( error, "group queue " << qName << ": message at " << position << " enqueued out of sequence");
+        assert(false);
+        return;
+    } else {
+        // pad any gap in the sequence so positions can be used as an index
+        while (base + int32_t(index.size()) < position) index.push_back(MessageState());
+    }
+
+    // The group id is decoded only here; the message's state then refers
+    // straight to its group.
     GroupState& state = findGroup(m);
-    GroupState::MessageState mState(m.getSequence());
-    state.members.push_back(mState);
-    uint32_t total = state.members.size();
+    index.push_back(MessageState());
+    MessageState& mState = index.back();
+    mState.group = &state;
+    if (state.total) {
+        mState.prev = state.tail;
+        index[state.tail - base].next = position;
+    } else {
+        state.head = position;
+    }
+    state.tail = position;
+    uint32_t total = ++state.total;
     QPID_LOG( trace, "group queue " << qName <<
               ": added message to group id=" << state.group << " total=" << total );
     if (total == 1) {
         // newly created group, no owner
-        assert(freeGroups.find(m.getSequence()) == freeGroups.end());
-        freeGroups[m.getSequence()] = &state;
+        disown(state);
     }
 }
 
 
 void MessageGroupManager::acquired( const Message& m )
 {
-    // @todo KAG  avoid lookup: retrieve direct reference to group state from QueuedMessage
-    // issue: const-ness??
-    GroupState& state = findGroup(m);
-    GroupState::MessageFifo::iterator gm = state.findMsg(m.getSequence());
-    assert(gm != state.members.end());
-    gm->acquired = true;
+    MessageState* mState = findMsg(m.getSequence());
+    assert(mState);
+    if (!mState) return;
+    GroupState& state = *mState->group;
+    mState->acquired = true;
     state.acquired += 1;
     QPID_LOG( trace, "group queue " << qName <<
               ": acquired message in group id=" << state.group << " acquired=" << state.acquired );
@@ -144,14 +179,13 @@ void MessageGroupManager::acquired( const Message& m )
 
 void MessageGroupManager::requeued( const Message& m )
 {
-    // @todo KAG  avoid lookup: retrieve direct reference to group state from QueuedMessage
-    // issue: const-ness??
-    GroupState& state = findGroup(m);
+    MessageState* mState = findMsg(m.getSequence());
+    assert(mState);
+    if (!mState) return;
+    GroupState& state = *mState->group;
     assert( state.acquired != 0 );
     state.acquired -= 1;
-    GroupState::MessageFifo::iterator i = state.findMsg(m.getSequence());
-    assert(i != state.members.end());
-    i->acquired = false;
+    mState->acquired = false;
     if (state.acquired == 0 && state.owned()) {
         QPID_LOG( trace, "group queue " << qName <<
                   ": consumer name=" << state.owner << " released group id=" << state.group);
@@ -164,42 +198,37 @@ void MessageGroupManager::requeued( const Message& m )
 
 void MessageGroupManager::dequeued( const Message& m )
 {
-    // @todo KAG  avoid lookup: retrieve direct reference to group state from QueuedMessage
-    // issue: const-ness??
-    GroupState& state = findGroup(m);
-    GroupState::MessageFifo::iterator i = state.findMsg(m.getSequence());
-    assert(i != state.members.end());
-    if (i->acquired) {
+    const qpid::framing::SequenceNumber position(m.getSequence());
+    MessageState* mState = findMsg(position);
+    assert(mState);
+    if (!mState) return;
+    GroupState& state = *mState->group;
+    if (mState->acquired) {
         assert( state.acquired != 0 );
         state.acquired -= 1;
     }
 
-    // special case if qm is first (oldest) message in the group:
-    // may need to re-insert it back on the freeGroups list, as the index will change
-    bool reFreeNeeded = false;
-    if (i == state.members.begin()) {
-        if (!state.owned()) {
-            // will be on the freeGroups list if mgmt is dequeueing rather than a consumer!
-            // if on freelist, it is indexed by first member, which is about to be removed!
-            unFree(state);
-            reFreeNeeded = true;
-        }
-        state.members.pop_front();
-    } else {
-        state.members.erase(i);
+    // unlink the message from its group
+    if (position == state.head) state.head = mState->next;
+    else index[mState->prev - base].next = mState->next;
+    if (position == state.tail) state.tail = mState->prev;
+    else index[mState->next - base].prev = mState->prev;
+    *mState = MessageState();
+    while (index.size() && !index.front().group) {
+        index.pop_front();
+        ++base;
     }
 
-    uint32_t total = state.members.size();
+    uint32_t total = --state.total;
     QPID_LOG( trace, "group queue " << qName <<
               ": dequeued message from group id=" << state.group << " total=" << total );
 
     if (total == 0) {
         QPID_LOG( trace, "group queue " << qName << ": deleting group id=" << state.group);
-        if (cachedGroup == &state) {
-            cachedGroup = 0;
-        }
-        std::string key(state.group);
-        messageGroups.erase( key );
+        // will be on the freeGroups list if mgmt is dequeueing rather than a consumer!
+        if (!state.owned()) unFree(state);
+        messageGroups.erase( state.group );
+        release(state);
     } else if (state.acquired == 0 && state.owned()) {
         QPID_LOG( trace, "group queue " << qName <<
                   ": consumer name=" << state.owner << " released group id=" << state.group);
@@ -210,21 +239,24 @@ void MessageGroupManager::dequeued( const Message& m )
         } else {
             QPID_LOG(warning, "Could not reset cursors for message group, unexpected container type");
         }
-    } else if (reFreeNeeded) {
-        disown(state);
     }
 }
 
 MessageGroupManager::~MessageGroupManager()
 {
-    QPID_LOG( debug, "group queue " << qName << " cache results: hits=" << hits << " misses=" << misses );
+    QPID_LOG( debug, "group queue " << qName << " destroyed with " << messageGroups.size() << " groups"
+              << " (pool size=" << groupPool.size() << ")" );
 }
 
 bool MessageGroupManager::acquire(const std::string& consumer, Message& m)
 {
     if (m.getState() == AVAILABLE) {
-        // @todo KAG avoid lookup: retrieve direct reference to group state from QueuedMessage
-        GroupState& state = findGroup(m);
+        MessageState* mState = findMsg(m.getSequence());
+        if (!mState) {
+            QPID_LOG( warning, "group queue " << qName << ": no group state for message at " << m.getSequence());
+            return false;
+        }
+        GroupState& state = *mState->group;
 
         if (!state.owned()) {
             own( state, consumer );
@@ -268,16 +300,16 @@ void MessageGroupManager::query(qpid::types::Variant::Map& status) const
          g != messageGroups.end(); ++g) {
         qpid::types::Variant::Map info;
         info[GROUP_ID_KEY] = g->first;
-        info[GROUP_MSG_COUNT] = (uint64_t) g->second.members.size();
+        info[GROUP_MSG_COUNT] = (uint64_t) g->second->total;
         // set the timestamp to the arrival timestamp of the oldest (HEAD) message, if present
         info[GROUP_TIMESTAMP] = 0;
-        if (g->second.members.size() != 0) {
-            Message* m = messages.find(g->second.members.front().position, 0);
+        if (g->second->total != 0) {
+            Message* m = messages.find(g->second->head, 0);
             if (m && m->getTimestamp()) {
                 info[GROUP_TIMESTAMP] = m->getTimestamp();
             }
         }
-        info[GROUP_CONSUMER] = g->second.owner;
+        info[GROUP_CONSUMER] = g->second->owner;
         groups.push_back(info);
     }
     state[GROUP_STATE_KEY] = groups;
@@ -51,43 +51,52 @@ class MessageGroupManager : public QueueObserver, public MessageDistributor
     Messages& messages;                 // parent Queue's in memory message container
     const std::string qName;            // name of parent queue (for logs)
 
+    // Group state is pooled and linked intrusively so that, once a message has
+    // been enqueued, acquiring, releasing and dequeuing it need neither a lookup
+    // by group id nor any heap allocation.
     struct GroupState {
         // note: update getState()/setState() when changing this object's state implementation
-
-        // track which messages are in this group, and if they have been acquired
-        struct MessageState {
-            qpid::framing::SequenceNumber position;
-            bool                    acquired;
-            MessageState() : acquired(false) {}
-            MessageState(const qpid::framing::SequenceNumber& p) : position(p), acquired(false) {}
-            bool operator<(const MessageState& b) const { return position < b.position; }
-        };
-        typedef std::deque<MessageState> MessageFifo;
-
-        std::string group;  // group identifier
+        std::string group;  // group identifier, interned when the group is created
         std::string owner;  // consumer with outstanding acquired messages
         uint32_t acquired;  // count of outstanding acquired messages
-        MessageFifo members;   // msgs belonging to this group, in enqueue order
+        uint32_t total;     // count of messages belonging to this group
+        qpid::framing::SequenceNumber head;   // oldest message in this group
+        qpid::framing::SequenceNumber tail;   // newest message in this group
+        GroupState* prev;   // links for the list of free groups, or of spare states
+        GroupState* next;
 
-        GroupState() : acquired(0) {}
+        GroupState() : acquired(0), total(0), prev(0), next(0) {}
         bool owned() const {return !owner.empty();}
-        MessageFifo::iterator findMsg(const qpid::framing::SequenceNumber &);
     };
 
-    typedef sys::unordered_map<std::string, struct GroupState> GroupMap;
-    typedef std::map<qpid::framing::SequenceNumber, struct GroupState *> GroupFifo;
+    // track which group each message is in, and if it has been acquired;
+    // the messages of a group are linked in enqueue order
+    struct MessageState {
+        GroupState* group;  // null once the message has left the queue
+        qpid::framing::SequenceNumber prev;   // neighbours within the group, valid
+        qpid::framing::SequenceNumber next;   // unless this is the group's head/tail
+        bool acquired;
+        MessageState() : group(0), acquired(false) {}
+    };
+    // indexed by position relative to the oldest tracked message
+    typedef std::deque<MessageState> MessageIndex;
+
+    typedef sys::unordered_map<std::string, GroupState*> GroupMap;
+    typedef std::deque<GroupState> GroupPool;
 
     GroupMap messageGroups; // index: group name
-    GroupFifo freeGroups;   // ordered by oldest free msg
-    //Consumers consumers;    // index: consumer name
+    GroupPool groupPool;    // storage for all group state
+    GroupState* spareGroups;// unused entries in groupPool
+    GroupState* freeGroups; // groups with messages but no owner
+    MessageIndex index;     // state for each message on the queue
+    qpid::framing::SequenceNumber base;   // position of first entry in index
 
     GroupState& findGroup( const Message& m );
-    unsigned long hits, misses; // for debug
-    uint32_t lastMsg;
-    std::string lastGroup;
-    GroupState *cachedGroup;
+    MessageState* findMsg( const qpid::framing::SequenceNumber& position );
+    GroupState* allocate();
+    void release( GroupState& state );
 
-    void unFree( const GroupState& state );
+    void unFree( GroupState& state );
     void own( GroupState& state, const std::string& owner );
     void disown( GroupState& state );
 
@@ -105,8 +114,7 @@ class MessageGroupManager : public QueueObserver, public MessageDistributor
                         Messages& container, unsigned int _timestamp=0 )
       : groupIdHeader( header ), timestamp(_timestamp), messages(container),
         qName(_qName),
-        hits(0), misses(0),
-        lastMsg(0), cachedGroup(0) {}
+        spareGroups(0), freeGroups(0) {}
     virtual ~MessageGroupManager();
 
     // QueueObserver iface
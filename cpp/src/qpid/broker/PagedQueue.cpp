@@ -0,0 +1,566 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/broker/PagedQueue.h"
+#include "qpid/broker/ExpiryPolicy.h"
+#include "qpid/broker/Queue.h"
+#include "qpid/broker/QueueCursor.h"
+#include "qpid/broker/amqp_0_10/MessageTransfer.h"
+#include "qpid/framing/Buffer.h"
+#include "qpid/sys/FileSysDir.h"
+#include "qpid/Exception.h"
+#include "qpid/Msg.h"
+#include "qpid/log/Statement.h"
+
+namespace qpid {
+namespace broker {
+namespace {
+using framing::SequenceNumber;
+
+// Each paged out message is written as a fixed size record header
+// followed by the encoded message itself:
+//   sequence(4) state(1) flags(1) delivery-count(4) persistence-id(8)
+//   timestamp(8) expiration(8) encoded-size(4)
+const size_t RECORD_HEADER_SIZE = 38;
+// Each region starts with the number of records it holds.
+const size_t REGION_HEADER_SIZE = 4;
+const uint8_t MANAGEMENT_MESSAGE = 0x01;
+const uint8_t EXPIRES = 0x02;
+
+Message padding(const SequenceNumber& id)
+{
+    Message m;
+    m.setState(DELETED);
+    m.setSequence(id);
+    return m;
+}
+
+const amqp_0_10::MessageTransfer* getTransfer(const Message& m)
+{
+    return dynamic_cast<const amqp_0_10::MessageTransfer*>(m.getPersistentContext().get());
+}
+
+size_t roundUp(size_t size, size_t unit)
+{
+    return ((size + unit - 1) / unit) * unit;
+}
+}
+
+PagedQueue::Page::Page(const SequenceNumber& f) :
+    offset(0), region(0), used(0), prefetched(false), first(f), slots(0), remaining(0),
+    availableCount(0), acquiredCount(0), bytes(0), loaded(true) {}
+
+bool PagedQueue::Page::isLoaded() const
+{
+    return loaded;
+}
+
+bool PagedQueue::Page::isEmpty() const
+{
+    return remaining == 0;
+}
+
+bool PagedQueue::Page::isVacant() const
+{
+    return slots == 0;
+}
+
+bool PagedQueue::Page::isFull(size_t pageSize) const
+{
+    return bytes >= pageSize;
+}
+
+bool PagedQueue::Page::isPageable() const
+{
+    for (std::deque<Message>::const_iterator i = messages.begin(); i != messages.end(); ++i) {
+        if (i->getState() == DELETED) continue;
+        if (!getTransfer(*i)) return false;
+    }
+    return true;
+}
+
+bool PagedQueue::Page::contains(const SequenceNumber& position) const
+{
+    return slots && !(position < first) && int32_t(position - first) < int32_t(slots);
+}
+
+bool PagedQueue::Page::precedes(const SequenceNumber& position) const
+{
+    return slots && int32_t(position - first) >= int32_t(slots);
+}
+
+bool PagedQueue::Page::hasAvailable() const
+{
+    return loaded || availableCount;
+}
+
+bool PagedQueue::Page::hasAcquired() const
+{
+    return loaded || acquiredCount;
+}
+
+size_t PagedQueue::Page::available() const
+{
+    if (!loaded) return availableCount;
+    size_t count(0);
+    for (std::deque<Message>::const_iterator i = messages.begin(); i != messages.end(); ++i) {
+        if (i->getState() == AVAILABLE) ++count;
+    }
+    return count;
+}
+
+Message* PagedQueue::Page::find(const SequenceNumber& position)
+{
+    if (!contains(position)) return 0;
+    Message& m = messages[position - first];
+    return m.getState() == DELETED ? 0 : &m;
+}
+
+Message* PagedQueue::Page::next(const SequenceNumber& position, QueueCursor& cursor, int32_t version)
+{
+    size_t i = contains(position) ? size_t(position - first) : 0;
+    while (i < messages.size()) {
+        Message& m = messages[i++];
+        if (m.getState() == DELETED) continue;
+        cursor.setPosition(m.getSequence(), version);
+        if (cursor.check(m)) return &m;
+    }
+    return 0;
+}
+
+void PagedQueue::Page::add(const Message& added)
+{
+    //add padding to prevent gaps in sequence, which break the index
+    //calculation (needed for queue replication)
+    while (slots && int32_t(added.getSequence() - first) > int32_t(slots)) {
+        messages.push_back(padding(first + int32_t(slots)));
+        ++slots;
+    }
+    messages.push_back(added);
+    messages.back().setState(AVAILABLE);
+    ++slots;
+    ++remaining;
+    bytes += RECORD_HEADER_SIZE + added.getContentSize();
+}
+
+/**
+ * For ha replication, the queue can sometimes be reset by removing
+ * some of the more recent messages; in this case the DELETED records
+ * at the end of the page must not interfere with indexing.
+ *
+ * @return false if there is a message at or beyond the specified
+ * position that has not been deleted
+ */
+bool PagedQueue::Page::trim(const SequenceNumber& position)
+{
+    while (slots && !precedes(position)) {
+        if (messages.back().getState() != DELETED) return false;
+        messages.pop_back();
+        --slots;
+    }
+    return true;
+}
+
+void PagedQueue::Page::deleted(Message& m)
+{
+    m.setState(DELETED);
+    --remaining;
+}
+
+void PagedQueue::Page::foreach(Functor f)
+{
+    for (std::deque<Message>::iterator i = messages.begin(); i != messages.end(); ++i) {
+        if (i->getState() == AVAILABLE) f(*i);
+    }
+}
+
+size_t PagedQueue::Page::encodedSize() const
+{
+    size_t size = REGION_HEADER_SIZE;
+    for (std::deque<Message>::const_iterator i = messages.begin(); i != messages.end(); ++i) {
+        if (i->getState() != DELETED) size += RECORD_HEADER_SIZE + getTransfer(*i)->encodedSize();
+    }
+    return size;
+}
+
+/**
+ * Writes out all messages that have not been deleted and releases
+ * them from memory.
+ */
+void PagedQueue::Page::encode(char* data, size_t size, const Queue& queue)
+{
+    framing::Buffer buffer(data, size);
+    buffer.putLong(remaining);
+    availableCount = acquiredCount = 0;
+    for (std::deque<Message>::const_iterator i = messages.begin(); i != messages.end(); ++i) {
+        if (i->getState() == DELETED) continue;
+        const amqp_0_10::MessageTransfer* transfer = getTransfer(*i);
+        uint8_t flags = (i->getIsManagementMessage() ? MANAGEMENT_MESSAGE : 0) | (i->getExpiration() < sys::FAR_FUTURE ? EXPIRES : 0);
+        buffer.putLong(i->getSequence());
+        buffer.putOctet(i->getState());
+        buffer.putOctet(flags);
+        buffer.putLong(i->getDeliveryCount());
+        buffer.putLongLong(transfer->getPersistenceId());
+        buffer.putLongLong(i->getTimestamp());
+        buffer.putLongLong(flags & EXPIRES ? int64_t(sys::Duration(sys::EPOCH, i->getExpiration())) : 0);
+        buffer.putLong(transfer->encodedSize());
+        transfer->encode(buffer);
+        if (i->getState() == AVAILABLE) ++availableCount;
+        else ++acquiredCount;
+        queue.countFlowedToDisk(i->getContentSize());
+    }
+    std::deque<Message>().swap(messages);
+    loaded = false;
+}
+
+/**
+ * Reads back in the messages written by encode(), padding the gaps
+ * left by those that had already been deleted.
+ */
+void PagedQueue::Page::decode(const char* data, size_t size, const Queue& queue, boost::intrusive_ptr<ExpiryPolicy> expiryPolicy)
+{
+    framing::Buffer buffer(const_cast<char*>(data), size);
+    uint32_t count = buffer.getLong();
+    for (uint32_t i = 0; i < count; ++i) {
+        SequenceNumber sequence(buffer.getLong());
+        MessageState state = MessageState(buffer.getOctet());
+        uint8_t flags = buffer.getOctet();
+        uint32_t deliveryCount = buffer.getLong();
+        uint64_t persistenceId = buffer.getLongLong();
+        uint64_t timestamp = buffer.getLongLong();
+        int64_t expiration = buffer.getLongLong();
+        uint32_t length = buffer.getLong();
+
+        boost::intrusive_ptr<amqp_0_10::MessageTransfer> transfer(new amqp_0_10::MessageTransfer);
+        framing::Buffer body(const_cast<char*>(data) + buffer.getPosition(), length);
+        transfer->decodeHeader(body);
+        transfer->decodeContent(body);
+        transfer->setPersistenceId(persistenceId);
+        buffer.setPosition(buffer.getPosition() + length);
+
+        while (int32_t(sequence - first) > int32_t(messages.size())) {
+            messages.push_back(padding(first + int32_t(messages.size())));
+        }
+        messages.push_back(Message(transfer, transfer));
+        Message& m = messages.back();
+        m.setSequence(sequence);
+        m.setState(state);
+        m.setIsManagementMessage(flags & MANAGEMENT_MESSAGE);
+        m.setTimestamp(timestamp);
+        for (uint32_t j = 0; j < deliveryCount; ++j) m.deliver();
+        if (flags & EXPIRES) {
+            m.setExpiration(sys::AbsTime(sys::EPOCH, sys::Duration(expiration)));
+            m.setExpiryPolicy(expiryPolicy);
+        }
+        queue.countLoadedFromDisk(m.getContentSize());
+    }
+    while (messages.size() < slots) {
+        messages.push_back(padding(first + int32_t(messages.size())));
+    }
+    loaded = true;
+}
+
+PagedQueue::PagedQueue(const Queue& q, const std::string& directory, uint maxPages, uint pageFactor,
+                       boost::intrusive_ptr<ExpiryPolicy> e, uint maxAhead)
+    : queue(q), pageSize(pageFactor * sys::MemoryMappedFile::getPageSize()), maxLoaded(maxPages),
+      maxPrefetched(maxAhead), expiryPolicy(e), fileSize(0), loaded(0), clock(0), version(0), prefetches(0)
+{
+    sys::FileSysDir dir(directory);
+    if (!dir.exists()) dir.mkdir();
+    std::string path = file.open("pq", directory);
+    QPID_LOG(debug, "PagedQueue[" << queue.getName() << "] created in " << path << ", page size is "
+             << pageSize << ", with at most " << maxLoaded << " pages loaded and "
+             << maxPrefetched << " read ahead");
+}
+
+PagedQueue::~PagedQueue()
+{
+    file.close();
+}
+
+size_t PagedQueue::size()
+{
+    size_t total(0);
+    for (Used::const_iterator i = used.begin(); i != used.end(); ++i) {
+        total += i->second.available();
+    }
+    return total;
+}
+
+bool PagedQueue::deleted(const QueueCursor& cursor)
+{
+    if (!cursor.valid) return false;
+    Used::iterator page = findPage(cursor.position, true);
+    if (page == used.end()) return false;
+    Message* m = page->second.find(cursor.position);
+    if (!m) return false;
+    page->second.deleted(*m);
+    removeIfEmpty(page);
+    return true;
+}
+
+void PagedQueue::publish(const Message& added)
+{
+    while (used.size() && !used.rbegin()->second.precedes(added.getSequence())) {
+        Used::iterator tail = --used.end();
+        if (!tail->second.isLoaded()) load(tail, used.end());
+        if (!tail->second.trim(added.getSequence())) throw qpid::Exception(QPID_MSG("Index out of sequence!"));
+        if (tail->second.isVacant()) {
+            used.erase(tail);
+            --loaded;
+        }
+    }
+    if (used.size() && !used.rbegin()->second.isLoaded()) load(--used.end(), used.end());
+    if (used.empty() || used.rbegin()->second.isFull(pageSize)) {
+        Used::iterator page = used.insert(Used::value_type(added.getSequence(), Page(added.getSequence()))).first;
+        ++loaded;
+        if (page != used.begin()) removeIfEmpty(--Used::iterator(page));
+        makeRoom(page, used.end());
+    }
+    Used::iterator tail = --used.end();
+    tail->second.add(added);
+    touch(tail);
+}
+
+Message* PagedQueue::next(QueueCursor& cursor)
+{
+    if (used.empty()) return 0;
+    Used::iterator i = used.begin();
+    SequenceNumber position(i->first);
+    if (cursor.valid && !(cursor.type == CONSUMER && cursor.version != version)) {
+        position = SequenceNumber(cursor.position) + 1;
+        i = findPageFrom(position);
+    }
+    bool fetched(false);
+    for (; i != used.end(); ++i) {
+        Page& page = i->second;
+        if (!page.isLoaded()) {
+            if (!page.hasAvailable() && !((cursor.type == PURGE || cursor.type == REPLICATOR) && page.hasAcquired())) continue;
+            load(i, used.end());
+            fetched = true;
+        }
+        touch(i);
+        Message* m = page.next(position, cursor, version);
+        if (m) {
+            //page in the following page ahead of consumers reaching it
+            Used::iterator ahead = i;
+            if (fetched && maxLoaded > 2 && ++ahead != used.end() && !ahead->second.isLoaded()) {
+                load(ahead, i);
+            }
+            prefetch(i);
+            return m;
+        }
+    }
+    return 0;
+}
+
+Message* PagedQueue::release(const QueueCursor& cursor)
+{
+    if (!cursor.valid) return 0;
+    Used::iterator page = findPage(cursor.position, true);
+    if (page == used.end()) return 0;
+    Message* m = page->second.find(cursor.position);
+    if (m) {
+        m->setState(AVAILABLE);
+        ++version;
+    }
+    return m;
+}
+
+Message* PagedQueue::find(const SequenceNumber& position, QueueCursor* cursor)
+{
+    Used::iterator page = findPage(position, true);
+    if (page != used.end()) {
+        if (cursor) cursor->setPosition(position, version);
+        return page->second.find(position);
+    } else if (cursor) {
+        if (used.empty() || !(position < used.begin()->first))
+            cursor->setPosition(position, version);//haven't yet got a message with that seq no
+        else cursor->valid = false;//reset
+    }
+    return 0;
+}
+
+Message* PagedQueue::find(const QueueCursor& cursor)
+{
+    if (cursor.valid) return find(cursor.position, 0);
+    else return 0;
+}
+
+void PagedQueue::foreach(Functor f)
+{
+    for (Used::iterator i = used.begin(); i != used.end(); ++i) {
+        if (!i->second.isLoaded()) {
+            if (!i->second.hasAvailable()) continue;
+            load(i, used.end());
+        }
+        touch(i);
+        i->second.foreach(f);
+    }
+}
+
+size_t PagedQueue::getPageCount() const
+{
+    return used.size();
+}
+
+size_t PagedQueue::getLoadedPageCount() const
+{
+    return loaded;
+}
+
+size_t PagedQueue::getPrefetchCount() const
+{
+    return prefetches;
+}
+
+/**
+ * @return the page holding the specified position, loading it if
+ * requested, or end() if there is no such page
+ */
+PagedQueue::Used::iterator PagedQueue::findPage(const SequenceNumber& position, bool load)
+{
+    Used::iterator i = used.upper_bound(position);
+    if (i == used.begin()) return used.end();
+    --i;
+    if (!i->second.contains(position)) return used.end();
+    if (load && !i->second.isLoaded()) this->load(i, used.end());
+    touch(i);
+    return i;
+}
+
+/**
+ * @return the first page holding a position greater than or equal to
+ * that specified
+ */
+PagedQueue::Used::iterator PagedQueue::findPageFrom(const SequenceNumber& position)
+{
+    Used::iterator i = used.upper_bound(position);
+    if (i != used.begin()) {
+        Used::iterator previous = i;
+        if ((--previous)->second.contains(position)) return previous;
+    }
+    return i;
+}
+
+bool PagedQueue::isTail(Used::iterator i) const
+{
+    return ++i == used.end();
+}
+
+void PagedQueue::touch(Used::iterator i)
+{
+    i->second.used = ++clock;
+}
+
+void PagedQueue::load(Used::iterator i, Used::iterator keep)
+{
+    Page& page = i->second;
+    makeRoom(i, keep);
+    char* data = file.map(page.offset, page.region);
+    page.decode(data, page.region, queue, expiryPolicy);
+    file.unmap(data, page.region);
+    deallocate(page.offset, page.region);
+    ++loaded;
+    QPID_LOG(debug, "PagedQueue[" << queue.getName() << "] loaded page " << i->first);
+}
+
+void PagedQueue::unload(Used::iterator i)
+{
+    Page& page = i->second;
+    page.region = roundUp(page.encodedSize(), pageSize);
+    page.offset = allocate(page.region);
+    char* data = file.map(page.offset, page.region);
+    page.encode(data, page.region, queue);
+    file.unmap(data, page.region);
+    page.prefetched = false;
+    --loaded;
+    QPID_LOG(debug, "PagedQueue[" << queue.getName() << "] unloaded page " << i->first << " (" << page.region << " bytes)");
+}
+
+/**
+ * Asks for the next few paged out pages after the one specified that
+ * hold messages still to be consumed to be read in the background,
+ * so that the page is already in memory when a consumer loads it.
+ */
+void PagedQueue::prefetch(Used::iterator i)
+{
+    uint ahead(0);
+    for (++i; i != used.end() && ahead < maxPrefetched; ++i) {
+        Page& page = i->second;
+        if (page.isLoaded() || !page.hasAvailable()) continue;
+        ++ahead;
+        if (page.prefetched) continue;
+        file.prefetch(page.offset, page.region);
+        page.prefetched = true;
+        ++prefetches;
+    }
+}
+
+/**
+ * Unloads the least recently used pages until there is room to hold
+ * another page in memory. The tail, the page to be loaded (which may
+ * be the tail) and the page to be kept (e.g. holding a message to
+ * which the caller retains a pointer) are never unloaded.
+ */
+void PagedQueue::makeRoom(Used::iterator except, Used::iterator keep)
+{
+    while (loaded >= maxLoaded + (except->second.isLoaded() ? 1 : 0)) {
+        Used::iterator victim = used.end();
+        for (Used::iterator i = used.begin(); i != used.end(); ++i) {
+            if (i == except || i == keep || !i->second.isLoaded() || isTail(i)) continue;
+            if ((victim == used.end() || i->second.used < victim->second.used) && i->second.isPageable()) victim = i;
+        }
+        if (victim == used.end()) return;
+        unload(victim);
+    }
+}
+
+void PagedQueue::removeIfEmpty(Used::iterator i)
+{
+    if (i->second.isEmpty() && !isTail(i)) {
+        if (i->second.isLoaded()) --loaded;
+        else deallocate(i->second.offset, i->second.region);
+        used.erase(i);
+    }
+}
+
+size_t PagedQueue::allocate(size_t size)
+{
+    Free::iterator i = free.lower_bound(size);
+    if (i != free.end()) {
+        size_t offset = i->second;
+        if (i->first > size) free.insert(Free::value_type(i->first - size, offset + size));
+        free.erase(i);
+        return offset;
+    } else {
+        size_t offset = fileSize;
+        fileSize += size;
+        file.expand(fileSize);
+        return offset;
+    }
+}
+
+void PagedQueue::deallocate(size_t offset, size_t size)
+{
+    free.insert(Free::value_type(size, offset));
+}
+
+}} // namespace qpid::broker
@@ -0,0 +1,147 @@
+#ifndef QPID_BROKER_PAGEDQUEUE_H
+#define QPID_BROKER_PAGEDQUEUE_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/broker/Messages.h"
+#include "qpid/broker/Message.h"
+#include "qpid/framing/SequenceNumber.h"
+#include "qpid/sys/MemoryMappedFile.h"
+#include "qpid/sys/Time.h"
+#include <boost/intrusive_ptr.hpp>
+#include <deque>
+#include <map>
+
+namespace qpid {
+namespace broker {
+
+class ExpiryPolicy;
+class Queue;
+
+/**
+ * A FIFO queue whose messages are held in fixed size pages, only a
+ * limited number of which are kept in memory at any one time. The
+ * remaining pages are written out to a memory mapped scratch file
+ * and read back in when a cursor reaches them, allowing very deep
+ * queues to be held without exhausting memory.
+ *
+ * As consumers move through the queue, the next few paged out pages
+ * are read from the file in the background, so that loading them
+ * does not have to wait on the disk.
+ *
+ * Pages holding messages that were not received over AMQP 0-10 are
+ * never paged out. A paged out message is restored from its
+ * persistent form, in the same way as a message recovered from the
+ * store (i.e. any annotations are carried as application headers).
+ */
+class PagedQueue : public Messages
+{
+  public:
+    PagedQueue(const Queue& queue, const std::string& directory, uint maxLoaded, uint pageFactor,
+               boost::intrusive_ptr<ExpiryPolicy> expiryPolicy, uint maxPrefetched = 0);
+    ~PagedQueue();
+    size_t size();
+    bool deleted(const QueueCursor&);
+    void publish(const Message& added);
+    Message* next(QueueCursor&);
+    Message* release(const QueueCursor& cursor);
+    Message* find(const QueueCursor&);
+    Message* find(const framing::SequenceNumber&, QueueCursor*);
+    void foreach(Functor);
+
+    /** @return the number of pages currently held */
+    size_t getPageCount() const;
+    /** @return the number of pages currently held in memory */
+    size_t getLoadedPageCount() const;
+    /** @return the number of times a paged out page has been read ahead */
+    size_t getPrefetchCount() const;
+
+  private:
+    class Page
+    {
+      public:
+        Page(const framing::SequenceNumber& first);
+        bool isLoaded() const;
+        bool isEmpty() const;
+        bool isVacant() const;
+        bool isFull(size_t pageSize) const;
+        bool isPageable() const;
+        bool contains(const framing::SequenceNumber&) const;
+        bool precedes(const framing::SequenceNumber&) const;
+        bool hasAvailable() const;
+        bool hasAcquired() const;
+        size_t available() const;
+        Message* find(const framing::SequenceNumber&);
+        Message* next(const framing::SequenceNumber&, QueueCursor&, int32_t version);
+        void add(const Message&);
+        bool trim(const framing::SequenceNumber&);
+        void deleted(Message&);
+        void foreach(Functor);
+        size_t encodedSize() const;
+        void encode(char* data, size_t size, const Queue&);
+        void decode(const char* data, size_t size, const Queue&, boost::intrusive_ptr<ExpiryPolicy>);
+
+        size_t offset;//of the region holding the page when unloaded
+        size_t region;//size of that region
+        uint64_t used;//when last accessed, for choosing which page to unload
+        bool prefetched;//whether the region has been read ahead since written
+      private:
+        std::deque<Message> messages;
+        framing::SequenceNumber first;
+        uint32_t slots;//number of sequence numbers spanned
+        uint32_t remaining;//number of messages not yet deleted
+        uint32_t availableCount;//only maintained while unloaded
+        uint32_t acquiredCount;//only maintained while unloaded
+        size_t bytes;
+        bool loaded;
+    };
+    typedef std::map<framing::SequenceNumber, Page> Used;
+    typedef std::multimap<size_t, size_t> Free;//region size to offset
+
+    const Queue& queue;
+    sys::MemoryMappedFile file;
+    const size_t pageSize;
+    const uint maxLoaded;
+    const uint maxPrefetched;
+    boost::intrusive_ptr<ExpiryPolicy> expiryPolicy;
+    Used used;
+    Free free;
+    size_t fileSize;
+    size_t loaded;
+    uint64_t clock;
+    int32_t version;
+    size_t prefetches;
+
+    Used::iterator findPage(const framing::SequenceNumber&, bool unloaded);
+    Used::iterator findPageFrom(const framing::SequenceNumber&);
+    bool isTail(Used::iterator) const;
+    void load(Used::iterator, Used::iterator keep);
+    void unload(Used::iterator);
+    void prefetch(Used::iterator);
+    void makeRoom(Used::iterator, Used::iterator keep);
+    void touch(Used::iterator);
+    void removeIfEmpty(Used::iterator);
+    size_t allocate(size_t size);
+    void deallocate(size_t offset, size_t size);
+};
+}} // namespace qpid::broker
+
+#endif  /*!QPID_BROKER_PAGEDQUEUE_H*/
@@ -22,7 +22,10 @@
 
 #include "qpid/broker/PersistableMessage.h"
 #include "qpid/broker/MessageStore.h"
+#include "qpid/framing/Buffer.h"
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 using namespace qpid::broker;
 
@@ -73,6 +76,17 @@ bool PersistableMessage::isDequeueComplete() { return false; }
 void PersistableMessage::dequeueComplete() {}
 void PersistableMessage::dequeueAsync(PersistableQueue::shared_ptr, MessageStore*) {}
 
+void PersistableMessage::encodePart(framing::Buffer& buffer, uint32_t offset) const
+{
+    uint32_t size = encodedSize();
+    if (offset >= size) return;
+    std::vector<char> bytes(size);
+    framing::Buffer whole(&bytes[0], size);
+    encode(whole);
+    buffer.putRawData(reinterpret_cast<uint8_t*>(&bytes[offset]),
+                      std::min(size - offset, buffer.available()));
+}
+
 }}
 
 
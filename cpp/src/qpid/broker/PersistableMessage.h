@@ -95,6 +95,13 @@ class PersistableMessage : public Persistable
     virtual void decodeHeader(framing::Buffer& buffer) = 0;
     virtual void decodeContent(framing::Buffer& buffer) = 0;
     virtual uint32_t encodedHeaderSize() const = 0;
+    /**
+     * Encode the part of what encode() writes that starts offset bytes
+     * in, as much of it as fits in buffer, so a store can encode straight
+     * into its own (possibly discontiguous) buffers. The default encodes
+     * the whole message and copies the part out.
+     */
+    QPID_BROKER_EXTERN virtual void encodePart(framing::Buffer& buffer, uint32_t offset) const;
     virtual boost::intrusive_ptr<PersistableMessage> merge(const std::map<std::string, qpid::types::Variant>& annotations) const = 0;
 };
 
@@ -43,6 +43,7 @@
 #include "qpid/framing/reply_exceptions.h"
 #include "qpid/framing/FieldTable.h"
 #include "qpid/framing/FieldValue.h"
+#include "qpid/sys/LatencyHistogram.h"
 #include "qpid/sys/Monitor.h"
 #include "qpid/sys/Time.h"
 #include "qpid/sys/Timer.h"
@@ -178,6 +179,7 @@ Queue::Queue(const string& _name, const QueueSettings& _settings,
     persistLastNode(false),
     inLastNodeFailure(false),
     messages(new MessageDeque()),
+    headerIndex(_settings.indexedHeaders),
     persistenceId(0),
     settings(b ? merge(_settings, b->getOptions()) : _settings),
     eventMode(0),
@@ -395,6 +397,9 @@ bool Queue::getNextMessage(Message& m, Consumer::shared_ptr& c)
                             }
                             observeAcquire(*msg, locker);
                             msg->deliver();
+                            // Browsers and redeliveries would count the same enqueue again
+                            if (msg->getDeliveryCount() == 1)
+                                sys::LatencyStats::recordSince(sys::LatencyStats::ENQUEUE_DISPATCH, msg->getStageTime());
                         } else {
                             QPID_LOG(debug, "Could not acquire message from '" << name << "'");
                             continue; //try another message
@@ -530,28 +535,55 @@ void Queue::cancel(Consumer::shared_ptr c)
 }
 
 /**
+ * Removes any available messages whose expiration time has passed.
+ * The expiry index is used to locate them, so the cost is
+ * proportional to the number of messages actually expiring rather
+ * than to the depth of the queue.
+ *
  *@param lapse: time since the last purgeExpired
  */
-void Queue::purgeExpired(sys::Duration lapse) {
-    //As expired messages are discarded during dequeue also, only
-    //bother explicitly expiring if the rate of dequeues since last
-    //attempt is less than one per second.
-    int count = dequeueSincePurge.get();
-    dequeueSincePurge -= count;
-    int seconds = int64_t(lapse)/qpid::sys::TIME_SEC;
-    if (seconds == 0 || count / seconds < 1) {
-        uint32_t count = remove(0, boost::bind(&Message::hasExpired, _1), 0, CONSUMER);
-        QPID_LOG(debug, "Purged " << count << " expired messages from " << getName());
-        //
-        // Report the count of discarded-by-ttl messages
-        //
-        if (mgmtObject && count) {
-            mgmtObject->inc_acquires(count);
-            mgmtObject->inc_discardsTtl(count);
-            if (brokerMgmtObject) {
-                brokerMgmtObject->inc_acquires(count);
-                brokerMgmtObject->inc_discardsTtl(count);
+void Queue::purgeExpired(sys::Duration /*lapse*/) {
+    std::deque<Message> expired;
+    {
+        Mutex::ScopedLock locker(messageLock);
+        if (expiryIndex.empty()) return;
+        ExpiryIndex::Entries due;
+        expiryIndex.due(AbsTime::now(), due);
+        for (ExpiryIndex::Entries::const_iterator i = due.begin(); i != due.end(); ++i) {
+            QueueCursor cursor(CONSUMER);
+            Message* m = messages->find(i->second, &cursor);
+            if (!m) {
+                //message has already been removed by some other means
+                expiryIndex.remove(*i);
+            } else if (m->getState() == AVAILABLE) {
+                if (m->hasExpired()) {
+                    //don't actually acquire, just act as if we did
+                    observeAcquire(*m, locker);
+                    observeDequeue(*m, locker);
+                    expired.push_back(*m);
+                    messages->deleted(cursor);
+                } else {
+                    //expiry policy disagrees; leave it to be checked on dispatch
+                    expiryIndex.remove(*i);
+                }
             }
+            //acquired messages stay indexed until dequeued or released
+        }
+    }
+    for (std::deque<Message>::iterator i = expired.begin(); i != expired.end(); ++i) {
+        if (i->isPersistent()) dequeueFromStore(i->getPersistentContext());
+    }
+    uint32_t count = expired.size();
+    QPID_LOG(debug, "Purged " << count << " expired messages from " << getName());
+    //
+    // Report the count of discarded-by-ttl messages
+    //
+    if (mgmtObject && count) {
+        mgmtObject->inc_acquires(count);
+        mgmtObject->inc_discardsTtl(count);
+        if (brokerMgmtObject) {
+            brokerMgmtObject->inc_acquires(count);
+            brokerMgmtObject->inc_discardsTtl(count);
         }
     }
 }
@@ -566,6 +598,10 @@ namespace {
         static const std::string paramsKey;
         static MessageFilter *create( const ::qpid::types::Variant::Map *filter );
         virtual bool match( const Message& ) const { return true; }
+        /** Collect the positions of candidate messages from the queue's
+         * header indexes; returns false if no index can be used, in which
+         * case each message must be matched in turn. */
+        virtual bool select( const HeaderIndex&, HeaderIndex::Positions& ) const { return false; }
         virtual ~MessageFilter() {}
     protected:
         MessageFilter() {};
@@ -593,6 +629,10 @@ namespace {
         {
             return msg.getPropertyAsString(header) == value;
         }
+        bool select( const HeaderIndex& index, HeaderIndex::Positions& positions ) const
+        {
+            return index.match(header, value, positions);
+        }
     private:
         const std::string header;
         const std::string value;
@@ -601,6 +641,78 @@ namespace {
     const std::string HeaderMatchFilter::headerKey("header_key");
     const std::string HeaderMatchFilter::valueKey("header_value");
 
+    // filter by message header string value prefix
+    class HeaderPrefixFilter : public MessageFilter
+    {
+    public:
+        /* Config:
+           { 'filter_type' : 'header_prefix_str',
+             'filter_params' : { 'header_key' : "<header name>",
+                                 'header_prefix' : "<prefix to match>"
+                               }
+           }
+        */
+        static const std::string typeKey;
+        static const std::string prefixKey;
+        HeaderPrefixFilter( const std::string& _header, const std::string& _prefix )
+            : MessageFilter (), header(_header), prefix(_prefix) {}
+        bool match( const Message& msg ) const
+        {
+            std::string value = msg.getPropertyAsString(header);
+            return !value.empty() && value.compare(0, prefix.size(), prefix) == 0;
+        }
+        bool select( const HeaderIndex& index, HeaderIndex::Positions& positions ) const
+        {
+            return index.prefix(header, prefix, positions);
+        }
+    private:
+        const std::string header;
+        const std::string prefix;
+    };
+    const std::string HeaderPrefixFilter::typeKey("header_prefix_str");
+    const std::string HeaderPrefixFilter::prefixKey("header_prefix");
+
+    // filter by message header string value falling within an (inclusive) range
+    class HeaderRangeFilter : public MessageFilter
+    {
+    public:
+        /* Config:
+           { 'filter_type' : 'header_range_str',
+             'filter_params' : { 'header_key' : "<header name>",
+                                 'header_min' : "<lowest value to match>", (optional)
+                                 'header_max' : "<highest value to match>" (optional)
+                               }
+           }
+        */
+        static const std::string typeKey;
+        static const std::string minKey;
+        static const std::string maxKey;
+        HeaderRangeFilter( const std::string& _header, const std::string& _min, const std::string& _max )
+            : MessageFilter (), header(_header), min(_min), max(_max) {}
+        bool match( const Message& msg ) const
+        {
+            std::string value = msg.getPropertyAsString(header);
+            return !value.empty() && value >= min && (max.empty() || value <= max);
+        }
+        bool select( const HeaderIndex& index, HeaderIndex::Positions& positions ) const
+        {
+            return index.range(header, min, max, positions);
+        }
+    private:
+        const std::string header;
+        const std::string min;
+        const std::string max;
+    };
+    const std::string HeaderRangeFilter::typeKey("header_range_str");
+    const std::string HeaderRangeFilter::minKey("header_min");
+    const std::string HeaderRangeFilter::maxKey("header_max");
+
+    std::string getParam( const ::qpid::types::Variant::Map& params, const std::string& key )
+    {
+        ::qpid::types::Variant::Map::const_iterator i = params.find(key);
+        return i == params.end() ? std::string() : i->second.asString();
+    }
+
     // factory to create correct filter based on map
     MessageFilter* MessageFilter::create( const ::qpid::types::Variant::Map *filter )
     {
@@ -609,17 +721,31 @@ namespace {
             Variant::Map::const_iterator i = filter->find(MessageFilter::typeKey);
             if (i != filter->end()) {
 
-                if (i->second.asString() == HeaderMatchFilter::typeKey) {
-                    Variant::Map::const_iterator p = filter->find(MessageFilter::paramsKey);
-                    if (p != filter->end() && p->second.getType() == VAR_MAP) {
-                        Variant::Map::const_iterator k = p->second.asMap().find(HeaderMatchFilter::headerKey);
-                        Variant::Map::const_iterator v = p->second.asMap().find(HeaderMatchFilter::valueKey);
-                        if (k != p->second.asMap().end() && v != p->second.asMap().end()) {
-                            std::string headerKey(k->second.asString());
+                Variant::Map::const_iterator p = filter->find(MessageFilter::paramsKey);
+                if (p != filter->end() && p->second.getType() == VAR_MAP) {
+                    const Variant::Map& params = p->second.asMap();
+                    std::string headerKey(getParam(params, HeaderMatchFilter::headerKey));
+                    if (i->second.asString() == HeaderMatchFilter::typeKey) {
+                        Variant::Map::const_iterator v = params.find(HeaderMatchFilter::valueKey);
+                        if (headerKey.size() && v != params.end()) {
                             std::string value(v->second.asString());
                             QPID_LOG(debug, "Message filtering by header value configured.  key: " << headerKey << " value: " << value );
                             return new HeaderMatchFilter( headerKey, value );
                         }
+                    } else if (i->second.asString() == HeaderPrefixFilter::typeKey) {
+                        Variant::Map::const_iterator v = params.find(HeaderPrefixFilter::prefixKey);
+                        if (headerKey.size() && v != params.end()) {
+                            std::string prefix(v->second.asString());
+                            QPID_LOG(debug, "Message filtering by header prefix configured.  key: " << headerKey << " prefix: " << prefix );
+                            return new HeaderPrefixFilter( headerKey, prefix );
+                        }
+                    } else if (i->second.asString() == HeaderRangeFilter::typeKey) {
+                        if (headerKey.size()) {
+                            std::string min(getParam(params, HeaderRangeFilter::minKey));
+                            std::string max(getParam(params, HeaderRangeFilter::maxKey));
+                            QPID_LOG(debug, "Message filtering by header range configured.  key: " << headerKey << " min: " << min << " max: " << max );
+                            return new HeaderRangeFilter( headerKey, min, max );
+                        }
                     }
                 }
             }
@@ -647,32 +773,56 @@ namespace {
     }
 } // end namespace
 
-uint32_t Queue::remove(const uint32_t maxCount, MessagePredicate p, MessageFunctor f, SubscriptionType type)
+/**
+ * Requires messageLock be held by caller.
+ */
+void Queue::removeMessage(Message& m, const QueueCursor& c, std::deque<Message>& removed, const Mutex::ScopedLock& locker)
+{
+    if (m.getState() == AVAILABLE) {
+        //don't actually acquire, just act as if we did
+        observeAcquire(m, locker);
+    }
+    observeDequeue(m, locker);
+    removed.push_back(m);//takes a copy of the message
+    if (!messages->deleted(c)) {
+        QPID_LOG(warning, "Failed to correctly remove message from " << name << "; state is not consistent!");
+        assert(false);
+    }
+}
+
+uint32_t Queue::remove(const uint32_t maxCount, MessagePredicate p, MessageFunctor f, SubscriptionType type, PositionSelector select)
 {
     std::deque<Message> removed;
     {
         QueueCursor c(type);
         uint32_t count(0);
         Mutex::ScopedLock locker(messageLock);
-        Message* m = messages->next(c);
-        while (m){
-            if (!p || p(*m)) {
-                if (!maxCount || count++ < maxCount) {
-                    if (m->getState() == AVAILABLE) {
-                        //don't actually acquire, just act as if we did
-                        observeAcquire(*m, locker);
+        HeaderIndex::Positions positions;
+        if (select && select(positions)) {
+            //visit only the candidates located through the index, in
+            //sequence order
+            for (HeaderIndex::Positions::const_iterator i = positions.begin(); i != positions.end(); ++i) {
+                Message* m = messages->find(*i, &c);
+                if (m && m->getState() == AVAILABLE && (!p || p(*m))) {
+                    if (!maxCount || count++ < maxCount) {
+                        removeMessage(*m, c, removed, locker);
+                    } else {
+                        break;
                     }
-                    observeDequeue(*m, locker);
-                    removed.push_back(*m);//takes a copy of the message
-                    if (!messages->deleted(c)) {
-                        QPID_LOG(warning, "Failed to correctly remove message from " << name << "; state is not consistent!");
-                        assert(false);
+                }
+            }
+        } else {
+            Message* m = messages->next(c);
+            while (m){
+                if (!p || p(*m)) {
+                    if (!maxCount || count++ < maxCount) {
+                        removeMessage(*m, c, removed, locker);
+                    } else {
+                        break;
                     }
-                } else {
-                    break;
                 }
+                m = messages->next(c);
             }
-            m = messages->next(c);
         }
     }
     for (std::deque<Message>::iterator i = removed.begin(); i != removed.end(); ++i) {
@@ -697,12 +847,15 @@ uint32_t Queue::remove(const uint32_t maxCount, MessagePredicate p, MessageFunct
  *
  * An optional filter can be supplied that will be applied against each message.  The
  * message is purged only if the filter matches.  See MessageDistributor for more detail.
+ * Where the filter is on a header listed in the queue's qpid.indexed_headers setting,
+ * only the messages located through that index are examined (in sequence order).
  */
 uint32_t Queue::purge(const uint32_t qty, boost::shared_ptr<Exchange> dest,
                       const qpid::types::Variant::Map *filter)
 {
     std::auto_ptr<MessageFilter> mf(MessageFilter::create(filter));
-    uint32_t count = remove(qty, boost::bind(&MessageFilter::match, mf.get(), _1), boost::bind(&reroute, dest, _1), CONSUMER/*?*/);
+    uint32_t count = remove(qty, boost::bind(&MessageFilter::match, mf.get(), _1), boost::bind(&reroute, dest, _1), CONSUMER/*?*/,
+                            boost::bind(&MessageFilter::select, mf.get(), boost::cref(headerIndex), _1));
 
     if (mgmtObject && count) {
         mgmtObject->inc_acquires(count);
@@ -728,12 +881,18 @@ uint32_t Queue::move(const Queue::shared_ptr destq, uint32_t qty,
                      const qpid::types::Variant::Map *filter)
 {
     std::auto_ptr<MessageFilter> mf(MessageFilter::create(filter));
-    return remove(qty, boost::bind(&MessageFilter::match, mf.get(), _1), boost::bind(&moveTo, destq, _1), CONSUMER/*?*/);
+    return remove(qty, boost::bind(&MessageFilter::match, mf.get(), _1), boost::bind(&moveTo, destq, _1), CONSUMER/*?*/,
+                  boost::bind(&MessageFilter::select, mf.get(), boost::cref(headerIndex), _1));
 }
 
 void Queue::push(Message& message, bool /*isRecovery*/)
 {
     QueueListeners::NotificationSet copy;
+    if (sys::LatencyStats::isEnabled() && !(message.getStageTime() == sys::AbsTime())) {
+        sys::AbsTime now = sys::AbsTime::now();
+        sys::LatencyStats::record(sys::LatencyStats::DECODE_ENQUEUE, sys::Duration(message.getStageTime(), now));
+        message.setStageTime(now);
+    }
     {
         Mutex::ScopedLock locker(messageLock);
         message.setSequence(++sequence);
@@ -920,6 +1079,8 @@ void Queue::dequeueCommitted(const QueueCursor& cursor)
 void Queue::observeDequeue(const Message& msg, const Mutex::ScopedLock&)
 {
     current -= QueueDepth(1, msg.getContentSize());
+    expiryIndex.remove(msg);
+    headerIndex.remove(msg);
     mgntDeqStats(msg, mgmtObject, brokerMgmtObject);
     for (Observers::const_iterator i = observers.begin(); i != observers.end(); ++i) {
         try{
@@ -1422,6 +1583,8 @@ void Queue::recoveryComplete(ExchangeRegistry& exchanges)
  */
 void Queue::observeEnqueue(const Message& m, const Mutex::ScopedLock&)
 {
+    expiryIndex.add(m);
+    headerIndex.add(m);
     for (Observers::iterator i = observers.begin(); i != observers.end(); ++i) {
         try {
             (*i)->enqueued(m);
@@ -25,6 +25,8 @@
 #include "qpid/broker/BrokerImportExport.h"
 #include "qpid/broker/OwnershipToken.h"
 #include "qpid/broker/Consumer.h"
+#include "qpid/broker/ExpiryIndex.h"
+#include "qpid/broker/HeaderIndex.h"
 #include "qpid/broker/Message.h"
 #include "qpid/broker/Messages.h"
 #include "qpid/broker/PersistableQueue.h"
@@ -116,6 +118,7 @@ class Queue : public boost::enable_shared_from_this<Queue>,
     typedef std::set< boost::shared_ptr<QueueObserver> > Observers;
     enum ConsumeCode {NO_MESSAGES=0, CANT_CONSUME=1, CONSUMED=2};
     typedef boost::function1<void, Message&> MessageFunctor;
+    typedef boost::function1<bool, HeaderIndex::Positions&> PositionSelector;
 
     const std::string name;
     MessageStore* store;
@@ -128,12 +131,16 @@ class Queue : public boost::enable_shared_from_this<Queue>,
     std::vector<std::string> traceExclude;
     QueueListeners listeners;
     std::auto_ptr<Messages> messages;
+    ExpiryIndex expiryIndex;
+    HeaderIndex headerIndex;
     std::vector<Message> pendingDequeues;
     /** messageLock is used to keep the Queue's state consistent while processing message
      * events, such as message dispatch, enqueue, acquire, and dequeue.  It must be held
      * while updating certain members in order to keep these members consistent with
      * each other:
      *     o  messages
+     *     o  expiryIndex
+     *     o  headerIndex
      *     o  sequence
      *     o  listeners
      *     o  allocator
@@ -193,7 +200,8 @@ class Queue : public boost::enable_shared_from_this<Queue>,
     void abandoned(const Message& message);
     bool checkNotDeleted(const Consumer::shared_ptr&);
     void notifyDeleted();
-    uint32_t remove(uint32_t maxCount, MessagePredicate, MessageFunctor, SubscriptionType);
+    uint32_t remove(uint32_t maxCount, MessagePredicate, MessageFunctor, SubscriptionType, PositionSelector = PositionSelector());
+    void removeMessage(Message&, const QueueCursor&, std::deque<Message>& removed, const sys::Mutex::ScopedLock&);
     virtual bool checkDepth(const QueueDepth& increment, const Message&);
 
   public:
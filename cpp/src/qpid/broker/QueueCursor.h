@@ -63,6 +63,7 @@ class QueueCursor
 
   friend class MessageDeque;
   friend class MessageMap;
+  friend class PagedQueue;
   friend class PriorityQueue;
   template <typename T> friend class IndexedDeque;
 };
@@ -30,10 +30,13 @@
 #include "qpid/broker/Fairshare.h"
 #include "qpid/broker/MessageDeque.h"
 #include "qpid/broker/MessageMap.h"
+#include "qpid/broker/PagedQueue.h"
 #include "qpid/broker/PriorityQueue.h"
 #include "qpid/broker/QueueFlowLimit.h"
 #include "qpid/broker/ThresholdAlerts.h"
 #include "qpid/broker/FifoDistributor.h"
+#include "qpid/framing/reply_exceptions.h"
+#include "qpid/Msg.h"
 #include <map>
 #include <memory>
 
@@ -66,6 +69,13 @@ boost::shared_ptr<Queue> QueueFactory::create(const std::string& name, const Que
         } else {
             queue->messages = std::auto_ptr<Messages>(new PriorityQueue(settings.priorities));
         }
+    } else if (settings.paging) {
+        std::string directory = broker ? broker->getPagingDir() : std::string();
+        if (directory.empty()) {
+            throw qpid::framing::InvalidArgumentException(QPID_MSG("Cannot create paged queue " << name << ": no paging directory is available"));
+        }
+        queue->messages = std::auto_ptr<Messages>(new PagedQueue(*queue, directory, settings.maxPages, settings.pageFactor,
+                                                                  broker->getExpiryPolicy(), settings.prefetchPages));
     } else if (settings.lvqKey.empty()) {//LVQ already handled above
         queue->messages = std::auto_ptr<Messages>(new MessageDeque());
     }
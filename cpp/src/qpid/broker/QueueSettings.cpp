@@ -24,6 +24,7 @@
 #include "qpid/types/Variant.h"
 #include "qpid/framing/reply_exceptions.h"
 #include "qpid/log/Statement.h"
+#include "qpid/StringUtils.h"
 #include "qpid/amqp_0_10/Codecs.h"
 
 
@@ -42,6 +43,7 @@ const std::string NO_LOCAL("no-local");
 const std::string BROWSE_ONLY("qpid.browse-only");
 const std::string TRACE_ID("qpid.trace.id");
 const std::string TRACE_EXCLUDES("qpid.trace.exclude");
+const std::string INDEXED_HEADERS("qpid.indexed_headers");
 const std::string LVQ_KEY("qpid.last_value_queue_key");
 const std::string AUTO_DELETE_TIMEOUT("qpid.auto_delete_timeout");
 const std::string ALERT_REPEAT_GAP("qpid.alert_repeat_gap");
@@ -54,6 +56,10 @@ const std::string ALERT_SIZE_DOWN("qpid.alert_size_down");
 const std::string PRIORITIES("qpid.priorities");
 const std::string FAIRSHARE("qpid.fairshare");
 const std::string FAIRSHARE_ALIAS("x-qpid-fairshare");
+const std::string PAGING("qpid.paging");
+const std::string MAX_PAGES("qpid.max_pages_loaded");
+const std::string PAGE_FACTOR("qpid.page_factor");
+const std::string PREFETCH_PAGES("qpid.pages_prefetched");
 
 const std::string LVQ_LEGACY("qpid.last_value_queue");
 const std::string LVQ_LEGACY_KEY("qpid.LVQ_key");
@@ -84,6 +90,10 @@ QueueSettings::QueueSettings(bool d, bool a) :
     isTemporary(false),
     priorities(0),
     defaultFairshare(0),
+    paging(false),
+    maxPages(4),
+    pageFactor(32),
+    prefetchPages(1),
     shareGroups(false),
     addTimestamp(false),
     dropMessagesAtLimit(false),
@@ -124,6 +134,16 @@ bool QueueSettings::handle(const std::string& key, const qpid::types::Variant& v
     } else if (key == TRACE_EXCLUDES) {
         traceExcludes = value.asString();
         return true;
+    } else if (key == INDEXED_HEADERS) {
+        if (value.getType() == qpid::types::VAR_LIST) {
+            const qpid::types::Variant::List& list = value.asList();
+            for (qpid::types::Variant::List::const_iterator i = list.begin(); i != list.end(); ++i) {
+                indexedHeaders.push_back(i->asString());
+            }
+        } else {
+            split(indexedHeaders, value.asString(), ", ");
+        }
+        return true;
     } else if (key == PRIORITIES) {
         priorities = value;
         return true;
@@ -132,6 +152,18 @@ bool QueueSettings::handle(const std::string& key, const qpid::types::Variant& v
         return true;
     } else if (isFairshareSetting(key, value, *this)) {
         return true;
+    } else if (key == PAGING) {
+        paging = value;
+        return true;
+    } else if (key == MAX_PAGES) {
+        maxPages = value;
+        return true;
+    } else if (key == PAGE_FACTOR) {
+        pageFactor = value;
+        return true;
+    } else if (key == PREFETCH_PAGES) {
+        prefetchPages = value;
+        return true;
     } else if (key == MessageGroupManager::qpidMessageGroupKey) {
         groupKey = value.asString();
         return true;
@@ -212,6 +244,13 @@ void QueueSettings::validate() const
         throw qpid::framing::InvalidArgumentException(QPID_MSG("Can only specify " << MessageGroupManager::qpidMessageGroupTimestamp
                                                                << " if " << MessageGroupManager::qpidMessageGroupKey << " is set"));
     }
+    if (paging && (lvqKey.size() || priorities || groupKey.size())) {
+        throw qpid::framing::InvalidArgumentException(QPID_MSG("Can only specify " << PAGING << " for a standard queue; it cannot be combined with "
+                                                               << LVQ_KEY << ", " << PRIORITIES << " or " << MessageGroupManager::qpidMessageGroupKey));
+    }
+    if (paging && (maxPages < 2 || pageFactor == 0)) {
+        throw qpid::framing::InvalidArgumentException(QPID_MSG(MAX_PAGES << " must be at least 2 and " << PAGE_FACTOR << " must be non-zero"));
+    }
 
     // @todo: remove once "sticky" consumers are supported - see QPID-3347
     if (!shareGroups && groupKey.size()) {
@@ -27,6 +27,7 @@
 #include "qpid/framing/FieldTable.h"
 #include <string>
 #include <map>
+#include <vector>
 
 namespace qpid {
 namespace types {
@@ -51,6 +52,12 @@ struct QueueSettings
     uint32_t defaultFairshare;
     std::map<uint32_t,uint32_t> fairshare;
 
+    //paging (standard queues only):
+    bool paging;
+    uint32_t maxPages;//number of pages held in memory at any time
+    uint32_t pageFactor;//page size as a multiple of the platform page size
+    uint32_t prefetchPages;//number of paged out pages read ahead of consumers
+
     //message groups:
     std::string groupKey;
     bool shareGroups;
@@ -63,6 +70,7 @@ struct QueueSettings
     bool isBrowseOnly;
     std::string traceId;
     std::string traceExcludes;
+    std::vector<std::string> indexedHeaders;//for filtering purge & move
     uint64_t autoDeleteDelay;//queueTtl?
 
     //flow control:
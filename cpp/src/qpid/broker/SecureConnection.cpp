@@ -43,6 +43,16 @@ size_t SecureConnection::decode(const char* buffer, size_t size)
     }
 }
 
+size_t SecureConnection::decodeShared(const ConstBufferRef& buffer)
+{
+    if (secured || securityLayer.get()) {
+        // Decrypted data lives elsewhere
+        return decode(buffer.begin(), buffer.end() - buffer.begin());
+    } else {
+        return codec->decodeShared(buffer);
+    }
+}
+
 size_t SecureConnection::encode(char* buffer, size_t size)
 {
     if (secured) {
@@ -43,6 +43,7 @@ class SecureConnection : public qpid::sys::ConnectionCodec
   public:
     SecureConnection();
     size_t decode(const char* buffer, size_t size);
+    size_t decodeShared(const ConstBufferRef& buffer);
     size_t encode(char* buffer, size_t size);
     bool canEncode();
     void closed();
@@ -313,6 +313,8 @@ Consumer(_name, type),
     resumeTtl(_resumeTtl),
     arguments(_arguments),
     notifyEnabled(true),
+    notifyPending(false),
+    suppressedWakeups(0),
     syncFrequency(_arguments.getAsInt(QPID_SYNC_FREQUENCY)),
     deliveryCount(0),
     protocols(parent->getSession().getBroker().getProtocolRegistry())
@@ -707,6 +709,12 @@ void SemanticState::reject(DeliveryId first, DeliveryId last)
 
 bool SemanticStateConsumerImpl::doOutput()
 {
+    {
+        // any notification from here on may not be seen by this
+        // dispatch, so must request output again
+        Mutex::ScopedLock l(lock);
+        notifyPending = false;
+    }
     try {
         return haveCredit() && doDispatch();
     } catch (const SessionException& e) {
@@ -718,12 +726,14 @@ void SemanticStateConsumerImpl::enableNotify()
 {
     Mutex::ScopedLock l(lock);
     notifyEnabled = true;
+    notifyPending = false;
 }
 
 void SemanticStateConsumerImpl::disableNotify()
 {
     Mutex::ScopedLock l(lock);
     notifyEnabled = false;
+    notifyPending = false;
 }
 
 bool SemanticStateConsumerImpl::isNotifyEnabled() const {
@@ -731,15 +741,32 @@ bool SemanticStateConsumerImpl::isNotifyEnabled() const {
     return notifyEnabled;
 }
 
+/**
+ * Notifications received before the IO thread has got round to
+ * calling doOutput() are coalesced into a single request for output,
+ * avoiding repeated wakeups of the connection for a burst of messages.
+ */
 void SemanticStateConsumerImpl::notify()
 {
     Mutex::ScopedLock l(lock);
     if (notifyEnabled) {
-        parent->session.getConnection().outputTasks.addOutputTask(this);
-        parent->session.getConnection().outputTasks.activateOutput();
+        if (notifyPending) {
+            ++suppressedWakeups;
+            if (mgmtObject) { mgmtObject->inc_suppressedWakeups(); }
+        } else {
+            notifyPending = true;
+            parent->session.getConnection().outputTasks.addOutputTask(this);
+            parent->session.getConnection().outputTasks.activateOutput();
+        }
     }
 }
 
+uint64_t SemanticStateConsumerImpl::getSuppressedWakeups() const
+{
+    Mutex::ScopedLock l(lock);
+    return suppressedWakeups;
+}
+
 
 // Test that a DeliveryRecord's ID is in a sequence set and some other
 // predicate on DeliveryRecord holds.
@@ -213,6 +213,8 @@ class SemanticStateConsumerImpl : public Consumer, public sys::OutputTask,
     framing::FieldTable arguments;
     Credit credit;
     bool notifyEnabled;
+    bool notifyPending;//set when output has been requested but doOutput() not yet called
+    uint64_t suppressedWakeups;
     const int syncFrequency;
     int deliveryCount;
     qmf::org::apache::qpid::broker::Subscription::shared_ptr mgmtObject;
@@ -246,6 +248,8 @@ class SemanticStateConsumerImpl : public Consumer, public sys::OutputTask,
     QPID_BROKER_EXTERN void enableNotify();
     QPID_BROKER_EXTERN void notify();
     QPID_BROKER_EXTERN bool isNotifyEnabled() const;
+    /** @return the number of notifications coalesced into an already pending one */
+    QPID_BROKER_EXTERN uint64_t getSuppressedWakeups() const;
 
     QPID_BROKER_EXTERN void requestDispatch();
 
@@ -33,6 +33,7 @@
 #include "qpid/framing/ServerInvoker.h"
 #include "qpid/log/Statement.h"
 #include "qpid/management/ManagementAgent.h"
+#include "qpid/sys/LatencyHistogram.h"
 
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
@@ -216,7 +217,13 @@ void SessionState::handleContent(AMQFrame& frame, const SequenceNumber& id)
         if (broker.isTimestamping())
             deliverable.getMessage().setTimestamp();
         deliverable.getMessage().setPublisher(&getConnection());
-
+        if (sys::LatencyStats::isEnabled()) {
+            sys::AbsTime now = sys::AbsTime::now();
+            sys::AbsTime read = sys::LatencyStats::getReadTime();
+            if (!(read == sys::AbsTime()))
+                sys::LatencyStats::record(sys::LatencyStats::READ_DECODE, sys::Duration(read, now));
+            deliverable.getMessage().setStageTime(now);
+        }
 
         IncompleteIngressMsgXfer xfer(this, msg);
         msg->getIngressCompletion().begin();
@@ -94,6 +94,8 @@ class SessionState : public qpid::SessionState,
 
     Broker& getBroker();
 
+    SemanticState& getSemanticState() { return semanticState; }
+
     void setTimeout(uint32_t seconds);
 
     /** OutputControl **/
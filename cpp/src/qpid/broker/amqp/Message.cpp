@@ -26,6 +26,7 @@
 #include "qpid/broker/MapHandler.h"
 #include "qpid/log/Statement.h"
 #include "qpid/framing/Buffer.h"
+#include <algorithm>
 #include <string.h>
 
 namespace qpid {
@@ -267,6 +268,20 @@ void Message::encode(framing::Buffer& buffer) const
     buffer.putRawData((const uint8_t*) getData(), getSize());
     QPID_LOG(debug, "Encoded 1.0 message of " << getSize() << " bytes, including " << bareMessage.size << " bytes of 'bare message'");
 }
+void Message::encodePart(framing::Buffer& buffer, uint32_t offset) const
+{
+    // The same bytes as encode(), from where they already are
+    static const char formatIndicator[4] = { 0, 0, 0, 0 };
+    if (offset < sizeof(formatIndicator)) {
+        uint32_t n = std::min(uint32_t(sizeof(formatIndicator)) - offset, buffer.available());
+        buffer.putRawData((const uint8_t*) formatIndicator + offset, n);
+        offset += n;
+    }
+    uint32_t size = encodedSize();
+    if (offset >= sizeof(formatIndicator) && offset < size)
+        buffer.putRawData((const uint8_t*) getData() + offset - sizeof(formatIndicator),
+                          std::min(size - offset, buffer.available()));
+}
 uint32_t Message::encodedSize() const
 {
     return 4/*format indicator*/ + data.size();
@@ -73,6 +73,7 @@ class Message : public qpid::broker::Message::Encoding, private qpid::amqp::Mess
 
     //PersistableMessage interface:
     void encode(framing::Buffer& buffer) const;
+    void encodePart(framing::Buffer& buffer, uint32_t offset) const;
     uint32_t encodedSize() const;
     void decodeHeader(framing::Buffer& buffer);
     void decodeContent(framing::Buffer& buffer);
@@ -33,6 +33,8 @@
 #include "qpid/framing/SendContent.h"
 #include "qpid/log/Statement.h"
 #include "boost/lexical_cast.hpp"
+#include <algorithm>
+#include <vector>
 
 using namespace qpid::framing;
 
@@ -42,6 +44,55 @@ namespace amqp_0_10 {
 namespace {
 const std::string QMF2("qmf2");
 const std::string PARTIAL("partial");
+
+/**
+ * Encodes the frames it is given as EncodeFrame and EncodeBody would,
+ * but only what lies from offset onwards and fits in the buffer.
+ * Content is written straight from the frames; a method or header
+ * frame that is only partly wanted is encoded aside and the part copied.
+ */
+class EncodePart
+{
+  public:
+    EncodePart(Buffer& b, uint32_t o) : buffer(b), offset(o) {}
+
+    void operator()(const AMQFrame& frame) {
+        if (frame.getBody()->type() == CONTENT_BODY) {
+            const AMQContentBody* content = static_cast<const AMQContentBody*>(frame.getBody());
+            uint32_t size = content->encodedSize();
+            if (skip(size)) return;
+            content->encode(buffer, offset, std::min(size - offset, buffer.available()));
+        } else {
+            uint32_t size = frame.encodedSize();
+            if (skip(size)) return;
+            if (offset == 0 && size <= buffer.available()) {
+                frame.encode(buffer);
+            } else {
+                std::vector<char> bytes(size);
+                Buffer whole(&bytes[0], size);
+                frame.encode(whole);
+                buffer.putRawData(reinterpret_cast<uint8_t*>(&bytes[offset]),
+                                  std::min(size - offset, buffer.available()));
+            }
+        }
+        offset = 0;
+    }
+
+  private:
+    Buffer& buffer;
+    uint32_t offset;
+
+    // True if the next size bytes are all before the part wanted, or it
+    // is already complete
+    bool skip(uint32_t size) {
+        if (buffer.available() == 0) return true;
+        if (offset >= size) {
+            offset -= size;
+            return true;
+        }
+        return false;
+    }
+};
 }
 MessageTransfer::MessageTransfer() : frames(framing::SequenceNumber()), requiredCredit(0), cachedRequiredCredit(false) {}
 MessageTransfer::MessageTransfer(const framing::SequenceNumber& id) : frames(id), requiredCredit(0), cachedRequiredCredit(false) {}
@@ -253,6 +304,14 @@ void MessageTransfer::encode(framing::Buffer& buffer) const
     frames.map_if(f2, TypeFilter<CONTENT_BODY>());
 }
 
+void MessageTransfer::encodePart(framing::Buffer& buffer, uint32_t offset) const
+{
+    // The same frames in the same order as encode()
+    EncodePart f(buffer, offset);
+    frames.map_if(f, TypeFilter2<METHOD_BODY, HEADER_BODY>());
+    frames.map_if(f, TypeFilter<CONTENT_BODY>());
+}
+
 void MessageTransfer::encodeContent(framing::Buffer& buffer) const
 {
     //encode the payload of each content frame
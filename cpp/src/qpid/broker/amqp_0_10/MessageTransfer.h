@@ -95,6 +95,7 @@ class MessageTransfer : public qpid::broker::Message::Encoding, public qpid::bro
     void decodeContent(framing::Buffer& buffer);
 
     void encode(framing::Buffer& buffer) const;
+    void encodePart(framing::Buffer& buffer, uint32_t offset) const;
     uint32_t encodedSize() const;
 
     /**
@@ -71,7 +71,7 @@ static class SocketFDPlugin : public Plugin {
         if (broker) {
             if (!options.socketFds.empty()) {
                 const broker::Broker::Options& opts = broker->getOptions();
-                SocketAcceptor* sa = new SocketAcceptor(opts.tcpNoDelay, false, opts.maxNegotiateTime, broker->getTimer());
+                SocketAcceptor* sa = new SocketAcceptor(opts.tcpNoDelay, false, opts.maxNegotiateTime, broker->getTimer(), &broker->getPollerPool());
                 for (unsigned i = 0; i<options.socketFds.size(); ++i) {
                     int fd = options.socketFds[i];
                     if (!isSocket(fd)) {
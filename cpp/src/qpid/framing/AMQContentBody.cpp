@@ -21,26 +21,87 @@
 #include "qpid/framing/AMQContentBody.h"
 #include <iostream>
 
+namespace {
+// Smaller content is copied: referring to it could keep a whole read
+// buffer alive for the sake of a few bytes
+const uint32_t MinSharedSize = 16384;
+}
+
 qpid::framing::AMQContentBody::AMQContentBody(){
 }
 
 qpid::framing::AMQContentBody::AMQContentBody(const std::string& _data) : data(_data){
 }
 
+void qpid::framing::AMQContentBody::unshare(){
+    if (shared.begin()) {
+        data.assign(shared.begin(), shared.end());
+        shared = ConstBufferRef();
+    }
+}
+
+std::string qpid::framing::AMQContentBody::getData() const{
+    if (shared.begin()) return std::string(shared.begin(), shared.end());
+    return data;
+}
+
+std::string& qpid::framing::AMQContentBody::getData(){
+    unshare();
+    return data;
+}
+
+void qpid::framing::AMQContentBody::appendData(std::string& out) const{
+    if (shared.begin()) out.append(shared.begin(), shared.end());
+    else out += data;
+}
+
+qpid::framing::AMQContentBody qpid::framing::AMQContentBody::slice(uint32_t offset, uint32_t size) const{
+    AMQContentBody part;
+    if (shared.begin()) {
+        ConstBufferRef whole(shared);
+        part.shared = whole.sub_buffer(whole.begin()+offset, whole.begin()+offset+size);
+    } else {
+        part.data = data.substr(offset, size);
+    }
+    return part;
+}
+
 uint32_t qpid::framing::AMQContentBody::encodedSize() const{
-    return data.size();
+    return shared.begin() ? shared.end() - shared.begin() : data.size();
 }
 void qpid::framing::AMQContentBody::encode(Buffer& buffer) const{
-    buffer.putRawData(data);
+    if (shared.begin())
+        buffer.putRawData(reinterpret_cast<const uint8_t*>(shared.begin()), shared.end() - shared.begin());
+    else
+        buffer.putRawData(data);
+}
+void qpid::framing::AMQContentBody::encode(Buffer& buffer, uint32_t offset, uint32_t size) const{
+    const char* start = shared.begin() ? shared.begin() : data.data();
+    buffer.putRawData(reinterpret_cast<const uint8_t*>(start + offset), size);
 }
 void qpid::framing::AMQContentBody::decode(Buffer& buffer, uint32_t _size){
-    buffer.getRawData(data, _size);
+    const ConstBufferRef* memory = buffer.getSharedMemory();
+    if (memory && _size >= MinSharedSize) {
+        buffer.checkAvailable(_size);
+        ConstBufferRef whole(*memory);
+        const char* start = buffer.getPointer() + buffer.getPosition();
+        shared = whole.sub_buffer(start, start + _size);
+        data.clear();
+        buffer.setPosition(buffer.getPosition() + _size);
+    } else {
+        shared = ConstBufferRef();
+        buffer.getRawData(data, _size);
+    }
 }
 
 void qpid::framing::AMQContentBody::print(std::ostream& out) const
 {
     out << "content (" << encodedSize() << " bytes)";
     const size_t max = 32;
-    out << " " << data.substr(0, max);
-    if (data.size() > max) out << "...";
+    if (shared.begin()) {
+        out << " " << std::string(shared.begin(), std::min(size_t(shared.end() - shared.begin()), max));
+    } else {
+        out << " " << data.substr(0, max);
+    }
+    if (encodedSize() > max) out << "...";
 }
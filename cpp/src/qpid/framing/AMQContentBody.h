@@ -21,6 +21,7 @@
 #include "qpid/framing/amqp_types.h"
 #include "qpid/framing/AMQBody.h"
 #include "qpid/framing/Buffer.h"
+#include "qpid/BufferRef.h"
 #include "qpid/CommonImportExport.h"
 
 #ifndef _AMQContentBody_
@@ -29,19 +30,37 @@
 namespace qpid {
 namespace framing {
 
+/**
+ * Content decoded from a Buffer over shared memory (see Buffer) keeps
+ * referring to that memory rather than being copied, so it travels from
+ * the read buffer to the queue and out again without a copy. The const
+ * getData() returns a copy of the content and leaves the body as it is,
+ * so bodies shared between threads can be read freely; the non-const
+ * getData() moves such content into the body's own string. encode(),
+ * appendData() and slice() don't need a copy.
+ */
 class QPID_COMMON_CLASS_EXTERN AMQContentBody :  public AMQBody
 {
     std::string data;
+    ConstBufferRef shared;
+
+    void unshare();
 
 public:
     QPID_COMMON_EXTERN AMQContentBody();
     QPID_COMMON_EXTERN AMQContentBody(const std::string& data);
     inline virtual ~AMQContentBody(){}
     inline uint8_t type() const { return CONTENT_BODY; };
-    inline const std::string& getData() const { return data; }
-    inline std::string& getData() { return data; }
+    QPID_COMMON_EXTERN std::string getData() const;
+    QPID_COMMON_EXTERN std::string& getData();
+    /** Append the content to out */
+    QPID_COMMON_EXTERN void appendData(std::string& out) const;
+    /** Body for part of this content, sharing its memory if it can */
+    QPID_COMMON_EXTERN AMQContentBody slice(uint32_t offset, uint32_t size) const;
     QPID_COMMON_EXTERN uint32_t encodedSize() const;
     QPID_COMMON_EXTERN void encode(Buffer& buffer) const;
+    /** Encode size bytes of the content starting at offset */
+    QPID_COMMON_EXTERN void encode(Buffer& buffer, uint32_t offset, uint32_t size) const;
     QPID_COMMON_EXTERN void decode(Buffer& buffer, uint32_t size);
     QPID_COMMON_EXTERN void print(std::ostream& out) const;
     void accept(AMQBodyConstVisitor& v) const { v.visit(*this); }
@@ -81,13 +81,26 @@ void AMQFrame::encode(Buffer& buffer) const
     body->encode(buffer);
 }
 
+namespace {
+inline uint32_t getWord(const char* data) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+}
+
 bool AMQFrame::decode(Buffer& buffer)
 {    
-    if(buffer.available() < frameOverhead())
+    const uint32_t overhead = frameOverhead();
+    if(buffer.available() < overhead)
         return false;
     uint32_t pos = buffer.getPosition();
 
-    uint8_t  flags = buffer.getOctet();
+    // Take the header a word at a time straight from the buffer:
+    //   flags(8) type(8) size(16) | reserved(8) track(8) channel(16) | reserved(32)
+    const char* header = buffer.getPointer() + pos;
+    uint32_t word0 = getWord(header);
+    uint32_t word1 = getWord(header + 4);
+    uint8_t flags = word0 >> 24;
     uint8_t framing_version = (flags & 0xc0) >> 6;
     if (framing_version != 0)
         throw FramingErrorException(QPID_MSG("Framing version unsupported"));
@@ -95,29 +108,26 @@ bool AMQFrame::decode(Buffer& buffer)
     eof = flags & 0x04;
     bos = flags & 0x02;
     eos = flags & 0x01;
-    uint8_t  type = buffer.getOctet();
-    uint16_t frame_size =  buffer.getShort();
-    if (frame_size < frameOverhead())
+    uint8_t  type = (word0 >> 16) & 0xff;
+    uint16_t frame_size = word0 & 0xffff;
+    if (frame_size < overhead)
         throw FramingErrorException(QPID_MSG("Frame size too small " << frame_size));    
-    uint8_t  reserved1 = buffer.getOctet();
-    uint8_t  field1 = buffer.getOctet();
-    subchannel = field1 & 0x0f;
-    channel = buffer.getShort();
-    (void) buffer.getLong(); // reserved2
+    subchannel = (word1 >> 16) & 0x0f;
+    channel = word1 & 0xffff;
     
-    // Verify that the protocol header meets current spec
+    // Verify that the protocol header meets current spec: the reserved
+    // bits of flags, the reserved octet and the top of the track octet
     // TODO: should we check reserved2 against zero as well? - the
     // spec isn't clear
-    if ((flags & 0x30) != 0 || reserved1 != 0 || (field1 & 0xf0) != 0)
+    if ((flags & 0x30) != 0 || (word1 & 0xfff00000) != 0)
         throw FramingErrorException(QPID_MSG("Reserved bits not zero"));
 
     // TODO: should no longer care about body size and only pass up
     // B,E,b,e flags
-    uint16_t body_size = frame_size - frameOverhead(); 
-    if (buffer.available() < body_size){
-        buffer.setPosition(pos);
+    uint16_t body_size = frame_size - overhead; 
+    if (buffer.available() - overhead < body_size)
         return false;
-    }
+    buffer.setPosition(pos + overhead);
 
     switch(type)
     {
@@ -20,6 +20,7 @@
  */
 #include "qpid/framing/Buffer.h"
 #include "qpid/framing/FieldTable.h" 
+#include "qpid/BufferRef.h"
 #include "qpid/Msg.h"
 #include <string.h>
 #include <boost/format.hpp>
@@ -31,7 +32,12 @@ namespace framing {
 using std::string;
 
 Buffer::Buffer(char* _data, uint32_t _size)
-    : size(_size), data(_data), position(0) {
+    : size(_size), data(_data), position(0), shared(0) {
+}
+
+Buffer::Buffer(const ConstBufferRef& memory)
+    : size(memory.end() - memory.begin()), data(const_cast<char*>(memory.begin())),
+      position(0), shared(&memory) {
 }
 
 void Buffer::reset(){
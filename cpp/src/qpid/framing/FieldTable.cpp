@@ -27,6 +27,7 @@
 #include "qpid/framing/reply_exceptions.h"
 #include "qpid/Msg.h"
 #include <assert.h>
+#include <boost/make_shared.hpp>
 
 // The locking rationale in the FieldTable seems a little odd, but it
 // maintains the concurrent guarantees and requirements that were in
@@ -312,6 +313,53 @@ void FieldTable::decode(Buffer& buffer){
     buffer.getRawData(&cachedBytes[0], cachedSize);
 }
 
+namespace {
+class DecodedValue : public FieldValue {
+  public:
+    DecodedValue(uint8_t type, FieldValue::Data* data) : FieldValue(type, data) {}
+};
+
+/**
+ * Decode a value of one of the commonest types - fixed width up to 8
+ * bytes, or a string or binary with an 8 or 16 bit length - straight from
+ * the encoded bytes at p, moving p past it. Returns an empty pointer,
+ * leaving p alone, for anything else or if the value doesn't fit before
+ * end, for the general decoder to deal with.
+ */
+FieldTable::ValuePtr decodeCommon(const uint8_t*& p, const uint8_t* end)
+{
+    size_t available = end - p;
+    if (available < 2) return FieldTable::ValuePtr();
+    uint8_t type = p[0];
+    size_t size;
+    FieldValue::Data* data;
+    switch (type >> 4) {
+      case 0: size = 1; break;
+      case 1: size = 2; break;
+      case 2: size = 4; break;
+      case 3: size = 8; break;
+      case 8: size = 1 + p[1]; break;
+      case 9:
+        if (available < 3) return FieldTable::ValuePtr();
+        size = 2 + (uint32_t(p[1]) << 8 | p[2]);
+        break;
+      default: return FieldTable::ValuePtr();
+    }
+    if (available < 1 + size) return FieldTable::ValuePtr();
+    const uint8_t* v = p + 1;
+    switch (type >> 4) {
+      case 0: data = new FixedWidthValue<1>(v); break;
+      case 1: data = new FixedWidthValue<2>(v); break;
+      case 2: data = new FixedWidthValue<4>(v); break;
+      case 3: data = new FixedWidthValue<8>(v); break;
+      case 8: data = new VariableWidthValue<1>(v + 1, v + size); break;
+      default: data = new VariableWidthValue<2>(v + 2, v + size); break;
+    }
+    p = v + size;
+    return boost::make_shared<DecodedValue>(type, data);
+}
+}
+
 void FieldTable::realDecode() const
 {
     ScopedLock<Mutex> l(lock);
@@ -321,18 +369,30 @@ void FieldTable::realDecode() const
         return;
 
     Buffer buffer((char*)&cachedBytes[0], cachedSize);
+    const uint8_t* start = &cachedBytes[0];
+    const uint8_t* end = start + cachedSize;
     uint32_t len = buffer.getLong();
     if (len) {
         uint32_t available = buffer.available();
         uint32_t count = buffer.getLong();
         uint32_t leftover = available - len;
         while(buffer.available() > leftover && count--){
-            std::string name;
-            ValuePtr value(new FieldValue);
-
-            buffer.getShortString(name);
-            value->decode(buffer);
-            values[name] = ValuePtr(value);
+            // Tables we encoded have their keys in order, so insert at the end
+            ValueMap::iterator i;
+            const uint8_t* key = start + buffer.getPosition();
+            const uint8_t* p = key + 1 + key[0];
+            ValuePtr value;
+            if (p < end && (value = decodeCommon(p, end))) {
+                i = values.insert(values.end(), ValueMap::value_type(std::string(key + 1, key + 1 + key[0]), ValuePtr()));
+                buffer.setPosition(p - start);
+            } else {
+                std::string name;
+                value = ValuePtr(new FieldValue);
+                buffer.getShortString(name);
+                value->decode(buffer);
+                i = values.insert(values.end(), ValueMap::value_type(name, ValuePtr()));
+            }
+            i->second = value;
         }
     }
     newBytes = false;
@@ -93,7 +93,7 @@ void FrameSet::getContent(std::string& out) const {
     out.reserve(getContentSize());
     for(Frames::const_iterator i = parts.begin(); i != parts.end(); i++) {
         if (i->getBody()->type() == CONTENT_BODY)
-            out += i->castBody<AMQContentBody>()->getData();
+            i->castBody<AMQContentBody>()->appendData(out);
     }
 }
 
@@ -51,7 +51,7 @@ void qpid::framing::SendContent::operator()(const AMQFrame& f)
 
 void qpid::framing::SendContent::sendFragment(const AMQContentBody& body, uint32_t offset, uint16_t size, bool first, bool last) const
 {
-    AMQFrame fragment((AMQContentBody(body.getData().substr(offset, size))));
+    AMQFrame fragment(body.slice(offset, size));
     setFlags(fragment, first, last);
     handler.handle(fragment);
 }
@@ -0,0 +1,118 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/legacystore/ConfigWriter.h"
+
+#include "qpid/legacystore/StoreException.h"
+#include "qpid/legacystore/TxnCtxt.h"
+#include "qpid/log/Statement.h"
+#include <algorithm>
+#include <exception>
+
+namespace mrg {
+namespace msgstore {
+
+ConfigWriter::ConfigWriter(DbEnv* e, u_int16_t m) :
+    env(e),
+    maxBatch(m ? m : 1),
+    committing(false)
+{}
+
+void ConfigWriter::write(const Change& change)
+{
+    Pending pending(change);
+    qpid::sys::Monitor::ScopedLock l(monitor);
+    queue.push_back(&pending);
+    while (!pending.done) {
+        if (committing) {
+            monitor.wait();
+            continue;
+        }
+        committing = true;
+        Batch batch;
+        while (!queue.empty() && batch.size() < maxBatch) {
+            batch.push_back(queue.front());
+            queue.pop_front();
+        }
+        try {
+            qpid::sys::Monitor::ScopedUnlock u(monitor);
+            commit(batch);
+        } catch (...) {
+            // commit() could not report this against the changes: fail the
+            // whole batch rather than leave its writers, and any queued
+            // behind them, waiting for ever
+            finish(batch, "Configuration commit failed");
+            if (!pending.done)
+                queue.erase(std::find(queue.begin(), queue.end(), &pending));
+            throw;
+        }
+        finish(batch, std::string());
+    }
+    if (!pending.error.empty())
+        throw StoreException(pending.error);
+}
+
+// Called with the lock held by the thread that committed the batch.
+void ConfigWriter::finish(Batch& batch, const std::string& error)
+{
+    for (Batch::iterator i = batch.begin(); i != batch.end(); ++i) {
+        if ((*i)->error.empty())
+            (*i)->error = error;
+        (*i)->done = true;
+    }
+    committing = false;
+    // Wakes those in the batch just committed, and lets one of any
+    // still queued commit the next
+    monitor.notifyAll();
+}
+
+// Called with no lock held, by one thread at a time.
+void ConfigWriter::commit(Batch& batch)
+{
+    TxnCtxt txn;
+    try {
+        txn.begin(env, true);
+        for (Batch::iterator i = batch.begin(); i != batch.end(); ++i) {
+            DbTxn* nested = 0;
+            env->txn_begin(txn.get(), &nested, 0);
+            try {
+                (*i)->change(nested);
+            } catch (const std::exception& e) {
+                nested->abort();
+                (*i)->error = e.what();
+                continue;
+            }
+            nested->commit(0);
+        }
+        txn.commit();
+        if (batch.size() > 1)
+            QPID_LOG(debug, "Committed " << batch.size() << " configuration changes together");
+    } catch (const std::exception& e) {
+        txn.abort();
+        QPID_LOG(error, "Failed to commit " << batch.size() << " configuration changes: " << e.what());
+        for (Batch::iterator i = batch.begin(); i != batch.end(); ++i) {
+            if ((*i)->error.empty())
+                (*i)->error = e.what();
+        }
+    }
+}
+
+}}
@@ -0,0 +1,88 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef QPID_LEGACYSTORE_CONFIGWRITER_H
+#define QPID_LEGACYSTORE_CONFIGWRITER_H
+
+#include "db-inc.h"
+#include "qpid/sys/Monitor.h"
+#include <boost/function.hpp>
+#include <deque>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace mrg{
+namespace msgstore{
+
+/**
+ * Group commit for changes to the configuration databases (queues,
+ * exchanges, bindings and general configuration).
+ *
+ * Each change still returns only once it is committed, but changes made
+ * at the same time from different threads share one Berkeley DB
+ * transaction - and so one log sync - rather than committing one after
+ * another. Whichever waiting thread finds no commit in progress takes
+ * the changes queued so far and commits them for everyone; the others
+ * wait for it. Each change runs in a transaction nested in the shared
+ * one, so a change that fails is undone and reported to its own caller
+ * without affecting the rest of the batch.
+ */
+class ConfigWriter
+{
+  public:
+    typedef boost::function<void (DbTxn*)> Change;
+
+    /**
+     * @param env the environment the configuration databases are in
+     * @param maxBatch the largest number of changes committed together;
+     *        1 commits every change in a transaction of its own
+     */
+    ConfigWriter(DbEnv* env, u_int16_t maxBatch);
+
+    /**
+     * Make a change within a transaction and wait for it to be committed.
+     * Throws StoreException if the change or its commit fails.
+     */
+    void write(const Change& change);
+
+  private:
+    struct Pending {
+        Change change;
+        bool done;
+        std::string error;
+        Pending(const Change& c) : change(c), done(false) {}
+    };
+    typedef std::vector<Pending*> Batch;
+
+    DbEnv* const env;
+    const u_int16_t maxBatch;
+    qpid::sys::Monitor monitor;
+    std::deque<Pending*> queue;
+    bool committing;
+
+    void commit(Batch& batch);
+    void finish(Batch& batch, const std::string& error);
+};
+
+}}
+
+#endif // ifndef QPID_LEGACYSTORE_CONFIGWRITER_H
@@ -0,0 +1,272 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/legacystore/ContentStore.h"
+
+#include "qpid/legacystore/DataTokenImpl.h"
+#include "qpid/legacystore/MessageDataSrc.h"
+#include "qpid/legacystore/StoreException.h"
+#include "qpid/legacystore/jrnl/jdir.h"
+#include "qpid/log/Statement.h"
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_AIO_SLEEPS 100000 // tot: ~1 sec
+#define AIO_SLEEP_TIME_US  10 // 0.01 ms
+
+namespace mrg {
+namespace msgstore {
+
+namespace {
+
+void dequeueRecord(JournalImpl& jc, IdSequence& messageIdSequence, u_int64_t rid)
+{
+    boost::intrusive_ptr<DataTokenImpl> ddtokp(new DataTokenImpl);
+    ddtokp->set_external_rid(true);
+    ddtokp->set_rid(messageIdSequence.next());
+    ddtokp->set_dequeue_rid(rid);
+    ddtokp->set_wstate(DataTokenImpl::ENQ);
+    // Manually increase the ref count, as raw pointers are used beyond this point
+    ddtokp->addRef();
+    try {
+        jc.dequeue_data_record(ddtokp.get());
+    } catch (const journal::jexception& e) {
+        ddtokp->release();
+        THROW_STORE_EXCEPTION(std::string("Journal ") + jc.id() + ": dequeue failed: " + e.what());
+    }
+}
+
+}
+
+ContentStore::ContentStore(JournalImpl* j,
+                           IdSequence& ids,
+                           const u_int16_t nf,
+                           const bool ae,
+                           const u_int16_t aemf,
+                           const u_int32_t fs,
+                           const u_int16_t np,
+                           const u_int32_t ps)
+  : journal(j),
+    messageIdSequence(ids),
+    numJrnlFiles(nf),
+    autoJrnlExpand(ae),
+    autoJrnlExpandMaxFiles(aemf),
+    jrnlFsizeSblks(fs),
+    wCacheNumPages(np),
+    wCachePgSizeSblks(ps)
+{}
+
+ContentStore::~ContentStore() {}
+
+bool ContentStore::share(const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message, u_int64_t queueId)
+{
+    const u_int64_t rid = message->getPersistenceId();
+    {
+        qpid::sys::Monitor::ScopedLock sl(lock);
+        // Another queue may be writing the same content; wait to see how it went
+        while (writing.find(rid) != writing.end())
+            lock.wait();
+        RefMapItr i = refs.find(rid);
+        if (i != refs.end()) {
+            i->second.insert(queueId);
+            return true;
+        }
+        chkInit();
+        writing.insert(rid);
+    }
+    // The journal serializes its own writes, so other queues can carry on
+    // sharing and releasing while the content goes in
+    bool written = false;
+    try {
+        written = writeContent(message);
+    } catch (...) {
+        qpid::sys::Monitor::ScopedLock sl(lock);
+        writing.erase(rid);
+        lock.notifyAll();
+        throw;
+    }
+    qpid::sys::Monitor::ScopedLock sl(lock);
+    writing.erase(rid);
+    lock.notifyAll();
+    if (!written) return false;
+    refs[rid].insert(queueId);
+    return true;
+}
+
+void ContentStore::release(u_int64_t rid, u_int64_t queueId)
+{
+    qpid::sys::Monitor::ScopedLock sl(lock);
+    RefMapItr i = refs.find(rid);
+    if (i == refs.end() || i->second.erase(queueId) == 0) return; // stored inline
+    if (i->second.empty()) {
+        refs.erase(i);
+        dequeueRecord(*journal, messageIdSequence, rid);
+    }
+}
+
+void ContentStore::releaseAll(u_int64_t queueId)
+{
+    qpid::sys::Monitor::ScopedLock sl(lock);
+    for (RefMapItr i = refs.begin(); i != refs.end();) {
+        if (i->second.erase(queueId) && i->second.empty()) {
+            dequeueRecord(*journal, messageIdSequence, i->first);
+            refs.erase(i++);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void ContentStore::recover(u_int64_t& highestRid)
+{
+    if (!journal::jdir::exists(journal->jrnl_dir() + journal->base_filename() + ".jinf")) return;
+    u_int64_t thisHighestRid = 0ULL;
+    try {
+        journal->recover(numJrnlFiles, autoJrnlExpand, autoJrnlExpandMaxFiles, jrnlFsizeSblks, wCacheNumPages,
+                         wCachePgSizeSblks, 0, thisHighestRid, 0);
+        if (highestRid == 0ULL)
+            highestRid = thisHighestRid;
+        else if (thisHighestRid - highestRid < 0x8000000000000000ULL) // RFC 1982 comparison for unsigned 64-bit
+            highestRid = thisHighestRid;
+
+        readContent();
+
+        journal->recover_complete(); // start journal.
+    } catch (const journal::jexception& e) {
+        THROW_STORE_EXCEPTION(std::string("ContentStore recover() failed: ") + e.what());
+    }
+}
+
+const std::string* ContentStore::recoverRef(JournalImpl* jc, u_int64_t rid, u_int64_t queueId)
+{
+    qpid::sys::Monitor::ScopedLock sl(lock);
+    ContentMap::const_iterator i = recovered.find(rid);
+    if (i == recovered.end()) {
+        orphans.push_back(std::make_pair(jc, rid));
+        return 0;
+    }
+    refs[rid].insert(queueId);
+    return &i->second;
+}
+
+void ContentStore::recoverComplete()
+{
+    qpid::sys::Monitor::ScopedLock sl(lock);
+    for (ContentMap::const_iterator i = recovered.begin(); i != recovered.end(); ++i) {
+        if (refs.find(i->first) == refs.end())
+            dequeueRecord(*journal, messageIdSequence, i->first);
+    }
+    recovered.clear();
+    for (OrphanList::const_iterator i = orphans.begin(); i != orphans.end(); ++i) {
+        try {
+            dequeueRecord(*i->first, messageIdSequence, i->second);
+        } catch (const StoreException& e) {
+            QPID_LOG(warning, "Could not dequeue reference to missing content: " << e.what());
+        }
+    }
+    orphans.clear();
+}
+
+void ContentStore::flush()
+{
+    qpid::sys::Monitor::ScopedLock sl(lock);
+    if (journal->is_ready()) journal->flush();
+}
+
+void ContentStore::stop()
+{
+    qpid::sys::Monitor::ScopedLock sl(lock);
+    if (journal->is_ready()) journal->stop(true);
+}
+
+void ContentStore::chkInit()
+{
+    if (!journal->is_ready()) {
+        journal::jdir::create_dir(journal->jrnl_dir());
+        journal->initialize(numJrnlFiles, autoJrnlExpand, autoJrnlExpandMaxFiles, jrnlFsizeSblks, wCacheNumPages,
+                            wCachePgSizeSblks);
+    }
+}
+
+bool ContentStore::writeContent(const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message)
+{
+    MessageDataSrc src(*message);
+    boost::intrusive_ptr<DataTokenImpl> dtokp(new DataTokenImpl);
+    dtokp->addRef();
+    dtokp->setSourceMessage(message);
+    dtokp->set_external_rid(true);
+    dtokp->set_rid(message->getPersistenceId());
+    // The message's enqueue is not complete until its content is written too
+    message->enqueueStart();
+    try {
+        journal->enqueue_data_record(src, src.getSize(), dtokp.get(), !message->isPersistent());
+    } catch (const StoreFullException&) {
+        message->enqueueComplete();
+        dtokp->release();
+        return false;
+    }
+    return true;
+}
+
+void ContentStore::readContent()
+{
+    DataTokenImpl dtok;
+    void* dbuff = NULL; size_t dbuffSize = 0;
+    void* xidbuff = NULL; size_t xidbuffSize = 0;
+    bool transientFlag = false;
+    bool externalFlag = false;
+    bool done = false;
+    try {
+        unsigned aio_sleep_cnt = 0;
+        while (!done) {
+            dtok.reset();
+            dtok.set_wstate(DataTokenImpl::ENQ);
+            mrg::journal::iores res = journal->read_data_record(&dbuff, dbuffSize, &xidbuff, xidbuffSize, transientFlag, externalFlag, &dtok);
+            switch (res) {
+              case mrg::journal::RHM_IORES_SUCCESS:
+                recovered[dtok.rid()].assign(static_cast<const char*>(dbuff), dbuffSize);
+                if (xidbuff)
+                    ::free(xidbuff);
+                else if (dbuff)
+                    ::free(dbuff);
+                aio_sleep_cnt = 0;
+                break;
+              case mrg::journal::RHM_IORES_PAGE_AIOWAIT:
+                if (++aio_sleep_cnt > MAX_AIO_SLEEPS)
+                    THROW_STORE_EXCEPTION("Timeout waiting for AIO in ContentStore::readContent()");
+                ::usleep(AIO_SLEEP_TIME_US);
+                break;
+              case mrg::journal::RHM_IORES_EMPTY:
+                done = true;
+                break;
+              default:
+                std::ostringstream oss;
+                oss << "readContent(): Unexpected result from journal read: " << mrg::journal::iores_str(res);
+                THROW_STORE_EXCEPTION(oss.str());
+            } // switch
+        }
+    } catch (const journal::jexception& e) {
+        THROW_STORE_EXCEPTION(std::string("ContentStore readContent() failed: ") + e.what());
+    }
+}
+
+}}
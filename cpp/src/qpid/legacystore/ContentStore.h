@@ -0,0 +1,132 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef QPID_LEGACYSTORE_CONTENTSTORE_H
+#define QPID_LEGACYSTORE_CONTENTSTORE_H
+
+#include "qpid/legacystore/IdSequence.h"
+#include "qpid/legacystore/JournalImpl.h"
+#include "qpid/broker/PersistableMessage.h"
+#include "qpid/sys/Monitor.h"
+#include <boost/intrusive_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace mrg{
+namespace msgstore{
+
+/**
+ * Holds the content of messages enqueued on more than one durable queue.
+ *
+ * The content is written once, to a journal of its own, with the message's
+ * persistence id as its record id. Each queue sharing it writes only an
+ * external enqueue record with that id to its own journal. The content
+ * record is dequeued when the last queue referring to it lets it go.
+ * References are not persisted: recovery rebuilds them from the external
+ * records found in the queue journals.
+ */
+class ContentStore
+{
+  public:
+    /** The content store takes ownership of the (uninitialized) journal. */
+    ContentStore(JournalImpl* journal,
+                 IdSequence& messageIdSequence,
+                 const u_int16_t numJrnlFiles,
+                 const bool autoJrnlExpand,
+                 const u_int16_t autoJrnlExpandMaxFiles,
+                 const u_int32_t jrnlFsizeSblks,
+                 const u_int16_t wCacheNumPages,
+                 const u_int32_t wCachePgSizeSblks);
+    ~ContentStore();
+
+    /**
+     * Record that the queue refers to the message's content, writing the
+     * content first if no queue does yet. Returns false if the content
+     * journal is full, in which case the caller stores the message inline.
+     */
+    bool share(const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message, u_int64_t queueId);
+
+    /**
+     * Drop the queue's reference to the content with the given id, if it
+     * has one, dequeueing the content if no other queue refers to it.
+     */
+    void release(u_int64_t rid, u_int64_t queueId);
+
+    /** Drop every reference held by the queue, as when it is destroyed. */
+    void releaseAll(u_int64_t queueId);
+
+    /**
+     * Recover the content journal if there is one, holding on to its
+     * records until recoverComplete(). highestRid is raised to the highest
+     * record id found.
+     */
+    void recover(u_int64_t& highestRid);
+
+    /**
+     * Record a reference found in a queue journal during recovery. Returns
+     * the content, or 0 if it is missing; the reference is then dequeued
+     * from the queue journal by recoverComplete().
+     */
+    const std::string* recoverRef(JournalImpl* jc, u_int64_t rid, u_int64_t queueId);
+
+    /**
+     * Dequeue content no recovered queue refers to, and references to
+     * missing content. Must be called once the message id sequence has been
+     * reset past every recovered id.
+     */
+    void recoverComplete();
+
+    void flush();
+    void stop();
+
+  private:
+    typedef std::map<u_int64_t, std::set<u_int64_t> > RefMap;
+    typedef RefMap::iterator RefMapItr;
+    typedef std::map<u_int64_t, std::string> ContentMap;
+    typedef std::vector<std::pair<JournalImpl*, u_int64_t> > OrphanList;
+
+    qpid::sys::Monitor lock;
+    boost::shared_ptr<JournalImpl> journal;
+    IdSequence& messageIdSequence;
+    const u_int16_t numJrnlFiles;
+    const bool autoJrnlExpand;
+    const u_int16_t autoJrnlExpandMaxFiles;
+    const u_int32_t jrnlFsizeSblks;
+    const u_int16_t wCacheNumPages;
+    const u_int32_t wCachePgSizeSblks;
+    RefMap refs;                // content id -> ids of the queues referring to it
+    ContentMap recovered;       // content read on recovery, until recoverComplete()
+    OrphanList orphans;         // references to missing content found on recovery
+    std::set<u_int64_t> writing; // content ids share() is writing, without the lock
+
+    void chkInit();
+    bool writeContent(const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message);
+    void readContent();
+    void dequeue(u_int64_t rid);
+};
+
+}}
+
+#endif // ifndef QPID_LEGACYSTORE_CONTENTSTORE_H
@@ -24,6 +24,7 @@
 
 #include "qpid/legacystore/jrnl/data_tok.h"
 #include "qpid/broker/PersistableMessage.h"
+#include "qpid/sys/Time.h"
 #include <boost/intrusive_ptr.hpp>
 
 namespace mrg {
@@ -33,12 +34,15 @@ class DataTokenImpl : public journal::data_tok, public qpid::RefCounted
 {
   private:
     boost::intrusive_ptr<qpid::broker::PersistableMessage> sourceMsg;
+    qpid::sys::AbsTime writeTime; // when the record was written to the write cache, if timed
   public:
     DataTokenImpl();
     virtual ~DataTokenImpl();
 
     inline boost::intrusive_ptr<qpid::broker::PersistableMessage>& getSourceMessage() { return sourceMsg; }
     inline void setSourceMessage(const boost::intrusive_ptr<qpid::broker::PersistableMessage>& msg) { sourceMsg = msg; }
+    inline const qpid::sys::AbsTime& getWriteTime() const { return writeTime; }
+    inline void setWriteTime(const qpid::sys::AbsTime& t) { writeTime = t; }
 };
 
 } // namespace msgstore
@@ -25,6 +25,7 @@
 #include "qpid/legacystore/jrnl/jexception.h"
 #include "qpid/log/Statement.h"
 #include "qpid/management/ManagementAgent.h"
+#include "qmf/org/apache/qpid/legacystore/ArgsJournalDumpCommitLatency.h"
 #include "qmf/org/apache/qpid/legacystore/ArgsJournalExpand.h"
 #include "qmf/org/apache/qpid/legacystore/EventCreated.h"
 #include "qmf/org/apache/qpid/legacystore/EventEnqThresholdExceeded.h"
@@ -33,6 +34,8 @@
 #include "qpid/sys/Monitor.h"
 #include "qpid/sys/Timer.h"
 #include "qpid/legacystore/StoreException.h"
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
 
 using namespace mrg::msgstore;
 using namespace mrg::journal;
@@ -49,6 +52,11 @@ GetEventsFireEvent::GetEventsFireEvent(JournalImpl* p, const qpid::sys::Duration
 
 void GetEventsFireEvent::fire() { qpid::sys::Mutex::ScopedLock sl(_gefe_lock); if (_parent) _parent->getEventsFire(); }
 
+FlushDeadlineEvent::FlushDeadlineEvent(JournalImpl* p, const qpid::sys::Duration timeout):
+    qpid::sys::TimerTask(timeout, "JournalFlushDeadline:"+p->id()), _parent(p) {}
+
+void FlushDeadlineEvent::fire() { qpid::sys::Mutex::ScopedLock sl(_fde_lock); if (_parent) _parent->flushDeadlineFire(); }
+
 JournalImpl::JournalImpl(qpid::sys::Timer& timer_,
                          const std::string& journalId,
                          const std::string& journalDirectory,
@@ -63,6 +71,11 @@ JournalImpl::JournalImpl(qpid::sys::Timer& timer_,
                          lastReadRid(0),
                          writeActivityFlag(false),
                          flushTriggeredFlag(true),
+                         flushLatencyTarget(0),
+                         flushBudget(0),
+                         arrivalInterval(0),
+                         pendingRecords(0),
+                         flushBatchSize(1),
                          _xidp(0),
                          _datap(0),
                          _dlen(0),
@@ -94,6 +107,7 @@ JournalImpl::~JournalImpl()
 	}
     getEventsFireEventsPtr->cancel();
     inactivityFireEventPtr->cancel();
+    if (flushDeadlineEventPtr.get()) static_cast<FlushDeadlineEvent*>(flushDeadlineEventPtr.get())->cancel();
     free_read_buffers();
 
     if (_mgmtObject.get() != 0) {
@@ -125,11 +139,26 @@ JournalImpl::initManagement(qpid::management::ManagementAgent* a)
         _mgmtObject->set_currentFileCount(0);
         _mgmtObject->set_writePageSize(0);
         _mgmtObject->set_writePages(0);
+        _mgmtObject->set_flushLatencyTarget(0);
 
         _agent->addObject(_mgmtObject, 0, true);
     }
 }
 
+void
+JournalImpl::setFlushLatencyTarget(const qpid::sys::Duration target)
+{
+    if (target <= 0) return;
+    flushLatencyTarget = target;
+    flushBudget = target / 2;
+    arrivalInterval = target;
+    commitLatency.reset(new qpid::sys::LatencyHistogram);
+    // Half the target is left for the write itself
+    flushDeadlineEventPtr = new FlushDeadlineEvent(this, target / 2);
+    if (_mgmtObject.get() != 0)
+        _mgmtObject->set_flushLatencyTarget(target / qpid::sys::TIME_USEC);
+}
+
 
 void
 JournalImpl::initialize(const u_int16_t num_jfiles,
@@ -346,6 +375,7 @@ void
 JournalImpl::enqueue_data_record(const void* const data_buff, const size_t tot_data_len,
         const size_t this_data_len, data_tok* dtokp, const bool transient)
 {
+    startWrite(dtokp);
     handleIoResult(jcntl::enqueue_data_record(data_buff, tot_data_len, this_data_len, dtokp, transient));
 
     if (_mgmtObject.get() != 0)
@@ -359,6 +389,7 @@ void
 JournalImpl::enqueue_extern_data_record(const size_t tot_data_len, data_tok* dtokp,
         const bool transient)
 {
+    startWrite(dtokp);
     handleIoResult(jcntl::enqueue_extern_data_record(tot_data_len, dtokp, transient));
 
     if (_mgmtObject.get() != 0)
@@ -368,12 +399,27 @@ JournalImpl::enqueue_extern_data_record(const size_t tot_data_len, data_tok* dto
     }
 }
 
+void
+JournalImpl::enqueue_data_record(data_src& src, const size_t tot_data_len, data_tok* dtokp,
+        const bool transient)
+{
+    startWrite(dtokp);
+    handleIoResult(jcntl::enqueue_data_record(src, tot_data_len, dtokp, transient));
+
+    if (_mgmtObject.get() != 0)
+    {
+        _mgmtObject->inc_enqueues();
+        _mgmtObject->inc_recordDepth();
+    }
+}
+
 void
 JournalImpl::enqueue_txn_data_record(const void* const data_buff, const size_t tot_data_len,
         const size_t this_data_len, data_tok* dtokp, const std::string& xid, const bool transient)
 {
     bool txn_incr = _mgmtObject.get() != 0 ? _tmap.in_map(xid) : false;
 
+    startWrite(dtokp);
     handleIoResult(jcntl::enqueue_txn_data_record(data_buff, tot_data_len, this_data_len, dtokp, xid, transient));
 
     if (_mgmtObject.get() != 0)
@@ -392,6 +438,7 @@ JournalImpl::enqueue_extern_txn_data_record(const size_t tot_data_len, data_tok*
 {
     bool txn_incr = _mgmtObject.get() != 0 ? _tmap.in_map(xid) : false;
 
+    startWrite(dtokp);
     handleIoResult(jcntl::enqueue_extern_txn_data_record(tot_data_len, dtokp, xid, transient));
 
     if (_mgmtObject.get() != 0)
@@ -404,9 +451,29 @@ JournalImpl::enqueue_extern_txn_data_record(const size_t tot_data_len, data_tok*
     }
 }
 
+void
+JournalImpl::enqueue_txn_data_record(data_src& src, const size_t tot_data_len, data_tok* dtokp,
+        const std::string& xid, const bool transient)
+{
+    bool txn_incr = _mgmtObject.get() != 0 ? _tmap.in_map(xid) : false;
+
+    startWrite(dtokp);
+    handleIoResult(jcntl::enqueue_txn_data_record(src, tot_data_len, dtokp, xid, transient));
+
+    if (_mgmtObject.get() != 0)
+    {
+        if (!txn_incr) // If this xid was not in _tmap, it will be now...
+            _mgmtObject->inc_txn();
+        _mgmtObject->inc_enqueues();
+        _mgmtObject->inc_txnEnqueues();
+        _mgmtObject->inc_recordDepth();
+    }
+}
+
 void
 JournalImpl::dequeue_data_record(data_tok* const dtokp, const bool txn_coml_commit)
 {
+    startWrite(dtokp);
     handleIoResult(jcntl::dequeue_data_record(dtokp, txn_coml_commit));
 
     if (_mgmtObject.get() != 0)
@@ -422,6 +489,7 @@ JournalImpl::dequeue_txn_data_record(data_tok* const dtokp, const std::string& x
 {
     bool txn_incr = _mgmtObject.get() != 0 ? _tmap.in_map(xid) : false;
 
+    startWrite(dtokp);
     handleIoResult(jcntl::dequeue_txn_data_record(dtokp, xid, txn_coml_commit));
 
     if (_mgmtObject.get() != 0)
@@ -437,6 +505,7 @@ JournalImpl::dequeue_txn_data_record(data_tok* const dtokp, const std::string& x
 void
 JournalImpl::txn_abort(data_tok* const dtokp, const std::string& xid)
 {
+    startWrite(dtokp);
     handleIoResult(jcntl::txn_abort(dtokp, xid));
 
     if (_mgmtObject.get() != 0)
@@ -449,6 +518,7 @@ JournalImpl::txn_abort(data_tok* const dtokp, const std::string& xid)
 void
 JournalImpl::txn_commit(data_tok* const dtokp, const std::string& xid)
 {
+    startWrite(dtokp);
     handleIoResult(jcntl::txn_commit(dtokp, xid));
 
     if (_mgmtObject.get() != 0)
@@ -464,6 +534,7 @@ JournalImpl::stop(bool block_till_aio_cmpl)
     InactivityFireEvent* ifep = dynamic_cast<InactivityFireEvent*>(inactivityFireEventPtr.get());
     assert(ifep); // dynamic_cast can return null if the cast fails
     ifep->cancel();
+    if (flushDeadlineEventPtr.get()) static_cast<FlushDeadlineEvent*>(flushDeadlineEventPtr.get())->cancel();
     jcntl::stop(block_till_aio_cmpl);
 
     if (_mgmtObject.get() != 0) {
@@ -483,6 +554,31 @@ JournalImpl::flush(const bool block_till_aio_cmpl)
     return res;
 }
 
+void
+JournalImpl::requestFlush()
+{
+    {
+        qpid::sys::Mutex::ScopedLock sl(_flush_lock);
+        if (pendingRecords && flushBatchSize > 1) return; // the batch's deadline is already set
+        pendingRecords = 0;
+    }
+    flush();
+}
+
+qpid::sys::Duration
+JournalImpl::getFlushBudget()
+{
+    qpid::sys::Mutex::ScopedLock sl(_flush_lock);
+    return flushBudget;
+}
+
+u_int32_t
+JournalImpl::getFlushBatchSize()
+{
+    qpid::sys::Mutex::ScopedLock sl(_flush_lock);
+    return flushBatchSize;
+}
+
 void
 JournalImpl::log(mrg::journal::log_level ll, const std::string& log_stmt) const
 {
@@ -525,15 +621,43 @@ JournalImpl::flushFire()
             flushTriggeredFlag = true;
         }
     }
+    if (commitLatency.get()) updateFlushStats();
     inactivityFireEventPtr->setupNextFire();
     {
         timer.add(inactivityFireEventPtr);
     }
 }
 
+void
+JournalImpl::flushDeadlineFire()
+{
+    {
+        qpid::sys::Mutex::ScopedLock sl(_flush_lock);
+        if (pendingRecords == 0) return;
+        pendingRecords = 0;
+    }
+    flush();
+}
+
 void
 JournalImpl::wr_aio_cb(std::vector<data_tok*>& dtokl)
 {
+    if (commitLatency.get()) {
+        const qpid::sys::AbsTime now = qpid::sys::AbsTime::now();
+        qpid::sys::Duration slowest(0);
+        qpid::sys::Mutex::ScopedLock sl(_flush_lock);
+        for (std::vector<data_tok*>::const_iterator i=dtokl.begin(); i!=dtokl.end(); i++) {
+            const qpid::sys::AbsTime& written = static_cast<DataTokenImpl*>(*i)->getWriteTime();
+            if (written == qpid::sys::AbsTime()) continue;
+            qpid::sys::Duration latency(written, now);
+            commitLatency->record(latency);
+            if (latency > slowest) slowest = latency;
+        }
+        if (slowest > flushLatencyTarget)
+            flushBudget = std::max(int64_t(flushBudget / 2), int64_t(flushLatencyTarget / 64));
+        else if (slowest < flushLatencyTarget / 2)
+            flushBudget = std::min(int64_t(flushBudget + flushLatencyTarget / 16), int64_t(flushLatencyTarget / 2));
+    }
     for (std::vector<data_tok*>::const_iterator i=dtokl.begin(); i!=dtokl.end(); i++)
     {
         DataTokenImpl* dtokp = static_cast<DataTokenImpl*>(*i);
@@ -575,6 +699,46 @@ JournalImpl::free_read_buffers()
     }
 }
 
+void
+JournalImpl::written()
+{
+    const qpid::sys::AbsTime now = qpid::sys::AbsTime::now();
+    bool flushNow = false;
+    {
+        qpid::sys::Mutex::ScopedLock sl(_flush_lock);
+        if (!(lastWriteTime == qpid::sys::AbsTime())) {
+            const int64_t interval = std::min(int64_t(qpid::sys::Duration(lastWriteTime, now)), int64_t(flushLatencyTarget));
+            arrivalInterval = arrivalInterval + (interval - arrivalInterval) / 8;
+        }
+        lastWriteTime = now;
+        // As many records as are expected to arrive within the budget, at least one
+        const int64_t batch = arrivalInterval > 0 ? flushBudget / arrivalInterval : JRNL_WMGR_MAXDTOKPP;
+        flushBatchSize = u_int32_t(std::max(int64_t(1), std::min(batch, int64_t(JRNL_WMGR_MAXDTOKPP))));
+        if (++pendingRecords >= flushBatchSize) {
+            pendingRecords = 0;
+            flushNow = true;
+        } else if (pendingRecords == 1) {
+            // First of a batch: write it out by the deadline if the batch is not filled before then
+            flushDeadlineEventPtr->restart();
+            timer.add(flushDeadlineEventPtr);
+        }
+    }
+    if (flushNow) flush();
+}
+
+void
+JournalImpl::updateFlushStats()
+{
+    if (_mgmtObject.get() == 0) return;
+    qpid::sys::Mutex::ScopedLock sl(_flush_lock);
+    _mgmtObject->set_flushBatchSize(flushBatchSize);
+    _mgmtObject->set_commitLatencySamples(commitLatency->getCount());
+    _mgmtObject->set_commitLatencyMean(commitLatency->getMean());
+    _mgmtObject->set_commitLatencyP50(commitLatency->getPercentile(50));
+    _mgmtObject->set_commitLatencyP99(commitLatency->getPercentile(99));
+    _mgmtObject->set_commitLatencyMax(commitLatency->getMax());
+}
+
 void
 JournalImpl::handleIoResult(const iores r)
 {
@@ -582,6 +746,7 @@ JournalImpl::handleIoResult(const iores r)
     switch (r)
     {
         case mrg::journal::RHM_IORES_SUCCESS:
+            if (commitLatency.get()) written();
             return;
         case mrg::journal::RHM_IORES_ENQCAPTHRESH:
             {
@@ -613,7 +778,7 @@ JournalImpl::handleIoResult(const iores r)
 }
 
 qpid::management::Manageable::status_t JournalImpl::ManagementMethod (uint32_t methodId,
-                                                                      qpid::management::Args& /*args*/,
+                                                                      qpid::management::Args& args,
                                                                       std::string& /*text*/)
 {
     Manageable::status_t status = Manageable::STATUS_UNKNOWN_METHOD;
@@ -627,6 +792,19 @@ qpid::management::Manageable::status_t JournalImpl::ManagementMethod (uint32_t m
 
         status = Manageable::STATUS_NOT_IMPLEMENTED;
         break;
+    case _qmf::Journal::METHOD_DUMPCOMMITLATENCY :
+        {
+            qpid::types::Variant::Map& buckets = dynamic_cast<_qmf::ArgsJournalDumpCommitLatency&>(args).o_buckets;
+            if (commitLatency.get()) {
+                qpid::sys::Mutex::ScopedLock sl(_flush_lock);
+                for (u_int32_t i = 0; i < qpid::sys::LatencyHistogram::Buckets; ++i) {
+                    if (commitLatency->getBucketCount(i))
+                        buckets[boost::lexical_cast<std::string>(qpid::sys::LatencyHistogram::getBucketLimit(i))] = commitLatency->getBucketCount(i);
+                }
+            }
+            status = Manageable::STATUS_OK;
+        }
+        break;
     }
 
     return status;
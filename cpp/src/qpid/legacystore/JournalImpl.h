@@ -28,10 +28,12 @@
 #include "qpid/legacystore/DataTokenImpl.h"
 #include "qpid/legacystore/PreparedTransaction.h"
 #include "qpid/broker/PersistableQueue.h"
+#include "qpid/sys/LatencyHistogram.h"
 #include "qpid/sys/Timer.h"
 #include "qpid/sys/Time.h"
 #include <boost/ptr_container/ptr_list.hpp>
 #include <boost/intrusive_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include "qpid/management/Manageable.h"
 #include "qmf/org/apache/qpid/legacystore/Journal.h"
 
@@ -68,6 +70,18 @@ class GetEventsFireEvent : public qpid::sys::TimerTask
     inline void cancel() { qpid::sys::Mutex::ScopedLock sl(_gefe_lock); _parent = 0; }
 };
 
+class FlushDeadlineEvent : public qpid::sys::TimerTask
+{
+    JournalImpl* _parent;
+    qpid::sys::Mutex _fde_lock;
+
+  public:
+    FlushDeadlineEvent(JournalImpl* p, const qpid::sys::Duration timeout);
+    virtual ~FlushDeadlineEvent() {}
+    void fire();
+    inline void cancel() { qpid::sys::Mutex::ScopedLock sl(_fde_lock); _parent = 0; }
+};
+
 class JournalImpl : public qpid::broker::ExternalQueueStore, public mrg::journal::jcntl, public mrg::journal::aio_callback
 {
   public:
@@ -90,6 +104,19 @@ class JournalImpl : public qpid::broker::ExternalQueueStore, public mrg::journal
     bool flushTriggeredFlag;
     boost::intrusive_ptr<qpid::sys::TimerTask> inactivityFireEventPtr;
 
+    // Adaptive flushing: records are written out once as many have accumulated as are expected to arrive
+    // within flushBudget, or once the first of them has waited half the latency target. The budget shrinks
+    // when commits take longer than the target and grows back while they take less than half of it.
+    qpid::sys::Mutex _flush_lock;
+    qpid::sys::Duration flushLatencyTarget; // 0: flush on demand only
+    qpid::sys::Duration flushBudget;
+    qpid::sys::Duration arrivalInterval;    // moving average of the time between records
+    qpid::sys::AbsTime lastWriteTime;
+    u_int32_t pendingRecords;               // written since the last flush
+    u_int32_t flushBatchSize;
+    boost::intrusive_ptr<qpid::sys::TimerTask> flushDeadlineEventPtr;
+    boost::scoped_ptr<qpid::sys::LatencyHistogram> commitLatency;
+
     // temp local vars for loadMsgContent below
     void* _xidp;
     void* _datap;
@@ -116,6 +143,12 @@ class JournalImpl : public qpid::broker::ExternalQueueStore, public mrg::journal
 
     void initManagement(qpid::management::ManagementAgent* agent);
 
+    /**
+     * Size write batches to keep commit latency - from a record being written to its write completing -
+     * within target, rather than flushing only on demand. Must be set before the journal is written to.
+     */
+    void setFlushLatencyTarget(const qpid::sys::Duration target);
+
     void initialize(const u_int16_t num_jfiles,
                     const bool auto_expand,
                     const u_int16_t ae_max_jfiles,
@@ -173,6 +206,9 @@ class JournalImpl : public qpid::broker::ExternalQueueStore, public mrg::journal
     void enqueue_extern_data_record(const size_t tot_data_len, mrg::journal::data_tok* dtokp,
                                     const bool transient = false);
 
+    void enqueue_data_record(mrg::journal::data_src& src, const size_t tot_data_len,
+                             mrg::journal::data_tok* dtokp, const bool transient = false);
+
     void enqueue_txn_data_record(const void* const data_buff, const size_t tot_data_len,
                                  const size_t this_data_len, mrg::journal::data_tok* dtokp, const std::string& xid,
                                  const bool transient = false);
@@ -180,6 +216,10 @@ class JournalImpl : public qpid::broker::ExternalQueueStore, public mrg::journal
     void enqueue_extern_txn_data_record(const size_t tot_data_len, mrg::journal::data_tok* dtokp,
                                         const std::string& xid, const bool transient = false);
 
+    void enqueue_txn_data_record(mrg::journal::data_src& src, const size_t tot_data_len,
+                                 mrg::journal::data_tok* dtokp, const std::string& xid,
+                                 const bool transient = false);
+
     void dequeue_data_record(mrg::journal::data_tok* const dtokp, const bool txn_coml_commit = false);
 
     void dequeue_txn_data_record(mrg::journal::data_tok* const dtokp, const std::string& xid, const bool txn_coml_commit = false);
@@ -197,9 +237,18 @@ class JournalImpl : public qpid::broker::ExternalQueueStore, public mrg::journal
     // Overrides for get_events timer
     mrg::journal::iores flush(const bool block_till_aio_cmpl = false);
 
+    // Flush on behalf of a client waiting for its records to be written. With adaptive flushing the
+    // records are left to be written with their batch, which will be within the latency target.
+    void requestFlush();
+
+    // Current adaptive flushing state
+    qpid::sys::Duration getFlushBudget();
+    u_int32_t getFlushBatchSize();
+
     // TimerTask callback
     void getEventsFire();
     void flushFire();
+    void flushDeadlineFire();
 
     // AIO callbacks
     virtual void wr_aio_cb(std::vector<mrg::journal::data_tok*>& dtokl);
@@ -223,7 +272,12 @@ class JournalImpl : public qpid::broker::ExternalQueueStore, public mrg::journal
         timer.add(getEventsFireEventsPtr);
         getEventsTimerSetFlag = true;
     }
+    inline void startWrite(mrg::journal::data_tok* dtokp) {
+        if (commitLatency.get()) static_cast<DataTokenImpl*>(dtokp)->setWriteTime(qpid::sys::AbsTime::now());
+    }
     void handleIoResult(const mrg::journal::iores r);
+    void written();
+    void updateFlushStats();
 
     // Management instrumentation callbacks overridden from jcntl
     inline void instr_incr_outstanding_aio_cnt() {
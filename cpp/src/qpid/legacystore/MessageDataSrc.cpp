@@ -0,0 +1,52 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/legacystore/MessageDataSrc.h"
+#include "qpid/framing/Buffer.h"
+#include <algorithm>
+#include <string.h>
+
+namespace mrg {
+namespace msgstore {
+
+MessageDataSrc::MessageDataSrc(const qpid::broker::PersistableMessage& m)
+  : message(m),
+    size(m.encodedSize() + sizeof(headerSize))
+{
+    qpid::framing::Buffer buffer(headerSize, sizeof(headerSize));
+    buffer.putLong(message.encodedHeaderSize());
+}
+
+void MessageDataSrc::write(void* wptr, const std::size_t offs, const std::size_t len)
+{
+    char* p = static_cast<char*>(wptr);
+    std::size_t n = 0;
+    if (offs < sizeof(headerSize)) {
+        n = std::min(len, sizeof(headerSize) - offs);
+        ::memcpy(p, headerSize + offs, n);
+    }
+    if (n < len) {
+        qpid::framing::Buffer buffer(p + n, len - n);
+        message.encodePart(buffer, offs + n - sizeof(headerSize));
+    }
+}
+
+}}
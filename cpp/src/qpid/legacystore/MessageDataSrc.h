@@ -0,0 +1,51 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef QPID_LEGACYSTORE_MESSAGEDATASRC_H
+#define QPID_LEGACYSTORE_MESSAGEDATASRC_H
+
+#include "qpid/legacystore/jrnl/data_src.h"
+#include "qpid/broker/PersistableMessage.h"
+#include <sys/types.h>
+
+namespace mrg{
+namespace msgstore{
+
+/**
+ * The data of a message's enqueue record - the size of its header, then
+ * the message itself - encoded straight into the journal's write cache
+ * as the journal asks for it.
+ */
+class MessageDataSrc : public mrg::journal::data_src
+{
+    const qpid::broker::PersistableMessage& message;
+    char headerSize[sizeof(u_int32_t)];
+    u_int64_t size;
+
+public:
+    MessageDataSrc(const qpid::broker::PersistableMessage& message);
+    u_int64_t getSize() const { return size; }
+    void write(void* wptr, const std::size_t offs, const std::size_t len);
+};
+
+}}
+
+#endif // ifndef QPID_LEGACYSTORE_MESSAGEDATASRC_H
@@ -23,7 +23,11 @@
 
 #include "qpid/legacystore/BindingDbt.h"
 #include "qpid/legacystore/BufferValue.h"
+#include "qpid/legacystore/ContentStore.h"
 #include "qpid/legacystore/IdDbt.h"
+#include "qpid/legacystore/MessageDataSrc.h"
+#include "qpid/legacystore/RecoveryPool.h"
+#include "qpid/legacystore/SharedJournals.h"
 #include "qpid/legacystore/jrnl/txn_map.h"
 #include "qpid/framing/FieldValue.h"
 #include "qpid/log/Statement.h"
@@ -57,6 +61,19 @@ MessageStoreImpl::TplRecoverStruct::TplRecoverStruct(const u_int64_t _rid,
                                                      tpc_flag(_tpc_flag)
 {}
 
+MessageStoreImpl::QueueRecoverStruct::QueueRecoverStruct(const qpid::broker::RecoverableQueue::shared_ptr& _queue,
+                                                         const txn_list& _prepared) :
+                                                         queue(_queue),
+                                                         highestRid(0ULL),
+                                                         rcnt(0L),
+                                                         idcnt(0L)
+{
+    for (txn_list::const_iterator i = _prepared.begin(); i != _prepared.end(); i++) {
+        prepared.push_back(new PreparedTransaction(i->xid, LockedMappings::shared_ptr(new LockedMappings),
+                                                   LockedMappings::shared_ptr(new LockedMappings)));
+    }
+}
+
 MessageStoreImpl::MessageStoreImpl(qpid::broker::Broker* broker_, const char* envpath) :
                                    numJrnlFiles(0),
                                    autoJrnlExpand(false),
@@ -69,6 +86,10 @@ MessageStoreImpl::MessageStoreImpl(qpid::broker::Broker* broker_, const char* en
                                    tplJrnlFsizeSblks(0),
                                    tplWCachePgSizeSblks(0),
                                    tplWCacheNumPages(0),
+                                   numSharedJrnls(0),
+                                   numRecoveryThreads(0),
+                                   flushLatencyTargetUs(0),
+                                   configBatchSize(0),
                                    highestRid(0),
                                    isInit(false),
                                    envPath(envpath),
@@ -263,7 +284,7 @@ bool MessageStoreImpl::init(const qpid::Options* options)
     chkJrnlAutoExpandOptions(opts, autoJrnlExpand, autoJrnlExpandMaxFiles, "auto-expand-max-jfiles", numJrnlFiles, "num-jfiles");
 
     // Pass option values to init(...)
-    return init(opts->storeDir, numJrnlFiles, jrnlFsizePgs, opts->truncateFlag, jrnlWrCachePageSizeKib, tplNumJrnlFiles, tplJrnlFSizePgs, tplJrnlWrCachePageSizeKib, autoJrnlExpand, autoJrnlExpandMaxFiles);
+    return init(opts->storeDir, numJrnlFiles, jrnlFsizePgs, opts->truncateFlag, jrnlWrCachePageSizeKib, tplNumJrnlFiles, tplJrnlFSizePgs, tplJrnlWrCachePageSizeKib, autoJrnlExpand, autoJrnlExpandMaxFiles, opts->numSharedJrnls, opts->numRecoveryThreads, opts->flushLatencyTargetUs, opts->configBatchSize);
 }
 
 // These params, taken from options, are assumed to be correct and verified
@@ -276,7 +297,11 @@ bool MessageStoreImpl::init(const std::string& dir,
                            u_int32_t tplJfileSizePgs,
                            u_int32_t tplWCachePageSizeKib,
                            bool      autoJExpand,
-                           u_int16_t autoJExpandMaxFiles)
+                           u_int16_t autoJExpandMaxFiles,
+                           u_int16_t sharedJrnls,
+                           u_int16_t recoveryThreads,
+                           u_int32_t flushTargetUs,
+                           u_int16_t configBatch)
 {
     if (isInit) return true;
 
@@ -291,6 +316,10 @@ bool MessageStoreImpl::init(const std::string& dir,
     tplWCacheNumPages = getJrnlWrNumPages(tplWCachePageSizeKib);
     autoJrnlExpand = autoJExpand;
     autoJrnlExpandMaxFiles = autoJExpandMaxFiles;
+    numSharedJrnls = sharedJrnls;
+    numRecoveryThreads = recoveryThreads;
+    flushLatencyTargetUs = flushTargetUs;
+    configBatchSize = configBatch;
     if (dir.size()>0) storeDir = dir;
 
     if (truncateFlag)
@@ -310,6 +339,10 @@ bool MessageStoreImpl::init(const std::string& dir,
     QPID_LOG(info,   "> TPL journal file size: " << tplJfileSizePgs << " (wpgs)");
     QPID_LOG(info,   "> TPL write cache page size: " << tplWCachePageSizeKib << " (KiB)");
     QPID_LOG(info,   "> TPL number of write cache pages: " << tplWCacheNumPages);
+    QPID_LOG(info,   "> Shared journals: " << numSharedJrnls);
+    QPID_LOG(info,   "> Recovery threads: " << numRecoveryThreads);
+    QPID_LOG(info,   "> Flush latency target: " << flushLatencyTargetUs << " (us)");
+    QPID_LOG(info,   "> Configuration changes per commit: " << configBatchSize);
 
     return isInit;
 }
@@ -361,10 +394,19 @@ void MessageStoreImpl::init()
                 open(generalDb, txn.get(), "general.db",  false);
                 txn.commit();
             } catch (...) { txn.abort(); throw; }
+            configWriterPtr.reset(new ConfigWriter(dbenv.get(), configBatchSize));
             // NOTE: during normal initialization, agent == 0 because the store is initialized before the management infrastructure.
             // However during a truncated initialization in a cluster, agent != 0. We always pass 0 as the agent for the
             // TplStore to keep things consistent in a cluster. See https://bugzilla.redhat.com/show_bug.cgi?id=681026
             tplStorePtr.reset(new TplJournalImpl(broker->getTimer(), "TplStore", getTplBaseDir(), "tpl", defJournalGetEventsTimeout, defJournalFlushTimeout, 0));
+            contentStorePtr.reset(new ContentStore(new JournalImpl(broker->getTimer(), "ContentStore", getContentBaseDir(), "content",
+                                                                   defJournalGetEventsTimeout, defJournalFlushTimeout, 0),
+                                                   messageIdSequence, numJrnlFiles, autoJrnlExpand, autoJrnlExpandMaxFiles,
+                                                   jrnlFsizeSblks, wCacheNumPages, wCachePgSizeSblks));
+            sharedJournalsPtr.reset(new SharedJournals(broker->getTimer(), getSharedBaseDir(), numSharedJrnls, messageIdSequence,
+                                                       defJournalGetEventsTimeout, defJournalFlushTimeout, numJrnlFiles,
+                                                       autoJrnlExpand, autoJrnlExpandMaxFiles, jrnlFsizeSblks, wCacheNumPages,
+                                                       wCachePgSizeSblks));
             isInit = true;
         } catch (const DbException& e) {
             if (e.get_errno() == DB_VERSION_MISMATCH)
@@ -392,6 +434,8 @@ void MessageStoreImpl::init()
 void MessageStoreImpl::finalize()
 {
     if (tplStorePtr.get() && tplStorePtr->is_ready()) tplStorePtr->stop(true);
+    if (contentStorePtr.get()) contentStorePtr->stop();
+    if (sharedJournalsPtr.get()) sharedJournalsPtr->stop();
     {
         qpid::sys::Mutex::ScopedLock sl(journalListLock);
         for (JournalListMapItr i = journalList.begin(); i != journalList.end(); i++)
@@ -422,6 +466,8 @@ void MessageStoreImpl::truncateInit(const bool saveStoreContent)
         closeDbs();
         dbs.clear();
         if (tplStorePtr->is_ready()) tplStorePtr->stop(true);
+        contentStorePtr->stop();
+        sharedJournalsPtr->stop();
         dbenv->close(0);
         isInit = false;
     }
@@ -518,6 +564,7 @@ void MessageStoreImpl::create(qpid::broker::PersistableQueue& queue,
     jQueue = new JournalImpl(broker->getTimer(), queue.getName(), getJrnlDir(queue),  std::string("JournalData"),
                              defJournalGetEventsTimeout, defJournalFlushTimeout, agent,
                              boost::bind(&MessageStoreImpl::journalDeleted, this, _1));
+    if (flushLatencyTargetUs) jQueue->setFlushLatencyTarget(flushLatencyTargetUs * qpid::sys::TIME_USEC);
     {
         qpid::sys::Mutex::ScopedLock sl(journalListLock);
         journalList[queue.getName()]=jQueue;
@@ -550,8 +597,9 @@ void MessageStoreImpl::create(qpid::broker::PersistableQueue& queue,
 void MessageStoreImpl::destroy(qpid::broker::PersistableQueue& queue)
 {
     checkInit();
-    destroy(queueDb, queue);
-    deleteBindingsForQueue(queue);
+    configWriterPtr->write(boost::bind(&MessageStoreImpl::deleteQueue, this, boost::cref(queue), _1));
+    contentStorePtr->releaseAll(queue.getPersistenceId());
+    sharedJournalsPtr->dequeueAll(queue.getPersistenceId());
     qpid::broker::ExternalQueueStore* eqs = queue.getExternalQueueStore();
     if (eqs) {
         JournalImpl* jQueue = static_cast<JournalImpl*>(eqs);
@@ -583,10 +631,7 @@ void MessageStoreImpl::create(const qpid::broker::PersistableExchange& exchange,
 void MessageStoreImpl::destroy(const qpid::broker::PersistableExchange& exchange)
 {
     checkInit();
-    destroy(exchangeDb, exchange);
-    //need to also delete bindings
-    IdDbt key(exchange.getPersistenceId());
-    bindingDb->del(0, &key, DB_AUTO_COMMIT);
+    configWriterPtr->write(boost::bind(&MessageStoreImpl::deleteExchange, this, boost::cref(exchange), _1));
 }
 
 void MessageStoreImpl::create(const qpid::broker::PersistableConfig& general)
@@ -615,19 +660,8 @@ bool MessageStoreImpl::create(db_ptr db,
                              const qpid::broker::Persistable& p)
 {
     u_int64_t id (seq.next());
-    Dbt key(&id, sizeof(id));
-    BufferValue value (p);
-
-    int status;
-    TxnCtxt txn;
-    txn.begin(dbenv.get(), true);
-    try {
-        status = db->put(txn.get(), &key, &value, DB_NOOVERWRITE);
-        txn.commit();
-    } catch (...) {
-        txn.abort();
-        throw;
-    }
+    int status = 0;
+    configWriterPtr->write(boost::bind(&MessageStoreImpl::createRecord, this, db, id, boost::cref(p), boost::ref(status), _1));
     if (status == DB_KEYEXIST) {
         return false;
     } else {
@@ -638,9 +672,37 @@ bool MessageStoreImpl::create(db_ptr db,
 
 void MessageStoreImpl::destroy(db_ptr db, const qpid::broker::Persistable& p)
 {
-    qpid::sys::Mutex::ScopedLock sl(bdbLock);
-    IdDbt key(p.getPersistenceId());
-    db->del(0, &key, DB_AUTO_COMMIT);
+    configWriterPtr->write(boost::bind(&MessageStoreImpl::deleteRecord, this, db, p.getPersistenceId(), _1));
+}
+
+void MessageStoreImpl::createRecord(db_ptr db,
+                                    u_int64_t id,
+                                    const qpid::broker::Persistable& p,
+                                    int& status,
+                                    DbTxn* txn)
+{
+    Dbt key(&id, sizeof(id));
+    BufferValue value (p);
+    status = db->put(txn, &key, &value, DB_NOOVERWRITE);
+}
+
+void MessageStoreImpl::deleteRecord(db_ptr db, u_int64_t id, DbTxn* txn)
+{
+    IdDbt key(id);
+    db->del(txn, &key, 0);
+}
+
+void MessageStoreImpl::deleteQueue(const qpid::broker::PersistableQueue& queue, DbTxn* txn)
+{
+    deleteRecord(queueDb, queue.getPersistenceId(), txn);
+    deleteBindingsForQueue(queue, txn);
+}
+
+void MessageStoreImpl::deleteExchange(const qpid::broker::PersistableExchange& exchange, DbTxn* txn)
+{
+    deleteRecord(exchangeDb, exchange.getPersistenceId(), txn);
+    //need to also delete bindings
+    deleteRecord(bindingDb, exchange.getPersistenceId(), txn);
 }
 
 
@@ -652,15 +714,7 @@ void MessageStoreImpl::bind(const qpid::broker::PersistableExchange& e,
     checkInit();
     IdDbt key(e.getPersistenceId());
     BindingDbt value(e, q, k, a);
-    TxnCtxt txn;
-    txn.begin(dbenv.get(), true);
-    try {
-        put(bindingDb, txn.get(), key, value);
-        txn.commit();
-    } catch (...) {
-        txn.abort();
-        throw;
-    }
+    configWriterPtr->write(boost::bind(&MessageStoreImpl::put, this, bindingDb, _1, boost::ref(key), boost::ref(value)));
 }
 
 void MessageStoreImpl::unbind(const qpid::broker::PersistableExchange& e,
@@ -669,7 +723,7 @@ void MessageStoreImpl::unbind(const qpid::broker::PersistableExchange& e,
                              const qpid::framing::FieldTable&)
 {
     checkInit();
-    deleteBinding(e, q, k);
+    configWriterPtr->write(boost::bind(&MessageStoreImpl::deleteBinding, this, boost::cref(e), boost::cref(q), boost::cref(k), _1));
 }
 
 void MessageStoreImpl::recover(qpid::broker::RecoveryManager& registry)
@@ -677,6 +731,8 @@ void MessageStoreImpl::recover(qpid::broker::RecoveryManager& registry)
     checkInit();
     txn_list prepared;
     recoverLockedMappings(prepared);
+    contentStorePtr->recover(highestRid); // before the queues, whose journals refer to it
+    sharedJournalsPtr->recover(highestRid);
 
     queue_index queues;//id->queue
     exchange_index exchanges;//id->exchange
@@ -784,6 +840,10 @@ void MessageStoreImpl::recoverQueues(TxnCtxt& txn,
 
     u_int64_t maxQueueId(1);
 
+    // The queues are created here, in the order they are read; their journals are recovered by the pool
+    RecoveryPool pool("queues", numRecoveryThreads);
+    QueueRecoverList states;
+
     IdDbt key;
     Dbt value;
     //read all queues
@@ -804,42 +864,76 @@ void MessageStoreImpl::recoverQueues(TxnCtxt& txn,
         jQueue = new JournalImpl(broker->getTimer(), queueName, getJrnlHashDir(queueName), std::string("JournalData"),
                                  defJournalGetEventsTimeout, defJournalFlushTimeout, agent,
                                  boost::bind(&MessageStoreImpl::journalDeleted, this, _1));
+        if (flushLatencyTargetUs) jQueue->setFlushLatencyTarget(flushLatencyTargetUs * qpid::sys::TIME_USEC);
         {
             qpid::sys::Mutex::ScopedLock sl(journalListLock);
             journalList[queueName] = jQueue;
         }
         queue->setExternalQueueStore(dynamic_cast<qpid::broker::ExternalQueueStore*>(jQueue));
 
-        try
-        {
-            long rcnt = 0L;     // recovered msg count
-            long idcnt = 0L;    // in-doubt msg count
-            u_int64_t thisHighestRid = 0ULL;
-            jQueue->recover(numJrnlFiles, autoJrnlExpand, autoJrnlExpandMaxFiles, jrnlFsizeSblks, wCacheNumPages, wCachePgSizeSblks, &prepared, thisHighestRid, key.id); // start recovery
-            if (highestRid == 0ULL)
-                highestRid = thisHighestRid;
-            else if (thisHighestRid - highestRid < 0x8000000000000000ULL) // RFC 1982 comparison for unsigned 64-bit
-                highestRid = thisHighestRid;
-            recoverMessages(txn, registry, queue, prepared, messages, rcnt, idcnt);
-            QPID_LOG(info, "Recovered queue \"" << queueName << "\": " << rcnt << " messages recovered; " << idcnt << " messages in-doubt.");
-            jQueue->recover_complete(); // start journal.
-        } catch (const journal::jexception& e) {
-            THROW_STORE_EXCEPTION(std::string("Queue ") + queueName + ": recoverQueues() failed: " + e.what());
-        }
         //read all messages: done on a per queue basis if using Journal
+        QueueRecover* state = new QueueRecover(queue, prepared);
+        states.push_back(state);
+        pool.add(boost::bind(&MessageStoreImpl::recoverQueue, this, boost::ref(txn), boost::ref(registry), boost::ref(*state)));
 
         queue_index[key.id] = queue;
         maxQueueId = std::max(key.id, maxQueueId);
     }
 
+    qpid::sys::AbsTime start = qpid::sys::now();
+    pool.execute();
+
+    // Merge what each queue found now that all are done
+    long rcnt = 0L;
+    long idcnt = 0L;
+    for (QueueRecoverList::iterator i = states.begin(); i != states.end(); i++) {
+        if (highestRid == 0ULL)
+            highestRid = i->highestRid;
+        else if (i->highestRid - highestRid < 0x8000000000000000ULL) // RFC 1982 comparison for unsigned 64-bit
+            highestRid = i->highestRid;
+        messages.insert(i->messages.begin(), i->messages.end());
+        txn_list::iterator k = i->prepared.begin();
+        for (txn_list::iterator j = prepared.begin(); j != prepared.end(); j++, k++) {
+            for (LockedMappings::iterator l = k->enqueues->begin(); l != k->enqueues->end(); l++)
+                j->enqueues->add(l->first, l->second);
+            for (LockedMappings::iterator l = k->dequeues->begin(); l != k->dequeues->end(); l++)
+                j->dequeues->add(l->first, l->second);
+        }
+        rcnt += i->rcnt;
+        idcnt += i->idcnt;
+    }
+    QPID_LOG(notice, "Recovered " << states.size() << " queues in " << (qpid::sys::Duration(start, qpid::sys::now()) / qpid::sys::TIME_MSEC)
+             << " ms using " << pool.getThreads() << " thread(s): " << rcnt << " messages recovered; " << idcnt << " messages in-doubt.");
+
     // NOTE: highestRid is set by both recoverQueues() and recoverTplStore() as
     // the messageIdSequence is used for both queue journals and the tpl journal.
     messageIdSequence.reset(highestRid + 1);
     QPID_LOG(info, "Most recent persistence id found: 0x" << std::hex << highestRid << std::dec);
+    contentStorePtr->recoverComplete();
+    sharedJournalsPtr->recoverComplete();
 
     queueIdSequence.reset(maxQueueId + 1);
 }
 
+// Runs on a recovery pool thread: must only touch the queue, its journal and its own state, besides the
+// content store and shared journals, which lock.
+void MessageStoreImpl::recoverQueue(TxnCtxt& txn,
+                                   qpid::broker::RecoveryManager& registry,
+                                   QueueRecover& state)
+{
+    const std::string& queueName = state.queue->getName();
+    JournalImpl* jQueue = static_cast<JournalImpl*>(state.queue->getExternalQueueStore());
+    try
+    {
+        jQueue->recover(numJrnlFiles, autoJrnlExpand, autoJrnlExpandMaxFiles, jrnlFsizeSblks, wCacheNumPages, wCachePgSizeSblks, &state.prepared, state.highestRid, state.queue->getPersistenceId()); // start recovery
+        recoverMessages(txn, registry, state.queue, state.prepared, state.messages, state.rcnt, state.idcnt);
+        QPID_LOG(info, "Recovered queue \"" << queueName << "\": " << state.rcnt << " messages recovered; " << state.idcnt << " messages in-doubt.");
+        jQueue->recover_complete(); // start journal.
+    } catch (const journal::jexception& e) {
+        THROW_STORE_EXCEPTION(std::string("Queue ") + queueName + ": recoverQueues() failed: " + e.what());
+    }
+}
+
 
 void MessageStoreImpl::recoverExchanges(TxnCtxt& txn,
                                        qpid::broker::RecoveryManager& registry,
@@ -935,8 +1029,6 @@ void MessageStoreImpl::recoverMessages(TxnCtxt& /*txn*/,
                                       long& rcnt,
                                       long& idcnt)
 {
-    size_t preambleLength = sizeof(u_int32_t)/*header size*/;
-
     JournalImpl* jc = static_cast<JournalImpl*>(queue->getExternalQueueStore());
     DataTokenImpl dtok;
     size_t readSize = 0;
@@ -955,6 +1047,11 @@ void MessageStoreImpl::recoverMessages(TxnCtxt& /*txn*/,
 
     dtok.set_wstate(DataTokenImpl::ENQ);
 
+    // Messages held by the shared journals are recovered in order with those of the queue's own journal
+    SharedJournals::RecordList shared;
+    sharedJournalsPtr->takeRecovered(queue->getPersistenceId(), shared);
+    SharedJournals::RecordList::const_iterator nextShared = shared.begin();
+
     // Read the message from the Journal.
     try {
         unsigned aio_sleep_cnt = 0;
@@ -965,32 +1062,30 @@ void MessageStoreImpl::recoverMessages(TxnCtxt& /*txn*/,
             switch (res)
             {
               case mrg::journal::RHM_IORES_SUCCESS: {
+                recoverSharedMessages(recovery, queue, shared, nextShared, dtok.rid(), rcnt);
                 msg_count++;
                 qpid::broker::RecoverableMessage::shared_ptr msg;
                 char* data = (char*)dbuff;
 
-                unsigned headerSize;
                 if (externalFlag) {
-                    msg = getExternMessage(recovery, dtok.rid(), headerSize); // large message external to jrnl
-                } else {
-                    headerSize = qpid::framing::Buffer(data, preambleLength).getLong();
-                    qpid::framing::Buffer headerBuff(data+ preambleLength, headerSize); /// do we want read size or header size ????
-                    msg = recovery.recoverMessage(headerBuff);
-                }
-                msg->setPersistenceId(dtok.rid());
-                // At some future point if delivery attempts are stored, then this call would
-                // become optional depending on that information.
-                msg->setRedelivered();
-		// Reset the TTL for the recovered message
-		msg->computeExpiration(broker->getExpiryPolicy());
-
-                u_int32_t contentOffset = headerSize + preambleLength;
-                u_int64_t contentSize = readSize - contentOffset;
-                if (msg->loadContent(contentSize) && !externalFlag) {
-                    //now read the content
-                    qpid::framing::Buffer contentBuff(data + contentOffset, contentSize);
-                    msg->decodeContent(contentBuff);
+                    // Content shared with other queues, kept in the content store
+                    const std::string* content = contentStorePtr->recoverRef(jc, dtok.rid(), queue->getPersistenceId());
+                    if (!content) {
+                        QPID_LOG(error, "Queue \"" << queue->getName() << "\": Content of message 0x" << std::hex << dtok.rid()
+                                 << std::dec << " is missing from the content store - message discarded.");
+                        dtok.reset();
+                        dtok.set_wstate(DataTokenImpl::ENQ);
+                        if (xidbuff)
+                            ::free(xidbuff);
+                        else if (dbuff)
+                            ::free(dbuff);
+                        aio_sleep_cnt = 0;
+                        break;
+                    }
+                    data = const_cast<char*>(content->data());
+                    readSize = content->size();
                 }
+                msg = decodeMessage(recovery, data, readSize, dtok.rid());
 
                 PreparedTransaction::list::iterator i = PreparedTransaction::getLockedPreparedTransaction(prepared, queue->getPersistenceId(), dtok.rid());
                 if (i == prepared.end()) { // not in prepared list
@@ -1057,16 +1152,50 @@ void MessageStoreImpl::recoverMessages(TxnCtxt& /*txn*/,
                 THROW_STORE_EXCEPTION(oss.str());
             } // switch
         } // while
+        recoverSharedMessages(recovery, queue, shared, nextShared, 0xffffffffffffffffULL, rcnt);
     } catch (const journal::jexception& e) {
         THROW_STORE_EXCEPTION(std::string("Queue ") + queue->getName() + ": recoverMessages() failed: " + e.what());
     }
 }
 
-qpid::broker::RecoverableMessage::shared_ptr MessageStoreImpl::getExternMessage(qpid::broker::RecoveryManager& /*recovery*/,
-                                                                 uint64_t /*messageId*/,
-                                                                 unsigned& /*headerSize*/)
+void MessageStoreImpl::recoverSharedMessages(qpid::broker::RecoveryManager& recovery,
+                                            qpid::broker::RecoverableQueue::shared_ptr& queue,
+                                            const SharedJournals::RecordList& records,
+                                            SharedJournals::RecordList::const_iterator& next,
+                                            u_int64_t before,
+                                            long& rcnt)
 {
-    throw mrg::journal::jexception(mrg::journal::jerrno::JERR__NOTIMPL, "MessageStoreImpl", "getExternMessage");
+    for (; next != records.end() && next->messageId < before; ++next) {
+        rcnt++;
+        queue->recover(decodeMessage(recovery, const_cast<char*>(next->data.data()), next->data.size(), next->messageId));
+    }
+}
+
+qpid::broker::RecoverableMessage::shared_ptr MessageStoreImpl::decodeMessage(qpid::broker::RecoveryManager& recovery,
+                                                                            char* data,
+                                                                            u_int64_t size,
+                                                                            u_int64_t messageId)
+{
+    size_t preambleLength = sizeof(u_int32_t)/*header size*/;
+
+    unsigned headerSize = qpid::framing::Buffer(data, preambleLength).getLong();
+    qpid::framing::Buffer headerBuff(data+ preambleLength, headerSize); /// do we want read size or header size ????
+    qpid::broker::RecoverableMessage::shared_ptr msg = recovery.recoverMessage(headerBuff);
+    msg->setPersistenceId(messageId);
+    // At some future point if delivery attempts are stored, then this call would
+    // become optional depending on that information.
+    msg->setRedelivered();
+    // Reset the TTL for the recovered message
+    msg->computeExpiration(broker->getExpiryPolicy());
+
+    u_int32_t contentOffset = headerSize + preambleLength;
+    u_int64_t contentSize = size - contentOffset;
+    if (msg->loadContent(contentSize)) {
+        //now read the content
+        qpid::framing::Buffer contentBuff(data + contentOffset, contentSize);
+        msg->decodeContent(contentBuff);
+    }
+    return msg;
 }
 
 int MessageStoreImpl::enqueueMessage(TxnCtxt& txn,
@@ -1274,9 +1403,11 @@ void MessageStoreImpl::flush(const qpid::broker::PersistableQueue& queue)
     try {
         JournalImpl* jc = static_cast<JournalImpl*>(queue.getExternalQueueStore());
         if (jc) {
-            // TODO: check if this result should be used...
-            /*mrg::journal::iores res =*/ jc->flush();
+            // With a flush latency target, the journal may hold the write back to batch it with others
+            jc->requestFlush();
         }
+        contentStorePtr->flush();
+        sharedJournalsPtr->flush(queue.getPersistenceId());
     } catch (const journal::jexception& e) {
         THROW_STORE_EXCEPTION(std::string("Queue ") + qn + ": flush() failed: " + e.what() );
     }
@@ -1313,32 +1444,20 @@ void MessageStoreImpl::enqueue(qpid::broker::TransactionContext* ctxt,
     if (ctxt) txn->addXidRecord(queue.getExternalQueueStore());
 }
 
-u_int64_t MessageStoreImpl::msgEncode(std::vector<char>& buff, const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message)
-{
-    u_int32_t headerSize = message->encodedHeaderSize();
-    u_int64_t size = message->encodedSize() + sizeof(u_int32_t);
-    try { buff = std::vector<char>(size); } // long + headers + content
-    catch (const std::exception& e) {
-        std::ostringstream oss;
-        oss << "Unable to allocate memory for encoding message; requested size: " << size << "; error: " << e.what();
-        THROW_STORE_EXCEPTION(oss.str());
-    }
-    qpid::framing::Buffer buffer(&buff[0],size);
-    buffer.putLong(headerSize);
-    message->encode(buffer);
-    return size;
-}
-
 void MessageStoreImpl::store(const qpid::broker::PersistableQueue* queue,
                             TxnCtxt* txn,
                             const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message,
-                            bool /*newId*/)
+                            bool newId)
 {
-    std::vector<char> buff;
-    u_int64_t size = msgEncode(buff, message);
+    // The message is encoded straight into the journal's write cache
+    MessageDataSrc src(*message);
 
     try {
         if (queue) {
+            // Non-transactional enqueues go to the queue's shared journal, if there is one
+            if (txn->getXid().empty() && sharedJournalsPtr->enqueue(message, src, queue->getPersistenceId()))
+                return;
+
             boost::intrusive_ptr<DataTokenImpl> dtokp(new DataTokenImpl);
             dtokp->addRef();
             dtokp->setSourceMessage(message);
@@ -1347,9 +1466,14 @@ void MessageStoreImpl::store(const qpid::broker::PersistableQueue* queue,
 
             JournalImpl* jc = static_cast<JournalImpl*>(queue->getExternalQueueStore());
             if (txn->getXid().empty()) {
-                jc->enqueue_data_record(&buff[0], size, size, dtokp.get(), !message->isPersistent());
+                // A message already stored for another queue shares its content with it, rather
+                // than being written again in full
+                if (!newId && contentStorePtr->share(message, queue->getPersistenceId()))
+                    jc->enqueue_extern_data_record(src.getSize(), dtokp.get(), !message->isPersistent());
+                else
+                    jc->enqueue_data_record(src, src.getSize(), dtokp.get(), !message->isPersistent());
             } else {
-                jc->enqueue_txn_data_record(&buff[0], size, size, dtokp.get(), txn->getXid(), !message->isPersistent());
+                jc->enqueue_txn_data_record(src, src.getSize(), dtokp.get(), txn->getXid(), !message->isPersistent());
             }
         } else {
             THROW_STORE_EXCEPTION(std::string("MessageStoreImpl::store() failed: queue NULL."));
@@ -1382,9 +1506,18 @@ void MessageStoreImpl::dequeue(qpid::broker::TransactionContext* ctxt,
         txn = &implicit;
     }
 
-    // add queue* to the txn map..
-    if (ctxt) txn->addXidRecord(queue.getExternalQueueStore());
-    async_dequeue(ctxt, msg, queue);
+    if (sharedJournalsPtr->contains(messageId, queueId)) {
+        // Held by a shared journal: dequeued from it now, or once committed if transactional
+        if (ctxt) txn->addRelease(messageId, queueId);
+        else sharedJournalsPtr->dequeue(messageId, queueId);
+    } else {
+        // add queue* to the txn map..
+        if (ctxt) txn->addXidRecord(queue.getExternalQueueStore());
+        async_dequeue(ctxt, msg, queue);
+        // Content shared with other queues is let go once the dequeue is committed
+        if (ctxt) txn->addRelease(messageId, queueId);
+        else contentStorePtr->release(messageId, queueId);
+    }
 
     msg->dequeueComplete();
 }
@@ -1440,6 +1573,13 @@ void MessageStoreImpl::completed(TxnCtxt& txn,
             tplStorePtr->dequeue_txn_data_record(txn.getDtok(), txn.getXid(), commit);
         }
         txn.complete(commit);
+        if (commit) {
+            const TxnCtxt::Releases& releases = txn.getReleases();
+            for (TxnCtxt::Releases::const_iterator i = releases.begin(); i != releases.end(); ++i) {
+                if (!sharedJournalsPtr->dequeue(i->first, i->second))
+                    contentStorePtr->release(i->first, i->second);
+            }
+        }
         if (mgmtObject.get() != 0) {
             mgmtObject->dec_tplTransactionDepth();
             if (commit)
@@ -1509,7 +1649,7 @@ void MessageStoreImpl::commit(qpid::broker::TransactionContext& ctxt)
     checkInit();
     TxnCtxt* txn(check(&ctxt));
     if (!txn->isTPC()) {
-        if (txn->impactedQueuesEmpty()) return;
+        if (txn->impactedQueuesEmpty() && txn->getReleases().empty()) return;
         localPrepare(dynamic_cast<TxnCtxt*>(txn));
     }
     completed(*dynamic_cast<TxnCtxt*>(txn), true);
@@ -1550,79 +1690,63 @@ void MessageStoreImpl::put(db_ptr db,
     }
 }
 
-void MessageStoreImpl::deleteBindingsForQueue(const qpid::broker::PersistableQueue& queue)
+void MessageStoreImpl::deleteBindingsForQueue(const qpid::broker::PersistableQueue& queue,
+                                              DbTxn* txn)
 {
-    TxnCtxt txn;
-    txn.begin(dbenv.get(), true);
     try {
-        {
-            Cursor bindings;
-            bindings.open(bindingDb, txn.get());
-
-            IdDbt key;
-            Dbt value;
-            while (bindings.next(key, value)) {
-                qpid::framing::Buffer buffer(reinterpret_cast<char*>(value.get_data()), value.get_size());
-                if (buffer.available() < 8) {
-                    THROW_STORE_EXCEPTION("Not enough data for binding");
-                }
-                uint64_t queueId = buffer.getLongLong();
-                if (queue.getPersistenceId() == queueId) {
-                    bindings->del(0);
-                    QPID_LOG(debug, "Deleting binding for " << queue.getName() << " " << key.id << "->" << queueId);
-                }
+        Cursor bindings;
+        bindings.open(bindingDb, txn);
+
+        IdDbt key;
+        Dbt value;
+        while (bindings.next(key, value)) {
+            qpid::framing::Buffer buffer(reinterpret_cast<char*>(value.get_data()), value.get_size());
+            if (buffer.available() < 8) {
+                THROW_STORE_EXCEPTION("Not enough data for binding");
+            }
+            uint64_t queueId = buffer.getLongLong();
+            if (queue.getPersistenceId() == queueId) {
+                bindings->del(0);
+                QPID_LOG(debug, "Deleting binding for " << queue.getName() << " " << key.id << "->" << queueId);
             }
         }
-        txn.commit();
     } catch (const std::exception& e) {
-        txn.abort();
         THROW_STORE_EXCEPTION_2("Error deleting bindings", e.what());
-    } catch (...) {
-        txn.abort();
-        throw;
     }
     QPID_LOG(debug, "Deleted all bindings for " << queue.getName() << ":" << queue.getPersistenceId());
 }
 
 void MessageStoreImpl::deleteBinding(const qpid::broker::PersistableExchange& exchange,
                                     const qpid::broker::PersistableQueue& queue,
-                                    const std::string& bkey)
+                                    const std::string& bkey,
+                                    DbTxn* txn)
 {
-    TxnCtxt txn;
-    txn.begin(dbenv.get(), true);
     try {
-        {
-            Cursor bindings;
-            bindings.open(bindingDb, txn.get());
+        Cursor bindings;
+        bindings.open(bindingDb, txn);
 
-            IdDbt key(exchange.getPersistenceId());
-            Dbt value;
+        IdDbt key(exchange.getPersistenceId());
+        Dbt value;
 
-            for (int status = bindings->get(&key, &value, DB_SET); status == 0; status = bindings->get(&key, &value, DB_NEXT_DUP)) {
-                qpid::framing::Buffer buffer(reinterpret_cast<char*>(value.get_data()), value.get_size());
-                if (buffer.available() < 8) {
-                    THROW_STORE_EXCEPTION("Not enough data for binding");
-                }
-                uint64_t queueId = buffer.getLongLong();
-                if (queue.getPersistenceId() == queueId) {
-                    std::string q;
-                    std::string k;
-                    buffer.getShortString(q);
-                    buffer.getShortString(k);
-                    if (bkey == k) {
-                        bindings->del(0);
-                        QPID_LOG(debug, "Deleting binding for " << queue.getName() << " " << key.id << "->" << queueId);
-                    }
+        for (int status = bindings->get(&key, &value, DB_SET); status == 0; status = bindings->get(&key, &value, DB_NEXT_DUP)) {
+            qpid::framing::Buffer buffer(reinterpret_cast<char*>(value.get_data()), value.get_size());
+            if (buffer.available() < 8) {
+                THROW_STORE_EXCEPTION("Not enough data for binding");
+            }
+            uint64_t queueId = buffer.getLongLong();
+            if (queue.getPersistenceId() == queueId) {
+                std::string q;
+                std::string k;
+                buffer.getShortString(q);
+                buffer.getShortString(k);
+                if (bkey == k) {
+                    bindings->del(0);
+                    QPID_LOG(debug, "Deleting binding for " << queue.getName() << " " << key.id << "->" << queueId);
                 }
             }
         }
-        txn.commit();
     } catch (const std::exception& e) {
-        txn.abort();
         THROW_STORE_EXCEPTION_2("Error deleting bindings", e.what());
-    } catch (...) {
-        txn.abort();
-        throw;
     }
 }
 
@@ -1647,6 +1771,20 @@ std::string MessageStoreImpl::getTplBaseDir()
     return dir.str();
 }
 
+std::string MessageStoreImpl::getContentBaseDir()
+{
+    std::ostringstream dir;
+    dir << storeDir << "/" << storeTopLevelDir << "/content/" ;
+    return dir.str();
+}
+
+std::string MessageStoreImpl::getSharedBaseDir()
+{
+    std::ostringstream dir;
+    dir << storeDir << "/" << storeTopLevelDir << "/shared/" ;
+    return dir.str();
+}
+
 std::string MessageStoreImpl::getJrnlDir(const qpid::broker::PersistableQueue& queue) //for exmaple /var/rhm/ + queueDir/
 {
     return getJrnlHashDir(queue.getName().c_str());
@@ -1687,7 +1825,11 @@ MessageStoreImpl::StoreOptions::StoreOptions(const std::string& name) :
                                              wCachePageSizeKib(defWCachePageSize),
                                              tplNumJrnlFiles(defTplNumJrnlFiles),
                                              tplJrnlFsizePgs(defTplJrnlFileSizePgs),
-                                             tplWCachePageSizeKib(defTplWCachePageSize)
+                                             tplWCachePageSizeKib(defTplWCachePageSize),
+                                             numSharedJrnls(defNumSharedJrnls),
+                                             numRecoveryThreads(defNumRecoveryThreads),
+                                             flushLatencyTargetUs(defFlushLatencyTargetUs),
+                                             configBatchSize(defConfigBatchSize)
 {
     std::ostringstream oss1;
     oss1 << "Default number of files for each journal instance (queue). [Allowable values: " <<
@@ -1726,6 +1868,20 @@ MessageStoreImpl::StoreOptions::StoreOptions(const std::string& name) :
                 "Size of the pages in the transaction prepared list write page cache in KiB. "
                 "Allowable values - powers of 2: 1, 2, 4, ... , 128. "
                 "Lower values decrease latency at the expense of throughput.")
+        ("shared-journals", qpid::optValue(numSharedJrnls, "N"),
+                "Number of journals shared by all queues for non-transactional enqueues, allowing many lightly "
+                "used queues to be written together. If 0, each queue uses only its own journal.")
+        ("recovery-threads", qpid::optValue(numRecoveryThreads, "N"),
+                "Number of threads recovering queue journals in parallel on startup. If 1, queues are recovered "
+                "one at a time; if 0, one thread per CPU.")
+        ("flush-latency-target", qpid::optValue(flushLatencyTargetUs, "N"),
+                "Target time in microseconds from writing a record to its commit. If non-zero, each queue journal "
+                "batches writes to fit the target, sizing batches from the arrival rate and measured commit "
+                "latency. If 0, writes are flushed as soon as a client asks.")
+        ("config-batch-size", qpid::optValue(configBatchSize, "N"),
+                "Largest number of queue, exchange and binding changes committed together. Changes made at the same "
+                "time share one database transaction and log sync; each still waits for its commit. If 1, every "
+                "change is committed on its own.")
         ;
 }
 
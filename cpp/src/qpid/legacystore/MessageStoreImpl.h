@@ -25,12 +25,15 @@
 #include <string>
 
 #include "db-inc.h"
+#include "qpid/legacystore/ConfigWriter.h"
+#include "qpid/legacystore/ContentStore.h"
 #include "qpid/legacystore/Cursor.h"
 #include "qpid/legacystore/IdDbt.h"
 #include "qpid/legacystore/IdSequence.h"
 #include "qpid/legacystore/JournalImpl.h"
 #include "qpid/legacystore/jrnl/jcfg.h"
 #include "qpid/legacystore/PreparedTransaction.h"
+#include "qpid/legacystore/SharedJournals.h"
 #include "qpid/broker/Broker.h"
 #include "qpid/broker/MessageStore.h"
 #include "qpid/management/Manageable.h"
@@ -72,6 +75,10 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
         u_int16_t tplNumJrnlFiles;
         u_int32_t tplJrnlFsizePgs;
         u_int32_t tplWCachePageSizeKib;
+        u_int16_t numSharedJrnls;
+        u_int16_t numRecoveryThreads;
+        u_int32_t flushLatencyTargetUs;
+        u_int16_t configBatchSize;
     };
 
   protected:
@@ -95,6 +102,19 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
     typedef std::map<std::string, TplRecover> TplRecoverMap;
     typedef TplRecoverMap::const_iterator TplRecoverMapCitr;
 
+    // Recovery state of one queue, kept apart from that of the queues being recovered alongside it
+    struct QueueRecoverStruct {
+        qpid::broker::RecoverableQueue::shared_ptr queue;
+        txn_list prepared;          // the queue's own locked mappings, merged into the shared list once done
+        message_index messages;     // the queue's in-doubt messages
+        u_int64_t highestRid;
+        long rcnt;                  // recovered msg count
+        long idcnt;                 // in-doubt msg count
+        QueueRecoverStruct(const qpid::broker::RecoverableQueue::shared_ptr& _queue, const txn_list& _prepared);
+    };
+    typedef QueueRecoverStruct QueueRecover;
+    typedef boost::ptr_list<QueueRecover> QueueRecoverList;
+
     typedef std::map<std::string, JournalImpl*> JournalListMap;
     typedef JournalListMap::iterator JournalListMapItr;
 
@@ -106,6 +126,10 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
     static const u_int16_t defTplNumJrnlFiles = 8;
     static const u_int32_t defTplJrnlFileSizePgs = 24;
     static const u_int32_t defTplWCachePageSize = defWCachePageSize / 8;
+    static const u_int16_t defNumSharedJrnls = 0;
+    static const u_int16_t defNumRecoveryThreads = 1;
+    static const u_int32_t defFlushLatencyTargetUs = 0;
+    static const u_int16_t defConfigBatchSize = 64;
     // TODO: set defAutoJrnlExpand to true and defAutoJrnlExpandMaxFiles to 16 when auto-expand comes on-line
     static const bool      defAutoJrnlExpand = false;
     static const u_int16_t defAutoJrnlExpandMaxFiles = 0;
@@ -127,9 +151,14 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
     boost::shared_ptr<TplJournalImpl> tplStorePtr;
     TplRecoverMap tplRecoverMap;
     qpid::sys::Mutex tplInitLock;
+    // Content of messages enqueued on more than one queue, shared between their journals
+    boost::shared_ptr<ContentStore> contentStorePtr;
+    // Journals shared by all queues for non-transactional enqueues, if any
+    boost::shared_ptr<SharedJournals> sharedJournalsPtr;
+    // Commits changes to the configuration databases in batches
+    boost::shared_ptr<ConfigWriter> configWriterPtr;
     JournalListMap journalList;
     qpid::sys::Mutex journalListLock;
-    qpid::sys::Mutex bdbLock;
 
     IdSequence queueIdSequence;
     IdSequence exchangeIdSequence;
@@ -147,6 +176,10 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
     u_int32_t tplJrnlFsizeSblks;
     u_int32_t tplWCachePgSizeSblks;
     u_int16_t tplWCacheNumPages;
+    u_int16_t numSharedJrnls;
+    u_int16_t numRecoveryThreads;
+    u_int32_t flushLatencyTargetUs;
+    u_int16_t configBatchSize;
     u_int64_t highestRid;
     bool isInit;
     const char* envPath;
@@ -180,6 +213,9 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
                        queue_index& index,
                        txn_list& locked,
                        message_index& messages);
+    void recoverQueue(TxnCtxt& txn,
+                      qpid::broker::RecoveryManager& recovery,
+                      QueueRecover& state);
     void recoverMessages(TxnCtxt& txn,
                          qpid::broker::RecoveryManager& recovery,
                          queue_index& index,
@@ -192,9 +228,16 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
                          message_index& prepared,
                          long& rcnt,
                          long& idcnt);
-    qpid::broker::RecoverableMessage::shared_ptr getExternMessage(qpid::broker::RecoveryManager& recovery,
-                                                                  uint64_t mId,
-                                                                  unsigned& headerSize);
+    void recoverSharedMessages(qpid::broker::RecoveryManager& recovery,
+                               qpid::broker::RecoverableQueue::shared_ptr& queue,
+                               const SharedJournals::RecordList& records,
+                               SharedJournals::RecordList::const_iterator& next,
+                               u_int64_t before,
+                               long& rcnt);
+    qpid::broker::RecoverableMessage::shared_ptr decodeMessage(qpid::broker::RecoveryManager& recovery,
+                                                               char* data,
+                                                               u_int64_t size,
+                                                               u_int64_t messageId);
     void recoverExchanges(TxnCtxt& txn,
                           qpid::broker::RecoveryManager& recovery,
                           exchange_index& index);
@@ -213,7 +256,6 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
     void recoverTplStore();
     void recoverLockedMappings(txn_list& txns);
     TxnCtxt* check(qpid::broker::TransactionContext* ctxt);
-    u_int64_t msgEncode(std::vector<char>& buff, const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message);
     void store(const qpid::broker::PersistableQueue* queue,
                TxnCtxt* txn,
                const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message,
@@ -226,12 +268,26 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
     bool create(db_ptr db,
                 IdSequence& seq,
                 const qpid::broker::Persistable& p);
+    void createRecord(db_ptr db,
+                      u_int64_t id,
+                      const qpid::broker::Persistable& p,
+                      int& status,
+                      DbTxn* txn);
+    void deleteRecord(db_ptr db,
+                      u_int64_t id,
+                      DbTxn* txn);
+    void deleteQueue(const qpid::broker::PersistableQueue& queue,
+                     DbTxn* txn);
+    void deleteExchange(const qpid::broker::PersistableExchange& exchange,
+                        DbTxn* txn);
     void completed(TxnCtxt& txn,
                    bool commit);
-    void deleteBindingsForQueue(const qpid::broker::PersistableQueue& queue);
+    void deleteBindingsForQueue(const qpid::broker::PersistableQueue& queue,
+                                DbTxn* txn);
     void deleteBinding(const qpid::broker::PersistableExchange& exchange,
                        const qpid::broker::PersistableQueue& queue,
-                       const std::string& key);
+                       const std::string& key,
+                       DbTxn* txn);
 
     void put(db_ptr db,
              DbTxn* txn,
@@ -251,6 +307,8 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
     std::string getJrnlBaseDir();
     std::string getBdbBaseDir();
     std::string getTplBaseDir();
+    std::string getContentBaseDir();
+    std::string getSharedBaseDir();
     inline void checkInit() {
         // TODO: change the default dir to ~/.qpidd
         if (!isInit) { init("/tmp"); isInit = true; }
@@ -288,7 +346,11 @@ class MessageStoreImpl : public qpid::broker::MessageStore, public qpid::managem
               u_int32_t tplJfileSizePgs = defTplJrnlFileSizePgs,
               u_int32_t tplWCachePageSize = defTplWCachePageSize,
               bool      autoJExpand = defAutoJrnlExpand,
-              u_int16_t autoJExpandMaxFiles = defAutoJrnlExpandMaxFiles);
+              u_int16_t autoJExpandMaxFiles = defAutoJrnlExpandMaxFiles,
+              u_int16_t sharedJrnls = defNumSharedJrnls,
+              u_int16_t recoveryThreads = defNumRecoveryThreads,
+              u_int32_t flushTargetUs = defFlushLatencyTargetUs,
+              u_int16_t configBatch = defConfigBatchSize);
 
     void truncateInit(const bool saveStoreContent = false);
 
@@ -0,0 +1,118 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/legacystore/RecoveryPool.h"
+
+#include "qpid/legacystore/StoreException.h"
+#include "qpid/log/Statement.h"
+#include "qpid/sys/SystemInfo.h"
+#include "qpid/sys/Thread.h"
+#include "qpid/sys/Time.h"
+#include <algorithm>
+#include <vector>
+
+namespace mrg {
+namespace msgstore {
+
+namespace {
+const qpid::sys::Duration progressInterval(10 * qpid::sys::TIME_SEC);
+}
+
+RecoveryPool::RecoveryPool(const std::string& w, u_int16_t t)
+  : what(w),
+    threads(t ? t : std::max(qpid::sys::SystemInfo::concurrency(), 1L)),
+    total(0),
+    done(0),
+    exited(0),
+    lastReport(qpid::sys::now())
+{}
+
+RecoveryPool::~RecoveryPool() {}
+
+void RecoveryPool::add(const Task& task)
+{
+    tasks.push_back(task);
+}
+
+void RecoveryPool::execute()
+{
+    total = tasks.size();
+    if (total < threads) threads = total;
+    if (threads <= 1) {
+        threads = 1;
+        run();
+    } else {
+        std::vector<qpid::sys::Thread> workers;
+        for (u_int16_t i = 0; i < threads; ++i)
+            workers.push_back(qpid::sys::Thread(*this));
+        {
+            qpid::sys::Monitor::ScopedLock sl(monitor);
+            while (exited < threads) monitor.wait();
+        }
+        for (std::vector<qpid::sys::Thread>::iterator i = workers.begin(); i != workers.end(); ++i)
+            i->join();
+    }
+    if (!failure.empty()) THROW_STORE_EXCEPTION(failure);
+}
+
+void RecoveryPool::run()
+{
+    Task task;
+    while (next(task)) {
+        try {
+            task();
+            finished(std::string());
+        } catch (const std::exception& e) {
+            finished(e.what());
+        } catch (...) {
+            finished("Unknown exception recovering " + what);
+        }
+    }
+}
+
+bool RecoveryPool::next(Task& task)
+{
+    qpid::sys::Monitor::ScopedLock sl(monitor);
+    if (tasks.empty() || !failure.empty()) {
+        ++exited;
+        monitor.notify();
+        return false;
+    }
+    task = tasks.front();
+    tasks.pop_front();
+    return true;
+}
+
+void RecoveryPool::finished(const std::string& error)
+{
+    qpid::sys::Monitor::ScopedLock sl(monitor);
+    ++done;
+    if (!error.empty() && failure.empty()) {
+        failure = error;
+        tasks.clear();
+    }
+    if (qpid::sys::Duration(lastReport, qpid::sys::now()) >= progressInterval) {
+        lastReport = qpid::sys::now();
+        QPID_LOG(notice, "Recovering " << what << ": " << done << " of " << total << " done");
+    }
+}
+
+}}
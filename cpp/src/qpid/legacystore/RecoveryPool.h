@@ -0,0 +1,84 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef QPID_LEGACYSTORE_RECOVERYPOOL_H
+#define QPID_LEGACYSTORE_RECOVERYPOOL_H
+
+#include "qpid/sys/Monitor.h"
+#include "qpid/sys/Runnable.h"
+#include "qpid/sys/Time.h"
+#include <boost/function.hpp>
+#include <deque>
+#include <string>
+#include <sys/types.h>
+
+namespace mrg{
+namespace msgstore{
+
+/**
+ * Runs independent recovery tasks - one per queue journal - on a number of
+ * threads, logging progress every so often until they are done.
+ *
+ * Each task runs start to finish on one thread, so whatever order a task
+ * imposes on its own work is kept; tasks share no order with each other.
+ * If a task throws, the tasks not yet started are dropped and execute()
+ * throws a StoreException carrying the first failure.
+ */
+class RecoveryPool : public qpid::sys::Runnable
+{
+  public:
+    typedef boost::function<void()> Task;
+
+    /** threads is the most threads to use; 0 means one per CPU. */
+    RecoveryPool(const std::string& what, u_int16_t threads);
+    ~RecoveryPool();
+
+    void add(const Task& task);
+
+    /**
+     * Run every task added, returning when all are done. With one thread,
+     * or one task, the tasks run on the calling thread.
+     */
+    void execute();
+
+    u_int16_t getThreads() const { return threads; }
+
+  private:
+    typedef std::deque<Task> Tasks;
+
+    qpid::sys::Monitor monitor;
+    const std::string what;
+    u_int16_t threads;
+    Tasks tasks;
+    size_t total;
+    size_t done;
+    u_int16_t exited;           // worker threads that have run out of tasks
+    std::string failure;
+    qpid::sys::AbsTime lastReport;
+
+    void run();                 // worker thread
+    bool next(Task& task);
+    void finished(const std::string& error);
+};
+
+}}
+
+#endif // ifndef QPID_LEGACYSTORE_RECOVERYPOOL_H
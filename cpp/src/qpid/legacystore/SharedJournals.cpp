@@ -0,0 +1,330 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/legacystore/SharedJournals.h"
+
+#include "qpid/legacystore/DataTokenImpl.h"
+#include "qpid/legacystore/MessageDataSrc.h"
+#include "qpid/legacystore/StoreException.h"
+#include "qpid/legacystore/jrnl/jdir.h"
+#include "qpid/framing/Buffer.h"
+#include "qpid/log/Statement.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_AIO_SLEEPS 100000 // tot: ~1 sec
+#define AIO_SLEEP_TIME_US  10 // 0.01 ms
+
+namespace mrg {
+namespace msgstore {
+
+namespace {
+
+const std::size_t idsSize = 2 * sizeof(u_int64_t); // queue id, message id
+
+/**
+ * The data of a shared journal record: the ids of the queue and message,
+ * then the message's usual enqueue record data.
+ */
+class SharedRecordSrc : public journal::data_src
+{
+    char ids[idsSize];
+    MessageDataSrc& src;
+
+  public:
+    SharedRecordSrc(u_int64_t queueId, u_int64_t messageId, MessageDataSrc& s) : src(s)
+    {
+        qpid::framing::Buffer buffer(ids, idsSize);
+        buffer.putLongLong(queueId);
+        buffer.putLongLong(messageId);
+    }
+
+    u_int64_t getSize() const { return idsSize + src.getSize(); }
+
+    void write(void* wptr, const std::size_t offs, const std::size_t len)
+    {
+        char* p = static_cast<char*>(wptr);
+        std::size_t n = 0;
+        if (offs < idsSize) {
+            n = std::min(len, idsSize - offs);
+            ::memcpy(p, ids + offs, n);
+        }
+        if (n < len) src.write(p + n, offs + n - idsSize, len - n);
+    }
+};
+
+void dequeueRecord(JournalImpl& jc, IdSequence& messageIdSequence, u_int64_t rid)
+{
+    boost::intrusive_ptr<DataTokenImpl> ddtokp(new DataTokenImpl);
+    ddtokp->set_external_rid(true);
+    ddtokp->set_rid(messageIdSequence.next());
+    ddtokp->set_dequeue_rid(rid);
+    ddtokp->set_wstate(DataTokenImpl::ENQ);
+    // Manually increase the ref count, as raw pointers are used beyond this point
+    ddtokp->addRef();
+    try {
+        jc.dequeue_data_record(ddtokp.get());
+    } catch (const journal::jexception& e) {
+        ddtokp->release();
+        THROW_STORE_EXCEPTION(std::string("Journal ") + jc.id() + ": dequeue failed: " + e.what());
+    }
+}
+
+}
+
+SharedJournals::SharedJournals(qpid::sys::Timer& t,
+                               const std::string& d,
+                               const u_int16_t c,
+                               IdSequence& ids,
+                               const qpid::sys::Duration get,
+                               const qpid::sys::Duration ft,
+                               const u_int16_t nf,
+                               const bool ae,
+                               const u_int16_t aemf,
+                               const u_int32_t fs,
+                               const u_int16_t np,
+                               const u_int32_t ps)
+  : timer(t),
+    dir(d),
+    count(c),
+    messageIdSequence(ids),
+    getEventsTimeout(get),
+    flushTimeout(ft),
+    numJrnlFiles(nf),
+    autoJrnlExpand(ae),
+    autoJrnlExpandMaxFiles(aemf),
+    jrnlFsizeSblks(fs),
+    wCacheNumPages(np),
+    wCachePgSizeSblks(ps)
+{
+    for (u_int16_t n = 0; n < count; n++)
+        journals.push_back(newJournal(n));
+}
+
+SharedJournals::~SharedJournals() {}
+
+bool SharedJournals::enqueue(const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message,
+                             MessageDataSrc& msgSrc,
+                             u_int64_t queueId)
+{
+    if (count == 0) return false;
+    const u_int16_t n = queueId % count;
+    JournalImpl& jc = *journals[n];
+    if (!jc.is_ready()) {
+        // Prevent multiple threads from late-initializing the journal
+        qpid::sys::Mutex::ScopedLock sl(lock);
+        if (!jc.is_ready()) {
+            journal::jdir::create_dir(jc.jrnl_dir());
+            jc.initialize(numJrnlFiles, autoJrnlExpand, autoJrnlExpandMaxFiles, jrnlFsizeSblks, wCacheNumPages,
+                          wCachePgSizeSblks);
+        }
+    }
+
+    const u_int64_t messageId = message->getPersistenceId();
+    SharedRecordSrc src(queueId, messageId, msgSrc);
+    boost::intrusive_ptr<DataTokenImpl> dtokp(new DataTokenImpl);
+    dtokp->addRef();
+    dtokp->setSourceMessage(message);
+    dtokp->set_external_rid(true);
+    dtokp->set_rid(messageIdSequence.next());
+    try {
+        jc.enqueue_data_record(src, src.getSize(), dtokp.get(), !message->isPersistent());
+    } catch (const StoreFullException&) {
+        dtokp->release();
+        return false;
+    }
+    qpid::sys::Mutex::ScopedLock sl(lock);
+    index[Key(queueId, messageId)] = Location(n, dtokp->rid());
+    return true;
+}
+
+bool SharedJournals::contains(u_int64_t messageId, u_int64_t queueId)
+{
+    qpid::sys::Mutex::ScopedLock sl(lock);
+    return index.find(Key(queueId, messageId)) != index.end();
+}
+
+bool SharedJournals::dequeue(u_int64_t messageId, u_int64_t queueId)
+{
+    Location l;
+    {
+        qpid::sys::Mutex::ScopedLock sl(lock);
+        Index::iterator i = index.find(Key(queueId, messageId));
+        if (i == index.end()) return false;
+        l = i->second;
+        index.erase(i);
+    }
+    dequeueRecord(*journals[l.first], messageIdSequence, l.second);
+    return true;
+}
+
+void SharedJournals::dequeueAll(u_int64_t queueId)
+{
+    std::vector<Location> locations;
+    {
+        qpid::sys::Mutex::ScopedLock sl(lock);
+        Index::iterator first = index.lower_bound(Key(queueId, 0));
+        Index::iterator last = index.lower_bound(Key(queueId + 1, 0));
+        for (Index::iterator i = first; i != last; ++i)
+            locations.push_back(i->second);
+        index.erase(first, last);
+    }
+    for (std::vector<Location>::const_iterator i = locations.begin(); i != locations.end(); ++i)
+        dequeueRecord(*journals[i->first], messageIdSequence, i->second);
+}
+
+void SharedJournals::flush(u_int64_t queueId)
+{
+    if (count == 0) return;
+    JournalImpl& jc = *journals[queueId % count];
+    if (jc.is_ready()) jc.flush();
+}
+
+void SharedJournals::recover(u_int64_t& highestRid)
+{
+    qpid::sys::Mutex::ScopedLock sl(lock);
+    for (u_int16_t n = 0; ; n++) {
+        if (n == journals.size()) {
+            if (!journal::jdir::exists(getJournalDir(n))) break;
+            journals.push_back(newJournal(n)); // left over from a larger number of shared journals
+        }
+        JournalImpl& jc = *journals[n];
+        if (!journal::jdir::exists(jc.jrnl_dir() + jc.base_filename() + ".jinf")) continue;
+        u_int64_t thisHighestRid = 0ULL;
+        try {
+            jc.recover(numJrnlFiles, autoJrnlExpand, autoJrnlExpandMaxFiles, jrnlFsizeSblks, wCacheNumPages,
+                       wCachePgSizeSblks, 0, thisHighestRid, 0);
+            if (highestRid == 0ULL)
+                highestRid = thisHighestRid;
+            else if (thisHighestRid - highestRid < 0x8000000000000000ULL) // RFC 1982 comparison for unsigned 64-bit
+                highestRid = thisHighestRid;
+
+            readRecords(n);
+
+            jc.recover_complete(); // start journal.
+        } catch (const journal::jexception& e) {
+            THROW_STORE_EXCEPTION(std::string("Journal ") + jc.id() + ": recover() failed: " + e.what());
+        }
+    }
+}
+
+void SharedJournals::takeRecovered(u_int64_t queueId, RecordList& records)
+{
+    qpid::sys::Mutex::ScopedLock sl(lock);
+    RecoveredMap::iterator i = recovered.find(queueId);
+    if (i == recovered.end()) return;
+    records.swap(i->second);
+    recovered.erase(i);
+    std::sort(records.begin(), records.end());
+}
+
+void SharedJournals::recoverComplete()
+{
+    RecoveredMap unclaimed;
+    {
+        qpid::sys::Mutex::ScopedLock sl(lock);
+        unclaimed.swap(recovered);
+    }
+    for (RecoveredMap::const_iterator i = unclaimed.begin(); i != unclaimed.end(); ++i) {
+        QPID_LOG(warning, "Discarding " << i->second.size() << " records of unknown queue " << i->first
+                 << " from shared journals");
+        dequeueAll(i->first);
+    }
+}
+
+void SharedJournals::stop()
+{
+    qpid::sys::Mutex::ScopedLock sl(lock);
+    for (std::vector<JournalPtr>::iterator i = journals.begin(); i != journals.end(); ++i) {
+        if ((*i)->is_ready()) (*i)->stop(true);
+    }
+}
+
+SharedJournals::JournalPtr SharedJournals::newJournal(u_int16_t n)
+{
+    std::ostringstream id;
+    id << "SharedJournal" << n;
+    return JournalPtr(new JournalImpl(timer, id.str(), getJournalDir(n), "shared", getEventsTimeout, flushTimeout, 0));
+}
+
+std::string SharedJournals::getJournalDir(u_int16_t n)
+{
+    std::ostringstream d;
+    d << dir << std::hex << std::setfill('0') << std::setw(4) << n << "/";
+    return d.str();
+}
+
+void SharedJournals::readRecords(u_int16_t n)
+{
+    JournalImpl& jc = *journals[n];
+    DataTokenImpl dtok;
+    void* dbuff = NULL; size_t dbuffSize = 0;
+    void* xidbuff = NULL; size_t xidbuffSize = 0;
+    bool transientFlag = false;
+    bool externalFlag = false;
+    bool done = false;
+    unsigned aio_sleep_cnt = 0;
+    while (!done) {
+        dtok.reset();
+        dtok.set_wstate(DataTokenImpl::ENQ);
+        mrg::journal::iores res = jc.read_data_record(&dbuff, dbuffSize, &xidbuff, xidbuffSize, transientFlag, externalFlag, &dtok);
+        switch (res) {
+          case mrg::journal::RHM_IORES_SUCCESS: {
+            if (dbuffSize < idsSize) {
+                std::ostringstream oss;
+                oss << "Journal " << jc.id() << ": record 0x" << std::hex << dtok.rid() << " is too short";
+                THROW_STORE_EXCEPTION(oss.str());
+            }
+            qpid::framing::Buffer buffer(static_cast<char*>(dbuff), idsSize);
+            u_int64_t queueId = buffer.getLongLong();
+            u_int64_t messageId = buffer.getLongLong();
+            RecordList& records = recovered[queueId];
+            records.push_back(Record(messageId));
+            records.back().data.assign(static_cast<const char*>(dbuff) + idsSize, dbuffSize - idsSize);
+            index[Key(queueId, messageId)] = Location(n, dtok.rid());
+            if (xidbuff)
+                ::free(xidbuff);
+            else if (dbuff)
+                ::free(dbuff);
+            aio_sleep_cnt = 0;
+            break;
+          }
+          case mrg::journal::RHM_IORES_PAGE_AIOWAIT:
+            if (++aio_sleep_cnt > MAX_AIO_SLEEPS)
+                THROW_STORE_EXCEPTION("Timeout waiting for AIO in SharedJournals::readRecords()");
+            ::usleep(AIO_SLEEP_TIME_US);
+            break;
+          case mrg::journal::RHM_IORES_EMPTY:
+            done = true;
+            break;
+          default:
+            std::ostringstream oss;
+            oss << "readRecords(): Unexpected result from journal read: " << mrg::journal::iores_str(res);
+            THROW_STORE_EXCEPTION(oss.str());
+        } // switch
+    }
+}
+
+}}
@@ -0,0 +1,154 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef QPID_LEGACYSTORE_SHAREDJOURNALS_H
+#define QPID_LEGACYSTORE_SHAREDJOURNALS_H
+
+#include "qpid/legacystore/IdSequence.h"
+#include "qpid/legacystore/JournalImpl.h"
+#include "qpid/broker/PersistableMessage.h"
+#include "qpid/sys/Mutex.h"
+#include "qpid/sys/Time.h"
+#include <boost/intrusive_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace mrg{
+namespace msgstore{
+
+class MessageDataSrc;
+
+/**
+ * A small number of journals shared by all queues.
+ *
+ * Non-transactional enqueues of a queue go to one of these journals,
+ * chosen by queue id, instead of to the queue's own journal. Each record
+ * carries the ids of its queue and message, and gets a record id of its
+ * own, so one write cache page - and one AIO write and completion - can
+ * hold enqueues and dequeues from any number of queues. This trades a
+ * journal per queue for a group commit across queues, which pays off when
+ * there are many durable queues each seeing little traffic.
+ *
+ * Which records each queue holds is kept in memory, and rebuilt on
+ * recovery from the records themselves.
+ */
+class SharedJournals
+{
+  public:
+    struct Record {
+        u_int64_t messageId;
+        std::string data;
+        Record(u_int64_t m) : messageId(m) {}
+        bool operator<(const Record& o) const { return messageId < o.messageId; }
+    };
+    typedef std::vector<Record> RecordList;
+
+    SharedJournals(qpid::sys::Timer& timer,
+                   const std::string& dir,
+                   const u_int16_t count,
+                   IdSequence& messageIdSequence,
+                   const qpid::sys::Duration getEventsTimeout,
+                   const qpid::sys::Duration flushTimeout,
+                   const u_int16_t numJrnlFiles,
+                   const bool autoJrnlExpand,
+                   const u_int16_t autoJrnlExpandMaxFiles,
+                   const u_int32_t jrnlFsizeSblks,
+                   const u_int16_t wCacheNumPages,
+                   const u_int32_t wCachePgSizeSblks);
+    ~SharedJournals();
+
+    /**
+     * Enqueue the message for the queue in its shared journal. Returns
+     * false if there are no shared journals or the queue's is full, in
+     * which case the caller uses the queue's own journal.
+     */
+    bool enqueue(const boost::intrusive_ptr<qpid::broker::PersistableMessage>& message,
+                 MessageDataSrc& src,
+                 u_int64_t queueId);
+
+    /** True if the message is enqueued for the queue in a shared journal. */
+    bool contains(u_int64_t messageId, u_int64_t queueId);
+
+    /**
+     * Dequeue the message for the queue. Returns false if a shared journal
+     * does not hold it.
+     */
+    bool dequeue(u_int64_t messageId, u_int64_t queueId);
+
+    /** Dequeue every message held for the queue, as when it is destroyed. */
+    void dequeueAll(u_int64_t queueId);
+
+    /** Flush the shared journal the queue enqueues to. */
+    void flush(u_int64_t queueId);
+
+    /**
+     * Recover every shared journal found, including any beyond the
+     * configured number, which are then only dequeued from. highestRid is
+     * raised to the highest record id found.
+     */
+    void recover(u_int64_t& highestRid);
+
+    /** Hand over the records recovered for the queue, in message id order. */
+    void takeRecovered(u_int64_t queueId, RecordList& records);
+
+    /**
+     * Dequeue the records of queues that were not recovered. Must be called
+     * once the message id sequence has been reset past every recovered id.
+     */
+    void recoverComplete();
+
+    void stop();
+
+  private:
+    typedef std::pair<u_int64_t, u_int64_t> Key;                // queue id, message id
+    typedef std::pair<u_int16_t, u_int64_t> Location;           // journal, record id
+    typedef std::map<Key, Location> Index;
+    typedef std::map<u_int64_t, RecordList> RecoveredMap;       // queue id -> records
+    typedef boost::shared_ptr<JournalImpl> JournalPtr;
+
+    qpid::sys::Mutex lock;
+    qpid::sys::Timer& timer;
+    const std::string dir;
+    const u_int16_t count;
+    IdSequence& messageIdSequence;
+    const qpid::sys::Duration getEventsTimeout;
+    const qpid::sys::Duration flushTimeout;
+    const u_int16_t numJrnlFiles;
+    const bool autoJrnlExpand;
+    const u_int16_t autoJrnlExpandMaxFiles;
+    const u_int32_t jrnlFsizeSblks;
+    const u_int16_t wCacheNumPages;
+    const u_int32_t wCachePgSizeSblks;
+    std::vector<JournalPtr> journals;
+    Index index;
+    RecoveredMap recovered;
+
+    JournalPtr newJournal(u_int16_t n);
+    std::string getJournalDir(u_int16_t n);
+    void readRecords(u_int16_t n);
+};
+
+}}
+
+#endif // ifndef QPID_LEGACYSTORE_SHAREDJOURNALS_H
@@ -26,6 +26,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "qpid/legacystore/DataTokenImpl.h"
 #include "qpid/legacystore/IdSequence.h"
@@ -42,6 +43,9 @@ namespace msgstore {
 
 class TxnCtxt : public qpid::broker::TransactionContext
 {
+  public:
+    typedef std::vector<std::pair<u_int64_t, u_int64_t> > Releases;
+
   protected:
     static qpid::sys::Mutex globalSerialiser;
 
@@ -55,6 +59,7 @@ class TxnCtxt : public qpid::broker::TransactionContext
     typedef std::auto_ptr<qpid::sys::Mutex::ScopedLock> AutoScopedLock;
 
     ipqdef impactedQueues; // list of Queues used in the txn
+    Releases releases; // (message id, queue id) of dequeues applied to shared storage on commit
     IdSequence* loggedtx;
     boost::intrusive_ptr<DataTokenImpl> dtokp;
     AutoScopedLock globalHolder;
@@ -90,6 +95,8 @@ class TxnCtxt : public qpid::broker::TransactionContext
     virtual const std::string& getXid();
 
     void addXidRecord(qpid::broker::ExternalQueueStore* queue);
+    inline void addRelease(u_int64_t messageId, u_int64_t queueId) { releases.push_back(std::make_pair(messageId, queueId)); }
+    inline const Releases& getReleases() const { return releases; }
     inline void prepare(JournalImpl* _preparedXidStorePtr) { preparedXidStorePtr = _preparedXidStorePtr; }
     void complete(bool commit);
     bool impactedQueuesEmpty();
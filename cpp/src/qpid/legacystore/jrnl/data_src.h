@@ -0,0 +1,63 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/**
+ * \file data_src.h
+ *
+ * Qpid asynchronous store plugin library
+ *
+ * This file contains the definition of the interface through which an
+ * enqueue record's data can be written into the write cache by whoever
+ * owns it, rather than being copied in from a contiguous buffer.
+ */
+
+#ifndef QPID_LEGACYSTORE_JRNL_DATA_SRC_H
+#define QPID_LEGACYSTORE_JRNL_DATA_SRC_H
+
+#include <cstddef>
+
+namespace mrg
+{
+namespace journal
+{
+
+    /**
+    * \class data_src
+    * \brief Source of the data for an enqueue record.
+    *
+    * The journal asks for the data a piece at a time, in order, as it fills each page of the
+    * write cache; a record that spans pages is asked for in several pieces. The source must
+    * stay valid until the enqueue call it was passed to returns.
+    */
+    class data_src
+    {
+    public:
+        virtual ~data_src() {}
+        /**
+        * \brief Write size bytes of the data, starting offs bytes in, to wptr.
+        */
+        virtual void write(void* wptr, const std::size_t offs, const std::size_t size) = 0;
+    };
+
+} // namespace journal
+} // namespace mrg
+
+#endif // ifndef QPID_LEGACYSTORE_JRNL_DATA_SRC_H
@@ -32,6 +32,7 @@
 
 #include "qpid/legacystore/jrnl/enq_map.h"
 
+#include <algorithm>
 #include <iomanip>
 #include "qpid/legacystore/jrnl/jerrno.h"
 #include "qpid/legacystore/jrnl/slock.h"
@@ -53,6 +54,7 @@ int16_t enq_map::EMAP_TRUE = 1;
 
 enq_map::enq_map():
         _map(),
+        _size(0),
         _pfid_enq_cnt()
 {}
 
@@ -74,13 +76,8 @@ enq_map::insert_pfid(const u_int64_t rid, const u_int16_t pfid)
 int16_t
 enq_map::insert_pfid(const u_int64_t rid, const u_int16_t pfid, const bool locked)
 {
-    std::pair<emap_itr, bool> ret;
-    emap_data_struct rec(pfid, locked);
-    {
-        slock s(_mutex);
-        ret = _map.insert(emap_param(rid, rec));
-    }
-    if (ret.second == false)
+    slock s(_mutex);
+    if (!insert(rid, locked ? pfid | EMAP_LOCK_FLAG : pfid))
         return EMAP_DUP_RID;
     _pfid_enq_cnt.at(pfid)++;
     return EMAP_OK;
@@ -90,25 +87,27 @@ int16_t
 enq_map::get_pfid(const u_int64_t rid)
 {
     slock s(_mutex);
-    emap_itr itr = _map.find(rid);
-    if (itr == _map.end()) // not found in map
+    emap_entry* e = find(rid);
+    if (e == 0) // not found in map
         return EMAP_RID_NOT_FOUND;
-    if (itr->second._lock)
+    if (e->_pfid_lock & EMAP_LOCK_FLAG)
         return EMAP_LOCKED;
-    return itr->second._pfid;
+    return e->_pfid_lock;
 }
 
 int16_t
 enq_map::get_remove_pfid(const u_int64_t rid, const bool txn_flag)
 {
     slock s(_mutex);
-    emap_itr itr = _map.find(rid);
-    if (itr == _map.end()) // not found in map
+    emap_itr sitr;
+    emap_seg_itr eitr;
+    emap_entry* e = find(rid, sitr, eitr);
+    if (e == 0) // not found in map
         return EMAP_RID_NOT_FOUND;
-    if (itr->second._lock && !txn_flag) // locked, but not a commit/abort
+    if ((e->_pfid_lock & EMAP_LOCK_FLAG) && !txn_flag) // locked, but not a commit/abort
         return EMAP_LOCKED;
-    u_int16_t pfid = itr->second._pfid;
-    _map.erase(itr);
+    u_int16_t pfid = e->_pfid_lock & ~EMAP_LOCK_FLAG;
+    erase(sitr, eitr);
     _pfid_enq_cnt.at(pfid)--;
     return pfid;
 }
@@ -117,10 +116,10 @@ bool
 enq_map::is_enqueued(const u_int64_t rid, bool ignore_lock)
 {
     slock s(_mutex);
-    emap_itr itr = _map.find(rid);
-    if (itr == _map.end()) // not found in map
+    emap_entry* e = find(rid);
+    if (e == 0) // not found in map
         return false;
-    if (!ignore_lock && itr->second._lock) // locked
+    if (!ignore_lock && (e->_pfid_lock & EMAP_LOCK_FLAG)) // locked
         return false;
     return true;
 }
@@ -129,10 +128,10 @@ int16_t
 enq_map::lock(const u_int64_t rid)
 {
     slock s(_mutex);
-    emap_itr itr = _map.find(rid);
-    if (itr == _map.end()) // not found in map
+    emap_entry* e = find(rid);
+    if (e == 0) // not found in map
         return EMAP_RID_NOT_FOUND;
-    itr->second._lock = true;
+    e->_pfid_lock |= EMAP_LOCK_FLAG;
     return EMAP_OK;
 }
 
@@ -140,10 +139,10 @@ int16_t
 enq_map::unlock(const u_int64_t rid)
 {
     slock s(_mutex);
-    emap_itr itr = _map.find(rid);
-    if (itr == _map.end()) // not found in map
+    emap_entry* e = find(rid);
+    if (e == 0) // not found in map
         return EMAP_RID_NOT_FOUND;
-    itr->second._lock = false;
+    e->_pfid_lock &= ~EMAP_LOCK_FLAG;
     return EMAP_OK;
 }
 
@@ -151,10 +150,10 @@ int16_t
 enq_map::is_locked(const u_int64_t rid)
 {
     slock s(_mutex);
-    emap_itr itr = _map.find(rid);
-    if (itr == _map.end()) // not found in map
+    emap_entry* e = find(rid);
+    if (e == 0) // not found in map
         return EMAP_RID_NOT_FOUND;
-    return itr->second._lock ? EMAP_TRUE : EMAP_FALSE;
+    return (e->_pfid_lock & EMAP_LOCK_FLAG) ? EMAP_TRUE : EMAP_FALSE;
 }
 
 void
@@ -163,8 +162,10 @@ enq_map::rid_list(std::vector<u_int64_t>& rv)
     rv.clear();
     {
         slock s(_mutex);
-        for (emap_itr itr = _map.begin(); itr != _map.end(); itr++)
-            rv.push_back(itr->first);
+        rv.reserve(_size);
+        for (emap_itr sitr = _map.begin(); sitr != _map.end(); sitr++)
+            for (emap_seg_itr eitr = sitr->second.begin(); eitr != sitr->second.end(); eitr++)
+                rv.push_back(sitr->first + eitr->_rid_offs);
     }
 }
 
@@ -174,9 +175,106 @@ enq_map::pfid_list(std::vector<u_int16_t>& fv)
     fv.clear();
     {
         slock s(_mutex);
-        for (emap_itr itr = _map.begin(); itr != _map.end(); itr++)
-            fv.push_back(itr->second._pfid);
+        fv.reserve(_size);
+        for (emap_itr sitr = _map.begin(); sitr != _map.end(); sitr++)
+            for (emap_seg_itr eitr = sitr->second.begin(); eitr != sitr->second.end(); eitr++)
+                fv.push_back(eitr->_pfid_lock & ~EMAP_LOCK_FLAG);
+    }
+}
+
+// private
+
+// Every rid is held by the segment with the highest base rid not above it.
+enq_map::emap_entry*
+enq_map::find(const u_int64_t rid, emap_itr& sitr, emap_seg_itr& eitr)
+{
+    sitr = _map.upper_bound(rid);
+    if (sitr == _map.begin())
+        return 0;
+    --sitr;
+    const u_int64_t offs = rid - sitr->first;
+    if (offs > 0xffffffffULL)
+        return 0;
+    eitr = std::lower_bound(sitr->second.begin(), sitr->second.end(), u_int32_t(offs));
+    if (eitr == sitr->second.end() || eitr->_rid_offs != offs)
+        return 0;
+    return &*eitr;
+}
+
+bool
+enq_map::insert(const u_int64_t rid, const u_int16_t pfid_lock)
+{
+    emap_itr sitr = _map.upper_bound(rid);
+    if (sitr == _map.begin())
+    {
+        // rid precedes every segment: move the first segment's base down to it if there is room,
+        // otherwise start a segment of its own
+        if (sitr != _map.end() && sitr->second.size() < EMAP_SEG_MAX &&
+                sitr->first + sitr->second.back()._rid_offs - rid <= 0xffffffffULL)
+        {
+            emap_seg seg;
+            seg.reserve(sitr->second.size() + 1);
+            seg.push_back(emap_entry(0, pfid_lock));
+            const u_int32_t delta = u_int32_t(sitr->first - rid);
+            for (emap_seg_itr eitr = sitr->second.begin(); eitr != sitr->second.end(); eitr++)
+                seg.push_back(emap_entry(eitr->_rid_offs + delta, eitr->_pfid_lock));
+            _map.erase(sitr);
+            _map[rid].swap(seg);
+        }
+        else
+            _map[rid].push_back(emap_entry(0, pfid_lock));
+        _size++;
+        return true;
+    }
+    --sitr;
+    const u_int64_t offs = rid - sitr->first;
+    if (offs > 0xffffffffULL)
+    {
+        // Too far past the segment's base: it can only be the first rid of a new segment
+        emap_seg& seg = _map.insert(sitr, emap::value_type(rid, emap_seg()))->second;
+        seg.push_back(emap_entry(0, pfid_lock));
+        _size++;
+        return true;
+    }
+    emap_seg& seg = sitr->second;
+    emap_seg_itr eitr = seg.end();
+    if (!seg.empty() && seg.back()._rid_offs >= offs) // not an append
+    {
+        eitr = std::lower_bound(seg.begin(), seg.end(), u_int32_t(offs));
+        if (eitr->_rid_offs == offs)
+            return false;
+    }
+    if (seg.size() < EMAP_SEG_MAX)
+    {
+        seg.insert(eitr, emap_entry(u_int32_t(offs), pfid_lock));
+        _size++;
+        return true;
     }
+    if (eitr == seg.end())
+    {
+        // Appending to a full segment: start the next one
+        _map.insert(sitr, emap::value_type(rid, emap_seg()))->second.push_back(emap_entry(0, pfid_lock));
+        _size++;
+        return true;
+    }
+    // Inserting into a full segment: move its upper half to a new segment, then insert
+    const size_t half = seg.size() / 2;
+    const u_int64_t base = sitr->first + seg[half]._rid_offs;
+    emap_seg& upper = _map.insert(sitr, emap::value_type(base, emap_seg()))->second;
+    upper.reserve(EMAP_SEG_MAX);
+    for (emap_seg_itr i = seg.begin() + half; i != seg.end(); i++)
+        upper.push_back(emap_entry(u_int32_t(sitr->first + i->_rid_offs - base), i->_pfid_lock));
+    seg.erase(seg.begin() + half, seg.end());
+    return insert(rid, pfid_lock);
+}
+
+void
+enq_map::erase(emap_itr sitr, emap_seg_itr eitr)
+{
+    sitr->second.erase(eitr);
+    if (sitr->second.empty())
+        _map.erase(sitr);
+    _size--;
 }
 
 } // namespace journal
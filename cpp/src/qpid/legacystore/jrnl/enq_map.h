@@ -71,6 +71,12 @@ namespace journal
     *   rid3 --- [ pfid, txn_lock ]
     *   ...
     * </pre>
+    *
+    * As rids are handed out in ascending order, the map holds them in segments: sorted arrays of
+    * at most EMAP_SEG_MAX entries, each entry being the rid's offset from the segment's base rid
+    * together with the pfid and lock flag packed into 16 bits. Segments are looked up by base rid.
+    * An entry takes 8 bytes, rather than a tree node per rid; appending to the last segment, the
+    * usual case, costs no allocation beyond the segment's own growth.
     */
     class enq_map
     {
@@ -85,20 +91,32 @@ namespace journal
 
     private:
 
-        struct emap_data_struct
+        static const u_int16_t EMAP_LOCK_FLAG = 0x8000;
+        static const size_t EMAP_SEG_MAX = 512;
+
+        struct emap_entry
         {
-            u_int16_t   _pfid;
-            bool        _lock;
-            emap_data_struct(const u_int16_t pfid, const bool lock) : _pfid(pfid), _lock(lock) {}
+            u_int32_t   _rid_offs;  ///< rid less the segment's base rid
+            u_int16_t   _pfid_lock; ///< pfid, with EMAP_LOCK_FLAG set if locked
+            emap_entry(const u_int32_t rid_offs, const u_int16_t pfid_lock) :
+                    _rid_offs(rid_offs), _pfid_lock(pfid_lock) {}
+            inline bool operator<(const u_int32_t rid_offs) const { return _rid_offs < rid_offs; }
         };
-        typedef std::pair<u_int64_t, emap_data_struct> emap_param;
-        typedef std::map<u_int64_t, emap_data_struct> emap;
+        typedef std::vector<emap_entry> emap_seg;
+        typedef emap_seg::iterator emap_seg_itr;
+        typedef std::map<u_int64_t, emap_seg> emap; // base rid -> segment
         typedef emap::iterator emap_itr;
 
         emap _map;
+        u_int32_t _size;
         smutex _mutex;
         std::vector<u_int32_t> _pfid_enq_cnt;
 
+        emap_entry* find(const u_int64_t rid, emap_itr& sitr, emap_seg_itr& eitr);
+        inline emap_entry* find(const u_int64_t rid) { emap_itr sitr; emap_seg_itr eitr; return find(rid, sitr, eitr); }
+        bool insert(const u_int64_t rid, const u_int16_t pfid_lock);
+        void erase(emap_itr sitr, emap_seg_itr eitr);
+
     public:
         enq_map();
         virtual ~enq_map();
@@ -114,9 +132,9 @@ namespace journal
         int16_t lock(const u_int64_t rid); // 0=ok; -1=rid not found
         int16_t unlock(const u_int64_t rid); // 0=ok; -1=rid not found
         int16_t is_locked(const u_int64_t rid); // 1=true; 0=false; -1=rid not found
-        inline void clear() { _map.clear(); }
-        inline bool empty() const { return _map.empty(); }
-        inline u_int32_t size() const { return u_int32_t(_map.size()); }
+        inline void clear() { _map.clear(); _size = 0; }
+        inline bool empty() const { return _size == 0; }
+        inline u_int32_t size() const { return _size; }
         void rid_list(std::vector<u_int64_t>& rv);
         void pfid_list(std::vector<u_int16_t>& fv);
     };
@@ -52,6 +52,7 @@ enq_rec::enq_rec():
         _enq_hdr(RHM_JDAT_ENQ_MAGIC, RHM_JDAT_VERSION, 0, 0, 0, false, false),
         _xidp(0),
         _data(0),
+        _src(0),
         _buff(0),
         _enq_tail(_enq_hdr)
 {}
@@ -63,6 +64,7 @@ enq_rec::enq_rec(const u_int64_t rid, const void* const dbuf, const std::size_t
         _enq_hdr(RHM_JDAT_ENQ_MAGIC, RHM_JDAT_VERSION, rid, xidlen, dlen, owi, transient),
         _xidp(xidp),
         _data(dbuf),
+        _src(0),
         _buff(0),
         _enq_tail(_enq_hdr)
 {}
@@ -84,6 +86,7 @@ enq_rec::reset()
     _enq_hdr._dsize = 0;
     _xidp = 0;
     _data = 0;
+    _src = 0;
     _buff = 0;
     _enq_tail._rid = 0;
 }
@@ -93,7 +96,7 @@ enq_rec::reset()
 void
 enq_rec::reset(const u_int64_t rid, const void* const dbuf, const std::size_t dlen,
         const void* const xidp, const std::size_t xidlen, const bool owi, const bool transient,
-        const bool external)
+        const bool external, data_src* const srcp)
 {
     _enq_hdr._rid = rid;
     _enq_hdr.set_owi(owi);
@@ -103,6 +106,7 @@ enq_rec::reset(const u_int64_t rid, const void* const dbuf, const std::size_t dl
     _enq_hdr._dsize = dlen;
     _xidp = xidp;
     _data = dbuf;
+    _src = srcp;
     _buff = 0;
     _enq_tail._rid = rid;
 }
@@ -142,7 +146,7 @@ enq_rec::encode(void* wptr, u_int32_t rec_offs_dblks, u_int32_t max_size_dblks)
                 {
                     if (wsize > rem)
                         wsize = rem;
-                    std::memcpy((char*)wptr + wr_cnt, (const char*)_data + rec_offs, wsize);
+                    write_data((char*)wptr + wr_cnt, rec_offs, wsize);
                     wr_cnt += wsize;
                     rem -= wsize;
                 }
@@ -178,7 +182,7 @@ enq_rec::encode(void* wptr, u_int32_t rec_offs_dblks, u_int32_t max_size_dblks)
             wsize = _enq_hdr._dsize > rec_offs ? _enq_hdr._dsize - rec_offs : 0;
             if (wsize && !_enq_hdr.is_external())
             {
-                std::memcpy((char*)wptr + wr_cnt, (const char*)_data + rec_offs, wsize);
+                write_data((char*)wptr + wr_cnt, rec_offs, wsize);
                 wr_cnt += wsize;
             }
             rec_offs -= _enq_hdr._dsize - wsize;
@@ -216,7 +220,7 @@ enq_rec::encode(void* wptr, u_int32_t rec_offs_dblks, u_int32_t max_size_dblks)
             if (rem && !_enq_hdr.is_external())
             {
                 wsize = rem >= _enq_hdr._dsize ? _enq_hdr._dsize : rem;
-                std::memcpy((char*)wptr + wr_cnt, _data, wsize);
+                write_data((char*)wptr + wr_cnt, 0, wsize);
                 wr_cnt += wsize;
                 rem -= wsize;
             }
@@ -238,7 +242,7 @@ enq_rec::encode(void* wptr, u_int32_t rec_offs_dblks, u_int32_t max_size_dblks)
             }
             if (!_enq_hdr.is_external())
             {
-                std::memcpy((char*)wptr + wr_cnt, _data, _enq_hdr._dsize);
+                write_data((char*)wptr + wr_cnt, 0, _enq_hdr._dsize);
                 wr_cnt += _enq_hdr._dsize;
             }
             std::memcpy((char*)wptr + wr_cnt, (void*)&_enq_tail, sizeof(_enq_tail));
@@ -600,6 +604,15 @@ enq_rec::set_rid(const u_int64_t rid)
     _enq_tail._rid = rid;
 }
 
+void
+enq_rec::write_data(void* wptr, const std::size_t offs, const std::size_t size)
+{
+    if (_src)
+        _src->write(wptr, offs, size);
+    else
+        std::memcpy(wptr, (const char*)_data + offs, size);
+}
+
 void
 enq_rec::chk_hdr() const
 {
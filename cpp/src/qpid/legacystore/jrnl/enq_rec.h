@@ -40,6 +40,7 @@ class enq_rec;
 }
 
 #include <cstddef>
+#include "qpid/legacystore/jrnl/data_src.h"
 #include "qpid/legacystore/jrnl/enq_hdr.h"
 #include "qpid/legacystore/jrnl/jrec.h"
 
@@ -58,6 +59,7 @@ namespace journal
         enq_hdr _enq_hdr;
         const void* _xidp;          ///< xid pointer for encoding (for writing to disk)
         const void* _data;          ///< Pointer to data to be written to disk
+        data_src* _src;             ///< Source of data to be written to disk, if not _data
         void* _buff;                ///< Pointer to buffer to receive data read from disk
         rec_tail _enq_tail;
 
@@ -80,10 +82,11 @@ namespace journal
 
         // Prepare instance for use in reading data from journal, xid and data will be allocated
         void reset();
-        // Prepare instance for use in writing data to journal
+        // Prepare instance for use in writing data to journal; the data comes from srcp if set,
+        // otherwise from dbuf
         void reset(const u_int64_t rid, const void* const dbuf, const std::size_t dlen,
                 const void* const xidp, const std::size_t xidlen, const bool owi, const bool transient,
-                const bool external);
+                const bool external, data_src* const srcp = 0);
 
         u_int32_t encode(void* wptr, u_int32_t rec_offs_dblks, u_int32_t max_size_dblks);
         u_int32_t decode(rec_hdr& h, void* rptr, u_int32_t rec_offs_dblks,
@@ -104,6 +107,7 @@ namespace journal
         void set_rid(const u_int64_t rid);
 
     private:
+        void write_data(void* wptr, const std::size_t offs, const std::size_t size);
         void chk_hdr() const;
         void chk_hdr(u_int64_t rid) const;
         void chk_tail() const;
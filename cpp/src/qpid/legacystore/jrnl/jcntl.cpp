@@ -234,6 +234,19 @@ jcntl::enqueue_extern_data_record(const std::size_t tot_data_len, data_tok* dtok
     return r;
 }
 
+iores
+jcntl::enqueue_data_record(data_src& src, const std::size_t tot_data_len, data_tok* dtokp, const bool transient)
+{
+    iores r;
+    check_wstatus("enqueue_data_record");
+    {
+        slock s(_wr_mutex);
+        while (handle_aio_wait(_wmgr.enqueue(0, tot_data_len, tot_data_len, dtokp, 0, 0, transient, false, &src), r,
+                        dtokp)) ;
+    }
+    return r;
+}
+
 iores
 jcntl::enqueue_txn_data_record(const void* const data_buff, const std::size_t tot_data_len,
         const std::size_t this_data_len, data_tok* dtokp, const std::string& xid,
@@ -263,6 +276,20 @@ jcntl::enqueue_extern_txn_data_record(const std::size_t tot_data_len, data_tok*
     return r;
 }
 
+iores
+jcntl::enqueue_txn_data_record(data_src& src, const std::size_t tot_data_len, data_tok* dtokp,
+        const std::string& xid, const bool transient)
+{
+    iores r;
+    check_wstatus("enqueue_tx_data_record");
+    {
+        slock s(_wr_mutex);
+        while (handle_aio_wait(_wmgr.enqueue(0, tot_data_len, tot_data_len, dtokp, xid.data(), xid.size(),
+                        transient, false, &src), r, dtokp)) ;
+    }
+    return r;
+}
+
 /* TODO
 iores
 jcntl::get_data_record(const u_int64_t& rid, const std::size_t& dsize, const std::size_t& dsize_avail,
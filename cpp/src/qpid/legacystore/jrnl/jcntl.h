@@ -307,6 +307,23 @@ namespace journal
         iores enqueue_extern_data_record(const std::size_t tot_data_len, data_tok* dtokp,
                 const bool transient = false);
 
+        /**
+        * \brief Enqueue data written into the write cache by its source.
+        *
+        * As enqueue_data_record() for data enqueued in one part, except that instead of being
+        * copied in from a buffer the data is asked of src a piece at a time as each page of the
+        * write cache is filled, so its owner can encode it straight into the cache.
+        *
+        * \param src Source of the data to be enqueued; it is not used after this call returns.
+        * \param tot_data_len Total data length.
+        * \param dtokp Pointer to data token which contains the details of the enqueue operation.
+        * \param transient Flag indicating transient persistence (ie, ignored on recover).
+        *
+        * \exception TODO
+        */
+        iores enqueue_data_record(data_src& src, const std::size_t tot_data_len, data_tok* dtokp,
+                const bool transient = false);
+
         /**
         * \brief Enqueue data.
         *
@@ -325,6 +342,8 @@ namespace journal
                 const bool transient = false);
         iores enqueue_extern_txn_data_record(const std::size_t tot_data_len, data_tok* dtokp,
                 const std::string& xid, const bool transient = false);
+        iores enqueue_txn_data_record(data_src& src, const std::size_t tot_data_len, data_tok* dtokp,
+                const std::string& xid, const bool transient = false);
 
         /* TODO
         **
@@ -120,7 +120,7 @@ wmgr::initialize(aio_callback* const cbp, const u_int32_t wcache_pgsize_sblks,
 iores
 wmgr::enqueue(const void* const data_buff, const std::size_t tot_data_len,
         const std::size_t this_data_len, data_tok* dtokp, const void* const xid_ptr,
-        const std::size_t xid_len, const bool transient, const bool external)
+        const std::size_t xid_len, const bool transient, const bool external, data_src* const srcp)
 {
     if (xid_len)
         assert(xid_ptr != 0);
@@ -150,7 +150,7 @@ wmgr::enqueue(const void* const data_buff, const std::size_t tot_data_len,
 
     u_int64_t rid = (dtokp->external_rid() | cont) ? dtokp->rid() : _wrfc.get_incr_rid();
     _enq_rec.reset(rid, data_buff, tot_data_len, xid_ptr, xid_len, _wrfc.owi(), transient,
-            external);
+            external, srcp);
     if (!cont)
     {
         dtokp->set_rid(rid);
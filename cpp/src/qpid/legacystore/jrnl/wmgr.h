@@ -42,6 +42,7 @@ class wmgr;
 }
 
 #include <cstring>
+#include "qpid/legacystore/jrnl/data_src.h"
 #include "qpid/legacystore/jrnl/enums.h"
 #include "qpid/legacystore/jrnl/pmgr.h"
 #include "qpid/legacystore/jrnl/wrfc.h"
@@ -109,7 +110,8 @@ namespace journal
                 const u_int32_t max_iowait_us, std::size_t eo = 0);
         iores enqueue(const void* const data_buff, const std::size_t tot_data_len,
                 const std::size_t this_data_len, data_tok* dtokp, const void* const xid_ptr,
-                const std::size_t xid_len, const bool transient, const bool external);
+                const std::size_t xid_len, const bool transient, const bool external,
+                data_src* const srcp = 0);
         iores dequeue(data_tok* dtokp, const void* const xid_ptr, const std::size_t xid_len,
                 const bool txn_coml_commit);
         iores abort(data_tok* dtokp, const void* const xid_ptr, const std::size_t xid_len);
@@ -0,0 +1,355 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <sstream>
+#include <qpid/log/Statement.h>
+#include <qpid/store/StoreException.h>
+#include <qpid/sys/Runnable.h>
+#include <qpid/sys/StrError.h>
+#include <qpid/sys/SystemInfo.h>
+#include <qpid/sys/Thread.h>
+
+#include "Log.h"
+
+namespace qpid {
+namespace store {
+namespace mmap_log {
+
+namespace {
+
+const char SegmentSuffix[] = ".seg";
+
+// Part of a segment written since it was last synced
+struct Dirty {
+    Segment::shared_ptr segment;
+    uint32_t from;
+    uint32_t to;
+};
+
+/*
+ * Reads and checks a set of segments on a number of threads; each takes
+ * the next segment not yet started until there are none left.
+ */
+class Scanner : public qpid::sys::Runnable {
+    std::vector<Segment::shared_ptr>& segments;
+    std::vector<Segment::RecordList>& found;
+    std::vector<bool>& clean;
+    qpid::sys::Mutex lock;
+    size_t next;
+    std::string failure;
+
+public:
+    Scanner(std::vector<Segment::shared_ptr>& s,
+            std::vector<Segment::RecordList>& f,
+            std::vector<bool>& c)
+        : segments(s), found(f), clean(c), next(0) {}
+
+    void run() {
+        for (;;) {
+            size_t i;
+            {
+                qpid::sys::Mutex::ScopedLock l(lock);
+                if (next == segments.size() || !failure.empty())
+                    return;
+                i = next++;
+            }
+            try {
+                clean[i] = segments[i]->scan(found[i]);
+            }
+            catch (const std::exception& e) {
+                qpid::sys::Mutex::ScopedLock l(lock);
+                failure = e.what();
+            }
+        }
+    }
+
+    const std::string& getFailure() const { return failure; }
+};
+
+}
+
+Log::Log() : segmentSize(0)
+{
+}
+
+Log::~Log()
+{
+}
+
+void
+Log::open(const std::string& d,
+          uint32_t size,
+          uint16_t threads,
+          RecordList& records)
+{
+    dir = d;
+    segmentSize = size;
+    if (::mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+        THROW_STORE_EXCEPTION("Cannot create log directory " + dir + ": " +
+                              qpid::sys::strError(errno));
+    DIR* dp = ::opendir(dir.c_str());
+    if (dp == 0)
+        THROW_STORE_EXCEPTION("Cannot read log directory " + dir + ": " +
+                              qpid::sys::strError(errno));
+    std::vector<std::string> names;
+    while (struct dirent* e = ::readdir(dp)) {
+        std::string name(e->d_name);
+        if (name.size() > sizeof(SegmentSuffix) - 1 &&
+            name.compare(name.size() - (sizeof(SegmentSuffix) - 1),
+                         std::string::npos, SegmentSuffix) == 0)
+            names.push_back(name);
+    }
+    ::closedir(dp);
+    std::sort(names.begin(), names.end());    // Zero padded, so in sequence
+
+    std::vector<Segment::shared_ptr> opened;
+    for (std::vector<std::string>::const_iterator i = names.begin();
+         i != names.end();
+         ++i) {
+        opened.push_back(Segment::open(dir + "/" + *i));
+    }
+    std::vector<Segment::RecordList> found(opened.size());
+    std::vector<bool> clean(opened.size(), true);
+    Scanner scanner(opened, found, clean);
+    if (threads == 0)
+        threads = static_cast<uint16_t>(std::max(qpid::sys::SystemInfo::concurrency(), 1L));
+    if (threads > opened.size())
+        threads = static_cast<uint16_t>(opened.size());
+    if (threads <= 1) {
+        scanner.run();
+    }
+    else {
+        std::vector<qpid::sys::Thread> workers;
+        for (uint16_t i = 0; i < threads; ++i)
+            workers.push_back(qpid::sys::Thread(scanner));
+        for (std::vector<qpid::sys::Thread>::iterator i = workers.begin();
+             i != workers.end();
+             ++i)
+            i->join();
+    }
+    if (!scanner.getFailure().empty())
+        THROW_STORE_EXCEPTION(scanner.getFailure());
+
+    for (size_t i = 0; i < opened.size(); ++i) {
+        Segment::shared_ptr s = opened[i];
+        if (!clean[i]) {
+            QPID_LOG(warning, "MMAP-LOG: " << s->getPath()
+                     << " has a damaged record at offset " << s->getWriteOffset()
+                     << (i + 1 == opened.size() ? "; the last write before the broker stopped was torn"
+                                                : "; records after it are lost"));
+        }
+        for (Segment::RecordList::const_iterator j = found[i].begin();
+             j != found[i].end();
+             ++j) {
+            Record r;
+            r.location = location(s->getSequence(), j->offset);
+            r.type = j->type;
+            r.length = j->length;
+            r.body = j->body;
+            records.push_back(r);
+            s->live += Segment::recordSize(j->length);
+        }
+        segments[s->getSequence()] = s;
+    }
+    QPID_LOG(info, "MMAP-LOG: Read " << records.size() << " records from "
+             << opened.size() << " segments in " << dir << " using "
+             << std::max(threads, static_cast<uint16_t>(1)) << " threads");
+    newHead();
+}
+
+Log::Location
+Log::append(uint16_t type, const char* body, uint32_t length, bool live)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    uint32_t offset = head->append(type, body, length);
+    if (offset == 0) {
+        newHead();
+        offset = head->append(type, body, length);
+        if (offset == 0) {
+            std::ostringstream oss;
+            oss << "A record of " << length << " bytes does not fit in a "
+                << segmentSize << " byte log segment";
+            THROW_STORE_EXCEPTION(oss.str());
+        }
+    }
+    if (live)
+        head->live += Segment::recordSize(length);
+    return location(head->getSequence(), offset);
+}
+
+Log::Record
+Log::read(Location loc)
+{
+    Segment::shared_ptr s;
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        s = find(loc);
+    }
+    if (!s) {
+        std::ostringstream oss;
+        oss << "No log segment " << sequenceOf(loc) << " for a record";
+        THROW_STORE_EXCEPTION(oss.str());
+    }
+    Segment::Record sr = s->read(offsetOf(loc));
+    Record r;
+    r.location = loc;
+    r.type = sr.type;
+    r.length = sr.length;
+    r.body = sr.body;
+    return r;
+}
+
+void
+Log::kill(Location loc)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    Segment::shared_ptr s = find(loc);
+    if (s)
+        s->live -= Segment::recordSize(s->read(offsetOf(loc)).length);
+}
+
+void
+Log::sync()
+{
+    qpid::sys::Mutex::ScopedLock sl(syncLock);
+    std::vector<Dirty> dirty;
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        for (SegmentMap::const_iterator i = segments.begin();
+             i != segments.end();
+             ++i) {
+            if (i->second->synced < i->second->getWriteOffset()) {
+                Dirty d = { i->second, i->second->synced, i->second->getWriteOffset() };
+                dirty.push_back(d);
+            }
+        }
+    }
+    // Appends carry on while the pages are written; each segment is only
+    // marked synced up to where it had reached when the sync started.
+    for (std::vector<Dirty>::iterator i = dirty.begin(); i != dirty.end(); ++i)
+        i->segment->sync(i->from, i->to);
+    qpid::sys::Mutex::ScopedLock l(lock);
+    for (std::vector<Dirty>::iterator i = dirty.begin(); i != dirty.end(); ++i)
+        i->segment->synced = std::max(i->segment->synced, i->to);
+}
+
+Log::Usage
+Log::getUsage()
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    Usage u = { segments.size() - 1, 0, 0 };
+    for (SegmentMap::const_iterator i = segments.begin();
+         i != segments.end();
+         ++i) {
+        if (i->second == head)
+            continue;
+        u.size += i->second->getSize();
+        u.live += i->second->live;
+    }
+    return u;
+}
+
+bool
+Log::getOldest(uint32_t& sequence, uint64_t& live)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    SegmentMap::const_iterator i = segments.begin();
+    if (i->second == head)
+        return false;
+    sequence = i->first;
+    live = i->second->live;
+    return true;
+}
+
+void
+Log::getRecords(uint32_t sequence, RecordList& records)
+{
+    Segment::shared_ptr s;
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        SegmentMap::const_iterator i = segments.find(sequence);
+        if (i == segments.end() || i->second == head)
+            return;
+        s = i->second;
+    }
+    // Nothing more is appended to a segment once it is no longer the head
+    Segment::RecordList found;
+    s->list(found);
+    for (Segment::RecordList::const_iterator j = found.begin();
+         j != found.end();
+         ++j) {
+        Record r;
+        r.location = location(sequence, j->offset);
+        r.type = j->type;
+        r.length = j->length;
+        r.body = j->body;
+        records.push_back(r);
+    }
+}
+
+void
+Log::drop(uint32_t sequence)
+{
+    Segment::shared_ptr s;
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        SegmentMap::iterator i = segments.find(sequence);
+        if (i == segments.end() || i->second == head)
+            return;
+        s = i->second;
+        segments.erase(i);
+    }
+    s->remove();
+}
+
+std::string
+Log::segmentPath(uint32_t sequence) const
+{
+    char name[32];
+    ::snprintf(name, sizeof(name), "%010u%s", sequence, SegmentSuffix);
+    return dir + "/" + name;
+}
+
+// Called with lock held, or before the log is shared.
+void
+Log::newHead()
+{
+    uint32_t sequence = segments.empty() ? 1 : segments.rbegin()->first + 1;
+    head = Segment::create(segmentPath(sequence), sequence, segmentSize);
+    segments[sequence] = head;
+}
+
+// Called with lock held.
+Segment::shared_ptr
+Log::find(Location loc)
+{
+    SegmentMap::const_iterator i = segments.find(sequenceOf(loc));
+    return i == segments.end() ? Segment::shared_ptr() : i->second;
+}
+
+}}}  // namespace qpid::store::mmap_log
@@ -0,0 +1,141 @@
+#ifndef QPID_STORE_MMAPLOG_LOG_H
+#define QPID_STORE_MMAPLOG_LOG_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+#include <qpid/sys/IntegerTypes.h>
+#include <qpid/sys/Mutex.h>
+
+#include "Segment.h"
+
+namespace qpid {
+namespace store {
+namespace mmap_log {
+
+/**
+ * @class Log
+ *
+ * An append-only log kept as a directory of fixed size Segment files,
+ * named by sequence number. Records are appended to the newest segment,
+ * the head; when it is full a new head is started.
+ *
+ * The log does not know what its records mean. Its user says which
+ * records it still needs: a record counts as live from when it is
+ * appended (or recovered) until kill() is called for it. Space is
+ * reclaimed a segment at a time, oldest first: the user appends again
+ * whatever is still live in the oldest segment, then drops it.
+ */
+class Log {
+
+public:
+    /// Where a record is: segment sequence number above, offset below.
+    typedef uint64_t Location;
+
+    static Location location(uint32_t sequence, uint32_t offset)
+        { return (static_cast<uint64_t>(sequence) << 32) | offset; }
+    static uint32_t sequenceOf(Location l) { return static_cast<uint32_t>(l >> 32); }
+    static uint32_t offsetOf(Location l) { return static_cast<uint32_t>(l); }
+
+    struct Record {
+        Location location;
+        uint16_t type;
+        uint32_t length;
+        const char* body;
+    };
+    typedef std::vector<Record> RecordList;
+
+    /// How full the segments other than the head are.
+    struct Usage {
+        size_t segments;
+        uint64_t size;        // Bytes in those segments
+        uint64_t live;        // Bytes held by their live records
+    };
+
+    Log();
+    ~Log();
+
+    /**
+     * Open the log in dir, creating it if need be, and return every record
+     * in it in the order written. Up to threads segments are read and
+     * checked at once; 0 means one per CPU. Appends go to a new segment of
+     * segmentSize bytes, so a tail torn by a crash is never written over.
+     */
+    void open(const std::string& dir,
+              uint32_t segmentSize,
+              uint16_t threads,
+              RecordList& records);
+
+    /**
+     * Append a record at the head and return where it is. A record
+     * appended with live false is counted as dead from the start, as a
+     * record that only cancels earlier ones is. Nothing appended is
+     * durable until the next sync() returns.
+     */
+    Location append(uint16_t type, const char* body, uint32_t length, bool live = true);
+
+    /**
+     * The record at a location. The body stays valid until the record's
+     * segment is dropped, which the user controls.
+     */
+    Record read(Location l);
+
+    /// The record at the location is no longer needed.
+    void kill(Location l);
+
+    /// Write everything appended so far to disk.
+    void sync();
+
+    Usage getUsage();
+
+    /**
+     * The sequence number and live bytes of the oldest segment. Returns
+     * false if the head is the only segment.
+     */
+    bool getOldest(uint32_t& sequence, uint64_t& live);
+
+    /// Every record in a segment other than the head, live or not.
+    void getRecords(uint32_t sequence, RecordList& records);
+
+    /// Delete a segment other than the head.
+    void drop(uint32_t sequence);
+
+private:
+    typedef std::map<uint32_t, Segment::shared_ptr> SegmentMap;
+
+    qpid::sys::Mutex lock;
+    qpid::sys::Mutex syncLock;      // Held for the whole of a sync()
+    std::string dir;
+    uint32_t segmentSize;
+    SegmentMap segments;
+    Segment::shared_ptr head;
+
+    std::string segmentPath(uint32_t sequence) const;
+    void newHead();
+    Segment::shared_ptr find(Location l);
+};
+
+}}}  // namespace qpid::store::mmap_log
+
+#endif /* QPID_STORE_MMAPLOG_LOG_H */
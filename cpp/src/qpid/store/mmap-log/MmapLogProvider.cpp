@@ -0,0 +1,1562 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <qpid/Options.h>
+#include <qpid/broker/Broker.h>
+#include <qpid/broker/RecoverableExchange.h>
+#include <qpid/broker/RecoverableQueue.h>
+#include <qpid/framing/Buffer.h>
+#include <qpid/framing/FieldTable.h>
+#include <qpid/log/Statement.h>
+#include <qpid/store/MessageStorePlugin.h>
+#include <qpid/store/StoreException.h>
+#include <qpid/store/StorageProvider.h>
+#include <qpid/sys/Monitor.h>
+#include <qpid/sys/Mutex.h>
+#include <qpid/sys/Runnable.h>
+#include <qpid/sys/Thread.h>
+#include <qpid/sys/Time.h>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+#include "Log.h"
+
+namespace qpid {
+namespace store {
+namespace mmap_log {
+
+namespace {
+
+// Record types. Each body starts with the ids it concerns, encoded with
+// qpid::framing::Buffer.
+enum RecordType {
+    QueueRecord = 1,    // id, queue
+    ExchangeRecord,     // id, exchange
+    ConfigRecord,       // id, config
+    BindingRecord,      // exchange id, queue id, key, args
+    DeleteRecord,       // type of object, id
+    UnbindRecord,       // exchange id, queue id, key
+    MessageRecord,      // id, header size, message
+    EnqueueRecord,      // message id, queue id, transaction id or 0
+    DequeueRecord,      // message id, queue id, transaction id or 0
+    PrepareRecord,      // transaction id, xid
+    CommitRecord,       // transaction id
+    AbortRecord         // transaction id
+};
+
+const uint32_t MessagePrefix = sizeof(uint64_t) + sizeof(uint32_t);
+
+class Worker : public qpid::sys::Runnable {
+    boost::function<void()> work;
+public:
+    Worker(const boost::function<void()>& w) : work(w) {}
+    void run() { work(); }
+};
+
+class TransactionContext : public qpid::broker::TransactionContext {
+    uint64_t id;
+public:
+    TransactionContext(uint64_t i) : id(i) {}
+    uint64_t getId() const { return id; }
+};
+
+class TPCTransactionContext : public qpid::broker::TPCTransactionContext {
+    uint64_t id;
+    std::string xid;
+public:
+    TPCTransactionContext(uint64_t i, const std::string& x) : id(i), xid(x) {}
+    uint64_t getId() const { return id; }
+    const std::string& getXid() const { return xid; }
+};
+
+// The id of the store transaction behind a broker one, or 0 for none.
+uint64_t transactionId(qpid::broker::TransactionContext* ctxt)
+{
+    if (ctxt == 0)
+        return 0;
+    TransactionContext* ctx = dynamic_cast<TransactionContext*>(ctxt);
+    if (ctx)
+        return ctx->getId();
+    TPCTransactionContext* tctx = dynamic_cast<TPCTransactionContext*>(ctxt);
+    if (tctx)
+        return tctx->getId();
+    throw qpid::broker::InvalidTransactionContextException();
+}
+
+}
+
+/**
+ * @class MmapLogProvider
+ *
+ * Implements a qpid::store::StorageProvider that keeps everything in one
+ * append-only Log of memory mapped segment files. Every change to the
+ * store is a record appended at the head of the log; an in-memory index
+ * says which records are still current. On startup the segments are
+ * read back and their records replayed, in the order written, to rebuild
+ * the index.
+ *
+ * Creating and deleting queues, exchanges, bindings and configuration,
+ * and ending transactions, sync the log before returning. Enqueues and
+ * dequeues are completed by a separate thread, which syncs everything
+ * appended since its last sync at once.
+ *
+ * A compaction thread reclaims space: when little of the oldest segment,
+ * or of the log as a whole, is still current, the records in the oldest
+ * segment that the index still points to are appended again at the head
+ * and the segment is deleted. Only ever deleting the oldest segment means
+ * a record that cancels another, such as a dequeue, never outlives it.
+ */
+class MmapLogProvider : public qpid::store::StorageProvider
+{
+protected:
+    void finalizeMe();
+
+public:
+    MmapLogProvider();
+    ~MmapLogProvider();
+
+    virtual qpid::Options* getOptions() { return &options; }
+
+    virtual void earlyInitialize (Plugin::Target& target);
+    virtual void initialize(Plugin::Target& target);
+
+    /**
+     * Receive notification that this provider is the one that will actively
+     * handle provider storage for the target. If the provider is to be used,
+     * this method will be called after earlyInitialize() and before any
+     * recovery operations (recovery, in turn, precedes call to initialize()).
+     */
+    virtual void activate(MessageStorePlugin &store);
+
+    /**
+     * @name Methods inherited from qpid::broker::MessageStore
+     */
+    //@{
+    virtual void create(PersistableQueue& queue,
+                        const qpid::framing::FieldTable& args);
+    virtual void destroy(PersistableQueue& queue);
+    virtual void create(const PersistableExchange& exchange,
+                        const qpid::framing::FieldTable& args);
+    virtual void destroy(const PersistableExchange& exchange);
+    virtual void bind(const PersistableExchange& exchange,
+                      const PersistableQueue& queue,
+                      const std::string& key,
+                      const qpid::framing::FieldTable& args);
+    virtual void unbind(const PersistableExchange& exchange,
+                        const PersistableQueue& queue,
+                        const std::string& key,
+                        const qpid::framing::FieldTable& args);
+    virtual void create(const PersistableConfig& config);
+    virtual void destroy(const PersistableConfig& config);
+    virtual void stage(const boost::intrusive_ptr<PersistableMessage>& msg);
+    virtual void destroy(PersistableMessage& msg);
+    virtual void appendContent(const boost::intrusive_ptr<const PersistableMessage>& msg,
+                               const std::string& data);
+    virtual void loadContent(const qpid::broker::PersistableQueue& queue,
+                             const boost::intrusive_ptr<const PersistableMessage>& msg,
+                             std::string& data,
+                             uint64_t offset,
+                             uint32_t length);
+    virtual void enqueue(qpid::broker::TransactionContext* ctxt,
+                         const boost::intrusive_ptr<PersistableMessage>& msg,
+                         const PersistableQueue& queue);
+    virtual void dequeue(qpid::broker::TransactionContext* ctxt,
+                         const boost::intrusive_ptr<PersistableMessage>& msg,
+                         const PersistableQueue& queue);
+    virtual void flush(const qpid::broker::PersistableQueue& queue);
+    virtual uint32_t outstandingQueueAIO(const PersistableQueue& queue);
+    //@}
+
+    /**
+     * @name Methods inherited from qpid::broker::TransactionalStore
+     */
+    //@{
+    virtual std::auto_ptr<qpid::broker::TransactionContext> begin();
+    virtual std::auto_ptr<qpid::broker::TPCTransactionContext> begin(const std::string& xid);
+    virtual void prepare(qpid::broker::TPCTransactionContext& txn);
+    virtual void commit(qpid::broker::TransactionContext& txn);
+    virtual void abort(qpid::broker::TransactionContext& txn);
+    virtual void collectPreparedXids(std::set<std::string>& xids);
+    //@}
+
+    virtual void recoverConfigs(qpid::broker::RecoveryManager& recoverer);
+    virtual void recoverExchanges(qpid::broker::RecoveryManager& recoverer,
+                                  ExchangeMap& exchangeMap);
+    virtual void recoverQueues(qpid::broker::RecoveryManager& recoverer,
+                               QueueMap& queueMap);
+    virtual void recoverBindings(qpid::broker::RecoveryManager& recoverer,
+                                 const ExchangeMap& exchangeMap,
+                                 const QueueMap& queueMap);
+    virtual void recoverMessages(qpid::broker::RecoveryManager& recoverer,
+                                 MessageMap& messageMap,
+                                 MessageQueueMap& messageQueueMap);
+    virtual void recoverTransactions(qpid::broker::RecoveryManager& recoverer,
+                                     PreparedTransactionMap& dtxMap);
+
+private:
+    struct ProviderOptions : public qpid::Options
+    {
+        std::string storeDir;
+        uint32_t segmentSize;
+        uint16_t compactThreshold;
+        uint32_t compactInterval;
+        uint16_t recoveryThreads;
+
+        ProviderOptions(const std::string &name)
+            : qpid::Options(name),
+              segmentSize(64),
+              compactThreshold(50),
+              compactInterval(10),
+              recoveryThreads(0)
+        {
+            addOptions()
+                ("mmap-log-dir",
+                 qpid::optValue(storeDir, "DIR"),
+                 "Location of the log (default uses data-dir if available)")
+                ("mmap-log-segment-size",
+                 qpid::optValue(segmentSize, "MiB"),
+                 "Size of each log segment file; a message must fit in "
+                 "one segment")
+                ("mmap-log-compact-threshold",
+                 qpid::optValue(compactThreshold, "PERCENT"),
+                 "Compact the oldest segment when no more than this much "
+                 "of it, or of all but the newest segment, is still in use")
+                ("mmap-log-compact-interval",
+                 qpid::optValue(compactInterval, "SECONDS"),
+                 "How often to check whether the log needs compacting")
+                ("mmap-log-recovery-threads",
+                 qpid::optValue(recoveryThreads, "N"),
+                 "Threads reading log segments at startup "
+                 "(0 means one per CPU)")
+                ;
+        }
+    };
+
+    struct BindingKey {
+        uint64_t exchangeId;
+        uint64_t queueId;
+        std::string key;
+
+        bool operator<(const BindingKey& rhs) const {
+            if (exchangeId != rhs.exchangeId) return exchangeId < rhs.exchangeId;
+            if (queueId != rhs.queueId) return queueId < rhs.queueId;
+            return key < rhs.key;
+        }
+    };
+
+    struct MessageEntry {
+        Log::Location location;     // 0 until the message record is seen
+        uint32_t refs;              // Enqueues referring to it
+    };
+
+    // Message id, queue id
+    typedef std::pair<uint64_t, uint64_t> EnqueueKey;
+
+    struct EnqueueEntry {
+        Log::Location location;
+        uint64_t txn;               // Not yet committed if not 0
+        Log::Location dequeue;      // Dequeue pending in a transaction
+        uint64_t dequeueTxn;
+    };
+
+    struct TxnEntry {
+        std::string xid;
+        Log::Location prepare;      // 0 until prepared
+        std::vector<EnqueueKey> enqueued;
+        std::vector<EnqueueKey> dequeued;
+    };
+
+    // Enqueue or dequeue waiting for the log to be synced
+    struct Pending {
+        boost::intrusive_ptr<PersistableMessage> msg;
+        uint64_t queueId;
+        bool enqueue;
+    };
+
+    typedef std::map<uint64_t, Log::Location> ObjectIndex;
+    typedef std::map<BindingKey, Log::Location> BindingIndex;
+    typedef std::map<uint64_t, MessageEntry> MessageIndex;
+    typedef std::map<EnqueueKey, EnqueueEntry> EnqueueIndex;
+    typedef std::map<uint64_t, TxnEntry> TxnIndex;
+    typedef std::vector<Pending> PendingList;
+
+    ProviderOptions options;
+    qpid::broker::Broker* broker;
+    Log log;
+
+    // The index, and the order records are appended in
+    qpid::sys::Mutex lock;
+    ObjectIndex queues;
+    ObjectIndex exchanges;
+    ObjectIndex configs;
+    BindingIndex bindings;
+    MessageIndex messages;
+    EnqueueIndex enqueues;
+    TxnIndex txns;
+    uint64_t nextId;
+    uint64_t nextTxnId;
+
+    qpid::sys::Monitor syncMonitor;
+    PendingList pending;
+    std::map<uint64_t, uint32_t> outstanding;   // Pending count by queue
+    qpid::sys::Monitor compactMonitor;
+    bool stopping;
+    Worker syncer;
+    Worker compactor;
+    qpid::sys::Thread syncThread;
+    qpid::sys::Thread compactThread;
+
+    Log::Location append(uint16_t type, const std::vector<char>& body, bool live = true);
+    template <class T>
+    Log::Location appendObject(uint16_t type, uint64_t id, const T& object);
+    Log::Location appendDelete(uint16_t type, uint64_t id);
+    Log::Location appendEnqueue(uint16_t type, const EnqueueKey& key, uint64_t txn, bool live = true);
+    Log::Location appendTxn(uint16_t type, uint64_t txn, bool live = true);
+    void storeMessage(const boost::intrusive_ptr<PersistableMessage>& msg);
+    void addPending(const boost::intrusive_ptr<PersistableMessage>& msg,
+                    uint64_t queueId,
+                    bool enqueue);
+
+    // Index maintenance, shared by recovery and normal running. All are
+    // called with lock held.
+    void noteId(uint64_t id) { if (id >= nextId) nextId = id + 1; }
+    void noteTxn(uint64_t txn) { if (txn >= nextTxnId) nextTxnId = txn + 1; }
+    void setObject(ObjectIndex& index, uint64_t id, Log::Location loc);
+    void removeObject(ObjectIndex& index, uint64_t id);
+    void removeBinding(BindingIndex::iterator i);
+    void removeQueue(uint64_t id);
+    void removeExchange(uint64_t id);
+    MessageEntry& messageEntry(uint64_t id);
+    void release(uint64_t id);
+    void addEnqueue(const EnqueueKey& key, Log::Location loc, uint64_t txn);
+    void addDequeue(const EnqueueKey& key, Log::Location loc, uint64_t txn);
+    void removeEnqueue(EnqueueIndex::iterator i);
+    void commitTxn(TxnIndex::iterator i);
+    void abortTxn(TxnIndex::iterator i);
+
+    void replay(const Log::Record& r);
+    void finishRecovery();
+    template <class Recover>
+    void recoverObjects(const ObjectIndex& index, Recover recover);
+
+    void syncPending();
+    void compactLog();
+    void compact();
+    bool relocate(const Log::Record& r);
+    void stop();
+};
+
+static MmapLogProvider static_instance_registers_plugin;
+
+namespace {
+
+qpid::framing::Buffer bodyBuffer(const Log::Record& r)
+{
+    return qpid::framing::Buffer(const_cast<char*>(r.body), r.length);
+}
+
+}
+
+void
+MmapLogProvider::finalizeMe()
+{
+    stop();
+}
+
+MmapLogProvider::MmapLogProvider()
+    : options("MMAP Log Provider options"),
+      broker(0),
+      nextId(1),
+      nextTxnId(1),
+      stopping(false),
+      syncer(boost::bind(&MmapLogProvider::syncPending, this)),
+      compactor(boost::bind(&MmapLogProvider::compactLog, this))
+{
+}
+
+MmapLogProvider::~MmapLogProvider()
+{
+    stop();
+}
+
+void
+MmapLogProvider::earlyInitialize(Plugin::Target &target)
+{
+    MessageStorePlugin *store = dynamic_cast<MessageStorePlugin *>(&target);
+    if (store) {
+        // Check the store dir option; if not specified, need to
+        // grab the broker's data dir.
+        if (options.storeDir.empty()) {
+            DataDir& dir = store->getBroker()->getDataDir();
+            if (dir.isEnabled()) {
+                options.storeDir = dir.getPath() + "/mmap-log";
+            }
+            else {
+                QPID_LOG(error,
+                         "MMAP-LOG: --mmap-log-dir required if --no-data-dir specified");
+                return;
+            }
+        }
+        if (options.segmentSize == 0 || options.segmentSize >= 4096) {
+            QPID_LOG(error,
+                     "MMAP-LOG: --mmap-log-segment-size must be from 1 to 4095");
+            return;
+        }
+        if (options.compactThreshold == 0 || options.compactThreshold > 90) {
+            QPID_LOG(error,
+                     "MMAP-LOG: --mmap-log-compact-threshold must be from 1 to 90");
+            return;
+        }
+        broker = store->getBroker();
+        store->providerAvailable("MMAP-LOG", this);
+        store->addFinalizer(boost::bind(&MmapLogProvider::finalizeMe, this));
+    }
+}
+
+void
+MmapLogProvider::initialize(Plugin::Target& target)
+{
+    MessageStorePlugin *store = dynamic_cast<MessageStorePlugin *>(&target);
+    if (store && broker && !syncThread) {
+        syncThread = qpid::sys::Thread(syncer);
+        compactThread = qpid::sys::Thread(compactor);
+    }
+}
+
+void
+MmapLogProvider::activate(MessageStorePlugin &store)
+{
+    Log::RecordList records;
+    log.open(options.storeDir,
+             options.segmentSize * 1024 * 1024,
+             options.recoveryThreads,
+             records);
+    qpid::sys::Mutex::ScopedLock l(lock);
+    for (Log::RecordList::const_iterator i = records.begin();
+         i != records.end();
+         ++i)
+        replay(*i);
+    finishRecovery();
+    QPID_LOG(info, "MMAP Log Provider is up: " << queues.size() << " queues, "
+             << messages.size() << " messages, " << enqueues.size()
+             << " enqueues in " << options.storeDir);
+}
+
+void
+MmapLogProvider::create(PersistableQueue& queue,
+                        const qpid::framing::FieldTable& /*args*/)
+{
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        uint64_t id = nextId++;
+        queue.setPersistenceId(id);
+        queues[id] = appendObject(QueueRecord, id, queue);
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::destroy(PersistableQueue& queue)
+{
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        appendDelete(QueueRecord, queue.getPersistenceId());
+        removeQueue(queue.getPersistenceId());
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::create(const PersistableExchange& exchange,
+                        const qpid::framing::FieldTable& /*args*/)
+{
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        uint64_t id = nextId++;
+        exchange.setPersistenceId(id);
+        exchanges[id] = appendObject(ExchangeRecord, id, exchange);
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::destroy(const PersistableExchange& exchange)
+{
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        appendDelete(ExchangeRecord, exchange.getPersistenceId());
+        removeExchange(exchange.getPersistenceId());
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::bind(const PersistableExchange& exchange,
+                      const PersistableQueue& queue,
+                      const std::string& key,
+                      const qpid::framing::FieldTable& args)
+{
+    BindingKey k = { exchange.getPersistenceId(), queue.getPersistenceId(), key };
+    std::vector<char> body(2 * sizeof(uint64_t) + 2 + key.size() + args.encodedSize());
+    qpid::framing::Buffer b(&body[0], body.size());
+    b.putLongLong(k.exchangeId);
+    b.putLongLong(k.queueId);
+    b.putShortString(key);
+    args.encode(b);
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        BindingIndex::iterator i = bindings.find(k);
+        if (i != bindings.end())
+            log.kill(i->second);
+        bindings[k] = append(BindingRecord, body);
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::unbind(const PersistableExchange& exchange,
+                        const PersistableQueue& queue,
+                        const std::string& key,
+                        const qpid::framing::FieldTable& /*args*/)
+{
+    BindingKey k = { exchange.getPersistenceId(), queue.getPersistenceId(), key };
+    std::vector<char> body(2 * sizeof(uint64_t) + 2 + key.size());
+    qpid::framing::Buffer b(&body[0], body.size());
+    b.putLongLong(k.exchangeId);
+    b.putLongLong(k.queueId);
+    b.putShortString(key);
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        BindingIndex::iterator i = bindings.find(k);
+        if (i == bindings.end())
+            return;
+        append(UnbindRecord, body, false);
+        removeBinding(i);
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::create(const PersistableConfig& config)
+{
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        uint64_t id = nextId++;
+        config.setPersistenceId(id);
+        configs[id] = appendObject(ConfigRecord, id, config);
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::destroy(const PersistableConfig& config)
+{
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        appendDelete(ConfigRecord, config.getPersistenceId());
+        removeObject(configs, config.getPersistenceId());
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::stage(const boost::intrusive_ptr<PersistableMessage>& msg)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    storeMessage(msg);
+}
+
+void
+MmapLogProvider::destroy(PersistableMessage& msg)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    MessageIndex::iterator i = messages.find(msg.getPersistenceId());
+    if (i != messages.end() && i->second.refs == 0) {
+        log.kill(i->second.location);
+        messages.erase(i);
+    }
+}
+
+void
+MmapLogProvider::appendContent(const boost::intrusive_ptr<const PersistableMessage>& /*msg*/,
+                               const std::string& /*data*/)
+{
+    // A message is one record, written whole when it is first stored.
+    THROW_STORE_EXCEPTION("MMAP-LOG: appendContent() is not supported");
+}
+
+void
+MmapLogProvider::loadContent(const qpid::broker::PersistableQueue& /*queue*/,
+                             const boost::intrusive_ptr<const PersistableMessage>& msg,
+                             std::string& data,
+                             uint64_t offset,
+                             uint32_t length)
+{
+    // Copy while holding the lock: compaction may move the record and
+    // delete its segment as soon as the lock is released.
+    qpid::sys::Mutex::ScopedLock l(lock);
+    MessageIndex::const_iterator i = messages.find(msg->getPersistenceId());
+    if (i == messages.end() || i->second.location == 0) {
+        std::ostringstream oss;
+        oss << "MMAP-LOG: loadContent() failed: no message " << msg->getPersistenceId();
+        THROW_STORE_EXCEPTION(oss.str());
+    }
+    Log::Record r = log.read(i->second.location);
+    qpid::framing::Buffer b(bodyBuffer(r));
+    b.getLongLong();
+    uint32_t headerSize = b.getLong();
+    uint64_t contentStart = MessagePrefix + headerSize;
+    uint64_t contentSize = r.length - contentStart;
+    if (offset >= contentSize)
+        return;
+    data.assign(r.body + contentStart + offset,
+                std::min(static_cast<uint64_t>(length), contentSize - offset));
+}
+
+void
+MmapLogProvider::enqueue(qpid::broker::TransactionContext* ctxt,
+                         const boost::intrusive_ptr<PersistableMessage>& msg,
+                         const PersistableQueue& queue)
+{
+    uint64_t txn = transactionId(ctxt);
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        storeMessage(msg);
+        EnqueueKey key(msg->getPersistenceId(), queue.getPersistenceId());
+        addEnqueue(key, appendEnqueue(EnqueueRecord, key, txn), txn);
+        if (txn) {
+            noteTxn(txn);
+            txns[txn].enqueued.push_back(key);
+        }
+    }
+    addPending(msg, queue.getPersistenceId(), true);
+}
+
+void
+MmapLogProvider::dequeue(qpid::broker::TransactionContext* ctxt,
+                         const boost::intrusive_ptr<PersistableMessage>& msg,
+                         const PersistableQueue& queue)
+{
+    uint64_t txn = transactionId(ctxt);
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        EnqueueKey key(msg->getPersistenceId(), queue.getPersistenceId());
+        EnqueueIndex::iterator i = enqueues.find(key);
+        if (i != enqueues.end()) {
+            if (txn) {
+                addDequeue(key, appendEnqueue(DequeueRecord, key, txn), txn);
+                txns[txn].dequeued.push_back(key);
+            }
+            else {
+                appendEnqueue(DequeueRecord, key, 0, false);
+                removeEnqueue(i);
+            }
+        }
+    }
+    addPending(msg, queue.getPersistenceId(), false);
+}
+
+void
+MmapLogProvider::flush(const qpid::broker::PersistableQueue& /*queue*/)
+{
+    // The syncer is already awake if anything is pending.
+    qpid::sys::Monitor::ScopedLock l(syncMonitor);
+    syncMonitor.notify();
+}
+
+uint32_t
+MmapLogProvider::outstandingQueueAIO(const PersistableQueue& queue)
+{
+    qpid::sys::Monitor::ScopedLock l(syncMonitor);
+    std::map<uint64_t, uint32_t>::const_iterator i =
+        outstanding.find(queue.getPersistenceId());
+    return i == outstanding.end() ? 0 : i->second;
+}
+
+std::auto_ptr<qpid::broker::TransactionContext>
+MmapLogProvider::begin()
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    std::auto_ptr<qpid::broker::TransactionContext> tc(new TransactionContext(nextTxnId++));
+    return tc;
+}
+
+std::auto_ptr<qpid::broker::TPCTransactionContext>
+MmapLogProvider::begin(const std::string& xid)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    uint64_t txn = nextTxnId++;
+    txns[txn].xid = xid;
+    std::auto_ptr<qpid::broker::TPCTransactionContext> tc(new TPCTransactionContext(txn, xid));
+    return tc;
+}
+
+void
+MmapLogProvider::prepare(qpid::broker::TPCTransactionContext& txn)
+{
+    TPCTransactionContext *ctx = dynamic_cast<TPCTransactionContext*> (&txn);
+    if (ctx == 0)
+        throw qpid::broker::InvalidTransactionContextException();
+    std::vector<char> body(sizeof(uint64_t) + 4 + ctx->getXid().size());
+    qpid::framing::Buffer b(&body[0], body.size());
+    b.putLongLong(ctx->getId());
+    b.putLongString(ctx->getXid());
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        TxnEntry& t = txns[ctx->getId()];
+        t.xid = ctx->getXid();
+        if (t.prepare)
+            log.kill(t.prepare);
+        t.prepare = append(PrepareRecord, body);
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::commit(qpid::broker::TransactionContext& txn)
+{
+    uint64_t id = transactionId(&txn);
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        TxnIndex::iterator i = txns.find(id);
+        if (i == txns.end())
+            return;     // Nothing was done in it
+        appendTxn(CommitRecord, id, false);
+        commitTxn(i);
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::abort(qpid::broker::TransactionContext& txn)
+{
+    uint64_t id = transactionId(&txn);
+    {
+        qpid::sys::Mutex::ScopedLock l(lock);
+        TxnIndex::iterator i = txns.find(id);
+        if (i == txns.end())
+            return;
+        appendTxn(AbortRecord, id, false);
+        abortTxn(i);
+    }
+    log.sync();
+}
+
+void
+MmapLogProvider::collectPreparedXids(std::set<std::string>& xids)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    for (TxnIndex::const_iterator i = txns.begin(); i != txns.end(); ++i) {
+        if (i->second.prepare)
+            xids.insert(i->second.xid);
+    }
+}
+
+template <class Recover>
+void
+MmapLogProvider::recoverObjects(const ObjectIndex& index, Recover recover)
+{
+    for (ObjectIndex::const_iterator i = index.begin(); i != index.end(); ++i) {
+        Log::Record r = log.read(i->second);
+        qpid::framing::Buffer b(bodyBuffer(r));
+        b.getLongLong();
+        qpid::framing::Buffer blob(const_cast<char*>(r.body) + sizeof(uint64_t),
+                                   r.length - sizeof(uint64_t));
+        recover(i->first, blob);
+    }
+}
+
+namespace {
+
+struct ConfigRecoverer {
+    qpid::broker::RecoveryManager& recoverer;
+    ConfigRecoverer(qpid::broker::RecoveryManager& r) : recoverer(r) {}
+    void operator()(uint64_t id, qpid::framing::Buffer& blob) {
+        recoverer.recoverConfig(blob)->setPersistenceId(id);
+    }
+};
+
+struct ExchangeRecoverer {
+    qpid::broker::RecoveryManager& recoverer;
+    ExchangeMap& exchangeMap;
+    ExchangeRecoverer(qpid::broker::RecoveryManager& r, ExchangeMap& m)
+        : recoverer(r), exchangeMap(m) {}
+    void operator()(uint64_t id, qpid::framing::Buffer& blob) {
+        broker::RecoverableExchange::shared_ptr exchange =
+            recoverer.recoverExchange(blob);
+        exchange->setPersistenceId(id);
+        exchangeMap[id] = exchange;
+    }
+};
+
+struct QueueRecoverer {
+    qpid::broker::RecoveryManager& recoverer;
+    QueueMap& queueMap;
+    QueueRecoverer(qpid::broker::RecoveryManager& r, QueueMap& m)
+        : recoverer(r), queueMap(m) {}
+    void operator()(uint64_t id, qpid::framing::Buffer& blob) {
+        broker::RecoverableQueue::shared_ptr queue = recoverer.recoverQueue(blob);
+        queue->setPersistenceId(id);
+        queueMap[id] = queue;
+    }
+};
+
+}
+
+void
+MmapLogProvider::recoverConfigs(qpid::broker::RecoveryManager& recoverer)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    recoverObjects(configs, ConfigRecoverer(recoverer));
+}
+
+void
+MmapLogProvider::recoverExchanges(qpid::broker::RecoveryManager& recoverer,
+                                  ExchangeMap& exchangeMap)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    recoverObjects(exchanges, ExchangeRecoverer(recoverer, exchangeMap));
+}
+
+void
+MmapLogProvider::recoverQueues(qpid::broker::RecoveryManager& recoverer,
+                               QueueMap& queueMap)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    recoverObjects(queues, QueueRecoverer(recoverer, queueMap));
+}
+
+void
+MmapLogProvider::recoverBindings(qpid::broker::RecoveryManager& /*recoverer*/,
+                                 const ExchangeMap& exchangeMap,
+                                 const QueueMap& queueMap)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    for (BindingIndex::const_iterator i = bindings.begin();
+         i != bindings.end();
+         ++i) {
+        ExchangeMap::const_iterator exch = exchangeMap.find(i->first.exchangeId);
+        QueueMap::const_iterator queue = queueMap.find(i->first.queueId);
+        if (exch == exchangeMap.end() || queue == queueMap.end())
+            continue;
+        Log::Record r = log.read(i->second);
+        qpid::framing::Buffer b(bodyBuffer(r));
+        b.getLongLong();
+        b.getLongLong();
+        std::string key;
+        b.getShortString(key);
+        qpid::framing::FieldTable args;
+        args.decode(b);
+        exch->second->bind(queue->second->getName(), key, args);
+    }
+}
+
+void
+MmapLogProvider::recoverMessages(qpid::broker::RecoveryManager& recoverer,
+                                 MessageMap& messageMap,
+                                 MessageQueueMap& messageQueueMap)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    for (MessageIndex::const_iterator i = messages.begin();
+         i != messages.end();
+         ++i) {
+        Log::Record r = log.read(i->second.location);
+        qpid::framing::Buffer b(bodyBuffer(r));
+        b.getLongLong();
+        uint32_t headerSize = b.getLong();
+        qpid::framing::Buffer headerBuff(const_cast<char*>(r.body) + MessagePrefix,
+                                         headerSize);
+        broker::RecoverableMessage::shared_ptr msg =
+            recoverer.recoverMessage(headerBuff);
+        msg->setPersistenceId(i->first);
+        msg->setRedelivered();
+        msg->computeExpiration(broker->getExpiryPolicy());
+        uint32_t contentSize = r.length - MessagePrefix - headerSize;
+        if (msg->loadContent(contentSize)) {
+            qpid::framing::Buffer contentBuff(const_cast<char*>(r.body) + MessagePrefix + headerSize,
+                                              contentSize);
+            msg->decodeContent(contentBuff);
+        }
+        messageMap[i->first] = msg;
+    }
+    for (EnqueueIndex::const_iterator i = enqueues.begin();
+         i != enqueues.end();
+         ++i) {
+        const EnqueueEntry& e = i->second;
+        if (e.txn)
+            messageQueueMap[i->first.first].push_back(
+                QueueEntry(i->first.second, QueueEntry::ADDING, txns[e.txn].xid));
+        else if (e.dequeueTxn)
+            messageQueueMap[i->first.first].push_back(
+                QueueEntry(i->first.second, QueueEntry::REMOVING, txns[e.dequeueTxn].xid));
+        else
+            messageQueueMap[i->first.first].push_back(QueueEntry(i->first.second));
+    }
+}
+
+void
+MmapLogProvider::recoverTransactions(qpid::broker::RecoveryManager& recoverer,
+                                     PreparedTransactionMap& dtxMap)
+{
+    qpid::sys::Mutex::ScopedLock l(lock);
+    for (TxnIndex::const_iterator i = txns.begin(); i != txns.end(); ++i) {
+        if (!i->second.prepare)
+            continue;
+        std::auto_ptr<qpid::broker::TPCTransactionContext>
+            ctx(new TPCTransactionContext(i->first, i->second.xid));
+        dtxMap[i->second.xid] = recoverer.recoverTransaction(i->second.xid, ctx);
+    }
+}
+
+////////////// Internal Methods
+
+// The append helpers are called with lock held, so records go into the
+// log in the same order as the changes they make to the index.
+
+Log::Location
+MmapLogProvider::append(uint16_t type, const std::vector<char>& body, bool live)
+{
+    return log.append(type, &body[0], body.size(), live);
+}
+
+template <class T>
+Log::Location
+MmapLogProvider::appendObject(uint16_t type, uint64_t id, const T& object)
+{
+    std::vector<char> body(sizeof(uint64_t) + object.encodedSize());
+    qpid::framing::Buffer b(&body[0], body.size());
+    b.putLongLong(id);
+    object.encode(b);
+    return append(type, body);
+}
+
+Log::Location
+MmapLogProvider::appendDelete(uint16_t type, uint64_t id)
+{
+    std::vector<char> body(sizeof(uint16_t) + sizeof(uint64_t));
+    qpid::framing::Buffer b(&body[0], body.size());
+    b.putShort(type);
+    b.putLongLong(id);
+    return log.append(DeleteRecord, &body[0], body.size(), false);
+}
+
+Log::Location
+MmapLogProvider::appendEnqueue(uint16_t type, const EnqueueKey& key, uint64_t txn, bool live)
+{
+    char body[3 * sizeof(uint64_t)];
+    qpid::framing::Buffer b(body, sizeof(body));
+    b.putLongLong(key.first);
+    b.putLongLong(key.second);
+    b.putLongLong(txn);
+    return log.append(type, body, sizeof(body), live);
+}
+
+Log::Location
+MmapLogProvider::appendTxn(uint16_t type, uint64_t txn, bool live)
+{
+    char body[sizeof(uint64_t)];
+    qpid::framing::Buffer b(body, sizeof(body));
+    b.putLongLong(txn);
+    return log.append(type, body, sizeof(body), live);
+}
+
+// Store the message if it is not in the log already. Called with lock held.
+void
+MmapLogProvider::storeMessage(const boost::intrusive_ptr<PersistableMessage>& msg)
+{
+    uint64_t id = msg->getPersistenceId();
+    if (id != 0) {
+        MessageIndex::const_iterator i = messages.find(id);
+        if (i != messages.end() && i->second.location != 0)
+            return;
+    }
+    else {
+        id = nextId++;
+        msg->setPersistenceId(id);
+    }
+    std::vector<char> body(MessagePrefix + msg->encodedSize());
+    qpid::framing::Buffer b(&body[0], body.size());
+    b.putLongLong(id);
+    b.putLong(msg->encodedHeaderSize());
+    msg->encode(b);
+    messageEntry(id).location = append(MessageRecord, body);
+}
+
+void
+MmapLogProvider::addPending(const boost::intrusive_ptr<PersistableMessage>& msg,
+                            uint64_t queueId,
+                            bool enqueue)
+{
+    Pending p = { msg, queueId, enqueue };
+    qpid::sys::Monitor::ScopedLock l(syncMonitor);
+    pending.push_back(p);
+    ++outstanding[queueId];
+    syncMonitor.notify();
+}
+
+void
+MmapLogProvider::setObject(ObjectIndex& index, uint64_t id, Log::Location loc)
+{
+    ObjectIndex::iterator i = index.find(id);
+    if (i != index.end()) {
+        log.kill(i->second);
+        i->second = loc;
+    }
+    else {
+        index[id] = loc;
+    }
+    noteId(id);
+}
+
+void
+MmapLogProvider::removeObject(ObjectIndex& index, uint64_t id)
+{
+    ObjectIndex::iterator i = index.find(id);
+    if (i != index.end()) {
+        log.kill(i->second);
+        index.erase(i);
+    }
+}
+
+void
+MmapLogProvider::removeBinding(BindingIndex::iterator i)
+{
+    log.kill(i->second);
+    bindings.erase(i);
+}
+
+void
+MmapLogProvider::removeQueue(uint64_t id)
+{
+    removeObject(queues, id);
+    for (BindingIndex::iterator i = bindings.begin(); i != bindings.end(); ) {
+        if (i->first.queueId == id)
+            removeBinding(i++);
+        else
+            ++i;
+    }
+    for (EnqueueIndex::iterator i = enqueues.begin(); i != enqueues.end(); ) {
+        if (i->first.second == id)
+            removeEnqueue(i++);
+        else
+            ++i;
+    }
+}
+
+void
+MmapLogProvider::removeExchange(uint64_t id)
+{
+    removeObject(exchanges, id);
+    for (BindingIndex::iterator i = bindings.begin(); i != bindings.end(); ) {
+        if (i->first.exchangeId == id)
+            removeBinding(i++);
+        else
+            ++i;
+    }
+}
+
+MmapLogProvider::MessageEntry&
+MmapLogProvider::messageEntry(uint64_t id)
+{
+    MessageIndex::iterator i = messages.find(id);
+    if (i == messages.end()) {
+        MessageEntry m = { 0, 0 };
+        i = messages.insert(MessageIndex::value_type(id, m)).first;
+    }
+    return i->second;
+}
+
+void
+MmapLogProvider::release(uint64_t id)
+{
+    MessageIndex::iterator i = messages.find(id);
+    if (i != messages.end() && --i->second.refs == 0) {
+        if (i->second.location)
+            log.kill(i->second.location);
+        messages.erase(i);
+    }
+}
+
+void
+MmapLogProvider::addEnqueue(const EnqueueKey& key, Log::Location loc, uint64_t txn)
+{
+    EnqueueIndex::iterator i = enqueues.find(key);
+    if (i != enqueues.end()) {
+        // Appended again by compaction; the earlier copy is superseded.
+        log.kill(i->second.location);
+        i->second.location = loc;
+        i->second.txn = txn;
+        return;
+    }
+    EnqueueEntry e = { loc, txn, 0, 0 };
+    enqueues[key] = e;
+    ++messageEntry(key.first).refs;
+}
+
+void
+MmapLogProvider::addDequeue(const EnqueueKey& key, Log::Location loc, uint64_t txn)
+{
+    EnqueueIndex::iterator i = enqueues.find(key);
+    if (i == enqueues.end()) {
+        log.kill(loc);
+        return;
+    }
+    if (i->second.dequeue)
+        log.kill(i->second.dequeue);
+    i->second.dequeue = loc;
+    i->second.dequeueTxn = txn;
+}
+
+void
+MmapLogProvider::removeEnqueue(EnqueueIndex::iterator i)
+{
+    uint64_t msgId = i->first.first;
+    log.kill(i->second.location);
+    if (i->second.dequeue)
+        log.kill(i->second.dequeue);
+    enqueues.erase(i);
+    release(msgId);
+}
+
+void
+MmapLogProvider::commitTxn(TxnIndex::iterator i)
+{
+    const TxnEntry& t = i->second;
+    for (std::vector<EnqueueKey>::const_iterator k = t.enqueued.begin();
+         k != t.enqueued.end();
+         ++k) {
+        EnqueueIndex::iterator e = enqueues.find(*k);
+        if (e != enqueues.end() && e->second.txn == i->first)
+            e->second.txn = 0;
+    }
+    for (std::vector<EnqueueKey>::const_iterator k = t.dequeued.begin();
+         k != t.dequeued.end();
+         ++k) {
+        EnqueueIndex::iterator e = enqueues.find(*k);
+        if (e != enqueues.end() && e->second.dequeueTxn == i->first)
+            removeEnqueue(e);
+    }
+    if (t.prepare)
+        log.kill(t.prepare);
+    txns.erase(i);
+}
+
+void
+MmapLogProvider::abortTxn(TxnIndex::iterator i)
+{
+    const TxnEntry& t = i->second;
+    for (std::vector<EnqueueKey>::const_iterator k = t.enqueued.begin();
+         k != t.enqueued.end();
+         ++k) {
+        EnqueueIndex::iterator e = enqueues.find(*k);
+        if (e != enqueues.end() && e->second.txn == i->first)
+            removeEnqueue(e);
+    }
+    for (std::vector<EnqueueKey>::const_iterator k = t.dequeued.begin();
+         k != t.dequeued.end();
+         ++k) {
+        EnqueueIndex::iterator e = enqueues.find(*k);
+        if (e != enqueues.end() && e->second.dequeueTxn == i->first) {
+            log.kill(e->second.dequeue);
+            e->second.dequeue = 0;
+            e->second.dequeueTxn = 0;
+        }
+    }
+    if (t.prepare)
+        log.kill(t.prepare);
+    txns.erase(i);
+}
+
+/*
+ * Apply one record read back from the log to the index. Compaction can
+ * leave a record ahead of one it refers to, such as an enqueue ahead of
+ * its message, and can leave two copies of a record if the broker stopped
+ * before the old segment was deleted; anything still dangling once every
+ * record is replayed is dropped by finishRecovery().
+ */
+void
+MmapLogProvider::replay(const Log::Record& r)
+{
+    qpid::framing::Buffer b(bodyBuffer(r));
+    switch (r.type) {
+    case QueueRecord:
+        setObject(queues, b.getLongLong(), r.location);
+        break;
+    case ExchangeRecord:
+        setObject(exchanges, b.getLongLong(), r.location);
+        break;
+    case ConfigRecord:
+        setObject(configs, b.getLongLong(), r.location);
+        break;
+    case BindingRecord:
+    case UnbindRecord: {
+        BindingKey k;
+        k.exchangeId = b.getLongLong();
+        k.queueId = b.getLongLong();
+        b.getShortString(k.key);
+        BindingIndex::iterator i = bindings.find(k);
+        if (i != bindings.end())
+            removeBinding(i);
+        if (r.type == BindingRecord)
+            bindings[k] = r.location;
+        else
+            log.kill(r.location);
+        break;
+    }
+    case DeleteRecord: {
+        uint16_t type = b.getShort();
+        uint64_t id = b.getLongLong();
+        noteId(id);
+        if (type == QueueRecord)
+            removeQueue(id);
+        else if (type == ExchangeRecord)
+            removeExchange(id);
+        else
+            removeObject(configs, id);
+        log.kill(r.location);
+        break;
+    }
+    case MessageRecord: {
+        uint64_t id = b.getLongLong();
+        MessageEntry& m = messageEntry(id);
+        if (m.location)
+            log.kill(m.location);
+        m.location = r.location;
+        noteId(id);
+        break;
+    }
+    case EnqueueRecord: {
+        EnqueueKey key;
+        key.first = b.getLongLong();
+        key.second = b.getLongLong();
+        uint64_t txn = b.getLongLong();
+        noteId(key.first);
+        addEnqueue(key, r.location, txn);
+        if (txn) {
+            noteTxn(txn);
+            txns[txn].enqueued.push_back(key);
+        }
+        break;
+    }
+    case DequeueRecord: {
+        EnqueueKey key;
+        key.first = b.getLongLong();
+        key.second = b.getLongLong();
+        uint64_t txn = b.getLongLong();
+        if (txn) {
+            noteTxn(txn);
+            addDequeue(key, r.location, txn);
+            txns[txn].dequeued.push_back(key);
+        }
+        else {
+            EnqueueIndex::iterator i = enqueues.find(key);
+            if (i != enqueues.end())
+                removeEnqueue(i);
+            log.kill(r.location);
+        }
+        break;
+    }
+    case PrepareRecord: {
+        uint64_t txn = b.getLongLong();
+        noteTxn(txn);
+        TxnEntry& t = txns[txn];
+        b.getLongString(t.xid);
+        if (t.prepare)
+            log.kill(t.prepare);
+        t.prepare = r.location;
+        break;
+    }
+    case CommitRecord:
+    case AbortRecord: {
+        uint64_t txn = b.getLongLong();
+        noteTxn(txn);
+        TxnIndex::iterator i = txns.find(txn);
+        if (i != txns.end()) {
+            if (r.type == CommitRecord)
+                commitTxn(i);
+            else
+                abortTxn(i);
+        }
+        log.kill(r.location);
+        break;
+    }
+    default:
+        QPID_LOG(warning, "MMAP-LOG: Ignoring record of unknown type " << r.type);
+        log.kill(r.location);
+        break;
+    }
+}
+
+void
+MmapLogProvider::finishRecovery()
+{
+    // A local transaction not committed before the broker stopped never
+    // will be.
+    for (TxnIndex::iterator i = txns.begin(); i != txns.end(); ) {
+        if (i->second.prepare)
+            ++i;
+        else
+            abortTxn(i++);
+    }
+    for (EnqueueIndex::iterator i = enqueues.begin(); i != enqueues.end(); ) {
+        MessageIndex::const_iterator m = messages.find(i->first.first);
+        if (queues.find(i->first.second) == queues.end() ||
+            m == messages.end() || m->second.location == 0) {
+            QPID_LOG(warning, "MMAP-LOG: Dropping enqueue of message "
+                     << i->first.first << " on queue " << i->first.second
+                     << ": no such " << (m == messages.end() || m->second.location == 0 ?
+                                         "message" : "queue"));
+            removeEnqueue(i++);
+        }
+        else {
+            ++i;
+        }
+    }
+    // Staged messages never enqueued
+    for (MessageIndex::iterator i = messages.begin(); i != messages.end(); ) {
+        if (i->second.refs == 0) {
+            log.kill(i->second.location);
+            messages.erase(i++);
+        }
+        else {
+            ++i;
+        }
+    }
+    for (BindingIndex::iterator i = bindings.begin(); i != bindings.end(); ) {
+        if (exchanges.find(i->first.exchangeId) == exchanges.end() ||
+            queues.find(i->first.queueId) == queues.end())
+            removeBinding(i++);
+        else
+            ++i;
+    }
+}
+
+void
+MmapLogProvider::syncPending()
+{
+    qpid::sys::Monitor::ScopedLock l(syncMonitor);
+    for (;;) {
+        if (pending.empty()) {
+            if (stopping)
+                return;
+            syncMonitor.wait();
+            continue;
+        }
+        PendingList done;
+        done.swap(pending);
+        bool synced = false;
+        {
+            qpid::sys::Monitor::ScopedUnlock u(syncMonitor);
+            try {
+                log.sync();
+                synced = true;
+            }
+            catch (const std::exception& e) {
+                QPID_LOG(critical, "MMAP-LOG: Holding " << done.size()
+                         << " enqueues and dequeues until the log can be synced: "
+                         << e.what());
+            }
+            if (synced) {
+                for (PendingList::iterator i = done.begin(); i != done.end(); ++i) {
+                    if (i->enqueue)
+                        i->msg->enqueueComplete();
+                    else
+                        i->msg->dequeueComplete();
+                }
+            }
+        }
+        if (!synced) {
+            // Nothing may be completed that is not known to be on disk: keep
+            // the batch, ahead of anything added meanwhile, and try again.
+            done.insert(done.end(), pending.begin(), pending.end());
+            done.swap(pending);
+            if (stopping)
+                return;
+            syncMonitor.wait(qpid::sys::AbsTime(qpid::sys::now(), qpid::sys::TIME_SEC));
+            continue;
+        }
+        for (PendingList::iterator i = done.begin(); i != done.end(); ++i) {
+            if (--outstanding[i->queueId] == 0)
+                outstanding.erase(i->queueId);
+        }
+    }
+}
+
+void
+MmapLogProvider::compactLog()
+{
+    qpid::sys::Duration interval(options.compactInterval * qpid::sys::TIME_SEC);
+    qpid::sys::Monitor::ScopedLock l(compactMonitor);
+    while (!stopping) {
+        compactMonitor.wait(qpid::sys::AbsTime(qpid::sys::now(), interval));
+        if (stopping)
+            break;
+        qpid::sys::Monitor::ScopedUnlock u(compactMonitor);
+        try {
+            compact();
+        }
+        catch (const std::exception& e) {
+            QPID_LOG(error, "MMAP-LOG: Compaction failed: " << e.what());
+        }
+    }
+}
+
+void
+MmapLogProvider::compact()
+{
+    const uint64_t segmentBytes = static_cast<uint64_t>(options.segmentSize) * 1024 * 1024;
+    const uint64_t threshold = options.compactThreshold;
+    // Stop after as many segments as there were to start with, so data that
+    // stays live is not copied round and round.
+    size_t passes = log.getUsage().segments;
+    for (size_t pass = 0; pass < passes; ++pass) {
+        uint32_t sequence;
+        uint64_t live;
+        if (!log.getOldest(sequence, live))
+            return;
+        Log::Usage usage = log.getUsage();
+        if (live * 100 > threshold * segmentBytes &&
+            usage.live * 100 > threshold * usage.size)
+            return;
+        Log::RecordList records;
+        log.getRecords(sequence, records);
+        size_t moved = 0;
+        for (Log::RecordList::const_iterator i = records.begin();
+             i != records.end();
+             ++i) {
+            qpid::sys::Mutex::ScopedLock l(lock);
+            if (relocate(*i))
+                ++moved;
+        }
+        // The copies must be on disk before the originals go.
+        log.sync();
+        log.drop(sequence);
+        QPID_LOG(debug, "MMAP-LOG: Compacted segment " << sequence << ", keeping "
+                 << moved << " of " << records.size() << " records");
+    }
+}
+
+/*
+ * Append again a record from the segment being compacted if the index
+ * still points to it, and point the index at the copy. Called with lock
+ * held.
+ */
+bool
+MmapLogProvider::relocate(const Log::Record& r)
+{
+    qpid::framing::Buffer b(bodyBuffer(r));
+    std::vector<char> body(r.body, r.body + r.length);
+    switch (r.type) {
+    case QueueRecord:
+    case ExchangeRecord:
+    case ConfigRecord: {
+        ObjectIndex& index = r.type == QueueRecord ? queues :
+            (r.type == ExchangeRecord ? exchanges : configs);
+        ObjectIndex::iterator i = index.find(b.getLongLong());
+        if (i == index.end() || i->second != r.location)
+            return false;
+        i->second = append(r.type, body);
+        return true;
+    }
+    case BindingRecord: {
+        BindingKey k;
+        k.exchangeId = b.getLongLong();
+        k.queueId = b.getLongLong();
+        b.getShortString(k.key);
+        BindingIndex::iterator i = bindings.find(k);
+        if (i == bindings.end() || i->second != r.location)
+            return false;
+        i->second = append(r.type, body);
+        return true;
+    }
+    case MessageRecord: {
+        MessageIndex::iterator i = messages.find(b.getLongLong());
+        if (i == messages.end() || i->second.location != r.location)
+            return false;
+        i->second.location = append(r.type, body);
+        return true;
+    }
+    case EnqueueRecord: {
+        EnqueueKey key;
+        key.first = b.getLongLong();
+        key.second = b.getLongLong();
+        EnqueueIndex::iterator i = enqueues.find(key);
+        if (i == enqueues.end() || i->second.location != r.location)
+            return false;
+        // Written with the transaction as it now stands, so the copy of an
+        // enqueue since committed needs no commit record.
+        i->second.location = appendEnqueue(EnqueueRecord, key, i->second.txn);
+        if (i->second.dequeue) {
+            // Keep a pending dequeue after the enqueue it refers to.
+            log.kill(i->second.dequeue);
+            i->second.dequeue = appendEnqueue(DequeueRecord, key, i->second.dequeueTxn);
+        }
+        return true;
+    }
+    case DequeueRecord: {
+        EnqueueKey key;
+        key.first = b.getLongLong();
+        key.second = b.getLongLong();
+        EnqueueIndex::iterator i = enqueues.find(key);
+        if (i == enqueues.end() || i->second.dequeue != r.location)
+            return false;
+        i->second.dequeue = append(r.type, body);
+        return true;
+    }
+    case PrepareRecord: {
+        TxnIndex::iterator i = txns.find(b.getLongLong());
+        if (i == txns.end() || i->second.prepare != r.location)
+            return false;
+        i->second.prepare = append(r.type, body);
+        return true;
+    }
+    default:
+        return false;               // Only ever cancels older records
+    }
+}
+
+void
+MmapLogProvider::stop()
+{
+    {
+        qpid::sys::Monitor::ScopedLock sl(syncMonitor);
+        qpid::sys::Monitor::ScopedLock cl(compactMonitor);
+        stopping = true;
+        syncMonitor.notify();
+        compactMonitor.notify();
+    }
+    if (syncThread) {
+        syncThread.join();
+        syncThread = qpid::sys::Thread();
+    }
+    if (compactThread) {
+        compactThread.join();
+        compactThread = qpid::sys::Thread();
+    }
+}
+
+}}}  // namespace qpid::store::mmap_log
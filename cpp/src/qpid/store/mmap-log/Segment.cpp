@@ -0,0 +1,239 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/crc.hpp>
+#include <qpid/store/StoreException.h>
+#include <qpid/sys/StrError.h>
+
+#include "Segment.h"
+
+namespace qpid {
+namespace store {
+namespace mmap_log {
+
+namespace {
+
+const char Magic[8] = { 'Q', 'P', 'I', 'D', 'M', 'L', 'O', 'G' };
+const uint32_t Version = 1;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sequence;
+    uint32_t size;
+    char reserved[12];
+};
+
+struct RecordHeader {
+    uint32_t length;
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t checksum;
+    uint32_t reserved2;
+};
+
+uint32_t checksum(uint16_t type, const char* body, uint32_t length)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(&type, sizeof(type));
+    crc.process_bytes(body, length);
+    return crc.checksum();
+}
+
+// A file's creation or removal is only durable once its directory is synced.
+void syncDirectory(const std::string& path)
+{
+    std::string::size_type slash = path.rfind('/');
+    std::string dir(slash == std::string::npos ? std::string(".") :
+                    slash == 0 ? std::string("/") : path.substr(0, slash));
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        THROW_STORE_EXCEPTION("Cannot open log directory " + dir + ": " +
+                              qpid::sys::strError(errno));
+    int err = ::fsync(fd) < 0 ? errno : 0;
+    ::close(fd);
+    if (err != 0)
+        THROW_STORE_EXCEPTION("Cannot sync log directory " + dir + ": " +
+                              qpid::sys::strError(err));
+}
+
+}
+
+Segment::Segment(const std::string& p, int f, uint32_t s)
+    : live(0), synced(0), path(p), sequence(0), size(s),
+      writeOffset(HeaderSize), fd(f), base(0)
+{
+    void* m = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        THROW_STORE_EXCEPTION("Cannot map log segment " + path + ": " +
+                              qpid::sys::strError(err));
+    }
+    base = static_cast<char*>(m);
+}
+
+Segment::~Segment()
+{
+    ::munmap(base, size);
+    ::close(fd);
+}
+
+Segment::shared_ptr
+Segment::create(const std::string& path, uint32_t sequence, uint32_t size)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        THROW_STORE_EXCEPTION("Cannot create log segment " + path + ": " +
+                              qpid::sys::strError(errno));
+    // Allocate the whole file now: running out of disk while writing to a
+    // mapping is a SIGBUS, not an error return.
+    int err = ::posix_fallocate(fd, 0, size);
+    if (err != 0) {
+        ::close(fd);
+        ::unlink(path.c_str());
+        THROW_STORE_EXCEPTION("Cannot allocate log segment " + path + ": " +
+                              qpid::sys::strError(err));
+    }
+    shared_ptr s(new Segment(path, fd, size));
+    s->sequence = sequence;
+    FileHeader* h = reinterpret_cast<FileHeader*>(s->base);
+    ::memcpy(h->magic, Magic, sizeof(Magic));
+    h->version = Version;
+    h->sequence = sequence;
+    h->size = size;
+    s->sync(0, HeaderSize);
+    s->synced = HeaderSize;
+    syncDirectory(path);
+    return s;
+}
+
+Segment::shared_ptr
+Segment::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0)
+        THROW_STORE_EXCEPTION("Cannot open log segment " + path + ": " +
+                              qpid::sys::strError(errno));
+    struct ::stat st;
+    if (::fstat(fd, &st) < 0 || st.st_size < HeaderSize) {
+        ::close(fd);
+        THROW_STORE_EXCEPTION("Log segment " + path + " is too short");
+    }
+    shared_ptr s(new Segment(path, fd, static_cast<uint32_t>(st.st_size)));
+    const FileHeader* h = reinterpret_cast<const FileHeader*>(s->base);
+    if (::memcmp(h->magic, Magic, sizeof(Magic)) != 0 ||
+        h->version != Version ||
+        h->size != s->size)
+        THROW_STORE_EXCEPTION("Log segment " + path + " has a bad header");
+    s->sequence = h->sequence;
+    return s;
+}
+
+uint32_t
+Segment::append(uint16_t type, const char* body, uint32_t length)
+{
+    uint32_t need = recordSize(length);
+    if (need > size - writeOffset)
+        return 0;
+    uint32_t offset = writeOffset;
+    RecordHeader* h = reinterpret_cast<RecordHeader*>(base + offset);
+    h->length = length;
+    h->type = type;
+    h->reserved = 0;
+    h->checksum = checksum(type, body, length);
+    h->reserved2 = 0;
+    ::memcpy(base + offset + RecordHeaderSize, body, length);
+    writeOffset += need;
+    return offset;
+}
+
+Segment::Record
+Segment::read(uint32_t offset) const
+{
+    const RecordHeader* h = reinterpret_cast<const RecordHeader*>(base + offset);
+    Record r;
+    r.type = h->type;
+    r.offset = offset;
+    r.length = h->length;
+    r.body = base + offset + RecordHeaderSize;
+    return r;
+}
+
+bool
+Segment::scan(RecordList& records)
+{
+    uint32_t offset = HeaderSize;
+    bool clean = true;
+    while (size - offset >= RecordHeaderSize) {
+        const RecordHeader* h = reinterpret_cast<const RecordHeader*>(base + offset);
+        if (h->length == 0 && h->type == 0 && h->checksum == 0)
+            break;                      // End of the records written
+        if (h->length > size - offset - RecordHeaderSize ||
+            h->checksum != checksum(h->type, base + offset + RecordHeaderSize, h->length)) {
+            clean = false;
+            break;
+        }
+        records.push_back(read(offset));
+        offset += recordSize(h->length);
+    }
+    writeOffset = offset;
+    synced = offset;
+    return clean;
+}
+
+void
+Segment::list(RecordList& records) const
+{
+    for (uint32_t offset = HeaderSize; offset < writeOffset; ) {
+        records.push_back(read(offset));
+        offset += recordSize(records.back().length);
+    }
+}
+
+void
+Segment::sync(uint32_t from, uint32_t to)
+{
+    static const uint32_t pageSize = ::sysconf(_SC_PAGESIZE);
+    if (to <= from)
+        return;
+    from &= ~(pageSize - 1);
+    if (::msync(base + from, to - from, MS_SYNC) < 0)
+        THROW_STORE_EXCEPTION("Cannot sync log segment " + path + ": " +
+                              qpid::sys::strError(errno));
+}
+
+void
+Segment::remove()
+{
+    if (::unlink(path.c_str()) < 0)
+        THROW_STORE_EXCEPTION("Cannot remove log segment " + path + ": " +
+                              qpid::sys::strError(errno));
+    syncDirectory(path);
+}
+
+}}}  // namespace qpid::store::mmap_log
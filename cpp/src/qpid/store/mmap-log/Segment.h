@@ -0,0 +1,128 @@
+#ifndef QPID_STORE_MMAPLOG_SEGMENT_H
+#define QPID_STORE_MMAPLOG_SEGMENT_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <qpid/sys/IntegerTypes.h>
+
+namespace qpid {
+namespace store {
+namespace mmap_log {
+
+/**
+ * @class Segment
+ *
+ * One file of the log, mapped into memory as a whole. The file is created
+ * at its full size, so the part not yet written reads as zeroes; records
+ * are appended one after another from just past the file header.
+ *
+ * Each record is a 16 byte header - body length, type and a CRC-32 of the
+ * type and body - followed by the body, padded to 8 bytes. A scan of the
+ * records stops at the first header that is all zeroes, which is the end
+ * of what was written, or at the first whose checksum does not match,
+ * which is where a write was torn by a crash. Headers are in host byte
+ * order: segments are not portable between architectures.
+ *
+ * Segments do no locking of their own; the Log serializes access.
+ */
+class Segment {
+
+public:
+    typedef boost::shared_ptr<Segment> shared_ptr;
+
+    static const uint32_t HeaderSize = 32;
+    static const uint32_t RecordHeaderSize = 16;
+
+    struct Record {
+        uint16_t type;
+        uint32_t offset;
+        uint32_t length;
+        const char* body;
+    };
+    typedef std::vector<Record> RecordList;
+
+    /// Create a new segment file of the given size.
+    static shared_ptr create(const std::string& path, uint32_t sequence, uint32_t size);
+
+    /// Open an existing segment file; scan() it before appending.
+    static shared_ptr open(const std::string& path);
+
+    ~Segment();
+
+    uint32_t getSequence() const { return sequence; }
+    uint32_t getSize() const { return size; }
+    uint32_t getWriteOffset() const { return writeOffset; }
+    const std::string& getPath() const { return path; }
+
+    /// Bytes a record with a body of the given length takes in a segment.
+    static uint32_t recordSize(uint32_t length)
+        { return RecordHeaderSize + ((length + 7) & ~7u); }
+
+    /// Append a record, returning its offset, or 0 if it does not fit.
+    uint32_t append(uint16_t type, const char* body, uint32_t length);
+
+    /// The record at the given offset, which must be one append() returned
+    /// or scan() found.
+    Record read(uint32_t offset) const;
+
+    /**
+     * Check every record from the start of the segment, adding the good
+     * ones to records, and leave the write offset just past the last good
+     * one. Returns false if the scan stopped at a damaged record rather than
+     * at the end of the records written.
+     */
+    bool scan(RecordList& records);
+
+    /// Every record up to the write offset, without checking them again.
+    void list(RecordList& records) const;
+
+    /// Write the given range of the segment back to its file.
+    void sync(uint32_t from, uint32_t to);
+
+    /// Delete the segment's file, durably; the mapping stays valid until
+    /// destroyed.
+    void remove();
+
+    // Bytes held by records still in use; maintained by the Log.
+    uint64_t live;
+
+    // Offset up to which the segment is known to be on disk; maintained by
+    // the Log.
+    uint32_t synced;
+
+private:
+    const std::string path;
+    uint32_t sequence;
+    uint32_t size;
+    uint32_t writeOffset;
+    int fd;
+    char* base;
+
+    Segment(const std::string& path, int fd, uint32_t size);
+};
+
+}}}  // namespace qpid::store::mmap_log
+
+#endif /* QPID_STORE_MMAPLOG_SEGMENT_H */
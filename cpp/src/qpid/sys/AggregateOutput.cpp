@@ -26,67 +26,110 @@
 namespace qpid {
 namespace sys {
 
-AggregateOutput::AggregateOutput(OutputControl& c) : busy(false), control(c) {}
+AggregateOutput::AggregateOutput(OutputControl& c) : added(0), turnUsed(0), control(c) {}
 
 void AggregateOutput::abort() { control.abort(); }
 
 void AggregateOutput::activateOutput() { control.activateOutput(); }
 
-namespace {
-// Clear the busy flag and notify waiting threads in destructor.
-struct ScopedBusy {
-    bool& flag;
-    Monitor& monitor;
-    ScopedBusy(bool& f, Monitor& m) : flag(f), monitor(m) { f = true; }
-    ~ScopedBusy() { flag = false; monitor.notifyAll(); }
-};
+// Move the tasks added since last time to the end of tasks, oldest first
+void AggregateOutput::collect() {
+    OutputTask* latest = added.get();
+    while (!added.boolCompareAndSwap(latest, 0)) latest = added.get();
+    OutputTask* oldest = 0;
+    while (latest) {
+        OutputTask* next = latest->nextForOutput;
+        latest->nextForOutput = oldest;
+        oldest = latest;
+        latest = next;
+    }
+    for (; oldest; oldest = oldest->nextForOutput) {
+        tasks.push_back(oldest);
+    }
+}
+
+// Finish the turn of the task at the front, keeping it for another turn
+// or dropping it. Output beyond its share is taken from its next turn.
+void AggregateOutput::endTurn(bool again) {
+    OutputTask* t = tasks.front();
+    tasks.pop_front();
+    if (again) {
+        t->outputOverdrawn = std::min<size_t>(turnUsed - TurnBytes, TurnBytes);
+        tasks.push_back(t);
+    } else {
+        t->outputOverdrawn = 0;
+    }
+    turnUsed = tasks.empty() ? 0 : tasks.front()->outputOverdrawn;
 }
 
 bool AggregateOutput::doOutput() {
+    // Held throughout so that removeOutputTask waits for the task to finish
     Mutex::ScopedLock l(lock);
-    ScopedBusy sb(busy, lock);
-
+    collect();
     while (!tasks.empty()) {
-        OutputTask* t=tasks.front();
-        tasks.pop_front();
-        taskSet.erase(t);
+        OutputTask* t = tasks.front();
+        // Anything that needs output again from here on must add the
+        // task again, as this call may not see it
+        t->queuedForOutput.boolCompareAndSwap(1, 0);
+        bool fair = tasks.size() > 1;
+        size_t before = fair ? control.getBuffered() : 0;
         bool didOutput;
-        {
-            // Allow concurrent call to addOutputTask.
-            // removeOutputTask will wait till !busy before removing a task.
-            Mutex::ScopedUnlock u(lock);
+        try {
             didOutput = t->doOutput();
+        } catch (...) {
+            endTurn(false);
+            throw;
         }
-        if (didOutput) {
-            if (taskSet.insert(t).second) {
-                tasks.push_back(t);
+        if (didOutput && t->queuedForOutput.boolCompareAndSwap(0, 1)) {
+            if (fair) {
+                size_t after = control.getBuffered();
+                turnUsed += after > before ? after - before : size_t(CallBytes);
+                if (turnUsed >= TurnBytes) endTurn(true);
             }
             return true;
         }
+        // Either it has nothing more to do or it was added again
+        // while running and will be collected from added
+        endTurn(false);
+        if (didOutput) return true;
+        collect();
     }
     return false;
 }
   
 void AggregateOutput::addOutputTask(OutputTask* task) {
-    Mutex::ScopedLock l(lock);
-    if (taskSet.insert(task).second) {
-        tasks.push_back(task);
-    }
+    if (!task->queuedForOutput.boolCompareAndSwap(0, 1)) return; // Already there
+    OutputTask* latest;
+    do {
+        latest = added.get();
+        task->nextForOutput = latest;
+    } while (!added.boolCompareAndSwap(latest, task));
 }
 
 void AggregateOutput::removeOutputTask(OutputTask* task) {
     Mutex::ScopedLock l(lock);
-    while (busy) lock.wait();
-    taskSet.erase(task);
-    tasks.erase(std::remove(tasks.begin(), tasks.end(), task), tasks.end());
+    collect();
+    TaskList::iterator i = std::find(tasks.begin(), tasks.end(), task);
+    if (i == tasks.end()) return;
+    if (i == tasks.begin()) {
+        endTurn(false);
+    } else {
+        tasks.erase(i);
+        task->outputOverdrawn = 0;
+    }
+    task->queuedForOutput = 0;
 }
   
 void AggregateOutput::removeAll()
 {
     Mutex::ScopedLock l(lock);
-    while (busy) lock.wait();
-    taskSet.clear();
+    collect();
+    for (TaskList::iterator i = tasks.begin(); i != tasks.end(); ++i) {
+        (*i)->queuedForOutput = 0;
+        (*i)->outputOverdrawn = 0;
+    }
     tasks.clear();
+    turnUsed = 0;
 }
   
 
@@ -21,39 +21,52 @@
 #ifndef _AggregateOutput_
 #define _AggregateOutput_
 
-#include "qpid/sys/Monitor.h"
+#include "qpid/sys/AtomicValue.h"
+#include "qpid/sys/Mutex.h"
 #include "qpid/sys/OutputControl.h"
 #include "qpid/sys/OutputTask.h"
 #include "qpid/CommonImportExport.h"
 
 #include <algorithm>
 #include <deque>
-#include <set>
 
 namespace qpid {
 namespace sys {
 
 /**
  * Holds a collection of output tasks, doOutput picks the next one to execute.
+ *
+ * Tasks with output are taken in turn. Each turn lasts until the task has
+ * produced TurnBytes of output or has no more to do, and anything over is
+ * taken from its next turn, so sessions sending small messages get as much
+ * of the connection as those sending large ones. If the transport can't
+ * say how much was output each call counts as CallBytes.
  * 
- * Tasks are automatically removed if their doOutput() or hasOutput() returns false.
+ * Tasks are automatically removed if their doOutput() returns false, and
+ * are only looked at again once added back.
  * 
- * Thread safe. addOutputTask may be called in one connection thread while
- * doOutput is called in another.
+ * Thread safe. addOutputTask may be called in any thread while doOutput
+ * is called in another; it takes no lock, just pushes the task onto a
+ * list that doOutput collects from. removeOutputTask waits for any
+ * doOutput in progress to finish.
  */
 
 class QPID_COMMON_CLASS_EXTERN AggregateOutput : public OutputTask, public OutputControl
 {
     typedef std::deque<OutputTask*> TaskList;
-    typedef std::set<OutputTask*> TaskSet;
 
-    Monitor lock;
-    TaskList tasks;
-    TaskSet taskSet;
-    bool busy;
+    Mutex lock;
+    TaskList tasks;             // Tasks with output, in turn; only used by doOutput
+    AtomicValue<OutputTask*> added; // Tasks added since doOutput last collected them, latest first
+    size_t turnUsed;            // Output charged to the task at the front of tasks
     OutputControl& control;
 
+    void collect();
+    void endTurn(bool again);
+
   public:
+    enum { TurnBytes = 16*1024, CallBytes = 256 };
+
     QPID_COMMON_EXTERN AggregateOutput(OutputControl& c);
 
     // These may be called concurrently with any function.
@@ -69,6 +82,7 @@ class QPID_COMMON_CLASS_EXTERN AggregateOutput : public OutputTask, public Outpu
     /** Apply f to each OutputTask* in the tasks list */
     template <class F> void eachOutput(F f) {
         Mutex::ScopedLock l(lock);
+        collect();
         std::for_each(tasks.begin(), tasks.end(), f);
     }
 };
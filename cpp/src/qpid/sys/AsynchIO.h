@@ -25,8 +25,10 @@
 
 #include "qpid/sys/IntegerTypes.h"
 #include "qpid/sys/SecuritySettings.h"
+#include "qpid/BufferRef.h"
 
 #include <string.h>
+#include <string>
 
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
@@ -84,6 +86,9 @@ struct AsynchIOBufferBase {
     int32_t byteCount;
     int32_t dataStart;
     int32_t dataCount;
+    // Ref-counted storage holding bytes (may be empty), which lets what
+    // is decoded from the buffer refer to it rather than copy it
+    BufferRef memory;
     
     AsynchIOBufferBase(char* const b, const int32_t s) :
         bytes(b),
@@ -91,10 +96,26 @@ struct AsynchIOBufferBase {
         dataStart(0),
         dataCount(0)
     {}
+
+    AsynchIOBufferBase(const BufferRef& m) :
+        bytes(m.begin()),
+        byteCount(m.end() - m.begin()),
+        dataStart(0),
+        dataCount(0),
+        memory(m)
+    {}
     
     virtual ~AsynchIOBufferBase()
     {}
 
+    /*
+     * Before reusing the buffer make sure nothing decoded from it still
+     * refers to its memory: if something does, move any data still in the
+     * buffer into new memory from the BufferPool and leave the old to its
+     * other owners
+     */
+    QPID_COMMON_EXTERN void reclaim();
+
     void squish() {
         if (dataStart != 0) {
             ::memmove(bytes, bytes + dataStart, dataCount);
@@ -137,6 +158,12 @@ public:
                             ClosedCallback cCb = 0,
                             BuffersEmptyCallback eCb = 0,
                             IdleCallback iCb = 0);
+
+    // Choose the platform IO implementation used by subsequent create()
+    // calls here and in AsynchAcceptor/AsynchConnector ("default" is
+    // always available). Returns false if the named implementation is
+    // known but can't be used on this system.
+    QPID_COMMON_EXTERN static bool selectBackend(const std::string& name);
 public:
     /*
      * Size of IO buffers - this is the maximum possible frame size + 1
@@ -164,6 +191,12 @@ public:
 
     virtual SecuritySettings getSecuritySettings() = 0;
 
+    /*
+     * Number of buffers written and of write system calls used to write
+     * them; implementations that don't gather writes need not count them
+     */
+    virtual void getWriteCounts(uint64_t& buffers, uint64_t& calls) const { buffers = calls = 0; }
+
 protected:
     // Derived class manages lifetime; must be constructed using the
     // static create() method. Deletes not allowed from outside.
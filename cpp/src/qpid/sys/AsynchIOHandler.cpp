@@ -23,6 +23,7 @@
 #include "qpid/sys/AsynchIO.h"
 #include "qpid/sys/Socket.h"
 #include "qpid/sys/SecuritySettings.h"
+#include "qpid/sys/LatencyHistogram.h"
 #include "qpid/sys/Timer.h"
 #include "qpid/framing/AMQP_HighestVersion.h"
 #include "qpid/framing/ProtocolInitiation.h"
@@ -104,6 +105,10 @@ void AsynchIOHandler::activateOutput() {
     aio->notifyPendingWrite();
 }
 
+void AsynchIOHandler::getWriteCounts(uint64_t& buffers, uint64_t& calls) const {
+    aio->getWriteCounts(buffers, calls);
+}
+
 namespace {
     SecuritySettings getSecuritySettings(AsynchIO* aio, bool nodict)
     {
@@ -111,6 +116,15 @@ namespace {
         settings.nodict = nodict;
         return settings;
     }
+
+    // Decode size bytes from start, letting the codec keep references to
+    // the buffer's memory if it has any
+    size_t decode(ConnectionCodec& codec, AsynchIO::BufferBase* buff, char* start, size_t size)
+    {
+        if (!buff->memory.begin())
+            return codec.decode(start, size);
+        return codec.decodeShared(buff->memory.sub_buffer(start, start+size));
+    }
 }
 
 void AsynchIOHandler::readbuff(AsynchIO& , AsynchIO::BufferBase* buff) {
@@ -121,8 +135,10 @@ void AsynchIOHandler::readbuff(AsynchIO& , AsynchIO::BufferBase* buff) {
     ++reads;
     size_t decoded = 0;
     if (codec) {                // Already initiated
+        bool timed = LatencyStats::isEnabled();
+        if (timed) LatencyStats::setReadTime(AbsTime::now());
         try {
-            decoded = codec->decode(buff->bytes+buff->dataStart, buff->dataCount);
+            decoded = decode(*codec, buff, buff->bytes+buff->dataStart, buff->dataCount);
             // When we've decoded 3 reads (probably frames) we will have authenticated and
             // started heartbeats, if specified, in many (but not all) cases so now we will cancel
             // the idle connection timeout - this is really hacky, and would be better implemented
@@ -135,6 +151,7 @@ void AsynchIOHandler::readbuff(AsynchIO& , AsynchIO::BufferBase* buff) {
             readError = true;
             aio->queueWriteClose();
         }
+        if (timed) LatencyStats::setReadTime(AbsTime());
     }else{
         framing::Buffer in(buff->bytes+buff->dataStart, buff->dataCount);
         framing::ProtocolInitiation protocolInit;
@@ -152,7 +169,7 @@ void AsynchIOHandler::readbuff(AsynchIO& , AsynchIO::BufferBase* buff) {
                     aio->queueWriteClose();
                 } else {
                     //read any further data that may already have been sent
-                    decoded += codec->decode(buff->bytes+buff->dataStart+in.getPosition(), buff->dataCount-in.getPosition());
+                    decoded += decode(*codec, buff, buff->bytes+buff->dataStart+in.getPosition(), buff->dataCount-in.getPosition());
                 }
             } catch (const std::exception& e) {
                 QPID_LOG(error, e.what());
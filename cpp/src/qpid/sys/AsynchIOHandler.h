@@ -64,6 +64,7 @@ class AsynchIOHandler : public OutputControl {
     // Output side
     QPID_COMMON_EXTERN void abort();
     QPID_COMMON_EXTERN void activateOutput();
+    QPID_COMMON_EXTERN void getWriteCounts(uint64_t& buffers, uint64_t& calls) const;
 
     // Input side
     QPID_COMMON_EXTERN void readbuff(AsynchIO& aio, AsynchIOBufferBase* buff);
@@ -0,0 +1,245 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/sys/BufferPool.h"
+#include "qpid/RefCounted.h"
+#include <boost/intrusive_ptr.hpp>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace qpid {
+namespace sys {
+
+/**
+ * Header placed in front of the memory of each buffer: counts the
+ * references to the buffer and gives it back to the pool when there
+ * are none left
+ */
+class BufferPool::Block : public RefCounted {
+  public:
+    BufferPool& pool;
+    const uint32_t sizeClass;   // ClassCount for a buffer too big to pool
+    const size_t capacity;
+
+    Block(BufferPool& p, uint32_t c, size_t n) : pool(p), sizeClass(c), capacity(n) {}
+
+    char* data() { return reinterpret_cast<char*>(this) + sizeof(Block); }
+
+    static Block* create(BufferPool& p, uint32_t c, size_t n) {
+        void* store = ::malloc(sizeof(Block) + n);
+        if (!store)
+            throw std::bad_alloc();
+        return new(store) Block(p, c, n);
+    }
+
+    void destroy() {
+        this->~Block();
+        ::free(reinterpret_cast<void*>(this));
+    }
+
+  protected:
+    void released() const {
+        const_cast<Block*>(this)->pool.recycle(const_cast<Block*>(this));
+    }
+};
+
+// Never destroyed: buffers can still be in use while statics are torn down
+BufferPool& BufferPool::instance() {
+    static BufferPool* pool = new BufferPool;
+    return *pool;
+}
+
+BufferPool::BufferPool(size_t m) :
+    maxIdle(m),
+    idleBytes(0),
+    largeAllocations(0),
+    largeInUse(0),
+    largeInUseBytes(0),
+    connectionMinimum(1),
+    connectionMaximum(4*AsynchIO::BufferCount)
+{}
+
+BufferPool::~BufferPool() {
+    for (uint32_t c = 0; c < ClassCount; ++c) {
+        std::vector<Block*>& free = classes[c].free;
+        for (std::vector<Block*>::iterator i = free.begin(); i != free.end(); ++i)
+            (*i)->destroy();
+    }
+}
+
+BufferRef BufferPool::allocate(size_t size) {
+    uint32_t c = 0;
+    while (c < ClassCount && (size_t(1) << (MinClassShift + c)) < size)
+        ++c;
+
+    Block* block = 0;
+    if (c == ClassCount) {
+        block = Block::create(*this, c, size);
+        ScopedLock<Mutex> l(lock);
+        ++largeAllocations;
+        ++largeInUse;
+        largeInUseBytes += size;
+    } else {
+        {
+            ScopedLock<Mutex> l(lock);
+            SizeClass& sc = classes[c];
+            ++sc.allocations;
+            ++sc.inUse;
+            if (!sc.free.empty()) {
+                block = sc.free.back();
+                sc.free.pop_back();
+                idleBytes -= block->capacity;
+                ++sc.reuses;
+            }
+        }
+        if (!block)
+            block = Block::create(*this, c, size_t(1) << (MinClassShift + c));
+    }
+    return BufferRef(boost::intrusive_ptr<RefCounted>(block), block->data(), block->data() + size);
+}
+
+void BufferPool::recycle(Block* block) {
+    {
+        ScopedLock<Mutex> l(lock);
+        if (block->sizeClass == ClassCount) {
+            --largeInUse;
+            largeInUseBytes -= block->capacity;
+        } else {
+            SizeClass& sc = classes[block->sizeClass];
+            --sc.inUse;
+            if (idleBytes + block->capacity <= maxIdle) {
+                sc.free.push_back(block);
+                idleBytes += block->capacity;
+                return;
+            }
+            ++sc.discards;
+        }
+    }
+    block->destroy();
+}
+
+void BufferPool::setMaxIdle(size_t bytes) {
+    std::vector<Block*> discarded;
+    {
+        ScopedLock<Mutex> l(lock);
+        maxIdle = bytes;
+        // Free the biggest buffers first
+        for (uint32_t c = ClassCount; c > 0 && idleBytes > maxIdle; --c) {
+            SizeClass& sc = classes[c-1];
+            while (!sc.free.empty() && idleBytes > maxIdle) {
+                idleBytes -= sc.free.back()->capacity;
+                discarded.push_back(sc.free.back());
+                sc.free.pop_back();
+                ++sc.discards;
+            }
+        }
+    }
+    for (std::vector<Block*>::iterator i = discarded.begin(); i != discarded.end(); ++i)
+        (*i)->destroy();
+}
+
+BufferPool::Stats BufferPool::getStats() const {
+    Stats stats;
+    ScopedLock<Mutex> l(lock);
+    stats.allocations = largeAllocations;
+    stats.reuses = 0;
+    stats.discards = 0;
+    stats.inUse = largeInUse;
+    stats.inUseBytes = largeInUseBytes;
+    stats.idle = 0;
+    stats.idleBytes = idleBytes;
+    for (uint32_t c = 0; c < ClassCount; ++c) {
+        const SizeClass& sc = classes[c];
+        stats.allocations += sc.allocations;
+        stats.reuses += sc.reuses;
+        stats.discards += sc.discards;
+        stats.inUse += sc.inUse;
+        stats.inUseBytes += sc.inUse << (MinClassShift + c);
+        stats.idle += sc.free.size();
+    }
+    return stats;
+}
+
+void BufferPool::setConnectionLimits(uint32_t minimum, uint32_t maximum) {
+    connectionMaximum = std::max(maximum, uint32_t(AsynchIO::BufferCount));
+    connectionMinimum = std::min(minimum, uint32_t(connectionMaximum));
+}
+
+AsynchIOBufferSet::AsynchIOBufferSet(BufferPool& p) :
+    pool(p),
+    size(0),
+    backed(0)
+{}
+
+void AsynchIOBufferSet::create(uint32_t s, uint32_t count) {
+    size = s;
+    count = std::max(count, pool.getConnectionMinimum());
+    for (uint32_t i = 0; i < count; ++i) {
+        slots.push_back(AsynchIOBufferBase(0, size));
+        spares.push_back(&slots.back());
+    }
+}
+
+AsynchIOBufferBase* AsynchIOBufferSet::spare(bool grow) {
+    if (spares.empty()) {
+        if (!grow || slots.size() >= pool.getConnectionMaximum())
+            return 0;
+        slots.push_back(AsynchIOBufferBase(0, size));
+        spares.push_back(&slots.back());
+    }
+    AsynchIOBufferBase* buff = spares.back();
+    buff->memory = pool.allocate(size);
+    buff->bytes = buff->memory.begin();
+    buff->dataStart = 0;
+    buff->dataCount = 0;
+    spares.pop_back();
+    ++backed;
+    return buff;
+}
+
+void AsynchIOBufferSet::trim(std::deque<AsynchIOBufferBase*>& queue) {
+    uint32_t minimum = pool.getConnectionMinimum();
+    // Work from the back, the buffer at the front may hold unread data
+    for (size_t i = queue.size(); i > 0 && backed > minimum; --i) {
+        AsynchIOBufferBase* buff = queue[i-1];
+        if (buff->dataCount != 0)
+            continue;
+        buff->memory = BufferRef();
+        buff->bytes = 0;
+        spares.push_back(buff);
+        --backed;
+        queue.erase(queue.begin() + (i-1));
+    }
+}
+
+void AsynchIOBufferBase::reclaim() {
+    if (memory.refCount() > 1) {
+        BufferRef fresh = BufferPool::instance().allocate(byteCount);
+        ::memcpy(fresh.begin(), bytes + dataStart, dataCount);
+        memory = fresh;
+        bytes = memory.begin();
+        dataStart = 0;
+    }
+}
+
+}} // namespace qpid::sys
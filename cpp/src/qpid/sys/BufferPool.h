@@ -0,0 +1,159 @@
+#ifndef QPID_SYS_BUFFERPOOL_H
+#define QPID_SYS_BUFFERPOOL_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/sys/AsynchIO.h"
+#include "qpid/sys/Mutex.h"
+#include "qpid/sys/IntegerTypes.h"
+#include "qpid/BufferRef.h"
+#include "qpid/CommonImportExport.h"
+#include <deque>
+#include <vector>
+
+namespace qpid {
+namespace sys {
+
+/**
+ * Memory for IO buffers, shared by all connections in the process.
+ *
+ * Requests are rounded up to a power of two size class and released
+ * buffers are kept on a free list for their class, so a buffer given up
+ * by a quiet connection is handed straight to a busy one. Idle memory
+ * beyond a configurable limit goes back to the system.
+ *
+ * The pool also holds the per-connection limits: the number of buffers a
+ * connection keeps while it is quiet and the number it may grow to while
+ * it is busy.
+ */
+class BufferPool {
+  public:
+    struct Stats {
+        uint64_t allocations;   // Buffers handed out
+        uint64_t reuses;        // ... of which came from the free lists
+        uint64_t discards;      // Released buffers freed as the pool was full
+        uint64_t inUse;         // Buffers handed out and not yet released
+        uint64_t inUseBytes;
+        uint64_t idle;          // Buffers on the free lists
+        uint64_t idleBytes;
+    };
+
+    /** Default idle memory limit */
+    const static size_t DefaultMaxIdle = 64*1024*1024;
+
+    QPID_COMMON_EXTERN static BufferPool& instance();
+
+    QPID_COMMON_EXTERN BufferPool(size_t maxIdle = DefaultMaxIdle);
+    QPID_COMMON_EXTERN ~BufferPool();
+
+    /** Memory for a buffer of size bytes; it returns to the pool when the last reference goes */
+    QPID_COMMON_EXTERN BufferRef allocate(size_t size);
+
+    /** Change the limit on idle memory; anything over is freed now */
+    QPID_COMMON_EXTERN void setMaxIdle(size_t bytes);
+
+    QPID_COMMON_EXTERN Stats getStats() const;
+
+    /**
+     * Buffers each connection keeps while quiet (may be 0) and the most
+     * it may have while busy (never less than AsynchIO::BufferCount)
+     */
+    QPID_COMMON_EXTERN void setConnectionLimits(uint32_t minimum, uint32_t maximum);
+    uint32_t getConnectionMinimum() const { return connectionMinimum; }
+    uint32_t getConnectionMaximum() const { return connectionMaximum; }
+
+  private:
+    class Block;
+
+    // Classes from 2^MinClassShift to 2^MaxClassShift bytes, anything
+    // bigger is allocated on its own and freed on release
+    enum { MinClassShift = 10, MaxClassShift = 20, ClassCount = MaxClassShift - MinClassShift + 1 };
+
+    struct SizeClass {
+        std::vector<Block*> free;
+        uint64_t allocations;
+        uint64_t reuses;
+        uint64_t discards;
+        uint64_t inUse;
+        SizeClass() : allocations(0), reuses(0), discards(0), inUse(0) {}
+    };
+
+    void recycle(Block* block);
+
+    mutable Mutex lock;         // Protects everything but the connection limits
+    SizeClass classes[ClassCount];
+    size_t maxIdle;
+    size_t idleBytes;
+    uint64_t largeAllocations;
+    uint64_t largeInUse;
+    uint64_t largeInUseBytes;
+    volatile uint32_t connectionMinimum;
+    volatile uint32_t connectionMaximum;
+};
+
+/**
+ * The buffers belonging to one AsynchIO: a slot for each buffer it may
+ * use, holding memory from the pool only while the buffer is needed.
+ * Slots are never freed until the connection goes, so pointers to them
+ * stay valid; buffers with memory are in the connection's read queue,
+ * with its handler or being written, the others wait here as spares.
+ *
+ * Not thread safe: only used on the connection's IO thread.
+ */
+class AsynchIOBufferSet {
+  public:
+    QPID_COMMON_EXTERN AsynchIOBufferSet(BufferPool& pool = BufferPool::instance());
+
+    /** Make count empty slots (more if the connection minimum is higher) for buffers of size bytes */
+    QPID_COMMON_EXTERN void create(uint32_t size, uint32_t count);
+
+    /** True if spare() would return a buffer without growing */
+    bool hasSpare() const { return !spares.empty(); }
+
+    /**
+     * An empty buffer with memory from a spare slot; if there is none
+     * and grow is set add a slot, up to the connection maximum.
+     * Returns 0 if there is nothing to give.
+     */
+    QPID_COMMON_EXTERN AsynchIOBufferBase* spare(bool grow);
+
+    /**
+     * The connection has gone quiet: give the memory of empty buffers in
+     * queue back to the pool, leaving it with at least the connection
+     * minimum (counting buffers that aren't in the queue)
+     */
+    QPID_COMMON_EXTERN void trim(std::deque<AsynchIOBufferBase*>& queue);
+
+    uint32_t getBacked() const { return backed; }
+    uint32_t getSlots() const { return slots.size(); }
+
+  private:
+    BufferPool& pool;
+    std::deque<AsynchIOBufferBase> slots;
+    std::vector<AsynchIOBufferBase*> spares;
+    uint32_t size;
+    uint32_t backed;
+};
+
+}}
+
+#endif  /*!QPID_SYS_BUFFERPOOL_H*/
@@ -23,6 +23,7 @@
  */
 #include "qpid/sys/Codec.h"
 #include "qpid/framing/ProtocolVersion.h"
+#include "qpid/BufferRef.h"
 
 namespace qpid {
 
@@ -47,6 +48,14 @@ class ConnectionCodec : public Codec {
 
     virtual framing::ProtocolVersion getVersion() const = 0;
 
+    /** Decode from ref-counted memory: content decoded from it may keep
+     * referring to the memory rather than being copied out. Codecs that
+     * can't do that just decode() it.
+     */
+    virtual std::size_t decodeShared(const ConstBufferRef& buffer) {
+        return decode(buffer.begin(), buffer.end() - buffer.begin());
+    }
+
     struct Factory {
         virtual ~Factory() {}
 
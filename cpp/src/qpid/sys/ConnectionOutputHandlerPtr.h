@@ -45,6 +45,7 @@ class ConnectionOutputHandlerPtr : public ConnectionOutputHandler
     size_t getBuffered() const { return next->getBuffered(); }
     void abort() { next->abort(); }
     void activateOutput() { next->activateOutput(); }
+    void getWriteCounts(uint64_t& buffers, uint64_t& calls) const { next->getWriteCounts(buffers, calls); }
     void send(framing::AMQFrame& f) { next->send(f); }
 
   private:
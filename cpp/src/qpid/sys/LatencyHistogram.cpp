@@ -0,0 +1,165 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/sys/LatencyHistogram.h"
+#include "qpid/sys/Mutex.h"
+#include "qpid/sys/Thread.h"
+#include <algorithm>
+#include <vector>
+#include <string.h>
+
+namespace qpid {
+namespace sys {
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::reset() {
+    ::memset(counts, 0, sizeof(counts));
+    count = 0;
+    total = 0;
+    min = 0;
+    max = 0;
+}
+
+uint32_t LatencyHistogram::getBucket(int64_t value) {
+    if (value < SubBuckets)
+        return value < 0 ? 0 : uint32_t(value);
+    uint64_t v = value;
+    uint32_t msb = 0;
+    for (uint32_t shift = 32; shift; shift >>= 1) {
+        if (v >> shift) {
+            v >>= shift;
+            msb += shift;
+        }
+    }
+    uint32_t range = msb - SubBucketBits + 1;
+    if (range > Ranges)
+        return Buckets - 1;
+    uint32_t sub = uint32_t(value >> (range - 1)) - SubBuckets;
+    return range * SubBuckets + sub;
+}
+
+int64_t LatencyHistogram::getBucketLimit(uint32_t bucket) {
+    if (bucket < SubBuckets)
+        return bucket;
+    uint32_t range = bucket / SubBuckets;
+    uint32_t sub = bucket % SubBuckets;
+    return (int64_t(SubBuckets + sub + 1) << (range - 1)) - 1;
+}
+
+void LatencyHistogram::record(int64_t value) {
+    if (value < 0) value = 0;
+    ++counts[getBucket(value)];
+    if (!count || value < min) min = value;
+    if (value > max) max = value;
+    ++count;
+    total += value;
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other) {
+    if (!other.count) return;
+    for (uint32_t i = 0; i < Buckets; ++i)
+        counts[i] += other.counts[i];
+    if (!count || other.min < min) min = other.min;
+    if (other.max > max) max = other.max;
+    count += other.count;
+    total += other.total;
+}
+
+int64_t LatencyHistogram::getPercentile(double percent) const {
+    if (!count) return 0;
+    uint64_t wanted = uint64_t(count * percent / 100.0 + 0.5);
+    if (wanted < 1) wanted = 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < Buckets; ++i) {
+        seen += counts[i];
+        if (seen >= wanted)
+            return std::min(getBucketLimit(i), max);
+    }
+    return max;
+}
+
+bool LatencyStats::enabled = false;
+
+namespace {
+struct Histograms {
+    LatencyHistogram stages[LatencyStats::STAGES];
+};
+
+Mutex registryLock;
+std::vector<Histograms*> registry;
+
+QPID_TSS Histograms* threadHistograms = 0;
+QPID_TSS int64_t threadReadTime = 0;
+
+Histograms& local() {
+    if (!threadHistograms) {
+        // Kept when the thread goes so its samples still count
+        threadHistograms = new Histograms;
+        Mutex::ScopedLock l(registryLock);
+        registry.push_back(threadHistograms);
+    }
+    return *threadHistograms;
+}
+
+const char* names[LatencyStats::STAGES] = {
+    "read-decode",
+    "decode-enqueue",
+    "enqueue-dispatch",
+    "dispatch-write"
+};
+}
+
+void LatencyStats::enable(bool on) {
+    enabled = on;
+}
+
+void LatencyStats::record(Stage stage, Duration latency) {
+    local().stages[stage].record(latency);
+}
+
+void LatencyStats::setReadTime(AbsTime read) {
+    threadReadTime = Duration(AbsTime::Epoch(), read);
+}
+
+AbsTime LatencyStats::getReadTime() {
+    return threadReadTime ? AbsTime(AbsTime::Epoch(), threadReadTime) : AbsTime();
+}
+
+void LatencyStats::get(Stage stage, LatencyHistogram& total) {
+    Mutex::ScopedLock l(registryLock);
+    for (std::vector<Histograms*>::iterator i = registry.begin(); i != registry.end(); ++i)
+        total.add((*i)->stages[stage]);
+}
+
+void LatencyStats::reset(Stage stage) {
+    Mutex::ScopedLock l(registryLock);
+    for (std::vector<Histograms*>::iterator i = registry.begin(); i != registry.end(); ++i)
+        (*i)->stages[stage].reset();
+}
+
+std::string LatencyStats::getName(Stage stage) {
+    return names[stage];
+}
+
+}} // namespace qpid::sys
@@ -0,0 +1,128 @@
+#ifndef QPID_SYS_LATENCYHISTOGRAM_H
+#define QPID_SYS_LATENCYHISTOGRAM_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/sys/Time.h"
+#include "qpid/sys/IntegerTypes.h"
+#include "qpid/CommonImportExport.h"
+#include <string>
+
+namespace qpid {
+namespace sys {
+
+/**
+ * Histogram of latencies in nanoseconds, log-linear like an HDR
+ * histogram: each power of two range is split into 16 buckets, so any
+ * value is known to within about 6%. Recording is a handful of
+ * instructions and takes no lock, so a histogram should only be recorded
+ * into by one thread at a time.
+ */
+class LatencyHistogram {
+  public:
+    enum {
+        SubBucketBits = 4,
+        SubBuckets = 1 << SubBucketBits,
+        Ranges = 40,                        // Up to 2^44ns, about 5 hours
+        Buckets = SubBuckets * (Ranges + 1)
+    };
+
+    QPID_COMMON_EXTERN LatencyHistogram();
+
+    QPID_COMMON_EXTERN void record(int64_t value);
+    /** Add the samples recorded in another histogram to this one */
+    QPID_COMMON_EXTERN void add(const LatencyHistogram& other);
+    QPID_COMMON_EXTERN void reset();
+
+    uint64_t getCount() const { return count; }
+    int64_t getMin() const { return count ? min : 0; }
+    int64_t getMax() const { return max; }
+    int64_t getMean() const { return count ? total / count : 0; }
+    /** Value below which the given percentage of samples fall */
+    QPID_COMMON_EXTERN int64_t getPercentile(double percent) const;
+
+    /** Samples in a bucket, and the largest value the bucket holds */
+    uint64_t getBucketCount(uint32_t bucket) const { return counts[bucket]; }
+    QPID_COMMON_EXTERN static int64_t getBucketLimit(uint32_t bucket);
+    QPID_COMMON_EXTERN static uint32_t getBucket(int64_t value);
+
+  private:
+    uint64_t counts[Buckets];
+    uint64_t count;
+    int64_t total;
+    int64_t min;
+    int64_t max;
+};
+
+/**
+ * Latency histograms for the stages a message goes through in the broker:
+ *  - read to decode: from a socket read completing to its frames being decoded
+ *  - decode to enqueue: from a message being complete to it being on a queue
+ *  - enqueue to dispatch: from being on a queue to being sent to a consumer
+ *  - dispatch to write: from output being queued on a connection to it
+ *    being encoded for writing to the socket
+ *
+ * Each thread records into its own histograms, which are added together
+ * when they are read. Nothing is recorded unless enabled.
+ */
+class LatencyStats {
+  public:
+    enum Stage {
+        READ_DECODE,
+        DECODE_ENQUEUE,
+        ENQUEUE_DISPATCH,
+        DISPATCH_WRITE,
+        STAGES
+    };
+
+    static bool isEnabled() { return enabled; }
+    QPID_COMMON_EXTERN static void enable(bool on);
+
+    QPID_COMMON_EXTERN static void record(Stage stage, Duration latency);
+    /** Record the time since start, if start was set */
+    static void recordSince(Stage stage, AbsTime start) {
+        if (enabled && !(start == AbsTime()))
+            record(stage, Duration(start, AbsTime::now()));
+    }
+
+    /**
+     * Note when the data the calling thread is about to decode was read,
+     * so that whatever is decoded from it can be timed from the read
+     */
+    QPID_COMMON_EXTERN static void setReadTime(AbsTime read);
+    /** When the data being decoded was read, or zero if unknown */
+    QPID_COMMON_EXTERN static AbsTime getReadTime();
+
+    /** The samples recorded for a stage by all threads */
+    QPID_COMMON_EXTERN static void get(Stage stage, LatencyHistogram& total);
+    /** Forget the samples recorded for a stage; samples being recorded as this happens may be lost */
+    QPID_COMMON_EXTERN static void reset(Stage stage);
+
+    QPID_COMMON_EXTERN static std::string getName(Stage stage);
+
+  private:
+    QPID_COMMON_EXTERN static bool enabled;
+};
+
+}}
+
+#endif  /*!QPID_SYS_LATENCYHISTOGRAM_H*/
@@ -20,12 +20,19 @@
  */
 
 #include "qpid/sys/MemStat.h"
+#include "qpid/sys/BufferPool.h"
 
 // Null memory stats provider:
 // This is for platforms that do not have a way to get allocated
-// memory status
-void qpid::sys::MemStat::loadMemInfo(qmf::org::apache::qpid::broker::Memory*)
+// memory status, only the IO buffer pool is reported
+void qpid::sys::MemStat::loadMemInfo(qmf::org::apache::qpid::broker::Memory* object)
 {
+    qpid::sys::BufferPool::Stats pool(qpid::sys::BufferPool::instance().getStats());
+    object->set_ioBufferInUse(pool.inUseBytes);
+    object->set_ioBufferIdle(pool.idleBytes);
+    object->set_ioBufferAllocs(pool.allocations);
+    object->set_ioBufferReuses(pool.reuses);
+    object->set_ioBufferDiscards(pool.discards);
 }
 
 
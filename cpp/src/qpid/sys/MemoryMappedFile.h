@@ -0,0 +1,73 @@
+#ifndef QPID_SYS_MEMORYMAPPEDFILE_H
+#define QPID_SYS_MEMORYMAPPEDFILE_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/CommonImportExport.h"
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+namespace qpid {
+namespace sys {
+
+class MemoryMappedFilePrivate;
+
+/**
+ * @class MemoryMappedFile
+ *
+ * A scratch file whose regions can be mapped into memory. The file is
+ * created with a unique name in the requested directory and is removed
+ * when it is closed (or when the process exits); its contents never
+ * outlive the object. Regions must be mapped at offsets that are a
+ * multiple of getPageSize().
+ */
+class MemoryMappedFile : private boost::noncopyable
+{
+  public:
+    QPID_COMMON_EXTERN MemoryMappedFile();
+    QPID_COMMON_EXTERN ~MemoryMappedFile();
+    /**
+     * Create the file in the specified directory, the name is used
+     * only as a prefix to aid diagnosis.
+     * @return the path of the file created
+     */
+    QPID_COMMON_EXTERN std::string open(const std::string& name, const std::string& directory);
+    QPID_COMMON_EXTERN void close();
+    /** The granularity with which regions of the file may be mapped. */
+    QPID_COMMON_EXTERN static size_t getPageSize();
+    /** Grow the file (if necessary) so that it is at least size bytes. */
+    QPID_COMMON_EXTERN void expand(size_t size);
+    QPID_COMMON_EXTERN char* map(size_t offset, size_t size);
+    QPID_COMMON_EXTERN void unmap(char* region, size_t size);
+    QPID_COMMON_EXTERN void flush(char* region, size_t size);
+    /**
+     * Start reading a region of the file into memory in the
+     * background, so that mapping it later need not wait on the disk.
+     * Only a hint: it may do nothing.
+     */
+    QPID_COMMON_EXTERN void prefetch(size_t offset, size_t size);
+  private:
+    boost::shared_ptr<MemoryMappedFilePrivate> impl;
+};
+}} // namespace qpid::sys
+
+#endif  /*!QPID_SYS_MEMORYMAPPEDFILE_H*/
@@ -23,6 +23,7 @@
  */
 
 #include "qpid/sys/IntegerTypes.h"
+#include <cstddef>
 
 namespace qpid {
 namespace sys {
@@ -33,6 +34,10 @@ namespace sys {
         virtual ~OutputControl() {}
         virtual void abort() = 0;
         virtual void activateOutput() = 0;
+        /** Buffers written and write calls made by the transport, if it counts them */
+        virtual void getWriteCounts(uint64_t& buffers, uint64_t& calls) const { buffers = calls = 0; }
+        /** Bytes of output queued but not yet written, if the transport counts them */
+        virtual size_t getBuffered() const { return 0; }
     };
 
 }
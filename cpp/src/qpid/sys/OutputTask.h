@@ -21,17 +21,28 @@
 #ifndef _OutputTask_
 #define _OutputTask_
 
+#include "qpid/sys/AtomicValue.h"
+#include "qpid/sys/IntegerTypes.h"
+
 namespace qpid {
 namespace sys {
 
     class OutputTask 
     {
     public:
+        OutputTask() : queuedForOutput(0), nextForOutput(0), outputOverdrawn(0) {}
         virtual ~OutputTask() {}
         /** Generate some  output.
          *@return true if output was generated, false if there is no work to do.
          */
         virtual bool doOutput() = 0;
+
+    private:
+        // Used by AggregateOutput to hold the task
+        friend class AggregateOutput;
+        AtomicValue<uint32_t> queuedForOutput;
+        OutputTask* nextForOutput;
+        size_t outputOverdrawn;
     };
 
 }
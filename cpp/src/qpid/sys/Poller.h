@@ -81,6 +81,10 @@ public:
     };
     
     QPID_COMMON_EXTERN Poller();
+    // Allow each wait for IO to harvest up to batchSize ready handles at once;
+    // they are handed out one at a time to the thread that harvested them.
+    // Ignored by implementations that cannot harvest events in batches.
+    QPID_COMMON_EXTERN explicit Poller(uint32_t batchSize);
     QPID_COMMON_EXTERN ~Poller();
     /** Note: this function is async-signal safe */
     QPID_COMMON_EXTERN void shutdown();
@@ -0,0 +1,130 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/sys/PollerPool.h"
+#include "qpid/sys/Runnable.h"
+#include "qpid/sys/SystemInfo.h"
+#include "qpid/sys/Thread.h"
+#include "qpid/Exception.h"
+#include "qpid/Msg.h"
+#include "qpid/log/Statement.h"
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <algorithm>
+
+namespace qpid {
+namespace sys {
+
+namespace {
+const std::string ROUND_ROBIN_NAME("round-robin");
+const std::string LEAST_CONNECTIONS_NAME("least-connections");
+
+class ShardThread : public Runnable {
+    Poller::shared_ptr poller;
+    long cpu;
+
+  public:
+    ShardThread(Poller::shared_ptr p, long c) : poller(p), cpu(c) {}
+
+    void run() {
+        if (cpu >= 0 && !SystemInfo::setThreadAffinity(cpu)) {
+            QPID_LOG(warning, "Could not bind IO thread to CPU " << cpu);
+        }
+        poller->run();
+    }
+};
+}
+
+PollerPool::PollerPool(size_t shards, uint32_t batchSize, Policy p) :
+    connections(new AtomicValue<uint32_t>[std::max(shards, size_t(1))]),
+    policy(p)
+{
+    for (size_t i = 0; i < std::max(shards, size_t(1)); ++i) {
+        pollers.push_back(Poller::shared_ptr(new Poller(batchSize)));
+    }
+}
+
+PollerPool::~PollerPool() {}
+
+size_t PollerPool::assign() {
+    size_t n = pollers.size();
+    size_t shard = nextShard++ % n;
+    if (policy == LEAST_CONNECTIONS) {
+        // Start from a rotating position so that ties are spread out
+        size_t start = shard;
+        uint32_t least = connections[shard].get();
+        for (size_t i = 1; i < n && least > 0; ++i) {
+            size_t s = (start + i) % n;
+            uint32_t c = connections[s].get();
+            if (c < least) {
+                least = c;
+                shard = s;
+            }
+        }
+    }
+    ++connections[shard];
+    return shard;
+}
+
+void PollerPool::release(size_t shard) {
+    --connections[shard];
+}
+
+void PollerPool::run(size_t threadCount, bool pin) {
+    size_t n = std::max(threadCount, pollers.size());
+    long cpus = pin ? SystemInfo::concurrency() : -1;
+    if (pin && cpus <= 0) {
+        QPID_LOG(warning, "Unable to determine number of CPUs, IO threads will not be bound");
+    }
+    QPID_LOG(info, "Running " << n << " IO threads over " << pollers.size() << " pollers");
+
+    boost::ptr_vector<ShardThread> shardThreads;
+    for (size_t i = 0; i < n; ++i) {
+        long cpu = (cpus > 0 && i < size_t(cpus)) ? long(i) : -1;
+        shardThreads.push_back(new ShardThread(pollers[i % pollers.size()], cpu));
+    }
+
+    // Run n-1 io threads, the calling thread being the last
+    std::vector<Thread> t(n-1);
+    for (size_t i = 1; i < n; ++i)
+        t[i-1] = Thread(shardThreads[i]);
+
+    shardThreads[0].run();
+
+    for (size_t i = 0; i < n-1; ++i) {
+        t[i].join();
+    }
+}
+
+void PollerPool::shutdown() {
+    // NB: this function must be async-signal safe
+    for (size_t i = 0; i < pollers.size(); ++i) {
+        pollers[i]->shutdown();
+    }
+}
+
+PollerPool::Policy PollerPool::getPolicy(const std::string& name) {
+    if (name == ROUND_ROBIN_NAME) return ROUND_ROBIN;
+    if (name == LEAST_CONNECTIONS_NAME) return LEAST_CONNECTIONS;
+    throw Exception(QPID_MSG("Invalid poller shard policy: " << name
+                             << " (expected " << ROUND_ROBIN_NAME << " or " << LEAST_CONNECTIONS_NAME << ")"));
+}
+
+}} // namespace qpid::sys
@@ -0,0 +1,88 @@
+#ifndef QPID_SYS_POLLERPOOL_H
+#define QPID_SYS_POLLERPOOL_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/sys/Poller.h"
+#include "qpid/sys/AtomicValue.h"
+#include "qpid/sys/IntegerTypes.h"
+#include "qpid/CommonImportExport.h"
+#include <boost/scoped_array.hpp>
+#include <string>
+#include <vector>
+
+namespace qpid {
+namespace sys {
+
+/**
+ * A set of independent pollers ("shards"), each serviced by its own
+ * group of IO threads. Every connection is assigned to a single shard
+ * for its lifetime, so its events are always handled by the same
+ * threads and the shards never contend on a common epoll set.
+ *
+ * New connections are placed according to a policy: round robin, or on
+ * the shard currently holding the fewest connections, which steers new
+ * load away from shards that have become skewed.
+ */
+class PollerPool {
+  public:
+    enum Policy {
+        ROUND_ROBIN,
+        LEAST_CONNECTIONS
+    };
+
+    QPID_COMMON_EXTERN PollerPool(size_t shards, uint32_t batchSize, Policy policy = LEAST_CONNECTIONS);
+    QPID_COMMON_EXTERN ~PollerPool();
+
+    size_t size() const { return pollers.size(); }
+    const Poller::shared_ptr& getPoller(size_t shard) const { return pollers[shard]; }
+    uint32_t getConnections(size_t shard) const { return connections[shard].get(); }
+
+    /** Choose the shard for a new connection and count it against that shard */
+    QPID_COMMON_EXTERN size_t assign();
+    /** A connection previously assigned to shard has gone away */
+    QPID_COMMON_EXTERN void release(size_t shard);
+
+    /**
+     * Service the pollers with threadCount IO threads (at least one per
+     * shard), the calling thread being one of them. If pin is set each
+     * thread is bound to its own CPU where there are enough. Returns when
+     * the pool has been shut down.
+     */
+    QPID_COMMON_EXTERN void run(size_t threadCount, bool pin);
+
+    /** Note: this function is async-signal safe */
+    QPID_COMMON_EXTERN void shutdown();
+
+    /** Parse "round-robin" or "least-connections", throws on anything else */
+    QPID_COMMON_EXTERN static Policy getPolicy(const std::string& name);
+
+  private:
+    std::vector<Poller::shared_ptr> pollers;
+    boost::scoped_array<AtomicValue<uint32_t> > connections;
+    AtomicValue<uint32_t> nextShard;
+    const Policy policy;
+};
+
+}}
+
+#endif  /*!QPID_SYS_POLLERPOOL_H*/
@@ -25,6 +25,7 @@
 #include "qpid/log/Statement.h"
 #include "qpid/sys/AsynchIOHandler.h"
 #include "qpid/sys/AsynchIO.h"
+#include "qpid/sys/PollerPool.h"
 #include "qpid/sys/Socket.h"
 #include "qpid/sys/SocketAddress.h"
 #include "qpid/sys/SystemInfo.h"
@@ -35,22 +36,39 @@ namespace qpid {
 namespace sys {
 
 namespace {
+    void closedOnShard(
+        PollerPool* pollers, size_t shard, AsynchIOHandler* async,
+        AsynchIO& aio, const Socket& s)
+    {
+        pollers->release(shard);
+        async->closedSocket(aio, s);
+    }
+
     void establishedCommon(
         AsynchIOHandler* async,
         boost::shared_ptr<Poller> poller, const SocketTransportOptions& opts, Timer* timer,
-        const Socket& s)
+        const Socket& s, PollerPool* pollers)
     {
         if (opts.tcpNoDelay) {
             s.setTcpNoDelay();
             QPID_LOG(info, "Set TCP_NODELAY on connection to " << s.getPeerAddress());
         }
 
+        AsynchIO::ClosedCallback closed = boost::bind(&AsynchIOHandler::closedSocket, async, _1, _2);
+        if (pollers) {
+            // The connection stays on the chosen shard until it is closed
+            size_t shard = pollers->assign();
+            poller = pollers->getPoller(shard);
+            closed = boost::bind(&closedOnShard, pollers, shard, async, _1, _2);
+            QPID_LOG(debug, "Connection " << s.getFullAddress() << " assigned to IO shard " << shard);
+        }
+
         AsynchIO* aio = AsynchIO::create
         (s,
          boost::bind(&AsynchIOHandler::readbuff, async, _1, _2),
          boost::bind(&AsynchIOHandler::eof, async, _1),
          boost::bind(&AsynchIOHandler::disconnect, async, _1),
-         boost::bind(&AsynchIOHandler::closedSocket, async, _1, _2),
+         closed,
          boost::bind(&AsynchIOHandler::nobuffs, async, _1),
          boost::bind(&AsynchIOHandler::idle, async, _1));
 
@@ -60,18 +78,18 @@ namespace {
 
     void establishedIncoming(
         boost::shared_ptr<Poller> poller, const SocketTransportOptions& opts, Timer* timer,
-        const Socket& s, ConnectionCodec::Factory* f)
+        PollerPool* pollers, const Socket& s, ConnectionCodec::Factory* f)
     {
         AsynchIOHandler* async = new AsynchIOHandler(broker::QPID_NAME_PREFIX+s.getFullAddress(), f, false, opts.nodict);
-        establishedCommon(async, poller, opts, timer, s);
+        establishedCommon(async, poller, opts, timer, s, pollers);
     }
 
     void establishedOutgoing(
         boost::shared_ptr<Poller> poller, const SocketTransportOptions& opts, Timer* timer,
-        const Socket& s, ConnectionCodec::Factory* f, const std::string& name)
+        PollerPool* pollers, const Socket& s, ConnectionCodec::Factory* f, const std::string& name)
     {
         AsynchIOHandler* async = new AsynchIOHandler(name, f, true, opts.nodict);
-        establishedCommon(async, poller, opts, timer, s);
+        establishedCommon(async, poller, opts, timer, s, pollers);
     }
 
     void connectFailed(
@@ -108,10 +126,10 @@ namespace {
     }
 }
 
-SocketAcceptor::SocketAcceptor(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer0) :
+SocketAcceptor::SocketAcceptor(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer0, PollerPool* pollers) :
     timer(timer0),
     options(tcpNoDelay, nodict, maxNegotiateTime),
-    established(boost::bind(&establishedIncoming, _1, options, &timer, _2, _3))
+    established(boost::bind(&establishedIncoming, _1, options, &timer, pollers, _2, _3))
 {}
 
 SocketAcceptor::SocketAcceptor(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer0, const EstablishedCallback& established0) :
@@ -171,10 +189,11 @@ void SocketAcceptor::accept(boost::shared_ptr<Poller> poller, ConnectionCodec::F
     }
 }
 
-SocketConnector::SocketConnector(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer0, const SocketFactory& factory0) :
+SocketConnector::SocketConnector(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer0, const SocketFactory& factory0, PollerPool* pollers0) :
     timer(timer0),
     factory(factory0),
-    options(tcpNoDelay, nodict, maxNegotiateTime)
+    options(tcpNoDelay, nodict, maxNegotiateTime),
+    pollers(pollers0)
 {}
 
 void SocketConnector::connect(
@@ -195,7 +214,7 @@ void SocketConnector::connect(
             *socket,
             host,
             port,
-            boost::bind(&establishedOutgoing, poller, options, &timer, _1, fact, name),
+            boost::bind(&establishedOutgoing, poller, options, &timer, pollers, _1, fact, name),
             boost::bind(&connectFailed, _1, _2, _3, failed));
         c->start(poller);
     } catch (std::exception&) {
@@ -34,6 +34,7 @@ namespace sys {
 
 class AsynchAcceptor;
 class Poller;
+class PollerPool;
 class Timer;
 class Socket;
 typedef boost::function0<Socket*> SocketFactory;
@@ -59,7 +60,9 @@ class SocketAcceptor : public TransportAcceptor {
     const EstablishedCallback established;
 
 public:
-    SocketAcceptor(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer);
+    // If pollers is given each accepted connection is assigned to one of its
+    // shards, otherwise it is serviced by the poller passed to accept()
+    SocketAcceptor(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer, PollerPool* pollers = 0);
     SocketAcceptor(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer, const EstablishedCallback& established);
 
     // Create sockets from list of interfaces and listen to them
@@ -75,9 +78,10 @@ class SocketConnector : public TransportConnector {
     Timer& timer;
     const SocketFactory factory;
     SocketTransportOptions options;
+    PollerPool* const pollers;
 
 public:
-    SocketConnector(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer, const SocketFactory& factory);
+    SocketConnector(bool tcpNoDelay, bool nodict, uint32_t maxNegotiateTime, Timer& timer, const SocketFactory& factory, PollerPool* pollers = 0);
 
     void connect(boost::shared_ptr<Poller> poller,
                  const std::string& name,
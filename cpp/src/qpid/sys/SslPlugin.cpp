@@ -117,7 +117,7 @@ static struct SslPlugin : public Plugin {
                     const broker::Broker::Options& opts = broker->getOptions();
                     TransportAcceptor::shared_ptr ta;
                     SocketAcceptor* sa =
-                        new SocketAcceptor(opts.tcpNoDelay, options.nodict, opts.maxNegotiateTime, broker->getTimer());
+                        new SocketAcceptor(opts.tcpNoDelay, options.nodict, opts.maxNegotiateTime, broker->getTimer(), &broker->getPollerPool());
                     uint16_t port = sa->listen(opts.listenInterfaces, boost::lexical_cast<std::string>(options.port), opts.connectionBacklog,
                                                options.multiplex ?
                                                  boost::bind(&createServerSSLMuxSocket, options) :
@@ -132,7 +132,7 @@ static struct SslPlugin : public Plugin {
 
                     TransportConnector::shared_ptr tc(
                         new SocketConnector(opts.tcpNoDelay, options.nodict, opts.maxNegotiateTime, broker->getTimer(),
-                                            &createClientSSLSocket));
+                                            &createClientSSLSocket, &broker->getPollerPool()));
                     broker->registerTransport("ssl", ta, tc, port);
                 } catch (const std::exception& e) {
                     QPID_LOG(error, "Failed to initialise SSL plugin: " << e.what());
@@ -62,7 +62,7 @@ static class TCPIOPlugin : public Plugin {
             uint16_t port = opts.port;
             TransportAcceptor::shared_ptr ta;
             if (shouldListen) {
-                SocketAcceptor* aa = new SocketAcceptor(opts.tcpNoDelay, false, opts.maxNegotiateTime, broker->getTimer());
+                SocketAcceptor* aa = new SocketAcceptor(opts.tcpNoDelay, false, opts.maxNegotiateTime, broker->getTimer(), &broker->getPollerPool());
                 ta.reset(aa);
                 port = aa->listen(opts.listenInterfaces, boost::lexical_cast<std::string>(opts.port), opts.connectionBacklog, &createSocket);
                 if ( port!=0 ) {
@@ -70,7 +70,7 @@ static class TCPIOPlugin : public Plugin {
                 }
             }
 
-            TransportConnector::shared_ptr tc(new SocketConnector(opts.tcpNoDelay, false, opts.maxNegotiateTime, broker->getTimer(), &createSocket));
+            TransportConnector::shared_ptr tc(new SocketConnector(opts.tcpNoDelay, false, opts.maxNegotiateTime, broker->getTimer(), &createSocket, &broker->getPollerPool()));
 
             broker->registerTransport("tcp", ta, tc, port);
         }
@@ -22,20 +22,32 @@
 #include "qpid/sys/Mutex.h"
 #include "qpid/log/Statement.h"
 
+#include <algorithm>
 #include <numeric>
 
 using boost::intrusive_ptr;
 using std::max;
+using std::min;
 
 namespace qpid {
 namespace sys {
 
+namespace {
+// Resolution of the timing wheel
+const Duration TickDuration(TIME_MSEC);
+}
+
 TimerTask::TimerTask(Duration timeout, const std::string&  n) :
     name(n),
     sortTime(AbsTime::FarFuture()),
     period(timeout),
     nextFireTime(AbsTime::now(), timeout),
-    state(WAITING)
+    state(WAITING),
+    timer(0),
+    list(0),
+    level(0),
+    expiry(0),
+    firing(false)
 {}
 
 TimerTask::TimerTask(AbsTime time, const std::string&  n) :
@@ -43,7 +55,12 @@ TimerTask::TimerTask(AbsTime time, const std::string&  n) :
     sortTime(AbsTime::FarFuture()),
     period(0),
     nextFireTime(time),
-    state(WAITING)
+    state(WAITING),
+    timer(0),
+    list(0),
+    level(0),
+    expiry(0),
+    firing(false)
 {}
 
 TimerTask::~TimerTask() {}
@@ -89,27 +106,52 @@ void TimerTask::restart() {
 }
 
 void TimerTask::cancel() {
+    {
     Monitor::ScopedLock l(stateMonitor);
     while (state == CALLING) {
         stateMonitor.wait();
     }
     state = CANCELLED;
+    }
+    // Don't leave it in the Timer until it would have been due
+    Timer* t = timer;
+    if (t) t->remove(*this);
 }
 
 // TODO AStitcher 21/08/09 The threshholds for emitting warnings are a little arbitrary
-Timer::Timer() :
+Timer::Timer(uint32_t threadCount) :
+    origin(AbsTime::now()),
+    current(0),
+    threads(max(threadCount, 1u)),
     active(false),
     late(50 * TIME_MSEC),
     overran(2 * TIME_MSEC),
     lateCancel(500 * TIME_MSEC),
     warn(60 * TIME_SEC)
 {
+    for (uint32_t l = 0; l < Levels; ++l) counts[l] = 0;
     start();
 }
 
 Timer::~Timer()
 {
     stop();
+    // Anything still held forgets this Timer
+    List tasks;
+    {
+        Monitor::ScopedLock l(monitor);
+        for (uint32_t l = 0; l < Levels; ++l) {
+            for (uint32_t i = 0; i < Slots; ++i) {
+                tasks.splice(tasks.end(), wheel[l][i]);
+            }
+            counts[l] = 0;
+        }
+        tasks.splice(tasks.end(), ready);
+        for (List::iterator i = tasks.begin(); i != tasks.end(); ++i) {
+            (*i)->list = 0;
+            (*i)->timer = 0;
+        }
+    }
 }
 
 class TimerTaskCallbackScope {
@@ -128,62 +170,190 @@ public:
     }
 };
 
+uint64_t Timer::tickOf(AbsTime time, bool roundUp) const
+{
+    Duration d(origin, time);
+    if (d <= 0) return 0;
+    uint64_t tick = d / TickDuration;
+    if (roundUp && d % TickDuration) ++tick;
+    return tick;
+}
+
+AbsTime Timer::timeOf(uint64_t tick) const
+{
+    return AbsTime(origin, Duration(tick * TickDuration));
+}
+
+// Put a task in the slot for its expiry: in level 0 if it's due within
+// a rotation, otherwise in the lowest level whose rotation covers it
+void Timer::insert(const intrusive_ptr<TimerTask>& task, uint64_t expiry)
+{
+    assert(!task->list);
+    expiry = max(expiry, current);
+    uint64_t delta = expiry - current;
+    uint32_t l = 0;
+    while (l < Levels-1 && delta >= (uint64_t(1) << (SlotBits*(l+1)))) ++l;
+    if (delta >= (uint64_t(1) << (SlotBits*Levels))) {
+        // Beyond the wheel: it'll be found not to be due and put back
+        expiry = current + (uint64_t(1) << (SlotBits*Levels)) - 1;
+    }
+    List& slot = wheel[l][(expiry >> (SlotBits*l)) & (Slots-1)];
+    task->position = slot.insert(slot.end(), task);
+    task->list = &slot;
+    task->level = l;
+    task->expiry = expiry;
+    ++counts[l];
+}
+
+void Timer::unlink(TimerTask& task)
+{
+    assert(task.list);
+    if (task.list != &ready) --counts[task.level];
+    task.list->erase(task.position);
+    task.list = 0;
+}
+
+// Spread the tasks in the next slot of a level over the levels below
+void Timer::cascade(uint32_t l)
+{
+    List tasks;
+    tasks.swap(wheel[l][(current >> (SlotBits*l)) & (Slots-1)]);
+    for (List::iterator i = tasks.begin(); i != tasks.end(); ++i) {
+        --counts[l];
+        (*i)->list = 0;
+        insert(*i, (*i)->expiry);
+    }
+}
+
+// Move everything due up to and including tick target to the ready list
+void Timer::advance(uint64_t target)
+{
+    while (current <= target) {
+        for (uint32_t l = Levels-1; l > 0; --l) {
+            if ((current & ((uint64_t(1) << (SlotBits*l)) - 1)) == 0) cascade(l);
+        }
+        List& slot = wheel[0][current & (Slots-1)];
+        for (List::iterator i = slot.begin(); i != slot.end(); ++i) {
+            (*i)->list = &ready;
+            --counts[0];
+        }
+        ready.splice(ready.end(), slot);
+        ++current;
+
+        // Skip the ticks where nothing can happen: up to the next
+        // rotation of the lowest level that has anything in it
+        uint32_t l = 0;
+        while (l < Levels && counts[l] == 0) ++l;
+        if (l == Levels) {
+            current = target + 1;
+        } else if (l > 0) {
+            uint64_t rotation = uint64_t(1) << (SlotBits*l);
+            current = min((current + rotation - 1) & ~(rotation - 1), target + 1);
+        }
+    }
+}
+
+// The earliest tick at which something in the wheel could become due:
+// the first occupied slot of level 0, or the first cascade of a higher
+// level's slot if that comes sooner
+bool Timer::nextDue(uint64_t& tick) const
+{
+    bool found = false;
+    if (counts[0]) {
+        for (uint64_t t = current; t < current + Slots; ++t) {
+            if (!wheel[0][t & (Slots-1)].empty()) {
+                tick = t;
+                found = true;
+                break;
+            }
+        }
+    }
+    for (uint32_t l = 1; l < Levels; ++l) {
+        if (!counts[l]) continue;
+        // The slot for this rotation is still to be cascaded if the
+        // wheel stopped right at its start
+        uint64_t rotation = current >> (SlotBits*l);
+        bool started = current & ((uint64_t(1) << (SlotBits*l)) - 1);
+        for (uint64_t r = started ? rotation + 1 : rotation; r <= rotation + Slots; ++r) {
+            if (!wheel[l][r & (Slots-1)].empty()) {
+                uint64_t t = r << (SlotBits*l);
+                tick = found ? min(tick, t) : t;
+                found = true;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
 void Timer::run()
 {
     Monitor::ScopedLock l(monitor);
     while (active) {
-        if (tasks.empty()) {
-            monitor.wait();
-        } else {
-            intrusive_ptr<TimerTask> t = tasks.top();
-            tasks.pop();
-            assert(!(t->nextFireTime < t->sortTime));
+        advance(tickOf(AbsTime::now(), false));
+        if (ready.empty()) {
+            uint64_t due;
+            if (nextDue(due)) {
+                monitor.wait(timeOf(due));
+            } else {
+                monitor.wait();
+            }
+            continue;
+        }
+        // Let another thread get on with the rest
+        if (threads > 1 && ++ready.begin() != ready.end()) {
+            monitor.notify();
+        }
 
-            // warn on extreme lateness
-            AbsTime start(AbsTime::now());
-            Duration delay(t->sortTime, start);
+        intrusive_ptr<TimerTask> t = ready.front();
+        unlink(*t);
+        assert(!(t->nextFireTime < t->sortTime));
+        if (t->firing) {
+            // Another thread is still firing it, try again on the next tick
+            insert(t, current);
+            continue;
+        }
+
+        // warn on extreme lateness
+        AbsTime start(AbsTime::now());
+        Duration delay(t->sortTime, start);
+        TimerTaskCallbackScope s(*t);
+        if (s) {
+            if (delay > lateCancel) {
+                QPID_LOG(debug, t->name << " cancelled timer woken up " <<
+                         delay / TIME_MSEC << "ms late");
+            }
+        } else if(Duration(t->nextFireTime, start) >= 0) {
+            t->firing = true;
             {
-            TimerTaskCallbackScope s(*t);
-            if (s) {
-                if (delay > lateCancel) {
-                    QPID_LOG(debug, t->name << " cancelled timer woken up " <<
-                             delay / TIME_MSEC << "ms late");
-                }
-                continue;
-            } else if(Duration(t->nextFireTime, start) >= 0) {
-                {
-                    Monitor::ScopedUnlock u(monitor);
-                    fire(t);
-                }
-                // Warn if callback overran next timer's start.
-                AbsTime end(AbsTime::now());
-                Duration overrun (0);
-                if (!tasks.empty()) {
-                    overrun = Duration(tasks.top()->nextFireTime, end);
-                }
-                bool warningsEnabled;                  // TimerWarning enabled
-                QPID_LOG_TEST(debug, warningsEnabled); // TimerWarning emitted at debug level
-                if (warningsEnabled) {
-                    if (overrun > overran) {
-                        if (delay > overran) // if delay is significant to an overrun.
-                            warn.lateAndOverran(t->name, delay, overrun, Duration(start, end));
-                        else
-                            warn.overran(t->name, overrun, Duration(start, end));
-                    }
-                    else if (delay > late)
-                        warn.late(t->name, delay);
-                }
-                continue;
-            } else {
-                // If the timer was adjusted into the future it might no longer
-                // be the next event, so push and then get top to make sure
-                // You can only push events into the future
-                t->sortTime = t->nextFireTime;
-                tasks.push(t);
+                Monitor::ScopedUnlock u(monitor);
+                fire(t);
             }
+            t->firing = false;
+            // Warn if callback overran next timer's start.
+            AbsTime end(AbsTime::now());
+            advance(tickOf(end, false));
+            Duration overrun (0);
+            if (!ready.empty()) {
+                overrun = Duration(ready.front()->sortTime, end);
+            }
+            bool warningsEnabled;                  // TimerWarning enabled
+            QPID_LOG_TEST(debug, warningsEnabled); // TimerWarning emitted at debug level
+            if (warningsEnabled) {
+                if (overrun > overran) {
+                    if (delay > overran) // if delay is significant to an overrun.
+                        warn.lateAndOverran(t->name, delay, overrun, Duration(start, end));
+                    else
+                        warn.overran(t->name, overrun, Duration(start, end));
+                }
+                else if (delay > late)
+                    warn.late(t->name, delay);
             }
-            assert(!tasks.empty());
-            monitor.wait(tasks.top()->sortTime);
+        } else {
+            // The task was restarted after it was added so put it back
+            // where it belongs now; you can only move tasks into the future
+            t->sortTime = t->nextFireTime;
+            insert(t, tickOf(t->sortTime, true));
         }
     }
 }
@@ -191,17 +361,36 @@ void Timer::run()
 void Timer::add(intrusive_ptr<TimerTask> task)
 {
     Monitor::ScopedLock l(monitor);
+    assert(!task->list || task->timer == this);
+    if (task->list) unlink(*task);
+    if (ready.empty() && !counts[0] && !counts[1] && !counts[2] && !counts[3]) {
+        // Nothing to move the wheel along since it was last looked at
+        current = max(current, tickOf(AbsTime::now(), false));
+    }
+    task->timer = this;
     task->sortTime = task->nextFireTime;
-    tasks.push(task);
+    insert(task, tickOf(task->sortTime, true));
     monitor.notify();
 }
 
+void Timer::remove(TimerTask& task)
+{
+    intrusive_ptr<TimerTask> held; // Released after unlocking
+    Monitor::ScopedLock l(monitor);
+    if (task.timer == this && task.list) {
+        held = *task.position;
+        unlink(task);
+    }
+}
+
 void Timer::start()
 {
     Monitor::ScopedLock l(monitor);
     if (!active) {
         active = true;
-        runner = Thread(this);
+        for (uint32_t i = 0; i < threads; ++i) {
+            runners.push_back(Thread(this));
+        }
     }
 }
 
@@ -213,7 +402,10 @@ void Timer::stop()
         active = false;
         monitor.notifyAll();
     }
-    runner.join();
+    for (std::vector<Thread>::iterator i = runners.begin(); i != runners.end(); ++i) {
+        i->join();
+    }
+    runners.clear();
 }
 
 // Allow subclasses to override behavior when firing a task.
@@ -225,11 +417,4 @@ void Timer::fire(boost::intrusive_ptr<TimerTask> t) {
     }
 }
 
-bool operator<(const intrusive_ptr<TimerTask>& a,
-                       const intrusive_ptr<TimerTask>& b)
-{
-    // Lower priority if time is later
-    return a.get() && b.get() && a->sortTime > b->sortTime;
-}
-
 }}
@@ -26,10 +26,12 @@
 #include "qpid/sys/Mutex.h"
 #include "qpid/sys/Thread.h"
 #include "qpid/sys/Runnable.h"
+#include "qpid/sys/IntegerTypes.h"
 #include "qpid/RefCounted.h"
 #include "qpid/CommonImportExport.h"
 #include <memory>
-#include <queue>
+#include <list>
+#include <vector>
 
 #include <boost/intrusive_ptr.hpp>
 
@@ -41,8 +43,8 @@ class Timer;
 class TimerTask : public RefCounted {
   friend class Timer;
   friend class TimerTaskCallbackScope;
-  friend bool operator<(const boost::intrusive_ptr<TimerTask>&,
-                        const boost::intrusive_ptr<TimerTask>&);
+
+    typedef std::list<boost::intrusive_ptr<TimerTask> > List;
 
     std::string name;
     AbsTime sortTime;
@@ -51,6 +53,15 @@ class TimerTask : public RefCounted {
     qpid::sys::Monitor stateMonitor;
     enum {WAITING, CALLING, CANCELLED} state;
 
+    // Where the task is held by the Timer it was last added to, protected
+    // by that Timer's lock
+    Timer* timer;
+    List* list;                 // 0 if not held at all
+    List::iterator position;
+    uint32_t level;
+    uint64_t expiry;            // Tick the task is due at
+    bool firing;
+
     bool prepareToFire();
     void finishFiring();
     bool readyToFire() const;
@@ -72,21 +83,49 @@ class TimerTask : public RefCounted {
     virtual void fire() = 0;
 };
 
-// For the priority_queue order
-bool operator<(const boost::intrusive_ptr<TimerTask>& a,
-               const boost::intrusive_ptr<TimerTask>& b);
-
+/**
+ * Runs TimerTasks when they are due.
+ *
+ * Tasks are held in a hierarchical timing wheel with millisecond ticks:
+ * adding and cancelling a task take constant time, and a cancelled task
+ * is dropped straight away rather than when it would have fired. Due
+ * tasks are fired by one thread, or by a pool of them; a task is never
+ * fired by two threads at once.
+ *
+ * A Timer must not be destroyed while other threads can still add or
+ * cancel its tasks.
+ */
 class Timer : private Runnable {
+    typedef TimerTask::List List;
+
+    // Level 0 has a slot per tick, each higher level a slot per
+    // rotation of the level below
+    enum { Levels = 4, SlotBits = 8, Slots = 1 << SlotBits };
+
     qpid::sys::Monitor monitor;
-    std::priority_queue<boost::intrusive_ptr<TimerTask> > tasks;
-    qpid::sys::Thread runner;
+    List wheel[Levels][Slots];
+    uint32_t counts[Levels];    // Tasks in each level
+    List ready;                 // Due and waiting to be fired
+    const AbsTime origin;       // Time of tick 0
+    uint64_t current;           // Next tick to be processed
+    std::vector<qpid::sys::Thread> runners;
+    const uint32_t threads;
     bool active;
 
     // Runnable interface
     void run();
 
+    uint64_t tickOf(AbsTime time, bool roundUp) const;
+    AbsTime timeOf(uint64_t tick) const;
+    void insert(const boost::intrusive_ptr<TimerTask>& task, uint64_t expiry);
+    void unlink(TimerTask& task);
+    void advance(uint64_t target);
+    void cascade(uint32_t level);
+    bool nextDue(uint64_t& tick) const;
+    void remove(TimerTask& task);
+
   public:
-    QPID_COMMON_EXTERN Timer();
+    QPID_COMMON_EXTERN Timer(uint32_t threads = 1);
     QPID_COMMON_EXTERN virtual ~Timer();
 
     QPID_COMMON_EXTERN virtual void add(boost::intrusive_ptr<TimerTask> task);
@@ -101,6 +140,9 @@ class Timer : private Runnable {
     Duration overran;
     Duration lateCancel;
     TimerWarnings warn;
+
+  private:
+    friend class TimerTask;
 };
 
 
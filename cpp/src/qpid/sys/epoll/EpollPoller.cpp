@@ -32,6 +32,7 @@
 #include <signal.h>
 
 #include <assert.h>
+#include <algorithm>
 #include <queue>
 #include <set>
 #include <exception>
@@ -196,6 +197,30 @@ class PollerPrivate {
     friend class Poller;
 
     static const int DefaultFds = 256;
+    static const int MaxEvents = 64;
+
+    /**
+     * Events harvested by a single epoll_wait but not yet returned by
+     * Poller::wait(). Each handle is made inactive as soon as it is
+     * harvested, exactly as if it had been returned, so nothing rearms it
+     * for another thread until this one is done with it; handles
+     * referenced here cannot be deleted until this thread next marks all
+     * handles unused, which it only does when the list has been drained.
+     */
+    struct ReadyList {
+        const PollerPrivate* poller;
+        int next;
+        int count;
+        ::epoll_event events[MaxEvents];
+
+        bool empty() const {
+            return next >= count;
+        }
+
+        void clear() {
+            next = count = 0;
+        }
+    };
 
     struct ReadablePipe {
         int fds[2];
@@ -259,6 +284,7 @@ class PollerPrivate {
     };
 
     const int epollFd;
+    const int batchSize;
     bool isShutdown;
     InterruptHandle interruptHandle;
     HandleSet registeredHandles;
@@ -288,9 +314,10 @@ class PollerPrivate {
         }
     }
 
-    PollerPrivate() :
+    PollerPrivate(uint32_t batch = 1) :
         alwaysReadableFd(alwaysReadable.getFD()),
         epollFd(::epoll_create(DefaultFds)),
+        batchSize(std::max(1, int(std::min(batch, uint32_t(MaxEvents))))),
         isShutdown(false) {
         QPID_POSIX_CHECK(epollFd);
         // Add always readable fd into our set (but not listening to it yet)
@@ -309,6 +336,7 @@ class PollerPrivate {
     }
 
     void resetMode(PollerHandlePrivate& handle);
+    void claim(ReadyList& ready);
 
     void interrupt() {
         ::epoll_event epe;
@@ -402,6 +430,34 @@ void PollerPrivate::resetMode(PollerHandlePrivate& eh) {
     interrupt();
 }
 
+// Take the handles just harvested into a ready list for this thread. An
+// event whose handle isn't ours to return is blanked.
+void PollerPrivate::claim(ReadyList& ready) {
+    for (int i = 0; i < ready.count; ++i) {
+        ::epoll_event& epe = ready.events[i];
+        if (epe.data.ptr == &interruptHandle || isShutdown) continue;
+
+        PollerHandlePrivate& eh = *static_cast<PollerHandlePrivate*>(epe.data.ptr);
+        ScopedLock<Mutex> l(eh.lock);
+        // the handle could have gone inactive since we left the epoll_wait
+        ::__uint32_t events = epe.events & (eh.events | ::EPOLLHUP | ::EPOLLERR);
+        if (!eh.isActive() || events == 0) {
+            epe.events = 0;
+            continue;
+        }
+        // If the connection has been hungup we could still be readable
+        // (just not writable), allow us to readable until we get here again;
+        // a handle hungup for the second time is left INACTIVE and returned
+        // as disconnected
+        if ((events & ::EPOLLHUP) && !eh.isHungup()) {
+            eh.setHungup();
+        } else {
+            eh.setInactive();
+        }
+        epe.events = events;
+    }
+}
+
 void Poller::monitorHandle(PollerHandle& handle, Direction dir) {
     PollerHandlePrivate& eh = *handle.impl;
     ScopedLock<Mutex> l(eh.lock);
@@ -548,7 +604,7 @@ bool Poller::hasShutdown()
 
 Poller::Event Poller::wait(Duration timeout) {
     static __thread PollerHandlePrivate* lastReturnedHandle = 0;
-    epoll_event epe;
+    static __thread PollerPrivate::ReadyList ready;
     int timeoutMs = (timeout == TIME_INFINITE) ? -1 : timeout / TIME_MSEC;
     AbsTime targetTimeout = 
         (timeout == TIME_INFINITE) ?
@@ -560,14 +616,28 @@ Poller::Event Poller::wait(Duration timeout) {
         lastReturnedHandle = 0;
     }
 
+    // Anything left over from a different poller is not ours to return
+    if (ready.poller != impl) {
+        ready.poller = impl;
+        ready.clear();
+    }
+
     // Repeat until we weren't interrupted by signal
     do {
-        PollerHandleDeletionManager.markAllUnusedInThisThread();
-        int rc = ::epoll_wait(impl->epollFd, &epe, 1, timeoutMs);
+        int rc;
+        if (ready.empty()) {
+            PollerHandleDeletionManager.markAllUnusedInThisThread();
+            rc = ::epoll_wait(impl->epollFd, ready.events, impl->batchSize, timeoutMs);
+            ready.next = 0;
+            ready.count = std::max(rc, 0);
+            impl->claim(ready);
+        } else {
+            rc = ready.count - ready.next;
+        }
         if (rc ==-1 && errno != EINTR) {
             QPID_POSIX_CHECK(rc);
         } else if (rc > 0) {
-            assert(rc == 1);
+            const ::epoll_event& epe = ready.events[ready.next++];
             void* dataPtr = epe.data.ptr;
 
             // Check if this is an interrupt
@@ -614,41 +684,43 @@ Poller::Event Poller::wait(Duration timeout) {
 
             // Check for shutdown
             if (impl->isShutdown) {
+                ready.clear();
                 PollerHandleDeletionManager.markAllUnusedInThisThread();
                 return Event(0, SHUTDOWN);
             }
 
+            if (epe.events == 0) continue;
             PollerHandlePrivate& eh = *static_cast<PollerHandlePrivate*>(dataPtr);
+            {
             ScopedLock<Mutex> l(eh.lock);
-
-            // the handle could have gone inactive since we left the epoll_wait
-            if (eh.isActive()) {
+            // The handle was claimed for this thread when it was harvested;
+            // since then the directions it is monitored for may have changed,
+            // or it may have been interrupted or removed
+            ::__uint32_t events = epe.events & (eh.events | ::EPOLLHUP | ::EPOLLERR);
+            if (eh.isActive()) continue;
+            if (eh.isInactive() && events != 0) {
                 PollerHandle* handle = eh.pollerHandle;
                 assert(handle);
-
-                // If the connection has been hungup we could still be readable
-                // (just not writable), allow us to readable until we get here again
-                if (epe.events & ::EPOLLHUP) {
-                    if (eh.isHungup()) {
-                        eh.setInactive();
-                        // Don't set up last Handle so that we don't reset this handle
-                        // on re-entering Poller::wait. This means that we will never
-                        // be set active again once we've returned disconnected, and so
-                        // can never be returned again.
-                        return Event(handle, DISCONNECTED);
-                    }
-                    eh.setHungup();
-                } else {
-                    eh.setInactive();
+                if ((events & ::EPOLLHUP) && !eh.isHungup()) {
+                    // Don't set up last Handle so that we don't reset this handle
+                    // on re-entering Poller::wait. This means that we will never
+                    // be set active again once we've returned disconnected, and so
+                    // can never be returned again.
+                    return Event(handle, DISCONNECTED);
                 }
                 lastReturnedHandle = &eh;
-                return Event(handle, PollerPrivate::epollToDirection(epe.events));
+                return Event(handle, PollerPrivate::epollToDirection(events));
+            }
             }
+            // Not returned, so rearm it, or pass on an interrupt
+            impl->resetMode(eh);
+            continue;
         }
         // We only get here if one of the following:
         // * epoll_wait was interrupted by a signal
         // * epoll_wait timed out
         // * the state of the handle changed after being returned by epoll_wait
+        //   (in which case we go on to any other events it returned)
         //
         // The only things we can do here are return a timeout or wait more.
         // Obviously if we timed out we return timeout; if the wait was meant to
@@ -670,6 +742,10 @@ Poller::Poller() :
     impl(new PollerPrivate())
 {}
 
+Poller::Poller(uint32_t batchSize) :
+    impl(new PollerPrivate(batchSize))
+{}
+
 Poller::~Poller() {
     delete impl;
 }
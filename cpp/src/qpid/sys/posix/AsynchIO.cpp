@@ -20,6 +20,7 @@
  */
 
 #include "qpid/sys/AsynchIO.h"
+#include "qpid/sys/BufferPool.h"
 #include "qpid/sys/Socket.h"
 #include "qpid/sys/SocketAddress.h"
 #include "qpid/sys/Poller.h"
@@ -27,20 +28,27 @@
 #include "qpid/sys/DispatchHandle.h"
 #include "qpid/sys/Time.h"
 #include "qpid/log/Statement.h"
+#include "qpid/Exception.h"
 
 #include "qpid/sys/posix/check.h"
+#include "qpid/sys/posix/BSDSocket.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include "qpid/sys/uring/UringAsynchIO.h"
+#endif
 
 // TODO The basic algorithm here is not really POSIX specific and with a
 // bit more abstraction could (should) be promoted to be platform portable
 #include <unistd.h>
+#include <limits.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <signal.h>
 #include <errno.h>
 #include <string.h>
 
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/shared_array.hpp>
 
 namespace qpid {
 namespace sys {
@@ -69,6 +77,16 @@ __thread int threadReadCount = 0;
 __thread int threadWriteTotal = 0;
 __thread int threadWriteCount = 0;
 __thread int64_t threadMaxIoTimeNs = 2 * 1000000; // start at 2ms
+
+// Most buffers gathered into a single write
+#if defined(IOV_MAX) && IOV_MAX < 64
+const int MaxGatherBuffers = IOV_MAX;
+#else
+const int MaxGatherBuffers = 64;
+#endif
+
+// Set at startup (see AsynchIO::selectBackend())
+bool useUring = false;
 }
 
 /*
@@ -271,10 +289,13 @@ public:
     virtual void requestCallback(RequestCallback);
     virtual BufferBase* getQueuedBuffer();
     virtual SecuritySettings getSecuritySettings();
+    virtual void getWriteCounts(uint64_t& buffers, uint64_t& calls) const;
 
 private:
     ~AsynchIO();
 
+    int write(const ::iovec* iov, int count);
+
     // Methods that are callback targets from Dispatcher.
     void readable(DispatchHandle& handle);
     void writeable(DispatchHandle& handle);
@@ -290,10 +311,10 @@ private:
     BuffersEmptyCallback emptyCallback;
     IdleCallback idleCallback;
     const Socket& socket;
+    const BSDSocket* const gatherSocket;
     std::deque<BufferBase*> bufferQueue;
     std::deque<BufferBase*> writeQueue;
-    std::vector<BufferBase> buffers;
-    boost::shared_array<char> bufferMemory;
+    AsynchIOBufferSet buffers;
     bool queuedClose;
     /**
      * This flag is used to detect and handle concurrency between
@@ -302,6 +323,8 @@ private:
      * thread processing this handle.
      */
     volatile bool writePending;
+    uint64_t buffersWritten;
+    uint64_t writeSyscalls;
 };
 
 AsynchIO::AsynchIO(const Socket& s,
@@ -319,8 +342,11 @@ AsynchIO::AsynchIO(const Socket& s,
     emptyCallback(eCb),
     idleCallback(iCb),
     socket(s),
+    gatherSocket(dynamic_cast<const BSDSocket*>(&s)),
     queuedClose(false),
-    writePending(false) {
+    writePending(false),
+    buffersWritten(0),
+    writeSyscalls(0) {
 
     s.setNonblocking();
 }
@@ -337,22 +363,16 @@ void AsynchIO::start(Poller::shared_ptr poller) {
 }
 
 void AsynchIO::createBuffers(uint32_t size) {
-    // Allocate all the buffer memory at once
-    bufferMemory.reset(new char[size*BufferCount]);
-
-    // Create the Buffer structs in a vector
-    // And push into the buffer queue
-    buffers.reserve(BufferCount);
-    for (uint32_t i = 0; i < BufferCount; i++) {
-        buffers.push_back(BufferBase(&bufferMemory[i*size], size));
-        queueReadBuffer(&buffers[i]);
-    }
+    // Buffers only get memory (from the shared pool) when they are
+    // needed, and give it back when the connection goes quiet
+    buffers.create(size, BufferCount);
 }
 
 void AsynchIO::queueReadBuffer(BufferBase* buff) {
     assert(buff);
     buff->dataStart = 0;
     buff->dataCount = 0;
+    buff->reclaim();
 
     bool queueWasEmpty = bufferQueue.empty();
     bufferQueue.push_back(buff);
@@ -362,6 +382,7 @@ void AsynchIO::queueReadBuffer(BufferBase* buff) {
 
 void AsynchIO::unread(BufferBase* buff) {
     assert(buff);
+    buff->reclaim();
     buff->squish();
 
     bool queueWasEmpty = bufferQueue.empty();
@@ -416,7 +437,7 @@ void AsynchIO::requestedCall(RequestCallback callback) {
 AsynchIO::BufferBase* AsynchIO::getQueuedBuffer() {
     // Always keep at least one buffer (it might have data that was "unread" in it)
     if (bufferQueue.size()<=1)
-        return 0;
+        return buffers.spare(false);
     BufferBase* buff = bufferQueue.back();
     assert(buff);
     buff->dataStart = 0;
@@ -433,6 +454,7 @@ void AsynchIO::readable(DispatchHandle& h) {
     AbsTime readStartTime = AbsTime::now();
     size_t total = 0;
     int readCalls = 0;
+    bool filled = false;
     do {
         // (Try to) get a buffer
         if (!bufferQueue.empty()) {
@@ -456,6 +478,7 @@ void AsynchIO::readable(DispatchHandle& h) {
                     QPID_PROBE4(asynchio_read_finished_done, &h, duration, total, readCalls);
                     break;
                 }
+                filled = true;
 
                 // Stop reading if we've overrun our timeslot
                 if ( duration > threadMaxIoTimeNs) {
@@ -487,7 +510,12 @@ void AsynchIO::readable(DispatchHandle& h) {
                 }
             }
         } else {
-            // Something to read but no buffer
+            // Something to read but no buffer: use a spare, adding one
+            // if the connection is allowed more
+            if (BufferBase* buff = buffers.spare(true)) {
+                bufferQueue.push_back(buff);
+                continue;
+            }
             if (emptyCallback) {
                 emptyCallback(*this);
             }
@@ -501,10 +529,22 @@ void AsynchIO::readable(DispatchHandle& h) {
         }
     } while (true);
 
+    // Unless it's keeping up with a steady flow the connection doesn't
+    // need its extra buffers any more
+    if (!filled)
+        buffers.trim(bufferQueue);
+
     ++threadReadCount;
     return;
 }
 
+int AsynchIO::write(const ::iovec* iov, int count) {
+    if (count == 1 || !gatherSocket) {
+        return socket.write(iov[0].iov_base, iov[0].iov_len);
+    }
+    return gatherSocket->writev(iov, count);
+}
+
 /*
  * We carry on writing whilst we have data to write and we can write
  */
@@ -515,38 +555,57 @@ void AsynchIO::writeable(DispatchHandle& h) {
     do {
         // See if we've got something to write
         if (!writeQueue.empty()) {
-            // Write buffer
-            BufferBase* buff = writeQueue.back();
-            writeQueue.pop_back();
+            // Gather as many queued buffers as we can, oldest first
+            ::iovec iov[MaxGatherBuffers];
+            int count = 0;
+            size_t requested = 0;
+            for (std::deque<BufferBase*>::reverse_iterator i = writeQueue.rbegin();
+                 i != writeQueue.rend() && count < MaxGatherBuffers;
+                 ++i, ++count) {
+                BufferBase* buff = *i;
+                assert(buff->dataStart+buff->dataCount <= buff->byteCount);
+                iov[count].iov_base = buff->bytes+buff->dataStart;
+                iov[count].iov_len = buff->dataCount;
+                requested += buff->dataCount;
+            }
             errno = 0;
-            assert(buff->dataStart+buff->dataCount <= buff->byteCount);
-            int rc = socket.write(buff->bytes+buff->dataStart, buff->dataCount);
+            int rc = write(iov, count);
             int64_t duration = Duration(writeStartTime, AbsTime::now());
             ++writeCalls;
+            ++writeSyscalls;
             if (rc >= 0) {
                 threadWriteTotal += rc;
                 total += rc;
 
-                // If we didn't write full buffer put rest back
-                if (rc != buff->dataCount) {
-                    buff->dataStart += rc;
-                    buff->dataCount -= rc;
-                    writeQueue.push_back(buff);
+                // Recycle the buffers written in full, a partly written
+                // buffer stays at the head of the queue for next time
+                size_t remaining = rc;
+                for (int i = 0; i < count; ++i) {
+                    BufferBase* buff = writeQueue.back();
+                    if (size_t(buff->dataCount) > remaining) {
+                        buff->dataStart += remaining;
+                        buff->dataCount -= remaining;
+                        break;
+                    }
+                    remaining -= buff->dataCount;
+                    writeQueue.pop_back();
+                    queueReadBuffer(buff);
+                    ++buffersWritten;
+                }
+
+                // If we didn't write everything the socket is full
+                if (size_t(rc) != requested) {
                     QPID_PROBE4(asynchio_write_finished_done, &h, duration, total, writeCalls);
                     break;
                 }
 
-                // Recycle the buffer
-                queueReadBuffer(buff);
-
                 // Stop writing if we've overrun our timeslot
                 if (duration > threadMaxIoTimeNs) {
                     QPID_PROBE4(asynchio_write_finished_maxtime, &h, duration, total, writeCalls);
                     break;
                 }
             } else {
-                // Put buffer back
-                writeQueue.push_back(buff);
+                // Nothing was written so the buffers are all still queued
                 QPID_PROBE5(asynchio_write_finished_error, &h, duration, total, writeCalls, errno);
 
                 if (errno == ECONNRESET || errno == EPIPE) {
@@ -555,7 +614,7 @@ void AsynchIO::writeable(DispatchHandle& h) {
                     h.unwatchWrite();
                     break;
                 } else if (errno == EAGAIN) {
-                    // We have just put a buffer back so we know
+                    // We still have buffers queued so we know
                     // we can carry on watching for writes
                     break;
                 } else {
@@ -579,6 +638,16 @@ void AsynchIO::writeable(DispatchHandle& h) {
             if (idleCallback) {
                 writePending = false;
                 idleCallback(*this);
+                // Let the callback fill any spare buffers too, so that
+                // they all go out in the same write
+                while (!writeQueue.empty() && !queuedClose &&
+                       writeQueue.size() < size_t(MaxGatherBuffers) &&
+                       (bufferQueue.size() > 1 || buffers.hasSpare())) {
+                    size_t queued = writeQueue.size();
+                    idleCallback(*this);
+                    if (writeQueue.size() == queued)
+                        break;
+                }
             }
             // If we still have no buffers to write we can't do anything more
             if (writeQueue.empty() && !writePending && !queuedClose) {
@@ -616,6 +685,11 @@ void AsynchIO::close(DispatchHandle& h) {
     }
 }
 
+void AsynchIO::getWriteCounts(uint64_t& buffers, uint64_t& calls) const {
+    buffers = buffersWritten;
+    calls = writeSyscalls;
+}
+
 SecuritySettings AsynchIO::getSecuritySettings() {
     SecuritySettings settings;
     settings.ssf = socket.getKeyLen();
@@ -628,6 +702,10 @@ SecuritySettings AsynchIO::getSecuritySettings() {
 AsynchAcceptor* AsynchAcceptor::create(const Socket& s, 
                                        Callback callback)
 {
+#ifdef HAVE_LINUX_IO_URING_H
+    if (posix::useUring && uring::handles(s))
+        return uring::createAcceptor(s, callback);
+#endif
     return new posix::AsynchAcceptor(s, callback);
 }
 
@@ -637,6 +715,8 @@ AsynchConnector* AsynchConnector::create(const Socket& s,
                                          ConnectedCallback connCb,
                                          FailedCallback failCb)
 {
+    // Connecting is rare enough that it always waits for readiness; the
+    // connected socket gets an io_uring AsynchIO if that was selected
     return new posix::AsynchConnector(s, hostname, port, connCb, failCb);
 }
 
@@ -648,7 +728,26 @@ AsynchIO* AsynchIO::create(const Socket& s,
                            AsynchIO::BuffersEmptyCallback eCb,
                            AsynchIO::IdleCallback iCb)
 {
+#ifdef HAVE_LINUX_IO_URING_H
+    if (posix::useUring && uring::handles(s))
+        return uring::createAsynchIO(s, rCb, eofCb, disCb, cCb, eCb, iCb);
+#endif
     return new posix::AsynchIO(s, rCb, eofCb, disCb, cCb, eCb, iCb);
 }
 
+bool AsynchIO::selectBackend(const std::string& name)
+{
+    if (name == "default") {
+        posix::useUring = false;
+        return true;
+    }
+    if (name == "io_uring") {
+#ifdef HAVE_LINUX_IO_URING_H
+        posix::useUring = uring::available();
+#endif
+        return posix::useUring;
+    }
+    throw qpid::Exception(QPID_MSG("Unknown IO backend: " << name));
+}
+
 }} // namespace qpid::sys
@@ -28,6 +28,7 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/errno.h>
 #include <unistd.h>
 #include <netinet/in.h>
@@ -224,6 +225,11 @@ int BSDSocket::write(const void *buf, size_t count) const
     return ::write(fd, buf, count);
 }
 
+int BSDSocket::writev(const struct ::iovec* iov, int count) const
+{
+    return ::writev(fd, iov, count);
+}
+
 std::string BSDSocket::getPeerAddress() const
 {
     if (peername.empty()) {
@@ -29,6 +29,8 @@
 
 #include <boost/scoped_ptr.hpp>
 
+struct iovec;
+
 namespace qpid {
 namespace sys {
 
@@ -94,6 +96,9 @@ public:
     QPID_COMMON_EXTERN virtual int read(void *buf, size_t count) const;
     QPID_COMMON_EXTERN virtual int write(const void *buf, size_t count) const;
 
+    /** Write several buffers in one call (posix specific and not in Socket interface) */
+    QPID_COMMON_EXTERN virtual int writev(const struct ::iovec* iov, int count) const;
+
     QPID_COMMON_EXTERN int getKeyLen() const;
     QPID_COMMON_EXTERN std::string getClientAuthId() const;
 
@@ -20,6 +20,7 @@
  */
 
 #include "qpid/sys/MemStat.h"
+#include "qpid/sys/BufferPool.h"
 
 #include <malloc.h>
 
@@ -34,5 +35,12 @@ void qpid::sys::MemStat::loadMemInfo(qmf::org::apache::qpid::broker::Memory* obj
     object->set_malloc_uordblks(info.uordblks);
     object->set_malloc_fordblks(info.fordblks);
     object->set_malloc_keepcost(info.keepcost);
+
+    qpid::sys::BufferPool::Stats pool(qpid::sys::BufferPool::instance().getStats());
+    object->set_ioBufferInUse(pool.inUseBytes);
+    object->set_ioBufferIdle(pool.idleBytes);
+    object->set_ioBufferAllocs(pool.allocations);
+    object->set_ioBufferReuses(pool.reuses);
+    object->set_ioBufferDiscards(pool.discards);
 }
 
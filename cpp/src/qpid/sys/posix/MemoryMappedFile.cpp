@@ -0,0 +1,115 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/sys/MemoryMappedFile.h"
+#include "qpid/sys/StrError.h"
+#include "qpid/Exception.h"
+#include "qpid/Msg.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <unistd.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace qpid {
+namespace sys {
+
+class MemoryMappedFilePrivate
+{
+  public:
+    int fd;
+    size_t size;
+
+    MemoryMappedFilePrivate() : fd(-1), size(0) {}
+    ~MemoryMappedFilePrivate() { if (fd >= 0) ::close(fd); }
+};
+
+MemoryMappedFile::MemoryMappedFile() : impl(new MemoryMappedFilePrivate) {}
+MemoryMappedFile::~MemoryMappedFile() {}
+
+std::string MemoryMappedFile::open(const std::string& name, const std::string& directory)
+{
+    std::string path = directory + "/" + name + ".XXXXXX";
+    std::vector<char> buffer(path.begin(), path.end());
+    buffer.push_back('\0');
+    int fd = ::mkstemp(&buffer[0]);
+    if (fd < 0) throw qpid::Exception(QPID_MSG("Could not create paging file " << path << ": " << strError(errno)));
+    path = &buffer[0];
+    // unlink straight away, the file is only needed while it is open
+    ::unlink(path.c_str());
+    close();
+    impl->fd = fd;
+    impl->size = 0;
+    return path;
+}
+
+void MemoryMappedFile::close()
+{
+    if (impl->fd >= 0) {
+        ::close(impl->fd);
+        impl->fd = -1;
+        impl->size = 0;
+    }
+}
+
+size_t MemoryMappedFile::getPageSize()
+{
+    return ::sysconf(_SC_PAGE_SIZE);
+}
+
+void MemoryMappedFile::expand(size_t size)
+{
+    if (size > impl->size) {
+        if (::ftruncate(impl->fd, size)) {
+            throw qpid::Exception(QPID_MSG("Could not expand paging file to " << size << " bytes: " << strError(errno)));
+        }
+        impl->size = size;
+    }
+}
+
+char* MemoryMappedFile::map(size_t offset, size_t size)
+{
+    void* region = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, impl->fd, offset);
+    if (region == MAP_FAILED) {
+        throw qpid::Exception(QPID_MSG("Could not map " << size << " bytes of paging file at " << offset << ": " << strError(errno)));
+    }
+    return static_cast<char*>(region);
+}
+
+void MemoryMappedFile::unmap(char* region, size_t size)
+{
+    ::munmap(region, size);
+}
+
+void MemoryMappedFile::flush(char* region, size_t size)
+{
+    ::msync(region, size, MS_ASYNC);
+}
+
+void MemoryMappedFile::prefetch(size_t offset, size_t size)
+{
+    ::posix_fadvise(impl->fd, offset, size, POSIX_FADV_WILLNEED);
+}
+
+}} // namespace qpid::sys
@@ -29,6 +29,8 @@
 #include <netinet/in.h> // For FreeBSD
 #include <ifaddrs.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -197,5 +199,17 @@ bool SystemInfo::threadSafeShutdown()
     return true;
 }
 
+bool SystemInfo::setThreadAffinity(unsigned cpu) {
+#ifdef CPU_SET    // Linux specific.
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    (void) cpu;
+    return false;
+#endif
+}
+
 
 }} // namespace qpid::sys
@@ -437,6 +437,10 @@ Poller::Poller() :
     impl(new PollerPrivate())
 {}
 
+Poller::Poller(uint32_t /*batchSize*/) :
+    impl(new PollerPrivate())
+{}
+
 Poller::~Poller() {
     delete impl;
 }
@@ -37,6 +37,8 @@
 #include <errno.h>
 #include <limits.h>
 #include <procfs.h>
+#include <sys/processor.h>
+#include <sys/procset.h>
 #include <fcntl.h>
 #include <sys/types.h>
 
@@ -107,4 +109,8 @@ bool SystemInfo::threadSafeShutdown()
     return true;
 }
 
+bool SystemInfo::setThreadAffinity(unsigned cpu) {
+    return ::processor_bind(P_LWPID, P_MYID, cpu, 0) == 0;
+}
+
 }} // namespace qpid::sys
@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/errno.h>
 #include <poll.h>
 #include <netinet/in.h>
@@ -306,6 +307,18 @@ int SslSocket::write(const void *buf, size_t count) const
     return PR_Write(nssSocket, buf, count);
 }
 
+int SslSocket::writev(const struct ::iovec* iov, int count) const
+{
+    // NSPR limits the number of buffers that can be written at once
+    PRIOVec prIov[PR_MAX_IOVECTOR_SIZE];
+    int n = count < PR_MAX_IOVECTOR_SIZE ? count : PR_MAX_IOVECTOR_SIZE;
+    for (int i = 0; i < n; ++i) {
+        prIov[i].iov_base = static_cast<char*>(iov[i].iov_base);
+        prIov[i].iov_len = iov[i].iov_len;
+    }
+    return PR_Writev(nssSocket, prIov, n, PR_INTERVAL_NO_TIMEOUT);
+}
+
 void SslSocket::setCertName(const std::string& name)
 {
     certname = name;
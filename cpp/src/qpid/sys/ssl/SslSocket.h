@@ -77,6 +77,7 @@ public:
     // TODO The following are raw operations, maybe they need better wrapping?
     int read(void *buf, size_t count) const;
     int write(const void *buf, size_t count) const;
+    int writev(const struct ::iovec* iov, int count) const;
 
     int getKeyLen() const;
     std::string getClientAuthId() const;
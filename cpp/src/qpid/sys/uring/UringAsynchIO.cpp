@@ -0,0 +1,1073 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/sys/uring/UringAsynchIO.h"
+#include "qpid/sys/BufferPool.h"
+#include "qpid/sys/Socket.h"
+#include "qpid/sys/Poller.h"
+#include "qpid/sys/DispatchHandle.h"
+#include "qpid/sys/Mutex.h"
+#include "qpid/sys/StrError.h"
+#include "qpid/sys/SystemInfo.h"
+#include "qpid/sys/posix/BSDSocket.h"
+#include "qpid/sys/posix/PrivatePosix.h"
+#include "qpid/log/Statement.h"
+#include "qpid/Exception.h"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <typeinfo>
+
+#include <boost/bind.hpp>
+
+namespace qpid {
+namespace sys {
+namespace uring {
+
+namespace {
+
+// Submission queue size for each ring; completions get twice as many
+const unsigned RingEntries = 1024;
+
+// Most rings created for a single Poller
+const long MaxRingsPerPoller = 16;
+
+// Rounds of reaping and servicing a ring does before letting the
+// thread go back to the Poller for other work
+const int MaxDispatchRounds = 8;
+
+// Most buffers gathered into a single send
+#if defined(IOV_MAX) && IOV_MAX < 64
+const int MaxGatherBuffers = IOV_MAX;
+#else
+const int MaxGatherBuffers = 64;
+#endif
+
+int setup(unsigned entries, ::io_uring_params* p) {
+    return ::syscall(__NR_io_uring_setup, entries, p);
+}
+
+int enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return ::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, 0, 0);
+}
+
+inline unsigned loadAcquire(const unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+inline void storeRelease(unsigned* p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+int toFd(const Socket& s) {
+    const IOHandle& h = s;
+    return h.fd;
+}
+}
+
+class Ring;
+
+/*
+ * Something with operations in flight on a Ring.
+ *
+ * The Ring calls completed() for each of its completions and serviced()
+ * after notify() has been called; both only ever happen on the thread
+ * currently dispatching the Ring so they are never concurrent.
+ */
+class Completion {
+public:
+    // Operation tags kept in the low bits of the user data
+    enum { TagMask = 3 };
+
+    virtual void completed(unsigned op, int result, unsigned flags) = 0;
+    virtual void serviced() = 0;
+
+protected:
+    Completion() : notified(false), retired(false) {}
+    virtual ~Completion() {}
+
+private:
+    friend class Ring;
+    bool notified;
+    bool retired;
+};
+
+/*
+ * A submission/completion queue pair whose completion queue is watched
+ * by a Poller.
+ *
+ * Requests may be submitted from any thread; those made while dispatching
+ * the ring are only handed to the kernel once the dispatching thread has
+ * finished its round, so one io_uring_enter covers them all.
+ */
+class Ring : public IOHandle {
+public:
+    Ring(const Poller::shared_ptr& poller);
+    ~Ring();
+
+    static Ring& forPoller(const Poller::shared_ptr& poller);
+
+    void submit(const ::io_uring_sqe& request);
+    void notify(Completion* c);
+    void retire(Completion* c);
+    bool inDispatch() const;
+
+    static uint64_t userData(Completion* c, unsigned op) {
+        return reinterpret_cast<uintptr_t>(c) | op;
+    }
+
+private:
+    void dispatch(DispatchHandle& h);
+    bool reap();
+    bool service();
+    void flushLocked();
+    bool queueWakeLocked();
+
+    Mutex lock;
+    unsigned sqEntries;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqFlags;
+    unsigned sqMask;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    ::io_uring_sqe* sqes;
+    ::io_uring_cqe* cqes;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+    unsigned unsubmitted;
+    bool wakePending;
+    std::vector<Completion*> notified;
+    std::auto_ptr<DispatchHandleRef> handle;
+};
+
+namespace {
+__thread const Ring* dispatching = 0;
+
+struct RingSet {
+    std::vector<Ring*> rings;
+    size_t next;
+    RingSet() : next(0) {}
+};
+
+// Rings live as long as the process, like the IO threads that service them
+Mutex ringsLock;
+std::map<Poller*, RingSet>* rings = 0;
+}
+
+Ring::Ring(const Poller::shared_ptr& poller) :
+    sqes(0), sqRing(MAP_FAILED), cqRing(MAP_FAILED),
+    unsubmitted(0), wakePending(false)
+{
+    ::io_uring_params p;
+    ::memset(&p, 0, sizeof(p));
+    fd = setup(RingEntries, &p);
+    if (fd < 0)
+        throw ErrnoException(QPID_MSG("Can't create io_uring"));
+    if (!(p.features & IORING_FEAT_NODROP)) {
+        ::close(fd);
+        throw Exception(QPID_MSG("Can't create io_uring: kernel may drop completions"));
+    }
+
+    sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(::io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    sqesSize = p.sq_entries * sizeof(::io_uring_sqe);
+
+    sqRing = ::mmap(0, sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cqRing = (p.features & IORING_FEAT_SINGLE_MMAP) ? sqRing :
+        ::mmap(0, cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void* sqeMemory = ::mmap(0, sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqeMemory == MAP_FAILED) {
+        int err = errno;
+        if (sqeMemory != MAP_FAILED) ::munmap(sqeMemory, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) ::munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) ::munmap(sqRing, sqRingSize);
+        ::close(fd);
+        throw ErrnoException(QPID_MSG("Can't map io_uring"), err);
+    }
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(cqRing);
+    sqEntries = p.sq_entries;
+    sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqFlags = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+    sqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast< ::io_uring_cqe*>(cq + p.cq_off.cqes);
+    sqes = static_cast< ::io_uring_sqe*>(sqeMemory);
+
+    // Submission slots are always used in order so map them one to one
+    unsigned* array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    for (unsigned i = 0; i < sqEntries; ++i)
+        array[i] = i;
+
+    handle.reset(new DispatchHandleRef(*this, boost::bind(&Ring::dispatch, this, _1), 0, 0));
+    handle->startWatch(poller);
+}
+
+Ring::~Ring() {
+    handle->stopWatch();
+    ::munmap(sqes, sqesSize);
+    if (cqRing != sqRing) ::munmap(cqRing, cqRingSize);
+    ::munmap(sqRing, sqRingSize);
+    ::close(fd);
+}
+
+Ring& Ring::forPoller(const Poller::shared_ptr& poller) {
+    ScopedLock<Mutex> l(ringsLock);
+    if (!rings)
+        rings = new std::map<Poller*, RingSet>;
+    RingSet& set = (*rings)[poller.get()];
+    if (set.rings.empty()) {
+        long count = std::min(std::max(SystemInfo::concurrency(), 1L), MaxRingsPerPoller);
+        for (long i = 0; i < count; ++i)
+            set.rings.push_back(new Ring(poller));
+        QPID_LOG(debug, "Created " << count << " io_uring rings for poller " << poller.get());
+    }
+    Ring* r = set.rings[set.next++ % set.rings.size()];
+    return *r;
+}
+
+bool Ring::inDispatch() const {
+    return dispatching == this;
+}
+
+void Ring::submit(const ::io_uring_sqe& request) {
+    ScopedLock<Mutex> l(lock);
+    unsigned tail = *sqTail;
+    if (tail - loadAcquire(sqHead) == sqEntries) {
+        // Full: hand what we have to the kernel to make room
+        flushLocked();
+        if (tail - loadAcquire(sqHead) == sqEntries)
+            throw Exception(QPID_MSG("io_uring submission queue full"));
+    }
+    sqes[tail & sqMask] = request;
+    storeRelease(sqTail, tail + 1);
+    ++unsubmitted;
+    if (dispatching != this)
+        flushLocked();
+}
+
+void Ring::flushLocked() {
+    // Post any wakeup a full queue held back, now there may be room
+    if (!wakePending && !notified.empty())
+        queueWakeLocked();
+    while (unsubmitted > 0) {
+        int rc = enter(fd, unsubmitted, 0, 0);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            // Anything left stays queued for the next flush
+            if (errno != EAGAIN && errno != EBUSY)
+                QPID_LOG(error, "io_uring submit failed: " << qpid::sys::strError(errno));
+            return;
+        }
+        unsubmitted -= std::min(unsigned(rc), unsubmitted);
+        if (rc == 0) return;
+        if (!wakePending && !notified.empty())
+            queueWakeLocked();
+    }
+}
+
+/*
+ * Queue the no-op completion that wakes the ring to service the notified
+ * list, unless the submission queue is full.
+ */
+bool Ring::queueWakeLocked() {
+    unsigned tail = *sqTail;
+    if (tail - loadAcquire(sqHead) == sqEntries)
+        return false;
+    ::io_uring_sqe& sqe = sqes[tail & sqMask];
+    ::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_NOP;
+    sqe.user_data = 0;
+    storeRelease(sqTail, tail + 1);
+    ++unsubmitted;
+    wakePending = true;
+    return true;
+}
+
+/*
+ * Arrange for c->serviced() to be called on the dispatching thread. Many
+ * notifications are folded into a single no-op completion so waking a busy
+ * ring costs at most one system call.
+ */
+void Ring::notify(Completion* c) {
+    ScopedLock<Mutex> l(lock);
+    if (c->notified)
+        return;
+    c->notified = true;
+    notified.push_back(c);
+    if (wakePending)
+        return;
+    if (!queueWakeLocked()) {
+        // Full: hand what we have to the kernel to make room. The flush
+        // posts the wakeup if it can; if not, c stays on the notified
+        // list for the next dispatch or flush to pick up
+        flushLocked();
+        return;
+    }
+    if (dispatching != this)
+        flushLocked();
+}
+
+/*
+ * Delete c now it has no operations in flight; if it is waiting to be
+ * serviced the delete is left until it comes off the notified list.
+ */
+void Ring::retire(Completion* c) {
+    {
+        ScopedLock<Mutex> l(lock);
+        if (c->notified) {
+            c->retired = true;
+            return;
+        }
+    }
+    delete c;
+}
+
+void Ring::dispatch(DispatchHandle&) {
+    dispatching = this;
+    for (int round = 0; round < MaxDispatchRounds; ++round) {
+        bool busy = reap();
+        busy = service() || busy;
+        {
+            ScopedLock<Mutex> l(lock);
+            flushLocked();
+        }
+        if (!busy) break;
+    }
+    dispatching = 0;
+    // Anything still unreaped leaves the ring readable so we'll be back
+}
+
+bool Ring::reap() {
+    unsigned head = *cqHead;
+    unsigned tail = loadAcquire(cqTail);
+    if (head == tail) {
+        // Completions the kernel couldn't post are flushed by entering
+        if (loadAcquire(sqFlags) & IORING_SQ_CQ_OVERFLOW)
+            enter(fd, 0, 0, IORING_ENTER_GETEVENTS);
+        return false;
+    }
+    for (; head != tail; ++head) {
+        const ::io_uring_cqe& cqe = cqes[head & cqMask];
+        uint64_t data = cqe.user_data;
+        int result = cqe.res;
+        unsigned flags = cqe.flags;
+        storeRelease(cqHead, head + 1);
+
+        // Wake ups carry no completion
+        if (data == 0) continue;
+        Completion* c = reinterpret_cast<Completion*>(data & ~uint64_t(Completion::TagMask));
+        try {
+            c->completed(data & Completion::TagMask, result, flags);
+        } catch (const std::exception& e) {
+            QPID_LOG(error, "Caught exception processing io_uring completion: " << e.what());
+        }
+    }
+    return true;
+}
+
+bool Ring::service() {
+    std::vector<Completion*> ready;
+    {
+        ScopedLock<Mutex> l(lock);
+        ready.swap(notified);
+        wakePending = false;
+    }
+    for (std::vector<Completion*>::iterator i = ready.begin(); i != ready.end(); ++i) {
+        Completion* c = *i;
+        bool retired;
+        {
+            ScopedLock<Mutex> l(lock);
+            c->notified = false;
+            retired = c->retired;
+        }
+        if (retired) {
+            delete c;
+            continue;
+        }
+        try {
+            c->serviced();
+        } catch (const std::exception& e) {
+            QPID_LOG(error, "Caught exception servicing io_uring request: " << e.what());
+        }
+    }
+    return !ready.empty();
+}
+
+/*
+ * Acceptor: keeps a multishot accept in flight on the listening socket
+ * (re-arming with a single shot accept on kernels without multishot).
+ */
+class Listener : public Completion {
+public:
+    Listener(const Socket& s, AsynchAcceptor::Callback callback);
+
+    void start(Poller::shared_ptr poller);
+    void stop();
+
+private:
+    enum { AcceptOp = 1, CancelOp = 2 };
+
+    void completed(unsigned op, int result, unsigned flags);
+    void serviced();
+    void arm();
+
+    AsynchAcceptor::Callback acceptedCallback;
+    const int fd;
+    Ring* ring;
+    bool multishot;
+    bool accepting;
+    bool cancelling;
+    volatile bool stopped;
+};
+
+Listener::Listener(const Socket& s, AsynchAcceptor::Callback callback) :
+    acceptedCallback(callback),
+    fd(toFd(s)),
+    ring(0),
+    multishot(true),
+    accepting(false),
+    cancelling(false),
+    stopped(false)
+{}
+
+void Listener::start(Poller::shared_ptr poller) {
+    ring = &Ring::forPoller(poller);
+    // Requests are only ever issued from IO threads: io_uring cancels
+    // those belonging to a thread when it exits
+    ring->notify(this);
+}
+
+void Listener::stop() {
+    stopped = true;
+    if (ring)
+        ring->notify(this);
+    else
+        delete this;
+}
+
+void Listener::arm() {
+    ::io_uring_sqe sqe;
+    ::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.fd = fd;
+    if (multishot)
+        sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe.user_data = Ring::userData(this, AcceptOp);
+    ring->submit(sqe);
+    accepting = true;
+}
+
+void Listener::completed(unsigned op, int result, unsigned flags) {
+    if (op == CancelOp) {
+        cancelling = false;
+    } else {
+        if (!(flags & IORING_CQE_F_MORE))
+            accepting = false;
+        if (result >= 0) {
+            if (stopped) {
+                ::close(result);
+            } else {
+                try {
+                    Socket* s = new BSDSocket(result);
+                    acceptedCallback(*s);
+                } catch (const std::exception& e) {
+                    QPID_LOG(error, "Could not accept socket: " << e.what());
+                }
+            }
+        } else if (result == -EINVAL && multishot && !stopped) {
+            QPID_LOG(info, "Multishot accept not supported, accepting one connection at a time");
+            multishot = false;
+        } else if (result != -ECANCELED) {
+            QPID_LOG(error, "Could not accept socket: " << qpid::sys::strError(-result));
+        }
+    }
+    serviced();
+}
+
+void Listener::serviced() {
+    if (!stopped) {
+        if (!accepting) arm();
+        return;
+    }
+    if (accepting && !cancelling) {
+        ::io_uring_sqe sqe;
+        ::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = -1;
+        sqe.addr = Ring::userData(this, AcceptOp);
+        sqe.user_data = Ring::userData(this, CancelOp);
+        ring->submit(sqe);
+        cancelling = true;
+    } else if (!accepting && !cancelling) {
+        ring->retire(this);
+    }
+}
+
+class AsynchAcceptor : public qpid::sys::AsynchAcceptor {
+public:
+    AsynchAcceptor(const Socket& s, AsynchAcceptor::Callback callback) :
+        listener(new Listener(s, callback))
+    {}
+
+    ~AsynchAcceptor() {
+        // The listener deletes itself once its accept is cancelled
+        listener->stop();
+    }
+
+    void start(Poller::shared_ptr poller) {
+        listener->start(poller);
+    }
+
+private:
+    Listener* listener;
+};
+
+/*
+ * io_uring version of AsynchIO reader/writer
+ *
+ * At most one receive and one (gathered) send are in flight at a time.
+ * The receive holds the buffer at the head of the read queue, exactly the
+ * one the readiness based version would have read into next, so buffers
+ * move between the connection and its handler as they always have. A
+ * quiet connection that has given all its buffers back to the pool waits
+ * with a poll instead, so it holds no buffer until there is data.
+ */
+class AsynchIO : public qpid::sys::AsynchIO, private Completion {
+public:
+    AsynchIO(const Socket& s,
+             ReadCallback rCb,
+             EofCallback eofCb,
+             DisconnectCallback disCb,
+             ClosedCallback cCb = 0,
+             BuffersEmptyCallback eCb = 0,
+             IdleCallback iCb = 0);
+
+    // Methods inherited from qpid::sys::AsynchIO
+
+    virtual void queueForDeletion();
+
+    virtual void start(Poller::shared_ptr poller);
+    virtual void createBuffers(uint32_t size);
+    virtual void queueReadBuffer(BufferBase* buff);
+    virtual void unread(BufferBase* buff);
+    virtual void queueWrite(BufferBase* buff);
+    virtual void notifyPendingWrite();
+    virtual void queueWriteClose();
+    virtual bool writeQueueEmpty();
+    virtual void requestCallback(RequestCallback);
+    virtual BufferBase* getQueuedBuffer();
+    virtual SecuritySettings getSecuritySettings();
+    virtual void getWriteCounts(uint64_t& buffers, uint64_t& calls) const;
+
+private:
+    enum { RecvOp = 1, SendOp = 2, CancelOp = 3 };
+
+    ~AsynchIO();
+
+    // Methods that are callbacks from the Ring
+    void completed(unsigned op, int result, unsigned flags);
+    void serviced();
+
+    void received(int result);
+    void sent(int result);
+    void receive();
+    void send();
+    void close();
+    void wake();
+
+private:
+    ReadCallback readCallback;
+    EofCallback eofCallback;
+    DisconnectCallback disCallback;
+    ClosedCallback closedCallback;
+    BuffersEmptyCallback emptyCallback;
+    IdleCallback idleCallback;
+    const Socket& socket;
+    const int fd;
+    Ring* ring;
+    std::deque<BufferBase*> bufferQueue;
+    std::deque<BufferBase*> writeQueue;
+    AsynchIOBufferSet buffers;
+    BufferBase* readBuffer;
+    ::iovec iov[MaxGatherBuffers];
+    size_t sendCount;
+    size_t sendBytes;
+    bool receiving;
+    bool sending;
+    bool cancelling;
+    bool readStopped;
+    bool readReady;
+    bool writeFailed;
+    bool writeInterest;
+    bool closed;
+    bool deleted;
+    volatile bool queuedClose;
+    /**
+     * Set by notifyPendingWrite() (which can be called from any thread)
+     * and cleared on the dispatching thread before calling idleCallback
+     */
+    volatile bool writePending;
+    Mutex requestLock;
+    std::vector<RequestCallback> requests;
+    uint64_t buffersWritten;
+    uint64_t writeSyscalls;
+};
+
+AsynchIO::AsynchIO(const Socket& s,
+                   ReadCallback rCb, EofCallback eofCb, DisconnectCallback disCb,
+                   ClosedCallback cCb, BuffersEmptyCallback eCb, IdleCallback iCb) :
+    readCallback(rCb),
+    eofCallback(eofCb),
+    disCallback(disCb),
+    closedCallback(cCb),
+    emptyCallback(eCb),
+    idleCallback(iCb),
+    socket(s),
+    fd(toFd(s)),
+    ring(0),
+    readBuffer(0),
+    sendCount(0),
+    sendBytes(0),
+    receiving(false),
+    sending(false),
+    cancelling(false),
+    readStopped(false),
+    readReady(false),
+    writeFailed(false),
+    writeInterest(false),
+    closed(false),
+    deleted(false),
+    queuedClose(false),
+    writePending(false),
+    buffersWritten(0),
+    writeSyscalls(0) {
+
+    s.setNonblocking();
+}
+
+AsynchIO::~AsynchIO() {
+}
+
+void AsynchIO::queueForDeletion() {
+    deleted = true;
+    if (!ring) {
+        delete this;
+    } else if (!receiving && !sending && !cancelling && ring->inDispatch()) {
+        ring->retire(this);
+    } else {
+        // Retired once the last operation in flight completes
+        wake();
+    }
+}
+
+void AsynchIO::start(Poller::shared_ptr poller) {
+    ring = &Ring::forPoller(poller);
+    ring->notify(this);
+}
+
+void AsynchIO::createBuffers(uint32_t size) {
+    // Buffers only get memory (from the shared pool) when they are
+    // needed, and give it back when the connection goes quiet
+    buffers.create(size, BufferCount);
+}
+
+// Anything changed outside the Ring's own callbacks needs it to look again
+void AsynchIO::wake() {
+    if (ring && !ring->inDispatch())
+        ring->notify(this);
+}
+
+void AsynchIO::queueReadBuffer(BufferBase* buff) {
+    assert(buff);
+    buff->dataStart = 0;
+    buff->dataCount = 0;
+    buff->reclaim();
+    bufferQueue.push_back(buff);
+    wake();
+}
+
+void AsynchIO::unread(BufferBase* buff) {
+    assert(buff);
+    buff->reclaim();
+    buff->squish();
+    bufferQueue.push_front(buff);
+    wake();
+}
+
+void AsynchIO::queueWrite(BufferBase* buff) {
+    assert(buff);
+    // If we've already closed the socket then throw the write away
+    if (queuedClose) {
+        queueReadBuffer(buff);
+        return;
+    } else {
+        writeQueue.push_front(buff);
+    }
+    writePending = false;
+    writeInterest = true;
+    wake();
+}
+
+// This can happen outside the callback context
+void AsynchIO::notifyPendingWrite() {
+    writePending = true;
+    if (ring) ring->notify(this);
+}
+
+void AsynchIO::queueWriteClose() {
+    queuedClose = true;
+    if (ring) ring->notify(this);
+}
+
+bool AsynchIO::writeQueueEmpty() {
+    return writeQueue.empty();
+}
+
+void AsynchIO::requestCallback(RequestCallback callback) {
+    assert(callback);
+    {
+        ScopedLock<Mutex> l(requestLock);
+        requests.push_back(callback);
+    }
+    if (ring) ring->notify(this);
+}
+
+/** Return a queued buffer if there are enough
+ * to spare
+ */
+AsynchIO::BufferBase* AsynchIO::getQueuedBuffer() {
+    // Always keep at least one buffer (it might have data that was "unread" in it)
+    if (bufferQueue.size()<=1)
+        return buffers.spare(false);
+    BufferBase* buff = bufferQueue.back();
+    assert(buff);
+    buff->dataStart = 0;
+    buff->dataCount = 0;
+    bufferQueue.pop_back();
+    return buff;
+}
+
+void AsynchIO::completed(unsigned op, int result, unsigned) {
+    switch (op) {
+    case RecvOp:
+        receiving = false;
+        received(result);
+        break;
+    case SendOp:
+        sending = false;
+        sent(result);
+        break;
+    case CancelOp:
+        cancelling = false;
+        break;
+    }
+    serviced();
+}
+
+void AsynchIO::received(int result) {
+    BufferBase* buff = readBuffer;
+    if (!buff) {
+        // A poll: there is something to read (or an error the
+        // receive will report), so it's worth taking a buffer
+        readReady = true;
+        return;
+    }
+    readBuffer = 0;
+    if (result > 0 && !closed) {
+        bool filled = result == buff->byteCount - buff->dataCount;
+        buff->dataCount += result;
+        readCallback(*this, buff);
+        // Unless it's keeping up with a steady flow the connection
+        // doesn't need its extra buffers any more
+        if (!filled)
+            buffers.trim(bufferQueue);
+        return;
+    }
+
+    // Put buffer back (at front so it doesn't interfere with unread buffers)
+    bufferQueue.push_front(buff);
+    if (closed || result == -EINTR || result == -EAGAIN || result == -ECANCELED) {
+        // Nothing read; just try again if we're still open
+        return;
+    }
+    // Eof or other side has gone away
+    if (result < 0 && result != -ECONNRESET) {
+        // Report error then just treat as a socket disconnect
+        QPID_LOG(error, "Error reading socket: " << qpid::sys::strError(-result) << "(" << -result << ")" );
+    }
+    readStopped = true;
+    eofCallback(*this);
+}
+
+void AsynchIO::sent(int result) {
+    if (result < 0) {
+        // Nothing was written so the buffers are all still queued
+        if (result == -EINTR || result == -EAGAIN) return;
+        if (result != -ECONNRESET && result != -EPIPE) {
+            // Report error then just treat as a socket disconnect
+            QPID_LOG(error, "Error writing socket: " << qpid::sys::strError(-result) << "(" << -result << ")" );
+        }
+        // We'll find out about the disconnect from the receive side
+        writeFailed = true;
+        return;
+    }
+
+    // Recycle the buffers written in full, a partly written
+    // buffer stays at the head of the queue for next time
+    size_t remaining = result;
+    for (size_t i = 0; i < sendCount; ++i) {
+        BufferBase* buff = writeQueue.back();
+        if (size_t(buff->dataCount) > remaining) {
+            buff->dataStart += remaining;
+            buff->dataCount -= remaining;
+            break;
+        }
+        remaining -= buff->dataCount;
+        writeQueue.pop_back();
+        queueReadBuffer(buff);
+        ++buffersWritten;
+    }
+}
+
+/*
+ * Work out what to do next after any completion or notification: run
+ * requested callbacks, then keep a send and a receive in flight.
+ */
+void AsynchIO::serviced() {
+    if (closed) {
+        if (deleted && !receiving && !sending && !cancelling)
+            ring->retire(this);
+        return;
+    }
+
+    std::vector<RequestCallback> calls;
+    {
+        ScopedLock<Mutex> l(requestLock);
+        calls.swap(requests);
+    }
+    for (std::vector<RequestCallback>::iterator i = calls.begin(); i != calls.end(); ++i) {
+        (*i)(*this);
+    }
+
+    if (!sending) {
+        if (writeFailed) {
+            // Can't write any more, so only closing is left
+            if (queuedClose) {
+                close();
+                return;
+            }
+        } else if (!writeQueue.empty()) {
+            send();
+        } else if (queuedClose) {
+            // If we're waiting to close the socket then can do it now as there is nothing to write
+            close();
+            return;
+        } else if (writeInterest || writePending) {
+            // Nothing to write but we could
+            if (idleCallback) {
+                writePending = false;
+                idleCallback(*this);
+                // Let the callback fill any spare buffers too, so that
+                // they all go out in the same send
+                while (!writeQueue.empty() && !queuedClose &&
+                       writeQueue.size() < size_t(MaxGatherBuffers) &&
+                       (bufferQueue.size() > 1 || buffers.hasSpare())) {
+                    size_t queued = writeQueue.size();
+                    idleCallback(*this);
+                    if (writeQueue.size() == queued)
+                        break;
+                }
+            }
+            if (!writeQueue.empty()) {
+                send();
+            } else if (queuedClose) {
+                close();
+                return;
+            } else {
+                // A notifyPendingWrite() after this point will bring us back
+                writeInterest = false;
+            }
+        }
+    }
+
+    if (!receiving && !readStopped) {
+        if (bufferQueue.empty() && (readReady || buffers.getBacked() != 0)) {
+            // Nowhere to read into: use a spare, adding one if the
+            // connection is allowed more
+            if (BufferBase* buff = buffers.spare(true)) {
+                bufferQueue.push_back(buff);
+            } else if (emptyCallback) {
+                emptyCallback(*this);
+            }
+        }
+        if (!bufferQueue.empty() || buffers.getBacked() == 0)
+            receive();
+    }
+}
+
+void AsynchIO::receive() {
+    ::io_uring_sqe sqe;
+    ::memset(&sqe, 0, sizeof(sqe));
+    sqe.fd = fd;
+    sqe.user_data = Ring::userData(this, RecvOp);
+    if (bufferQueue.empty()) {
+        // Wait for something to read before taking a buffer
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.poll32_events = POLLIN;
+    } else {
+        BufferBase* buff = bufferQueue.front();
+        assert(buff);
+        bufferQueue.pop_front();
+        readBuffer = buff;
+        readReady = false;
+
+        sqe.opcode = IORING_OP_RECV;
+        sqe.addr = reinterpret_cast<uintptr_t>(buff->bytes + buff->dataCount);
+        sqe.len = buff->byteCount - buff->dataCount;
+    }
+    ring->submit(sqe);
+    receiving = true;
+}
+
+void AsynchIO::send() {
+    // Gather as many queued buffers as we can, oldest first
+    sendCount = 0;
+    sendBytes = 0;
+    for (std::deque<BufferBase*>::reverse_iterator i = writeQueue.rbegin();
+         i != writeQueue.rend() && sendCount < size_t(MaxGatherBuffers);
+         ++i, ++sendCount) {
+        BufferBase* buff = *i;
+        assert(buff->dataStart+buff->dataCount <= buff->byteCount);
+        iov[sendCount].iov_base = buff->bytes+buff->dataStart;
+        iov[sendCount].iov_len = buff->dataCount;
+        sendBytes += buff->dataCount;
+    }
+
+    ::io_uring_sqe sqe;
+    ::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITEV;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uintptr_t>(iov);
+    sqe.len = sendCount;
+    sqe.user_data = Ring::userData(this, SendOp);
+    ring->submit(sqe);
+    sending = true;
+    ++writeSyscalls;
+}
+
+/*
+ * Close the socket and callback to say we've done it
+ */
+void AsynchIO::close() {
+    closed = true;
+    if (receiving) {
+        // The ring holds its own reference to the socket so closing it
+        // doesn't end a receive in flight; cancel it explicitly
+        ::io_uring_sqe sqe;
+        ::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = -1;
+        sqe.addr = Ring::userData(this, RecvOp);
+        sqe.user_data = Ring::userData(this, CancelOp);
+        ring->submit(sqe);
+        cancelling = true;
+    }
+    socket.close();
+    if (closedCallback) {
+        closedCallback(*this, socket);
+    }
+}
+
+void AsynchIO::getWriteCounts(uint64_t& buffers, uint64_t& calls) const {
+    buffers = buffersWritten;
+    calls = writeSyscalls;
+}
+
+SecuritySettings AsynchIO::getSecuritySettings() {
+    SecuritySettings settings;
+    settings.ssf = socket.getKeyLen();
+    settings.authid = socket.getClientAuthId();
+    return settings;
+}
+
+bool available() {
+    static int supported = -1;
+    if (supported < 0) {
+        ::io_uring_params p;
+        ::memset(&p, 0, sizeof(p));
+        int fd = setup(4, &p);
+        if (fd < 0) {
+            QPID_LOG(info, "io_uring not available: " << qpid::sys::strError(errno));
+            supported = 0;
+        } else {
+            // We rely on completions never being dropped and on the ring
+            // copying submissions when they are handed over
+            supported = (p.features & IORING_FEAT_NODROP) && (p.features & IORING_FEAT_SUBMIT_STABLE);
+            ::close(fd);
+        }
+    }
+    return supported;
+}
+
+bool handles(const Socket& s) {
+    // Other sockets (eg SSL) do their own IO on top of the descriptor
+    return typeid(s) == typeid(BSDSocket);
+}
+
+qpid::sys::AsynchAcceptor* createAcceptor(const Socket& s, qpid::sys::AsynchAcceptor::Callback callback) {
+    return new uring::AsynchAcceptor(s, callback);
+}
+
+qpid::sys::AsynchIO* createAsynchIO(const Socket& s,
+                                    qpid::sys::AsynchIO::ReadCallback rCb,
+                                    qpid::sys::AsynchIO::EofCallback eofCb,
+                                    qpid::sys::AsynchIO::DisconnectCallback disCb,
+                                    qpid::sys::AsynchIO::ClosedCallback cCb,
+                                    qpid::sys::AsynchIO::BuffersEmptyCallback eCb,
+                                    qpid::sys::AsynchIO::IdleCallback iCb)
+{
+    return new uring::AsynchIO(s, rCb, eofCb, disCb, cCb, eCb, iCb);
+}
+
+}}} // namespace qpid::sys::uring
@@ -0,0 +1,60 @@
+#ifndef QPID_SYS_URING_ASYNCHIO_H
+#define QPID_SYS_URING_ASYNCHIO_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "qpid/sys/AsynchIO.h"
+
+namespace qpid {
+namespace sys {
+namespace uring {
+
+/*
+ * io_uring implementation of the AsynchIO interfaces (Linux only).
+ *
+ * Instead of waiting for readiness and then issuing a read or write per
+ * buffer, each connection keeps a receive and a gathered send in flight
+ * on a submission ring. Every Poller owns a small set of rings whose
+ * completion queues are watched through the Poller itself, so completions
+ * are processed by the usual IO threads and all callbacks for a
+ * connection are serialised exactly as they are with DispatchHandle.
+ */
+
+/** True if the running kernel supports the io_uring features we use */
+bool available();
+
+/** True if this backend can drive the socket (plain TCP sockets only) */
+bool handles(const Socket& s);
+
+AsynchAcceptor* createAcceptor(const Socket& s, AsynchAcceptor::Callback callback);
+
+AsynchIO* createAsynchIO(const Socket& s,
+                         AsynchIO::ReadCallback rCb,
+                         AsynchIO::EofCallback eofCb,
+                         AsynchIO::DisconnectCallback disCb,
+                         AsynchIO::ClosedCallback cCb,
+                         AsynchIO::BuffersEmptyCallback eCb,
+                         AsynchIO::IdleCallback iCb);
+
+}}} // namespace qpid::sys::uring
+
+#endif  /*!QPID_SYS_URING_ASYNCHIO_H*/
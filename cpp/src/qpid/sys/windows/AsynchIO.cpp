@@ -30,6 +30,7 @@
 #include "qpid/sys/Thread.h"
 #include "qpid/sys/Time.h"
 #include "qpid/log/Statement.h"
+#include "qpid/Exception.h"
 
 #include "qpid/sys/windows/check.h"
 #include "qpid/sys/windows/mingw32_compat.h"
@@ -833,4 +834,14 @@ AsynchIO* qpid::sys::AsynchIO::create(const Socket& s,
     return new qpid::sys::windows::AsynchIO(s, rCb, eofCb, disCb, cCb, eCb, iCb);
 }
 
+bool qpid::sys::AsynchIO::selectBackend(const std::string& name)
+{
+    // Completion ports are the only implementation here
+    if (name == "default")
+        return true;
+    if (name == "io_uring")
+        return false;
+    throw qpid::Exception(QPID_MSG("Unknown IO backend: " << name));
+}
+
 }}  // namespace qpid::sys
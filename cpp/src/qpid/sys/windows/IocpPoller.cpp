@@ -213,6 +213,10 @@ Poller::Poller() :
     impl(new PollerPrivate())
 {}
 
+Poller::Poller(uint32_t /*batchSize*/) :
+    impl(new PollerPrivate())
+{}
+
 Poller::~Poller() {
     delete impl;
 }
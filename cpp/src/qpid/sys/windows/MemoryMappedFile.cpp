@@ -0,0 +1,121 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "qpid/sys/MemoryMappedFile.h"
+#include "qpid/sys/StrError.h"
+#include "qpid/Exception.h"
+#include "qpid/Msg.h"
+
+#include <windows.h>
+
+namespace qpid {
+namespace sys {
+
+class MemoryMappedFilePrivate
+{
+  public:
+    HANDLE file;
+    size_t size;
+
+    MemoryMappedFilePrivate() : file(INVALID_HANDLE_VALUE), size(0) {}
+    ~MemoryMappedFilePrivate() { if (file != INVALID_HANDLE_VALUE) ::CloseHandle(file); }
+};
+
+MemoryMappedFile::MemoryMappedFile() : impl(new MemoryMappedFilePrivate) {}
+MemoryMappedFile::~MemoryMappedFile() {}
+
+std::string MemoryMappedFile::open(const std::string& name, const std::string& directory)
+{
+    char path[MAX_PATH];
+    if (!::GetTempFileName(directory.c_str(), name.substr(0, 3).c_str(), 0, path))
+        throw qpid::Exception(QPID_MSG("Could not create paging file in " << directory << ": " << strError(GetLastError())));
+    HANDLE h = ::CreateFile(path,
+                            GENERIC_READ|GENERIC_WRITE,
+                            0, /* No sharing */
+                            0, /* Default security */
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, /* Delete file when closed */
+                            NULL);
+    if (h == INVALID_HANDLE_VALUE)
+        throw qpid::Exception(QPID_MSG("Could not create paging file " << path << ": " << strError(GetLastError())));
+    close();
+    impl->file = h;
+    impl->size = 0;
+    return std::string(path);
+}
+
+void MemoryMappedFile::close()
+{
+    if (impl->file != INVALID_HANDLE_VALUE) {
+        ::CloseHandle(impl->file);
+        impl->file = INVALID_HANDLE_VALUE;
+        impl->size = 0;
+    }
+}
+
+size_t MemoryMappedFile::getPageSize()
+{
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+
+void MemoryMappedFile::expand(size_t size)
+{
+    if (size > impl->size) {
+        LARGE_INTEGER end;
+        end.QuadPart = size;
+        if (!::SetFilePointerEx(impl->file, end, 0, FILE_BEGIN) || !::SetEndOfFile(impl->file))
+            throw qpid::Exception(QPID_MSG("Could not expand paging file to " << size << " bytes: " << strError(GetLastError())));
+        impl->size = size;
+    }
+}
+
+char* MemoryMappedFile::map(size_t offset, size_t size)
+{
+    HANDLE mapping = ::CreateFileMapping(impl->file, 0, PAGE_READWRITE, 0, 0, 0);
+    if (!mapping)
+        throw qpid::Exception(QPID_MSG("Could not map paging file: " << strError(GetLastError())));
+    ULARGE_INTEGER start;
+    start.QuadPart = offset;
+    void* region = ::MapViewOfFile(mapping, FILE_MAP_WRITE, start.HighPart, start.LowPart, size);
+    // the view keeps the mapping object alive
+    ::CloseHandle(mapping);
+    if (!region)
+        throw qpid::Exception(QPID_MSG("Could not map " << size << " bytes of paging file at " << offset << ": " << strError(GetLastError())));
+    return static_cast<char*>(region);
+}
+
+void MemoryMappedFile::unmap(char* region, size_t /*size*/)
+{
+    ::UnmapViewOfFile(region);
+}
+
+void MemoryMappedFile::flush(char* region, size_t size)
+{
+    ::FlushViewOfFile(region, size);
+}
+
+void MemoryMappedFile::prefetch(size_t /*offset*/, size_t /*size*/)
+{
+    // No read ahead for unmapped regions; the view is read in when mapped
+}
+
+}} // namespace qpid::sys
@@ -205,4 +205,10 @@ bool SystemInfo::threadSafeShutdown()
 #endif
 }
 
+bool SystemInfo::setThreadAffinity(unsigned cpu) {
+    if (cpu >= sizeof(DWORD_PTR) * 8)
+        return false;
+    return ::SetThreadAffinityMask(::GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+}
+
 }} // namespace qpid::sys
@@ -0,0 +1,124 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#include "unit_test.h"
+#include "qpid/sys/AggregateOutput.h"
+
+namespace qpid {
+namespace tests {
+
+QPID_AUTO_TEST_SUITE(AggregateOutputTestSuite)
+
+using namespace qpid::sys;
+
+namespace {
+struct Control : public OutputControl
+{
+    size_t buffered;
+    uint activations;
+    Control() : buffered(0), activations(0) {}
+    void abort() {}
+    void activateOutput() { ++activations; }
+    size_t getBuffered() const { return buffered; }
+};
+
+// Writes a fixed amount each time it's asked, until it runs out
+struct Task : public OutputTask
+{
+    Control& control;
+    size_t size;
+    uint remaining;
+    uint calls;
+    size_t written;
+    Task(Control& c, size_t s, uint r) : control(c), size(s), remaining(r), calls(0), written(0) {}
+    bool doOutput() {
+        ++calls;
+        if (!remaining) return false;
+        --remaining;
+        control.buffered += size;
+        written += size;
+        return true;
+    }
+};
+}
+
+QPID_AUTO_TEST_CASE(testIdleTasksDropped)
+{
+    Control control;
+    AggregateOutput output(control);
+    Task task(control, 100, 2);
+    output.addOutputTask(&task);
+    output.addOutputTask(&task);
+    BOOST_CHECK(output.doOutput());
+    BOOST_CHECK(output.doOutput());
+    BOOST_CHECK(!output.doOutput());
+    BOOST_CHECK_EQUAL(task.calls, 3u);
+    // Not looked at again until added back
+    BOOST_CHECK(!output.doOutput());
+    BOOST_CHECK_EQUAL(task.calls, 3u);
+    task.remaining = 1;
+    output.addOutputTask(&task);
+    BOOST_CHECK(output.doOutput());
+    BOOST_CHECK_EQUAL(task.written, 300u);
+}
+
+QPID_AUTO_TEST_CASE(testFairByBytes)
+{
+    Control control;
+    AggregateOutput output(control);
+    Task big(control, 8000, 1000);
+    Task small(control, 100, 100000);
+    output.addOutputTask(&big);
+    output.addOutputTask(&small);
+    while (control.buffered < 1000000) {
+        BOOST_REQUIRE(output.doOutput());
+    }
+    // Each gets about half the bytes, though small needs many more calls
+    BOOST_CHECK(big.written > 400000 && big.written < 600000);
+    BOOST_CHECK(small.written > 400000 && small.written < 600000);
+}
+
+QPID_AUTO_TEST_CASE(testRemove)
+{
+    Control control;
+    AggregateOutput output(control);
+    Task a(control, 100, 10);
+    Task b(control, 100, 10);
+    output.addOutputTask(&a);
+    output.addOutputTask(&b);
+    output.removeOutputTask(&a);
+    while (output.doOutput()) ;
+    BOOST_CHECK_EQUAL(a.calls, 0u);
+    BOOST_CHECK_EQUAL(b.written, 1000u);
+    // Can be added again after removal
+    output.addOutputTask(&a);
+    output.addOutputTask(&b);
+    output.removeAll();
+    BOOST_CHECK(!output.doOutput());
+    output.addOutputTask(&a);
+    while (output.doOutput()) ;
+    BOOST_CHECK_EQUAL(a.written, 1000u);
+}
+
+QPID_AUTO_TEST_SUITE_END()
+
+}} // namespace qpid::tests
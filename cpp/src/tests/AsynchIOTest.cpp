@@ -0,0 +1,379 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "unit_test.h"
+#include "qpid/sys/AsynchIO.h"
+#include "qpid/sys/Monitor.h"
+#include "qpid/sys/Poller.h"
+#include "qpid/sys/Socket.h"
+#include "qpid/sys/SocketAddress.h"
+#include "qpid/sys/Thread.h"
+#include "qpid/sys/Time.h"
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include "qpid/sys/posix/BSDSocket.h"
+#include <sys/socket.h>
+#endif
+
+namespace qpid {
+namespace tests {
+
+QPID_AUTO_TEST_SUITE(AsynchIOTestSuite)
+
+using namespace qpid::sys;
+
+namespace {
+
+std::string pattern(size_t size) {
+    std::string s;
+    for (size_t i = 0; s.size() < size; ++i)
+        s += boost::lexical_cast<std::string>(i) + ",";
+    s.resize(size);
+    return s;
+}
+
+/*
+ * A client that connects to an echo server on the loopback interface,
+ * writes a pattern in chunks, reads it all back and closes; the server
+ * closes when it sees the client go.
+ */
+class Loopback {
+    Monitor lock;
+    Poller::shared_ptr poller;
+    const std::string sent;
+    const size_t chunk;
+    size_t written;
+    std::string received;
+    int closed;
+    std::string failure;
+
+    // Server side: write back whatever is read, in the buffer it came in
+    void echo(AsynchIO& aio, AsynchIO::BufferBase* buff) {
+        aio.queueWrite(buff);
+    }
+
+    void serverEof(AsynchIO& aio) {
+        aio.queueWriteClose();
+    }
+
+    void accepted(const Socket& s) {
+        AsynchIO* aio = AsynchIO::create(s,
+                                         boost::bind(&Loopback::echo, this, _1, _2),
+                                         boost::bind(&Loopback::serverEof, this, _1),
+                                         boost::bind(&Loopback::disconnected, this, _1),
+                                         boost::bind(&Loopback::socketClosed, this, _1, _2));
+        aio->createBuffers(chunk);
+        aio->start(poller);
+    }
+
+    // Client side
+    void connected(const Socket& s) {
+        AsynchIO* aio = AsynchIO::create(s,
+                                         boost::bind(&Loopback::read, this, _1, _2),
+                                         boost::bind(&Loopback::clientEof, this, _1),
+                                         boost::bind(&Loopback::disconnected, this, _1),
+                                         boost::bind(&Loopback::socketClosed, this, _1, _2),
+                                         0,
+                                         boost::bind(&Loopback::write, this, _1));
+        aio->createBuffers(chunk);
+        aio->start(poller);
+        aio->notifyPendingWrite();
+    }
+
+    void connectFailed(const Socket& s, int, const std::string& error) {
+        fail("Connect failed: " + error);
+        delete &s;
+    }
+
+    void write(AsynchIO& aio) {
+        if (written == sent.size())
+            return;
+        AsynchIO::BufferBase* buff = aio.getQueuedBuffer();
+        if (!buff)
+            return;
+        size_t n = std::min(chunk, sent.size() - written);
+        ::memcpy(buff->bytes, sent.data() + written, n);
+        buff->dataCount = n;
+        written += n;
+        aio.queueWrite(buff);
+    }
+
+    void read(AsynchIO& aio, AsynchIO::BufferBase* buff) {
+        bool done;
+        {
+            Monitor::ScopedLock l(lock);
+            received.append(buff->bytes + buff->dataStart, buff->dataCount);
+            done = received.size() >= sent.size();
+        }
+        aio.queueReadBuffer(buff);
+        if (done)
+            aio.queueWriteClose();
+        else
+            aio.notifyPendingWrite();
+    }
+
+    void clientEof(AsynchIO& aio) {
+        fail("Server closed first");
+        aio.queueWriteClose();
+    }
+
+    void disconnected(AsynchIO& aio) {
+        fail("Disconnected");
+        aio.queueWriteClose();
+    }
+
+    void socketClosed(AsynchIO& aio, const Socket& s) {
+        delete &s;
+        aio.queueForDeletion();
+        Monitor::ScopedLock l(lock);
+        ++closed;
+        lock.notifyAll();
+    }
+
+    void fail(const std::string& error) {
+        Monitor::ScopedLock l(lock);
+        if (failure.empty())
+            failure = error;
+    }
+
+  public:
+    Loopback(size_t size, size_t c)
+        : poller(new Poller), sent(pattern(size)), chunk(c), written(0), closed(0) {}
+
+    void run() {
+        std::vector<Thread> threads;
+        for (int i = 0; i < 2; ++i)
+            threads.push_back(Thread(*poller));
+
+        std::auto_ptr<Socket> listener(createSocket());
+        int port = listener->listen(SocketAddress("127.0.0.1", "0"));
+        std::auto_ptr<AsynchAcceptor> acceptor(
+            AsynchAcceptor::create(*listener, boost::bind(&Loopback::accepted, this, _1)));
+        acceptor->start(poller);
+
+        Socket* client = createSocket();
+        AsynchConnector* connector =
+            AsynchConnector::create(*client, "127.0.0.1", boost::lexical_cast<std::string>(port),
+                                    boost::bind(&Loopback::connected, this, _1),
+                                    boost::bind(&Loopback::connectFailed, this, _1, _2, _3));
+        connector->start(poller);
+
+        {
+            Monitor::ScopedLock l(lock);
+            AbsTime deadline(now(), 10*TIME_SEC);
+            while (closed < 2 && failure.empty() && lock.wait(deadline))
+                ;
+            BOOST_CHECK_EQUAL(failure, "");
+            BOOST_CHECK_EQUAL(closed, 2);
+            BOOST_CHECK_EQUAL(received.size(), sent.size());
+            BOOST_CHECK(received == sent);
+        }
+
+        acceptor.reset();
+        poller->shutdown();
+        for (std::vector<Thread>::iterator i = threads.begin(); i != threads.end(); ++i)
+            i->join();
+    }
+};
+
+#ifndef _WIN32
+/*
+ * One end of a socket pair writes a pattern, filling every buffer it can
+ * each time it is idle so that they are gathered into one write, then
+ * closes; the other end reads it all back.
+ */
+class GatherWrite {
+    Monitor lock;
+    Poller::shared_ptr poller;
+    const std::string sent;
+    const size_t chunk;
+    size_t written;
+    std::string received;
+    int closed;
+    std::string failure;
+    uint64_t buffersWritten;
+    uint64_t writeCalls;
+
+    void write(AsynchIO& aio) {
+        if (written == sent.size()) {
+            aio.queueWriteClose();
+            return;
+        }
+        AsynchIO::BufferBase* buff = aio.getQueuedBuffer();
+        if (!buff)
+            return;
+        size_t n = std::min(chunk, sent.size() - written);
+        ::memcpy(buff->bytes, sent.data() + written, n);
+        buff->dataCount = n;
+        written += n;
+        aio.queueWrite(buff);
+    }
+
+    void unexpectedRead(AsynchIO& aio, AsynchIO::BufferBase* buff) {
+        fail("Writer read data");
+        aio.queueReadBuffer(buff);
+    }
+
+    void writerClosed(AsynchIO& aio, const Socket& s) {
+        Monitor::ScopedLock l(lock);
+        aio.getWriteCounts(buffersWritten, writeCalls);
+        socketClosed(aio, s);
+    }
+
+    void read(AsynchIO& aio, AsynchIO::BufferBase* buff) {
+        {
+            Monitor::ScopedLock l(lock);
+            received.append(buff->bytes + buff->dataStart, buff->dataCount);
+        }
+        aio.queueReadBuffer(buff);
+    }
+
+    // The writer closing can show up as end of file or as a hang up
+    void readerEof(AsynchIO& aio) {
+        aio.queueWriteClose();
+    }
+
+    void readerClosed(AsynchIO& aio, const Socket& s) {
+        Monitor::ScopedLock l(lock);
+        socketClosed(aio, s);
+    }
+
+    void disconnected(AsynchIO& aio) {
+        fail("Disconnected");
+        aio.queueWriteClose();
+    }
+
+    // Called with lock held
+    void socketClosed(AsynchIO& aio, const Socket& s) {
+        delete &s;
+        aio.queueForDeletion();
+        ++closed;
+        lock.notifyAll();
+    }
+
+    void fail(const std::string& error) {
+        Monitor::ScopedLock l(lock);
+        if (failure.empty())
+            failure = error;
+    }
+
+  public:
+    GatherWrite(size_t size, size_t c)
+        : poller(new Poller), sent(pattern(size)), chunk(c), written(0), closed(0),
+          buffersWritten(0), writeCalls(0) {}
+
+    /** sendBuffer is the writer's socket send buffer size, or 0 to leave it be */
+    void run(int sendBuffer) {
+        int fds[2];
+        BOOST_REQUIRE_EQUAL(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        if (sendBuffer)
+            BOOST_REQUIRE_EQUAL(::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer)), 0);
+
+        std::vector<Thread> threads;
+        for (int i = 0; i < 2; ++i)
+            threads.push_back(Thread(*poller));
+
+        AsynchIO* reader = AsynchIO::create(*new BSDSocket(fds[1]),
+                                            boost::bind(&GatherWrite::read, this, _1, _2),
+                                            boost::bind(&GatherWrite::readerEof, this, _1),
+                                            boost::bind(&GatherWrite::readerEof, this, _1),
+                                            boost::bind(&GatherWrite::readerClosed, this, _1, _2));
+        reader->createBuffers(chunk);
+        reader->start(poller);
+
+        AsynchIO* writer = AsynchIO::create(*new BSDSocket(fds[0]),
+                                            boost::bind(&GatherWrite::unexpectedRead, this, _1, _2),
+                                            0,
+                                            boost::bind(&GatherWrite::disconnected, this, _1),
+                                            boost::bind(&GatherWrite::writerClosed, this, _1, _2),
+                                            0,
+                                            boost::bind(&GatherWrite::write, this, _1));
+        writer->createBuffers(chunk);
+        // Writing starts as soon as the socket is watched, and the writer
+        // may be gone by the time this returns
+        writer->start(poller);
+
+        {
+            Monitor::ScopedLock l(lock);
+            AbsTime deadline(now(), 10*TIME_SEC);
+            while (closed < 2 && failure.empty() && lock.wait(deadline))
+                ;
+            BOOST_CHECK_EQUAL(failure, "");
+            BOOST_CHECK_EQUAL(closed, 2);
+            BOOST_CHECK_EQUAL(received.size(), sent.size());
+            BOOST_CHECK(received == sent);
+        }
+
+        poller->shutdown();
+        for (std::vector<Thread>::iterator i = threads.begin(); i != threads.end(); ++i)
+            i->join();
+    }
+
+    uint64_t getBuffersWritten() const { return buffersWritten; }
+    uint64_t getWriteCalls() const { return writeCalls; }
+};
+#endif
+
+}
+
+QPID_AUTO_TEST_CASE(testLoopback) {
+    BOOST_REQUIRE(AsynchIO::selectBackend("default"));
+    Loopback(256*1024, 1000).run();
+}
+
+QPID_AUTO_TEST_CASE(testUringLoopback) {
+    if (!AsynchIO::selectBackend("io_uring")) {
+        BOOST_TEST_MESSAGE("io_uring is not available, skipping");
+        return;
+    }
+    Loopback(256*1024, 1000).run();
+    AsynchIO::selectBackend("default");
+}
+
+#ifndef _WIN32
+QPID_AUTO_TEST_CASE(testGatherWrite) {
+    BOOST_REQUIRE(AsynchIO::selectBackend("default"));
+    // Everything fits in the socket, so each write takes all the buffers queued
+    GatherWrite test(128*1024, 8*1024);
+    test.run(0);
+    BOOST_CHECK_EQUAL(test.getBuffersWritten(), 16u);
+    BOOST_CHECK(test.getWriteCalls() < test.getBuffersWritten());
+}
+
+QPID_AUTO_TEST_CASE(testPartialWrite) {
+    BOOST_REQUIRE(AsynchIO::selectBackend("default"));
+    // A small send buffer takes a buffer at a time, or less, so buffers are
+    // left partly written and are recycled one by one as they complete
+    GatherWrite test(512*1024, 16*1024);
+    test.run(4096);
+    BOOST_CHECK_EQUAL(test.getBuffersWritten(), 32u);
+    BOOST_CHECK(test.getWriteCalls() > test.getBuffersWritten());
+}
+#endif
+
+QPID_AUTO_TEST_SUITE_END()
+
+}} // namespace qpid::tests
@@ -0,0 +1,119 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#include "unit_test.h"
+#include "qpid/sys/BufferPool.h"
+#include <deque>
+
+namespace qpid {
+namespace tests {
+
+QPID_AUTO_TEST_SUITE(BufferPoolTestSuite)
+
+using namespace qpid::sys;
+
+QPID_AUTO_TEST_CASE(testReuse) {
+    BufferPool pool(1024*1024);
+    char* first;
+    {
+        BufferRef b = pool.allocate(65535);
+        BOOST_CHECK_EQUAL(b.end() - b.begin(), 65535);
+        first = b.begin();
+        BufferPool::Stats stats = pool.getStats();
+        BOOST_CHECK_EQUAL(stats.inUse, 1u);
+        BOOST_CHECK_EQUAL(stats.inUseBytes, 65536u);
+        BOOST_CHECK_EQUAL(stats.idle, 0u);
+    }
+    BufferPool::Stats stats = pool.getStats();
+    BOOST_CHECK_EQUAL(stats.inUse, 0u);
+    BOOST_CHECK_EQUAL(stats.idle, 1u);
+    BOOST_CHECK_EQUAL(stats.idleBytes, 65536u);
+
+    // Same size class gets the same memory back
+    BufferRef b = pool.allocate(40000);
+    BOOST_CHECK(b.begin() == first);
+    stats = pool.getStats();
+    BOOST_CHECK_EQUAL(stats.allocations, 2u);
+    BOOST_CHECK_EQUAL(stats.reuses, 1u);
+    BOOST_CHECK_EQUAL(stats.idle, 0u);
+}
+
+QPID_AUTO_TEST_CASE(testIdleLimit) {
+    BufferPool pool(2*65536);
+    {
+        BufferRef b1 = pool.allocate(65536);
+        BufferRef b2 = pool.allocate(65536);
+        BufferRef b3 = pool.allocate(65536);
+        BufferRef big = pool.allocate(4*1024*1024);
+        BOOST_CHECK_EQUAL(pool.getStats().inUse, 4u);
+    }
+    BufferPool::Stats stats = pool.getStats();
+    BOOST_CHECK_EQUAL(stats.inUse, 0u);
+    BOOST_CHECK_EQUAL(stats.idleBytes, 2*65536u);
+    BOOST_CHECK_EQUAL(stats.discards, 1u);
+
+    pool.setMaxIdle(0);
+    stats = pool.getStats();
+    BOOST_CHECK_EQUAL(stats.idle, 0u);
+    BOOST_CHECK_EQUAL(stats.discards, 3u);
+}
+
+QPID_AUTO_TEST_CASE(testBufferSet) {
+    BufferPool pool;
+    pool.setConnectionLimits(1, 6);
+    AsynchIOBufferSet buffers(pool);
+    buffers.create(1024, AsynchIO::BufferCount);
+    BOOST_CHECK_EQUAL(buffers.getSlots(), uint32_t(AsynchIO::BufferCount));
+    BOOST_CHECK_EQUAL(buffers.getBacked(), 0u);
+
+    // Use all the slots then grow up to the maximum
+    std::deque<AsynchIOBufferBase*> queue;
+    while (AsynchIOBufferBase* b = buffers.spare(true)) {
+        BOOST_CHECK(b->bytes);
+        BOOST_CHECK_EQUAL(b->byteCount, 1024);
+        queue.push_back(b);
+    }
+    BOOST_CHECK_EQUAL(buffers.getSlots(), 6u);
+    BOOST_CHECK_EQUAL(buffers.getBacked(), 6u);
+    BOOST_CHECK(!buffers.spare(false));
+
+    // Going quiet keeps the minimum and anything holding data
+    queue.front()->dataCount = 10;
+    buffers.trim(queue);
+    BOOST_CHECK_EQUAL(queue.size(), 1u);
+    BOOST_CHECK_EQUAL(queue.front()->dataCount, 10);
+    BOOST_CHECK_EQUAL(buffers.getBacked(), 1u);
+    BOOST_CHECK_EQUAL(pool.getStats().inUse, 1u);
+    BOOST_CHECK(buffers.hasSpare());
+
+    // A quiet connection may keep nothing at all
+    pool.setConnectionLimits(0, 6);
+    queue.front()->dataCount = 0;
+    buffers.trim(queue);
+    BOOST_CHECK(queue.empty());
+    BOOST_CHECK_EQUAL(buffers.getBacked(), 0u);
+    BOOST_CHECK_EQUAL(pool.getStats().inUse, 0u);
+}
+
+QPID_AUTO_TEST_SUITE_END()
+
+}} // namespace qpid::tests
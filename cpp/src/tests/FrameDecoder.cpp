@@ -24,7 +24,9 @@
 #include "qpid/framing/FrameDecoder.h"
 #include "qpid/framing/AMQContentBody.h"
 #include "qpid/framing/Buffer.h"
+#include "qpid/RefCountedBuffer.h"
 #include <string>
+#include <string.h>
 
 
 namespace qpid {
@@ -72,6 +74,38 @@ QPID_AUTO_TEST_CASE(testByteFragments) {
 }
 
 
+QPID_AUTO_TEST_CASE(testSharedContent) {
+    string big = makeData(32768);
+    string small = makeData(42);
+    string encoded = encodeFrame(big) + encodeFrame(small);
+    BufferRef memory = RefCountedBuffer::create(encoded.size());
+    ::memcpy(memory.begin(), encoded.data(), encoded.size());
+
+    AMQFrame first, second;
+    {
+        ConstBufferRef shared(memory);
+        Buffer buf(shared);
+        BOOST_CHECK(first.decode(buf));
+        BOOST_CHECK(second.decode(buf));
+        BOOST_CHECK_EQUAL(buf.available(), 0u);
+    }
+    // Only the large content refers to the memory, the small one was copied
+    BOOST_CHECK_EQUAL(memory.refCount(), 2);
+    // Reading the content through a const body copies it out, leaving the body as it was
+    BOOST_CHECK_EQUAL(big, getData(first));
+    BOOST_CHECK_EQUAL(memory.refCount(), 2);
+
+    // Content outlives our reference and re-encodes unchanged
+    ::memset(memory.begin() + encoded.size() - small.size(), 0, small.size());
+    memory = BufferRef();
+    string reencoded;
+    reencoded.resize(first.encodedSize());
+    Buffer out(&reencoded[0], reencoded.size());
+    first.encode(out);
+    BOOST_CHECK(reencoded == encodeFrame(big));
+    BOOST_CHECK_EQUAL(big, getData(first));
+    BOOST_CHECK_EQUAL(small, getData(second));
+}
 
 QPID_AUTO_TEST_SUITE_END()
 
@@ -0,0 +1,108 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#include "unit_test.h"
+#include "qpid/sys/LatencyHistogram.h"
+
+namespace qpid {
+namespace tests {
+
+QPID_AUTO_TEST_SUITE(LatencyHistogramTestSuite)
+
+using namespace qpid::sys;
+
+QPID_AUTO_TEST_CASE(testBuckets) {
+    // Small values have a bucket each
+    for (int64_t i = 0; i < LatencyHistogram::SubBuckets; ++i) {
+        BOOST_CHECK_EQUAL(LatencyHistogram::getBucket(i), uint32_t(i));
+        BOOST_CHECK_EQUAL(LatencyHistogram::getBucketLimit(uint32_t(i)), i);
+    }
+    // Every value is in the first bucket whose limit is not below it
+    int64_t values[] = {16, 17, 31, 32, 33, 1000, 1023, 1024, 123456789, int64_t(1) << 40};
+    for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); ++i) {
+        uint32_t b = LatencyHistogram::getBucket(values[i]);
+        BOOST_CHECK(values[i] <= LatencyHistogram::getBucketLimit(b));
+        BOOST_CHECK(values[i] > LatencyHistogram::getBucketLimit(b - 1));
+    }
+    // Buckets are no more than 1/16th as wide as the values in them
+    uint32_t b = LatencyHistogram::getBucket(1000000);
+    int64_t width = LatencyHistogram::getBucketLimit(b) - LatencyHistogram::getBucketLimit(b - 1);
+    BOOST_CHECK(width * LatencyHistogram::SubBuckets <= 1000000);
+    // Huge values go in the last bucket
+    BOOST_CHECK_EQUAL(LatencyHistogram::getBucket(int64_t(1) << 62), uint32_t(LatencyHistogram::Buckets - 1));
+}
+
+QPID_AUTO_TEST_CASE(testPercentiles) {
+    LatencyHistogram h;
+    BOOST_CHECK_EQUAL(h.getCount(), 0u);
+    BOOST_CHECK_EQUAL(h.getPercentile(50), 0);
+    for (int64_t i = 1; i <= 1000; ++i)
+        h.record(i * 1000);
+    BOOST_CHECK_EQUAL(h.getCount(), 1000u);
+    BOOST_CHECK_EQUAL(h.getMin(), 1000);
+    BOOST_CHECK_EQUAL(h.getMax(), 1000000);
+    BOOST_CHECK_EQUAL(h.getMean(), 500500);
+    // Percentiles are accurate to the width of a bucket
+    BOOST_CHECK(h.getPercentile(50) >= 500000 && h.getPercentile(50) <= 500000 + 500000/16);
+    BOOST_CHECK(h.getPercentile(99) >= 990000 && h.getPercentile(99) <= 1000000);
+    BOOST_CHECK_EQUAL(h.getPercentile(100), 1000000);
+}
+
+QPID_AUTO_TEST_CASE(testAdd) {
+    LatencyHistogram a, b;
+    a.record(10);
+    a.record(20);
+    b.record(5);
+    b.record(3000);
+    a.add(b);
+    BOOST_CHECK_EQUAL(a.getCount(), 4u);
+    BOOST_CHECK_EQUAL(a.getMin(), 5);
+    BOOST_CHECK_EQUAL(a.getMax(), 3000);
+    a.reset();
+    BOOST_CHECK_EQUAL(a.getCount(), 0u);
+    BOOST_CHECK_EQUAL(a.getMax(), 0);
+}
+
+QPID_AUTO_TEST_CASE(testStats) {
+    LatencyHistogram before;
+    LatencyStats::get(LatencyStats::DISPATCH_WRITE, before);
+    LatencyStats::record(LatencyStats::DISPATCH_WRITE, 100*TIME_USEC);
+    LatencyStats::record(LatencyStats::DISPATCH_WRITE, 200*TIME_USEC);
+    LatencyHistogram after;
+    LatencyStats::get(LatencyStats::DISPATCH_WRITE, after);
+    BOOST_CHECK_EQUAL(after.getCount(), before.getCount() + 2);
+    // Nothing is recorded against a start time that was never set
+    LatencyStats::enable(true);
+    LatencyStats::recordSince(LatencyStats::DISPATCH_WRITE, AbsTime());
+    LatencyStats::enable(false);
+    LatencyHistogram unchanged;
+    LatencyStats::get(LatencyStats::DISPATCH_WRITE, unchanged);
+    BOOST_CHECK_EQUAL(unchanged.getCount(), after.getCount());
+    LatencyStats::reset(LatencyStats::DISPATCH_WRITE);
+    LatencyHistogram cleared;
+    LatencyStats::get(LatencyStats::DISPATCH_WRITE, cleared);
+    BOOST_CHECK_EQUAL(cleared.getCount(), 0u);
+}
+
+QPID_AUTO_TEST_SUITE_END()
+
+}} // namespace qpid::tests
@@ -28,7 +28,9 @@
 
 #include "unit_test.h"
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 using namespace qpid::broker;
 using namespace qpid::framing;
@@ -69,6 +71,35 @@ QPID_AUTO_TEST_CASE(testEncodeDecode)
     BOOST_CHECK(msg.isPersistent());
 }
 
+QPID_AUTO_TEST_CASE(testEncodePart)
+{
+    qpid::types::Variant::Map properties;
+    properties["routing-key"] = "MyRoutingKey";
+    properties["abc"] = "xyz";
+    Message msg = MessageUtils::createMessage(properties, "abcdefghijklmn");
+    broker::amqp_0_10::MessageTransfer& transfer = broker::amqp_0_10::MessageTransfer::get(msg);
+    AMQFrame more((AMQContentBody("opqrstuvwxyz")));
+    transfer.getFrames().append(more);
+
+    uint32_t size = transfer.encodedSize();
+    std::vector<char> whole(size);
+    Buffer wholeBuffer(&whole[0], size);
+    transfer.encode(wholeBuffer);
+
+    // Every part, at every offset, matches the same part of the whole
+    uint32_t lengths[] = { 1, 7, 64, size };
+    for (size_t l = 0; l < sizeof(lengths)/sizeof(lengths[0]); ++l) {
+        for (uint32_t offset = 0; offset < size; ++offset) {
+            uint32_t length = std::min(lengths[l], size - offset);
+            std::vector<char> part(length);
+            Buffer partBuffer(&part[0], length);
+            transfer.encodePart(partBuffer, offset);
+            BOOST_REQUIRE_EQUAL(0u, partBuffer.available());
+            BOOST_REQUIRE(std::equal(part.begin(), part.end(), whole.begin() + offset));
+        }
+    }
+}
+
 QPID_AUTO_TEST_SUITE_END()
 
 }} // namespace qpid::tests
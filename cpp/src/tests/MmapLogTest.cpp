@@ -0,0 +1,252 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "unit_test.h"
+#include "test_tools.h"
+#include "TempDir.h"
+#include "qpid/store/mmap-log/Log.h"
+#include "qpid/store/StoreException.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <boost/lexical_cast.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace qpid {
+namespace tests {
+
+QPID_AUTO_TEST_SUITE(MmapLogTestSuite)
+
+using qpid::store::mmap_log::Log;
+using qpid::store::mmap_log::Segment;
+
+namespace {
+
+const uint32_t SegmentSize = 64 * 1024;
+
+std::string body(int i)
+{
+    // Lengths that are and are not a multiple of the 8 byte padding
+    return "record-" + boost::lexical_cast<std::string>(i) + std::string(i % 11, '.');
+}
+
+uint16_t type(int i) { return static_cast<uint16_t>(i % 5 + 1); }
+
+std::string bodyOf(const Log::Record& r) { return std::string(r.body, r.length); }
+
+std::string segmentPath(const TempDir& dir, uint32_t sequence)
+{
+    char name[32];
+    ::snprintf(name, sizeof(name), "%010u.seg", sequence);
+    return dir.getPath() + "/" + name;
+}
+
+bool exists(const std::string& path) { return ::access(path.c_str(), F_OK) == 0; }
+
+void corrupt(const std::string& path, uint32_t offset)
+{
+    int fd = ::open(path.c_str(), O_RDWR);
+    BOOST_REQUIRE(fd >= 0);
+    char c;
+    BOOST_REQUIRE_EQUAL(::pread(fd, &c, 1, offset), 1);
+    c = ~c;
+    BOOST_REQUIRE_EQUAL(::pwrite(fd, &c, 1, offset), 1);
+    ::close(fd);
+}
+
+}
+
+QPID_AUTO_TEST_CASE(testAppendAndReplay) {
+    TempDir dir("mmap_log_test");
+    std::vector<Log::Location> locations;
+    {
+        Log log;
+        Log::RecordList records;
+        log.open(dir.getPath(), SegmentSize, 1, records);
+        BOOST_CHECK(records.empty());
+        for (int i = 0; i < 100; ++i) {
+            std::string b(body(i));
+            locations.push_back(log.append(type(i), b.data(), b.size()));
+        }
+        log.sync();
+        for (int i = 0; i < 100; ++i) {
+            Log::Record r = log.read(locations[i]);
+            BOOST_CHECK_EQUAL(r.location, locations[i]);
+            BOOST_CHECK_EQUAL(r.type, type(i));
+            BOOST_CHECK_EQUAL(bodyOf(r), body(i));
+        }
+    }
+    // Replay on more than one thread gives everything back in order
+    Log log;
+    Log::RecordList records;
+    log.open(dir.getPath(), SegmentSize, 2, records);
+    BOOST_REQUIRE_EQUAL(records.size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK_EQUAL(records[i].location, locations[i]);
+        BOOST_CHECK_EQUAL(records[i].type, type(i));
+        BOOST_CHECK_EQUAL(bodyOf(records[i]), body(i));
+    }
+    // Appends after recovery go to a new segment
+    Log::Location l = log.append(1, "x", 1);
+    BOOST_CHECK(Log::sequenceOf(l) > Log::sequenceOf(locations.back()));
+}
+
+QPID_AUTO_TEST_CASE(testSegmentsRoll) {
+    TempDir dir("mmap_log_test");
+    std::string big(SegmentSize / 4, 'b');
+    std::vector<Log::Location> locations;
+    {
+        Log log;
+        Log::RecordList records;
+        log.open(dir.getPath(), SegmentSize, 1, records);
+        for (int i = 0; i < 10; ++i)
+            locations.push_back(log.append(type(i), big.data(), big.size()));
+        log.sync();
+        BOOST_CHECK(Log::sequenceOf(locations.back()) > Log::sequenceOf(locations.front()));
+        BOOST_CHECK(log.getUsage().segments > 0u);
+        // A record bigger than a segment is refused
+        std::string huge(SegmentSize, 'h');
+        BOOST_CHECK_THROW(log.append(1, huge.data(), huge.size()),
+                          qpid::store::StoreException);
+    }
+    Log log;
+    Log::RecordList records;
+    log.open(dir.getPath(), SegmentSize, 0, records);
+    BOOST_REQUIRE_EQUAL(records.size(), 10u);
+    for (size_t i = 0; i < records.size(); ++i) {
+        BOOST_CHECK_EQUAL(records[i].location, locations[i]);
+        BOOST_CHECK_EQUAL(bodyOf(records[i]), big);
+    }
+}
+
+QPID_AUTO_TEST_CASE(testTornTail) {
+    TempDir dir("mmap_log_test");
+    std::vector<Log::Location> locations;
+    {
+        Log log;
+        Log::RecordList records;
+        log.open(dir.getPath(), SegmentSize, 1, records);
+        for (int i = 0; i < 10; ++i) {
+            std::string b(body(i));
+            locations.push_back(log.append(type(i), b.data(), b.size()));
+        }
+        log.sync();
+    }
+    // Damage the body of the eighth record, as a crash part way through
+    // writing it would
+    Log::Location torn = locations[7];
+    corrupt(segmentPath(dir, Log::sequenceOf(torn)),
+            Log::offsetOf(torn) + Segment::RecordHeaderSize + 2);
+    uint32_t next;
+    {
+        Log log;
+        Log::RecordList records;
+        log.open(dir.getPath(), SegmentSize, 1, records);
+        BOOST_REQUIRE_EQUAL(records.size(), 7u);
+        for (int i = 0; i < 7; ++i)
+            BOOST_CHECK_EQUAL(bodyOf(records[i]), body(i));
+        // The damaged segment is never appended to again
+        Log::Location l = log.append(1, "after", 5);
+        next = Log::sequenceOf(l);
+        BOOST_CHECK(next > Log::sequenceOf(torn));
+        log.sync();
+    }
+    Log log;
+    Log::RecordList records;
+    log.open(dir.getPath(), SegmentSize, 1, records);
+    BOOST_REQUIRE_EQUAL(records.size(), 8u);
+    BOOST_CHECK_EQUAL(bodyOf(records[6]), body(6));
+    BOOST_CHECK_EQUAL(bodyOf(records[7]), "after");
+    BOOST_CHECK_EQUAL(Log::sequenceOf(records[7].location), next);
+}
+
+QPID_AUTO_TEST_CASE(testCompaction) {
+    TempDir dir("mmap_log_test");
+    std::string big(SegmentSize / 8, 'c');
+    std::set<std::string> live;
+    uint32_t oldest;
+    {
+        Log log;
+        Log::RecordList records;
+        log.open(dir.getPath(), SegmentSize, 1, records);
+        std::vector<Log::Location> locations;
+        for (int i = 0; i < 20; ++i) {
+            std::string b(body(i) + big);
+            locations.push_back(log.append(type(i), b.data(), b.size()));
+            live.insert(b);
+        }
+        // Everything but every third record is no longer needed
+        for (int i = 0; i < 20; ++i) {
+            if (i % 3 != 0) {
+                log.kill(locations[i]);
+                live.erase(body(i) + big);
+            }
+        }
+        log.sync();
+
+        uint64_t liveBytes;
+        BOOST_REQUIRE(log.getOldest(oldest, liveBytes));
+        BOOST_CHECK_EQUAL(oldest, Log::sequenceOf(locations.front()));
+        Log::RecordList old;
+        log.getRecords(oldest, old);
+        BOOST_REQUIRE(!old.empty());
+        uint64_t expected = 0;
+        for (size_t i = 0; i < old.size(); ++i) {
+            std::string b(bodyOf(old[i]));
+            if (live.count(b))
+                expected += Segment::recordSize(old[i].length);
+        }
+        BOOST_CHECK_EQUAL(liveBytes, expected);
+
+        // Copy forward what is still live, then drop the segment
+        for (size_t i = 0; i < old.size(); ++i) {
+            std::string b(bodyOf(old[i]));
+            if (live.count(b)) {
+                log.append(old[i].type, b.data(), b.size());
+                log.kill(old[i].location);
+            }
+        }
+        log.sync();
+        log.drop(oldest);
+        BOOST_CHECK(!exists(segmentPath(dir, oldest)));
+        uint32_t after;
+        BOOST_CHECK(!log.getOldest(after, liveBytes) || after > oldest);
+    }
+    Log log;
+    Log::RecordList records;
+    log.open(dir.getPath(), SegmentSize, 1, records);
+    std::multiset<std::string> recovered;
+    for (size_t i = 0; i < records.size(); ++i) {
+        BOOST_CHECK(Log::sequenceOf(records[i].location) != oldest);
+        recovered.insert(bodyOf(records[i]));
+    }
+    // Every live record survives exactly once; dead ones that were in the
+    // dropped segment are gone
+    for (std::set<std::string>::const_iterator i = live.begin(); i != live.end(); ++i)
+        BOOST_CHECK_EQUAL(recovered.count(*i), 1u);
+    BOOST_CHECK(recovered.count(body(1) + big) == 0);
+}
+
+QPID_AUTO_TEST_SUITE_END()
+
+}} // namespace qpid::tests
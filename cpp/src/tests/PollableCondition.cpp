@@ -21,12 +21,16 @@
 
 #include "test_tools.h"
 #include "unit_test.h"
+#include "qpid/sys/AtomicValue.h"
 #include "qpid/sys/Poller.h"
 #include "qpid/sys/PollableCondition.h"
 #include "qpid/sys/Monitor.h"
+#include "qpid/sys/Runnable.h"
 #include "qpid/sys/Time.h"
 #include "qpid/sys/Thread.h"
 #include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <vector>
 
 namespace qpid {
 namespace tests {
@@ -104,6 +108,68 @@ QPID_AUTO_TEST_CASE(testPollableCondition) {
     runner.join();
 }
 
+namespace {
+// Notices if it is ever called by two threads at once
+struct Exclusive {
+    AtomicValue<uint32_t> inside;
+    AtomicValue<uint32_t> calls;
+    bool overlapped;
+
+    Exclusive() : inside(0), calls(0), overlapped(false) {}
+
+    void call(PollableCondition& pc) {
+        if (++inside > 1) overlapped = true;
+        ++calls;
+        qpid::sys::usleep(50);
+        pc.clear();
+        --inside;
+    }
+};
+
+// Keeps changing what the conditions are watched for, rearming them
+struct Toggler : public Runnable {
+    boost::ptr_vector<PollableCondition>& conditions;
+    AbsTime until;
+    Toggler(boost::ptr_vector<PollableCondition>& c, Duration d) : conditions(c), until(now(), d) {}
+    void run() {
+        while (now() < until) {
+            for (size_t i = 0; i < conditions.size(); ++i) {
+                conditions[i].clear();
+                conditions[i].set();
+            }
+        }
+    }
+};
+}
+
+// Several threads taking batches of events from one poller must still
+// never dispatch the same handle at once, however often it is rearmed
+QPID_AUTO_TEST_CASE(testBatchedPollerThreads) {
+    const size_t count = 32;
+    boost::shared_ptr<Poller> poller(new Poller(16));
+    std::vector<Exclusive> callbacks(count);
+    boost::ptr_vector<PollableCondition> conditions;
+    for (size_t i = 0; i < count; ++i) {
+        conditions.push_back(new PollableCondition(boost::bind(&Exclusive::call, &callbacks[i], _1), poller));
+        conditions.back().set();
+    }
+    std::vector<Thread> runners;
+    for (size_t i = 0; i < 4; ++i) runners.push_back(Thread(*poller));
+
+    Toggler toggler(conditions, TIME_SEC/2);
+    Thread t1(toggler);
+    Thread t2(toggler);
+    t1.join();
+    t2.join();
+
+    poller->shutdown();
+    for (size_t i = 0; i < runners.size(); ++i) runners[i].join();
+    for (size_t i = 0; i < count; ++i) {
+        BOOST_CHECK(!callbacks[i].overlapped);
+        BOOST_CHECK(callbacks[i].calls.get() > 0);
+    }
+}
+
 QPID_AUTO_TEST_SUITE_END()
 
 }} //namespace qpid::tests
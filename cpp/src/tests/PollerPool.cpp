@@ -0,0 +1,122 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#include "unit_test.h"
+#include "qpid/sys/PollerPool.h"
+#include "qpid/sys/PollableCondition.h"
+#include "qpid/sys/Monitor.h"
+#include "qpid/sys/Runnable.h"
+#include "qpid/sys/Thread.h"
+#include "qpid/sys/Time.h"
+#include <boost/bind.hpp>
+
+namespace qpid {
+namespace tests {
+
+QPID_AUTO_TEST_SUITE(PollerPoolTestSuite)
+
+using namespace qpid::sys;
+
+QPID_AUTO_TEST_CASE(testRoundRobin) {
+    PollerPool pool(3, 1, PollerPool::ROUND_ROBIN);
+    BOOST_CHECK_EQUAL(pool.size(), 3u);
+    for (size_t i = 0; i < 6; ++i) {
+        BOOST_CHECK_EQUAL(pool.assign(), i % 3);
+    }
+    for (size_t i = 0; i < 3; ++i) {
+        BOOST_CHECK_EQUAL(pool.getConnections(i), 2u);
+    }
+}
+
+QPID_AUTO_TEST_CASE(testLeastConnections) {
+    PollerPool pool(3, 1, PollerPool::LEAST_CONNECTIONS);
+    for (size_t i = 0; i < 6; ++i) pool.assign();
+    for (size_t i = 0; i < 3; ++i) {
+        BOOST_CHECK_EQUAL(pool.getConnections(i), 2u);
+    }
+    // Skew the load: everything on shard 1 goes away, new connections
+    // should all be steered to it until it catches up
+    pool.release(1);
+    pool.release(1);
+    BOOST_CHECK_EQUAL(pool.assign(), 1u);
+    BOOST_CHECK_EQUAL(pool.assign(), 1u);
+    BOOST_CHECK_EQUAL(pool.getConnections(1), 2u);
+}
+
+QPID_AUTO_TEST_CASE(testPolicyNames) {
+    BOOST_CHECK_EQUAL(PollerPool::getPolicy("round-robin"), PollerPool::ROUND_ROBIN);
+    BOOST_CHECK_EQUAL(PollerPool::getPolicy("least-connections"), PollerPool::LEAST_CONNECTIONS);
+    BOOST_CHECK_THROW(PollerPool::getPolicy("random"), qpid::Exception);
+}
+
+namespace {
+struct Signalled {
+    Monitor lock;
+    bool fired;
+
+    Signalled() : fired(false) {}
+
+    void call(PollableCondition& pc) {
+        Monitor::ScopedLock l(lock);
+        pc.clear();
+        fired = true;
+        lock.notify();
+    }
+
+    bool wait() {
+        Monitor::ScopedLock l(lock);
+        AbsTime deadline(now(), TIME_SEC);
+        while (!fired) {
+            if (!lock.wait(deadline)) return false;
+        }
+        return true;
+    }
+};
+
+struct PoolRunner : public Runnable {
+    PollerPool& pool;
+    PoolRunner(PollerPool& p) : pool(p) {}
+    void run() { pool.run(4, false); }
+};
+}
+
+QPID_AUTO_TEST_CASE(testShardsAreServiced) {
+    PollerPool pool(2, 4);
+    Signalled first, second;
+    PollableCondition c0(boost::bind(&Signalled::call, &first, _1), pool.getPoller(0));
+    PollableCondition c1(boost::bind(&Signalled::call, &second, _1), pool.getPoller(1));
+
+    PoolRunner runner(pool);
+    Thread t(runner);
+
+    c1.set();
+    BOOST_CHECK(second.wait());
+    c0.set();
+    BOOST_CHECK(first.wait());
+
+    pool.shutdown();
+    t.join();
+}
+
+QPID_AUTO_TEST_SUITE_END()
+
+}} //namespace qpid::tests
@@ -21,8 +21,10 @@
 #include "MessageUtils.h"
 #include "unit_test.h"
 #include "test_tools.h"
+#include "TempDir.h"
 #include "qpid/Exception.h"
 #include "qpid/broker/Broker.h"
+#include "qpid/broker/Connection.h"
 #include "qpid/broker/DeliverableMessage.h"
 #include "qpid/broker/FanOutExchange.h"
 #include "qpid/broker/Queue.h"
@@ -31,6 +33,7 @@
 #include "qpid/broker/QueueRegistry.h"
 #include "qpid/broker/NullMessageStore.h"
 #include "qpid/broker/ExpiryPolicy.h"
+#include "qpid/broker/PagedQueue.h"
 #include "qpid/framing/DeliveryProperties.h"
 #include "qpid/framing/FieldTable.h"
 #include "qpid/framing/MessageTransferBody.h"
@@ -40,6 +43,11 @@
 #include "qpid/framing/reply_exceptions.h"
 #include "qpid/broker/QueueFlowLimit.h"
 #include "qpid/broker/QueueSettings.h"
+#include "qpid/broker/SessionHandler.h"
+#include "qpid/broker/SessionState.h"
+#include "qpid/sys/ConnectionOutputHandler.h"
+#include "qpid/sys/LatencyHistogram.h"
+#include "qpid/sys/SecuritySettings.h"
 #include "qpid/sys/Timer.h"
 
 #include <iostream>
@@ -78,6 +86,18 @@ public:
     OwnershipToken* getSession() { return 0; }
 };
 
+// Counts the requests to write made on a connection, discarding what is sent
+class CountingOutputHandler : public qpid::sys::ConnectionOutputHandler
+{
+public:
+    int activations;
+    CountingOutputHandler() : activations(0) {}
+    void send(AMQFrame&) {}
+    void close() {}
+    void abort() {}
+    void activateOutput() { ++activations; }
+};
+
 class FailOnDeliver : public Deliverable
 {
     Message msg;
@@ -201,6 +221,92 @@ QPID_AUTO_TEST_CASE(testPurgeExpired) {
     BOOST_CHECK_EQUAL(queue.getMessageCount(), 5u);
 }
 
+QPID_AUTO_TEST_CASE(testPurgeExpiredAcquired) {
+    Queue::shared_ptr queue(new Queue("my-queue"));
+    addMessagesToQueue(4, *queue, 200, 200);
+    TestConsumer::shared_ptr c(new TestConsumer("test"));
+    queue->consume(c);
+    BOOST_CHECK(queue->dispatch(c));
+    ::usleep(300*1000);
+    queue->purgeExpired(0);
+    //acquired message is left alone until it is released
+    BOOST_CHECK_EQUAL(queue->getMessageCount(), 0u);
+    queue->release(c->lastCursor);
+    BOOST_CHECK_EQUAL(queue->getMessageCount(), 1u);
+    queue->purgeExpired(0);
+    BOOST_CHECK_EQUAL(queue->getMessageCount(), 0u);
+}
+
+QPID_AUTO_TEST_CASE(testEnqueueDispatchLatency) {
+    LatencyStats::enable(true);
+    LatencyStats::reset(LatencyStats::ENQUEUE_DISPATCH);
+    Queue::shared_ptr queue(new Queue("my-queue"));
+    Message msg = MessageUtils::createMessage(qpid::types::Variant::Map(), "abc");
+    msg.setStageTime(AbsTime::now());
+    queue->deliver(msg);
+
+    //browsing does not count
+    TestConsumer::shared_ptr browser(new TestConsumer("browser", false));
+    queue->consume(browser);
+    BOOST_CHECK(queue->dispatch(browser));
+    LatencyHistogram stats;
+    LatencyStats::get(LatencyStats::ENQUEUE_DISPATCH, stats);
+    BOOST_CHECK_EQUAL(stats.getCount(), 0u);
+
+    //the first acquiring delivery does, a redelivery after release does not
+    TestConsumer::shared_ptr c(new TestConsumer("test"));
+    queue->consume(c);
+    BOOST_CHECK(queue->dispatch(c));
+    queue->release(c->lastCursor);
+    BOOST_CHECK(queue->dispatch(c));
+    stats.reset();
+    LatencyStats::get(LatencyStats::ENQUEUE_DISPATCH, stats);
+    BOOST_CHECK_EQUAL(stats.getCount(), 1u);
+    LatencyStats::enable(false);
+}
+
+QPID_AUTO_TEST_CASE(testNotifyPending) {
+    Broker::Options opts;
+    opts.port = 0;
+    opts.enableMgmt = false;
+    opts.dataDir = "";
+    opts.auth = false;
+    boost::intrusive_ptr<Broker> broker = Broker::create(opts);
+    CountingOutputHandler out;
+    Connection connection(&out, *broker, "test-connection", qpid::sys::SecuritySettings());
+    SessionHandler& handler = connection.getChannel(1);
+    handler.attachAs("test-session");
+    SemanticState& state = handler.getSession()->getSemanticState();
+    Queue::shared_ptr queue(new Queue("my-queue"));
+    state.consume("test", queue, false, true, false);
+    boost::shared_ptr<SemanticStateConsumerImpl> consumer =
+        boost::dynamic_pointer_cast<SemanticStateConsumerImpl>(state.find("test"));
+    BOOST_REQUIRE(consumer);
+
+    //notifications before the connection gets round to output make one request
+    int before = out.activations;
+    consumer->notify();
+    consumer->notify();
+    consumer->notify();
+    BOOST_CHECK_EQUAL(out.activations, before + 1);
+    BOOST_CHECK_EQUAL(consumer->getSuppressedWakeups(), 2u);
+
+    //once output has been done, the next notification makes a new request
+    consumer->doOutput();
+    consumer->notify();
+    BOOST_CHECK_EQUAL(out.activations, before + 2);
+
+    //as does one made after notification is reenabled
+    consumer->disableNotify();
+    consumer->notify();
+    BOOST_CHECK_EQUAL(out.activations, before + 2);
+    consumer->enableNotify();
+    consumer->notify();
+    BOOST_CHECK_EQUAL(out.activations, before + 3);
+    BOOST_CHECK_EQUAL(consumer->getSuppressedWakeups(), 2u);
+    state.cancel("test");
+}
+
 QPID_AUTO_TEST_CASE(testQueueCleaner) {
     Timer timer;
     QueueRegistry queues;
@@ -496,6 +602,106 @@ QPID_AUTO_TEST_CASE(testGroupsMultiConsumerDefaults) {
     queue->cancel(c2);
 }
 
+QPID_AUTO_TEST_CASE(testGroupsPurgeAndReuse) {
+    //
+    // Verify that group state is consistent when messages are removed out of
+    // order by management, and that groups can be recreated once emptied.
+    //
+    QueueSettings settings;
+    settings.shareGroups = 1;
+    settings.groupKey = "GROUP-ID";
+    QueueFactory factory;
+    Queue::shared_ptr queue(factory.create("my_queue", settings));
+
+    std::string groups[] = { std::string("a"), std::string("b"), std::string("a"),
+                             std::string("b"), std::string("a") };
+    for (int i = 0; i < 5; ++i) {
+        queue->deliver(createGroupMessage(i, groups[i]));
+    }
+
+    // Queue = a-0, b-1, a-2, b-3, a-4
+    // (positions start at 1)
+    BOOST_CHECK(queue->dequeueMessageAt(framing::SequenceNumber(1)));   // a-0, head of free group
+    BOOST_CHECK(queue->dequeueMessageAt(framing::SequenceNumber(4)));   // b-3, tail of group
+    BOOST_CHECK(queue->dequeueMessageAt(framing::SequenceNumber(3)));   // a-2, middle of group
+
+    // Queue = b-1, a-4
+    TestConsumer::shared_ptr c1(new TestConsumer("C1"));
+    TestConsumer::shared_ptr c2(new TestConsumer("C2"));
+    queue->consume(c1);
+    queue->consume(c2);
+
+    std::deque<QueueCursor> dequeMeC1;
+    std::deque<QueueCursor> dequeMeC2;
+    verifyAcquire(queue, c1, dequeMeC1, "b", 1 );
+    verifyAcquire(queue, c2, dequeMeC2, "a", 4 );
+    BOOST_CHECK( !queue->dispatch(c1) );
+
+    queue->dequeue(0, dequeMeC1.front());
+    queue->dequeue(0, dequeMeC2.front());
+    BOOST_CHECK_EQUAL(uint32_t(0), queue->getMessageCount());
+
+    // groups are gone; a new message for "a" is free for any consumer
+    queue->deliver(createGroupMessage(5, "a"));
+    dequeMeC1.clear();
+    verifyAcquire(queue, c1, dequeMeC1, "a", 5 );
+
+    queue->cancel(c1);
+    queue->cancel(c2);
+}
+
+namespace {
+qpid::types::Variant::Map headerFilter(const std::string& type, const std::string& param, const std::string& value,
+                                       const std::string& param2 = std::string(), const std::string& value2 = std::string())
+{
+    qpid::types::Variant::Map params;
+    params["header_key"] = "region";
+    params[param] = value;
+    if (param2.size()) params[param2] = value2;
+    qpid::types::Variant::Map filter;
+    filter["filter_type"] = type;
+    filter["filter_params"] = params;
+    return filter;
+}
+}
+
+QPID_AUTO_TEST_CASE(testIndexedPurgeAndMove) {
+    const char* regions[] = { "eu-north", "eu-west", "us-east", "ap-south" };
+    QueueSettings settings;
+    settings.indexedHeaders.push_back("region");
+    Queue::shared_ptr indexed(new Queue("indexed", settings));
+    Queue::shared_ptr plain(new Queue("plain"));
+    for (int i = 0; i < 20; ++i) {
+        qpid::types::Variant::Map properties;
+        properties["region"] = regions[i % 4];
+        Message m = MessageUtils::createMessage(properties, boost::lexical_cast<string>(i+1));
+        indexed->deliver(m);
+        plain->deliver(m);
+    }
+    //an indexed queue must give the same results as one without indexes
+    Queue::shared_ptr queues[] = { indexed, plain };
+    for (int i = 0; i < 2; ++i) {
+        Queue::shared_ptr q = queues[i];
+        qpid::types::Variant::Map filter = headerFilter("header_match_str", "header_value", "us-east");
+        BOOST_CHECK_EQUAL(q->purge(2, boost::shared_ptr<Exchange>(), &filter), 2u);
+        BOOST_CHECK_EQUAL(q->purge(0, boost::shared_ptr<Exchange>(), &filter), 3u);
+        BOOST_CHECK_EQUAL(q->getMessageCount(), 15u);
+
+        filter = headerFilter("header_prefix_str", "header_prefix", "eu-");
+        Queue::shared_ptr destination(new Queue("destination"));
+        BOOST_CHECK_EQUAL(q->move(destination, 0, &filter), 10u);
+        BOOST_CHECK_EQUAL(destination->getMessageCount(), 10u);
+        BOOST_CHECK_EQUAL(q->getMessageCount(), 5u);
+
+        filter = headerFilter("header_range_str", "header_min", "a", "header_max", "b");
+        TestConsumer::shared_ptr c(new TestConsumer("test", false));
+        BOOST_CHECK(q->dispatch(c));
+        BOOST_CHECK_EQUAL(c->lastMessage.getContent(), "4");
+        BOOST_CHECK_EQUAL(q->purge(0, boost::shared_ptr<Exchange>(), &filter), 5u);
+        BOOST_CHECK_EQUAL(q->getMessageCount(), 0u);
+    }
+}
+
 QPID_AUTO_TEST_CASE(testSetPositionFifo) {
     Queue::shared_ptr q(new Queue("my-queue", true));
     BOOST_CHECK_EQUAL(q->getPosition(), SequenceNumber(0));
@@ -620,6 +826,104 @@ QPID_AUTO_TEST_CASE(testSetPositionPriority) {
     BOOST_CHECK_EQUAL("1", c->lastMessage.getContent());
 }
 
+QPID_AUTO_TEST_CASE(testPagedQueue) {
+    TempDir dir("paged_queue_test");
+    Queue queue("my-queue");
+    //one platform page per page, at most two pages in memory
+    PagedQueue messages(queue, dir.getPath(), 2, 1, boost::intrusive_ptr<ExpiryPolicy>());
+    std::string content(MemoryMappedFile::getPageSize() / 4, 'x');
+    for (int i = 0; i < 40; ++i) {
+        Message m = MessageUtils::createMessage(qpid::types::Variant::Map(), boost::lexical_cast<string>(i+1) + content);
+        m.setSequence(i+1);
+        messages.publish(m);
+    }
+    BOOST_CHECK_EQUAL(messages.size(), 40u);
+    BOOST_CHECK(messages.getPageCount() > 2u);
+    BOOST_CHECK_EQUAL(messages.getLoadedPageCount(), 2u);
+
+    //browse all messages, paging them back in
+    QueueCursor browser(BROWSER);
+    for (int i = 0; i < 40; ++i) {
+        Message* m = messages.next(browser);
+        BOOST_REQUIRE(m);
+        BOOST_CHECK_EQUAL(m->getSequence(), SequenceNumber(i+1));
+        BOOST_CHECK_EQUAL(m->getContent(), boost::lexical_cast<string>(i+1) + content);
+        BOOST_CHECK(messages.getLoadedPageCount() <= 2u);
+    }
+    BOOST_CHECK(!messages.next(browser));
+
+    //acquire the first message, then release it after it has been paged out and in again
+    QueueCursor consumer(CONSUMER);
+    Message* first = messages.next(consumer);
+    BOOST_REQUIRE(first);
+    first->setState(ACQUIRED);
+    first->deliver();
+    QueueCursor acquired(consumer);
+    BOOST_CHECK_EQUAL(messages.size(), 39u);
+    BOOST_CHECK(messages.find(SequenceNumber(40), 0));
+    BOOST_CHECK(messages.find(SequenceNumber(20), 0));
+    BOOST_CHECK_EQUAL(messages.size(), 39u);
+    Message* released = messages.release(acquired);
+    BOOST_REQUIRE(released);
+    BOOST_CHECK_EQUAL(released->getSequence(), SequenceNumber(1));
+    BOOST_CHECK_EQUAL(released->getDeliveryCount(), 1);
+    BOOST_CHECK_EQUAL(messages.size(), 40u);
+
+    //consume everything
+    for (int i = 0; i < 40; ++i) {
+        Message* m = messages.next(consumer);
+        BOOST_REQUIRE(m);
+        BOOST_CHECK_EQUAL(m->getSequence(), SequenceNumber(i+1));
+        BOOST_CHECK_EQUAL(m->getContent(), boost::lexical_cast<string>(i+1) + content);
+        m->setState(ACQUIRED);
+        BOOST_CHECK(messages.deleted(consumer));
+    }
+    BOOST_CHECK(!messages.next(consumer));
+    BOOST_CHECK_EQUAL(messages.size(), 0u);
+    BOOST_CHECK_EQUAL(messages.getPageCount(), 1u);
+}
+
+QPID_AUTO_TEST_CASE(testPagedQueuePrefetch) {
+    TempDir dir("paged_queue_test");
+    Queue queue("my-queue");
+    //one platform page per page, at most two pages in memory, two read ahead
+    PagedQueue messages(queue, dir.getPath(), 2, 1, boost::intrusive_ptr<ExpiryPolicy>(), 2);
+    std::string content(MemoryMappedFile::getPageSize() / 4, 'x');
+    for (int i = 0; i < 40; ++i) {
+        Message m = MessageUtils::createMessage(qpid::types::Variant::Map(), boost::lexical_cast<string>(i+1) + content);
+        m.setSequence(i+1);
+        messages.publish(m);
+    }
+    BOOST_CHECK_EQUAL(messages.getPrefetchCount(), 0u);
+
+    //reaching the first page reads the two after it ahead, once only
+    QueueCursor consumer(CONSUMER);
+    Message* m = messages.next(consumer);
+    BOOST_REQUIRE(m);
+    BOOST_CHECK_EQUAL(messages.getPrefetchCount(), 2u);
+    m->setState(ACQUIRED);
+    BOOST_CHECK(messages.deleted(consumer));
+    m = messages.next(consumer);
+    BOOST_REQUIRE(m);
+    BOOST_CHECK_EQUAL(messages.getPrefetchCount(), 2u);
+    m->setState(ACQUIRED);
+    BOOST_CHECK(messages.deleted(consumer));
+
+    //read ahead does not change what is consumed
+    for (int i = 2; i < 40; ++i) {
+        m = messages.next(consumer);
+        BOOST_REQUIRE(m);
+        BOOST_CHECK_EQUAL(m->getSequence(), SequenceNumber(i+1));
+        BOOST_CHECK_EQUAL(m->getContent(), boost::lexical_cast<string>(i+1) + content);
+        BOOST_CHECK(messages.getLoadedPageCount() <= 2u);
+        m->setState(ACQUIRED);
+        BOOST_CHECK(messages.deleted(consumer));
+    }
+    BOOST_CHECK(!messages.next(consumer));
+    BOOST_CHECK(messages.getPrefetchCount() > 2u);
+    BOOST_CHECK_EQUAL(messages.size(), 0u);
+}
+
 QPID_AUTO_TEST_SUITE_END()
 
 }} // namespace qpid::tests
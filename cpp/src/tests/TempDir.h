@@ -0,0 +1,89 @@
+#ifndef TESTS_TEMPDIR_H
+#define TESTS_TEMPDIR_H
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace qpid {
+namespace tests {
+
+/**
+ * A directory of its own for a test that needs files, under $TMPDIR or
+ * /tmp; it is removed, with everything in it, when the TempDir goes.
+ */
+class TempDir {
+  public:
+    TempDir(const std::string& prefix = "qpid_test") {
+        const char* tmp = ::getenv("TMPDIR");
+        std::string pattern = std::string(tmp && *tmp ? tmp : "/tmp") + "/" + prefix + ".XXXXXX";
+        std::vector<char> name(pattern.begin(), pattern.end());
+        name.push_back(0);
+        if (::mkdtemp(&name[0]) == 0)
+            throw std::runtime_error("Cannot create temporary directory " + pattern);
+        path = &name[0];
+    }
+
+    ~TempDir() { remove(path); }
+
+    const std::string& getPath() const { return path; }
+
+  private:
+    std::string path;
+
+    static void remove(const std::string& p) {
+        struct ::stat st;
+        if (::lstat(p.c_str(), &st) < 0)
+            return;
+        if (S_ISDIR(st.st_mode)) {
+            if (DIR* d = ::opendir(p.c_str())) {
+                std::vector<std::string> entries;
+                while (struct dirent* e = ::readdir(d)) {
+                    std::string name(e->d_name);
+                    if (name != "." && name != "..")
+                        entries.push_back(p + "/" + name);
+                }
+                ::closedir(d);
+                for (std::vector<std::string>::const_iterator i = entries.begin();
+                     i != entries.end(); ++i)
+                    remove(*i);
+            }
+            ::rmdir(p.c_str());
+        }
+        else {
+            ::unlink(p.c_str());
+        }
+    }
+
+    TempDir(const TempDir&);
+    TempDir& operator=(const TempDir&);
+};
+
+}} // namespace qpid::tests
+
+#endif  /*!TESTS_TEMPDIR_H*/
@@ -25,6 +25,7 @@
 #include <math.h>
 #include <iostream>
 #include <memory>
+#include <vector>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -119,12 +120,151 @@ QPID_AUTO_TEST_CASE(testGeneral)
     timer.add(task3);
     timer.add(task4);
 
-    dynamic_pointer_cast<TestTask>(task3)->wait(Duration(6 * TIME_SEC));
+    dynamic_pointer_cast<TestTask>(task3)->wait(Duration(10 * TIME_SEC));
 
-    dynamic_pointer_cast<TestTask>(task1)->check(3);
-    dynamic_pointer_cast<TestTask>(task2)->check(1);
-    dynamic_pointer_cast<TestTask>(task3)->check(4);
-    dynamic_pointer_cast<TestTask>(task4)->check(2);
+    // The order is what matters; the tolerance allows for a loaded machine
+    dynamic_pointer_cast<TestTask>(task1)->check(3, 1 * TIME_SEC);
+    dynamic_pointer_cast<TestTask>(task2)->check(1, 1 * TIME_SEC);
+    dynamic_pointer_cast<TestTask>(task3)->check(4, 1 * TIME_SEC);
+    dynamic_pointer_cast<TestTask>(task4)->check(2, 1 * TIME_SEC);
+}
+
+class CountingTask : public TimerTask
+{
+    Monitor& monitor;
+    uint& fired;
+    const AbsTime due;
+    const Duration hold;
+
+  public:
+    bool early;
+    Duration lateness;
+    uint order;                 // 1 for the first task to fire, and so on
+
+    CountingTask(Duration timeout, Monitor& m, uint& f, Duration h = 0)
+        : TimerTask(timeout, "Counting"), monitor(m), fired(f),
+          due(now(), timeout), hold(h), early(false), lateness(0), order(0) {}
+
+    void fire()
+    {
+        AbsTime at(now());
+        early = at < due;
+        lateness = Duration(due, at);
+        if (hold) {
+            Monitor busy;
+            Monitor::ScopedLock l(busy);
+            AbsTime until(now(), hold);
+            while (busy.wait(until)) ;
+        }
+        Monitor::ScopedLock l(monitor);
+        order = ++fired;
+        monitor.notifyAll();
+    }
+};
+
+bool waitFor(Monitor& monitor, uint& fired, uint expected, Duration limit)
+{
+    AbsTime deadline(now(), limit);
+    Monitor::ScopedLock l(monitor);
+    while (fired < expected) {
+        if (!monitor.wait(deadline)) return fired >= expected;
+    }
+    return true;
+}
+
+QPID_AUTO_TEST_CASE(testCancel)
+{
+    Monitor monitor;
+    uint fired = 0;
+    Timer timer;
+    intrusive_ptr<CountingTask> task(new CountingTask(Duration(200 * TIME_MSEC), monitor, fired));
+    intrusive_ptr<CountingTask> other(new CountingTask(Duration(400 * TIME_MSEC), monitor, fired));
+    timer.add(task);
+    timer.add(other);
+    BOOST_CHECK_EQUAL(task->refCount(), 2);
+    task->cancel();
+    // Dropped by the timer straight away
+    BOOST_CHECK_EQUAL(task->refCount(), 1);
+    BOOST_CHECK(waitFor(monitor, fired, 1, 2 * TIME_SEC));
+    BOOST_CHECK(!waitFor(monitor, fired, 2, 300 * TIME_MSEC));
+    BOOST_CHECK_EQUAL(fired, 1u);
+}
+
+QPID_AUTO_TEST_CASE(testRestart)
+{
+    Monitor monitor;
+    uint fired = 0;
+    Timer timer;
+    intrusive_ptr<CountingTask> task(new CountingTask(Duration(200 * TIME_MSEC), monitor, fired));
+    timer.add(task);
+    AbsTime start(now());
+    task->restart();
+    BOOST_CHECK(!waitFor(monitor, fired, 1, 100 * TIME_MSEC));
+    task->restart();
+    BOOST_CHECK(waitFor(monitor, fired, 1, 2 * TIME_SEC));
+    BOOST_CHECK(Duration(start, now()) >= 300 * TIME_MSEC);
+}
+
+// Enough tasks, far enough apart, to use every level of the wheel below
+// a minute and to need more than one rotation of the lowest
+QPID_AUTO_TEST_CASE(testManyTasks)
+{
+    Monitor monitor;
+    uint fired = 0;
+    Timer timer;
+    std::vector<intrusive_ptr<CountingTask> > tasks;
+    for (uint i = 0; i < 1000; ++i) {
+        tasks.push_back(new CountingTask(Duration((i % 700) * TIME_MSEC), monitor, fired));
+        timer.add(tasks.back());
+    }
+    intrusive_ptr<CountingTask> late(new CountingTask(Duration(70 * TIME_SEC), monitor, fired));
+    timer.add(late);
+    BOOST_CHECK(waitFor(monitor, fired, 1000, 20 * TIME_SEC));
+    // Lateness depends on the load on the machine; the bound only catches
+    // tasks left behind for a rotation of a higher level
+    for (uint i = 0; i < tasks.size(); ++i) {
+        BOOST_CHECK(!tasks[i]->early);
+        BOOST_CHECK(tasks[i]->lateness < 5 * TIME_SEC);
+    }
+    late->cancel();
+    BOOST_CHECK_EQUAL(late->refCount(), 1);
+}
+
+// A task waiting in a higher level of the wheel must not be held up by
+// a later one in the lowest level: here the first task is still to be
+// cascaded down when the last is added, due well after it
+QPID_AUTO_TEST_CASE(testNotLate)
+{
+    Monitor monitor;
+    uint fired = 0;
+    Timer timer;
+    intrusive_ptr<CountingTask> cascaded(new CountingTask(Duration(300 * TIME_MSEC), monitor, fired));
+    intrusive_ptr<CountingTask> first(new CountingTask(Duration(200 * TIME_MSEC), monitor, fired));
+    timer.add(cascaded);
+    timer.add(first);
+    BOOST_CHECK(waitFor(monitor, fired, 1, 10 * TIME_SEC));
+    intrusive_ptr<CountingTask> last(new CountingTask(Duration(250 * TIME_MSEC), monitor, fired));
+    timer.add(last);
+    BOOST_CHECK(waitFor(monitor, fired, 3, 10 * TIME_SEC));
+    BOOST_CHECK(!cascaded->early);
+    BOOST_CHECK(!last->early);
+    // Held up, the cascaded task would fire after the last
+    BOOST_CHECK_EQUAL(first->order, 1u);
+    BOOST_CHECK_EQUAL(cascaded->order, 2u);
+    BOOST_CHECK_EQUAL(last->order, 3u);
+}
+
+QPID_AUTO_TEST_CASE(testFirePool)
+{
+    Monitor monitor;
+    uint fired = 0;
+    Timer timer(4);
+    // Each takes half a second to fire, so unless they are fired by
+    // different threads they can't all be done in time
+    for (uint i = 0; i < 4; ++i) {
+        timer.add(new CountingTask(Duration(100 * TIME_MSEC), monitor, fired, Duration(500 * TIME_MSEC)));
+    }
+    BOOST_CHECK(waitFor(monitor, fired, 4, 1500 * TIME_MSEC));
 }
 
 QPID_AUTO_TEST_SUITE_END()
@@ -0,0 +1,235 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/**
+ * Times decoding a stream of small messages, and the field tables in
+ * their headers, comparing the decoders against straightforward ones that
+ * read each field through a framing::Buffer, as the originals did.
+ */
+
+#include "qpid/Options.h"
+#include "qpid/framing/AMQFrame.h"
+#include "qpid/framing/AMQContentBody.h"
+#include "qpid/framing/AMQHeaderBody.h"
+#include "qpid/framing/BodyFactory.h"
+#include "qpid/framing/Buffer.h"
+#include "qpid/framing/DeliveryProperties.h"
+#include "qpid/framing/FieldTable.h"
+#include "qpid/framing/FieldValue.h"
+#include "qpid/framing/MessageProperties.h"
+#include "qpid/framing/MessageTransferBody.h"
+#include "qpid/framing/MethodBodyFactory.h"
+#include "qpid/framing/reply_exceptions.h"
+#include "qpid/sys/Time.h"
+
+#include <exception>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string.h>
+#include <vector>
+
+namespace qpid {
+namespace tests {
+
+using namespace qpid::framing;
+using qpid::sys::AbsTime;
+using qpid::sys::Duration;
+
+struct Args : public qpid::Options
+{
+    uint messages;
+    uint iterations;
+    uint contentSize;
+    uint headers;
+    bool help;
+
+    Args() : qpid::Options("Decoder benchmark"),
+             messages(10000), iterations(20), contentSize(64), headers(6), help(false)
+    {
+        addOptions()
+            ("messages", qpid::optValue(messages, "N"), "number of messages in the stream decoded")
+            ("iterations", qpid::optValue(iterations, "N"), "number of times to decode the stream")
+            ("content-size", qpid::optValue(contentSize, "N"), "size of each message's content")
+            ("headers", qpid::optValue(headers, "N"), "number of application headers in each message")
+            ("help", qpid::optValue(help), "print this usage statement");
+    }
+};
+
+// Decode a frame the way AMQFrame::decode used to, a field at a time
+bool referenceDecode(Buffer& buffer)
+{
+    if (buffer.available() < AMQFrame::frameOverhead())
+        return false;
+    uint32_t pos = buffer.getPosition();
+    uint8_t flags = buffer.getOctet();
+    if ((flags & 0xc0) != 0)
+        throw FramingErrorException(QPID_MSG("Framing version unsupported"));
+    uint8_t type = buffer.getOctet();
+    uint16_t frameSize = buffer.getShort();
+    if (frameSize < AMQFrame::frameOverhead())
+        throw FramingErrorException(QPID_MSG("Frame size too small " << frameSize));
+    uint8_t reserved1 = buffer.getOctet();
+    uint8_t field1 = buffer.getOctet();
+    (void) buffer.getShort(); // channel
+    (void) buffer.getLong();  // reserved2
+    if ((flags & 0x30) != 0 || reserved1 != 0 || (field1 & 0xf0) != 0)
+        throw FramingErrorException(QPID_MSG("Reserved bits not zero"));
+    uint16_t bodySize = frameSize - AMQFrame::frameOverhead();
+    if (buffer.available() < bodySize) {
+        buffer.setPosition(pos);
+        return false;
+    }
+    boost::intrusive_ptr<AMQBody> body;
+    switch (type) {
+      case 0:
+      case METHOD_BODY: {
+          ClassId c = buffer.getOctet();
+          MethodId m = buffer.getOctet();
+          body = MethodBodyFactory::create(c, m);
+          break;
+      }
+      case HEADER_BODY: body = BodyFactory::create<AMQHeaderBody>(); break;
+      case CONTENT_BODY: body = BodyFactory::create<AMQContentBody>(); break;
+      default: throw IllegalArgumentException(QPID_MSG("Invalid frame type " << type));
+    }
+    body->decode(buffer, bodySize);
+    return true;
+}
+
+// Decode a field table the way FieldTable used to, a field at a time
+size_t referenceDecode(Buffer& buffer, std::map<std::string, FieldTable::ValuePtr>& values)
+{
+    uint32_t len = buffer.getLong();
+    if (len) {
+        uint32_t available = buffer.available();
+        uint32_t count = buffer.getLong();
+        uint32_t leftover = available - len;
+        while (buffer.available() > leftover && count--) {
+            std::string name;
+            FieldTable::ValuePtr value(new FieldValue);
+            buffer.getShortString(name);
+            value->decode(buffer);
+            values[name] = value;
+        }
+    }
+    return values.size();
+}
+
+std::vector<char> encodeMessages(const Args& args, FieldTable& headers)
+{
+    for (uint i = 0; i < args.headers; ++i) {
+        std::ostringstream name;
+        name << "header-" << i;
+        if (i % 2) headers.setInt(name.str(), i * 1000);
+        else headers.setString(name.str(), "some header value " + name.str());
+    }
+    std::vector<AMQFrame> frames;
+    for (uint i = 0; i < args.messages; ++i) {
+        AMQFrame method((MessageTransferBody(ProtocolVersion(), "amq.direct", 0, 0)));
+        method.setEof(false);
+        AMQFrame header((AMQHeaderBody()));
+        header.setBof(false);
+        header.setEof(false);
+        header.castBody<AMQHeaderBody>()->get<DeliveryProperties>(true)->setRoutingKey("benchmark-queue");
+        MessageProperties* props = header.castBody<AMQHeaderBody>()->get<MessageProperties>(true);
+        props->setContentType("text/plain");
+        props->setApplicationHeaders(headers);
+        AMQFrame content((AMQContentBody(std::string(args.contentSize, 'x'))));
+        content.setBof(false);
+        frames.push_back(method);
+        frames.push_back(header);
+        frames.push_back(content);
+    }
+    size_t size = 0;
+    for (size_t i = 0; i < frames.size(); ++i) size += frames[i].encodedSize();
+    std::vector<char> data(size);
+    Buffer buffer(&data[0], size);
+    for (size_t i = 0; i < frames.size(); ++i) frames[i].encode(buffer);
+    return data;
+}
+
+void report(const std::string& what, Duration reference, Duration current, uint64_t count)
+{
+    std::cout << what << ": " << double(reference) / count << " ns before, "
+              << double(current) / count << " ns now ("
+              << double(reference) / double(current) << "x)" << std::endl;
+}
+
+}} // namespace qpid::tests
+
+using namespace qpid::tests;
+
+int main(int argc, char** argv)
+{
+    try {
+        Args args;
+        args.parse(argc, argv);
+        if (args.help) {
+            std::cout << args << std::endl;
+            return 0;
+        }
+        FieldTable headers;
+        std::vector<char> data = encodeMessages(args, headers);
+        uint64_t frames = uint64_t(args.messages) * 3 * args.iterations;
+
+        AbsTime start = AbsTime::now();
+        for (uint i = 0; i < args.iterations; ++i) {
+            Buffer buffer(&data[0], data.size());
+            while (referenceDecode(buffer)) ;
+        }
+        Duration reference(start, AbsTime::now());
+        start = AbsTime::now();
+        for (uint i = 0; i < args.iterations; ++i) {
+            Buffer buffer(&data[0], data.size());
+            AMQFrame frame;
+            while (frame.decode(buffer)) ;
+        }
+        report("frame", reference, Duration(start, AbsTime::now()), frames);
+
+        std::vector<char> table(headers.encodedSize());
+        Buffer out(&table[0], table.size());
+        headers.encode(out);
+        uint64_t tables = uint64_t(args.messages) * args.iterations;
+        start = AbsTime::now();
+        for (uint64_t i = 0; i < tables; ++i) {
+            // FieldTable::decode copies the table before decoding it
+            boost::shared_array<uint8_t> copy(new uint8_t[table.size()]);
+            ::memcpy(copy.get(), &table[0], table.size());
+            Buffer buffer(reinterpret_cast<char*>(copy.get()), table.size());
+            std::map<std::string, FieldTable::ValuePtr> values;
+            referenceDecode(buffer, values);
+        }
+        reference = Duration(start, AbsTime::now());
+        start = AbsTime::now();
+        for (uint64_t i = 0; i < tables; ++i) {
+            Buffer buffer(&table[0], table.size());
+            FieldTable decoded;
+            decoded.decode(buffer);
+            decoded.isSet("header-0"); // Decodes it all
+        }
+        report("field table", reference, Duration(start, AbsTime::now()), tables);
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+    }
+    return 1;
+}
@@ -0,0 +1,358 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "unit_test.h"
+
+#include "qpid/legacystore/MessageStoreImpl.h"
+#include "qpid/legacystore/Cursor.h"
+#include "qpid/legacystore/IdDbt.h"
+#include "qpid/legacystore/StoreException.h"
+#include <iostream>
+#include "qpid/broker/DirectExchange.h"
+#include "qpid/broker/Queue.h"
+#include "qpid/broker/RecoveryManagerImpl.h"
+#include "qpid/framing/Buffer.h"
+#include "qpid/framing/FieldTable.h"
+#include "qpid/log/Logger.h"
+#include "qpid/sys/Runnable.h"
+#include "qpid/sys/Thread.h"
+#include "qpid/sys/Timer.h"
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+using namespace mrg::msgstore;
+using namespace qpid;
+using namespace qpid::broker;
+using namespace qpid::framing;
+using namespace std;
+
+namespace {
+qpid::broker::Broker::Options opts;
+qpid::broker::Broker br(opts);
+}
+
+QPID_AUTO_TEST_SUITE(ConfigWriterTest)
+
+#define SET_LOG_LEVEL(level) \
+    qpid::log::Options opts(""); \
+    opts.selectors.clear(); \
+    opts.selectors.push_back(level); \
+    qpid::log::Logger::instance().configure(opts);
+
+const string test_filename("ConfigWriterTest");
+const char* tdp = getenv("TMP_DATA_DIR");
+const string test_dir(tdp && strlen(tdp) > 0 ? tdp : "/tmp/ConfigWriterTest");
+
+// Test store which commits its configuration changes in batches of a given
+// size, and can be inspected and made to fail part way through a change.
+// init() hides functions in MessageStoreImpl. To avoid the compiler
+// warnings/errors this is renamed with a 'TMS' prefix.
+class TestMessageStore: public MessageStoreImpl
+{
+  public:
+    using MessageStoreImpl::defConfigBatchSize;
+
+    TestMessageStore(qpid::broker::Broker* br, const char* envpath = 0) : MessageStoreImpl(br, envpath) {}
+    bool TMSinit(const std::string& dir, u_int16_t configBatch, const bool truncateFlag = false) {
+        return init(dir, 4, 1, truncateFlag, defWCachePageSize, defTplNumJrnlFiles, defTplJrnlFileSizePgs,
+                    defTplWCachePageSize, defAutoJrnlExpand, defAutoJrnlExpandMaxFiles, defNumSharedJrnls,
+                    defNumRecoveryThreads, defFlushLatencyTargetUs, configBatch);
+    }
+
+    // Number of stored bindings from the exchange to the queue; an id of 0 matches any
+    u_int32_t TMSbindingCount(u_int64_t exchangeId, u_int64_t queueId) {
+        u_int32_t count = 0;
+        Cursor bindings;
+        bindings.open(bindingDb, 0);
+        IdDbt key;
+        Dbt value;
+        while (bindings.next(key, value)) {
+            qpid::framing::Buffer buffer(reinterpret_cast<char*>(value.get_data()), value.get_size());
+            if ((!exchangeId || key.id == exchangeId) && (!queueId || buffer.getLongLong() == queueId))
+                ++count;
+        }
+        return count;
+    }
+    bool TMSqueueStored(u_int64_t id) { return stored(queueDb, id); }
+    bool TMSexchangeStored(u_int64_t id) { return stored(exchangeDb, id); }
+
+    // Destroy in a change which fails once the records have been deleted
+    void TMSdestroyThenFail(const qpid::broker::PersistableQueue& queue) {
+        configWriterPtr->write(boost::bind(&TestMessageStore::deleteQueueThenFail, this, boost::cref(queue), _1));
+    }
+    void TMSdestroyThenFail(const qpid::broker::PersistableExchange& exchange) {
+        configWriterPtr->write(boost::bind(&TestMessageStore::deleteExchangeThenFail, this, boost::cref(exchange), _1));
+    }
+
+  private:
+    bool stored(db_ptr db, u_int64_t id) {
+        Cursor records;
+        records.open(db, 0);
+        IdDbt key;
+        Dbt value;
+        while (records.next(key, value)) {
+            if (key.id == id) return true;
+        }
+        return false;
+    }
+    void deleteQueueThenFail(const qpid::broker::PersistableQueue& queue, DbTxn* txn) {
+        deleteQueue(queue, txn);
+        THROW_STORE_EXCEPTION("Failed after deleting queue");
+    }
+    void deleteExchangeThenFail(const qpid::broker::PersistableExchange& exchange, DbTxn* txn) {
+        deleteExchange(exchange, txn);
+        THROW_STORE_EXCEPTION("Failed after deleting exchange");
+    }
+};
+
+// === Helper fns ===
+
+const string exchangeName("ConfigWriterExchange");
+const size_t numQueues = 8;
+const size_t numKeys = 20; // per queue; the odd ones are unbound again
+const FieldTable noArgs;
+
+string queueName(size_t q)
+{
+    return "ConfigWriterQueue" + boost::lexical_cast<string>(q);
+}
+
+string bindingKey(size_t k)
+{
+    return "key" + boost::lexical_cast<string>(k);
+}
+
+void recover(MessageStoreImpl& store, QueueRegistry& queues, ExchangeRegistry& exchanges, LinkRegistry& links)
+{
+    sys::Timer t;
+    DtxManager mgr(t);
+    mgr.setStore (&store);
+    RecoveryManagerImpl recovery(queues, exchanges, links, mgr, br.getProtocolRegistry());
+    store.recover(recovery);
+}
+
+// Binds one queue with every key, then unbinds the odd ones. If asked to,
+// repeats each bind, which fails as the binding is already stored.
+class Binder : public qpid::sys::Runnable
+{
+    TestMessageStore& store;
+    const Exchange& exchange;
+    const Queue& queue;
+    const bool duplicate;
+
+  public:
+    u_int32_t failures;
+
+    Binder(TestMessageStore& s, const Exchange& e, const Queue& q, bool d) :
+        store(s), exchange(e), queue(q), duplicate(d), failures(0) {}
+
+    void run() {
+        for (size_t k = 0; k < numKeys; ++k) {
+            store.bind(exchange, queue, bindingKey(k), noArgs);
+            if (duplicate) {
+                try {
+                    store.bind(exchange, queue, bindingKey(k), noArgs);
+                } catch (const StoreException&) {
+                    ++failures;
+                }
+            }
+        }
+        for (size_t k = 1; k < numKeys; k += 2)
+            store.unbind(exchange, queue, bindingKey(k), noArgs);
+    }
+};
+
+// Binds and unbinds numQueues queues at once, with the first also
+// attempting duplicate binds if asked to, then checks that each change
+// made survives a restart.
+void bindUnbindConcurrently(u_int16_t configBatch, bool duplicates)
+{
+    {
+        TestMessageStore store(&br);
+        store.TMSinit(test_dir, configBatch, true); // truncate store
+        Exchange::shared_ptr exchange(new DirectExchange(exchangeName, true, noArgs));
+        store.create(*exchange, noArgs);
+        std::vector<Queue::shared_ptr> queues;
+        boost::ptr_vector<Binder> binders;
+        for (size_t q = 0; q < numQueues; ++q) {
+            queues.push_back(Queue::shared_ptr(new Queue(queueName(q), 0, &store, 0)));
+            store.create(*queues.back(), noArgs);
+            binders.push_back(new Binder(store, *exchange, *queues.back(), duplicates && q == 0));
+        }
+        std::vector<qpid::sys::Thread> threads;
+        for (size_t q = 0; q < numQueues; ++q)
+            threads.push_back(qpid::sys::Thread(binders[q]));
+        for (size_t q = 0; q < numQueues; ++q)
+            threads[q].join();
+
+        // Only the duplicates failed
+        BOOST_CHECK_EQUAL(duplicates ? numKeys : 0, binders[0].failures);
+        for (size_t q = 1; q < numQueues; ++q)
+            BOOST_CHECK_EQUAL(0u, binders[q].failures);
+        BOOST_CHECK_EQUAL(numQueues * numKeys / 2, store.TMSbindingCount(exchange->getPersistenceId(), 0));
+    }//db will be closed
+    {
+        TestMessageStore store(&br);
+        store.TMSinit(test_dir, configBatch);
+        ExchangeRegistry exchanges;
+        QueueRegistry queues;
+        LinkRegistry links;
+        recover(store, queues, exchanges, links);
+
+        Exchange::shared_ptr exchange = exchanges.get(exchangeName);
+        for (size_t q = 0; q < numQueues; ++q) {
+            Queue::shared_ptr queue = queues.find(queueName(q));
+            BOOST_REQUIRE(queue);
+            for (size_t k = 0; k < numKeys; ++k) {
+                const string key(bindingKey(k));
+                BOOST_CHECK_EQUAL(k % 2 == 0, exchange->isBound(queue, &key, 0));
+            }
+        }
+    }
+}
+
+// === Test suite ===
+
+QPID_AUTO_TEST_CASE(ConcurrentBindUnbind)
+{
+    cout << test_filename << ".ConcurrentBindUnbind: " << flush;
+    bindUnbindConcurrently(TestMessageStore::defConfigBatchSize, false);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(ConcurrentBindUnbindUnbatched)
+{
+    cout << test_filename << ".ConcurrentBindUnbindUnbatched: " << flush;
+    bindUnbindConcurrently(1, false);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(FailedChangeInBatch)
+{
+    cout << test_filename << ".FailedChangeInBatch: " << flush;
+    bindUnbindConcurrently(TestMessageStore::defConfigBatchSize, true);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(QueueDestroyRemovesBindings)
+{
+    cout << test_filename << ".QueueDestroyRemovesBindings: " << flush;
+    {
+        TestMessageStore store(&br);
+        store.TMSinit(test_dir, TestMessageStore::defConfigBatchSize, true); // truncate store
+        Exchange::shared_ptr exchange(new DirectExchange(exchangeName, true, noArgs));
+        Queue::shared_ptr queue1(new Queue(queueName(1), 0, &store, 0));
+        Queue::shared_ptr queue2(new Queue(queueName(2), 0, &store, 0));
+        store.create(*exchange, noArgs);
+        store.create(*queue1, noArgs);
+        store.create(*queue2, noArgs);
+        for (size_t k = 0; k < numKeys; ++k) {
+            store.bind(*exchange, *queue1, bindingKey(k), noArgs);
+            store.bind(*exchange, *queue2, bindingKey(k), noArgs);
+        }
+        const u_int64_t id1 = queue1->getPersistenceId();
+        const u_int64_t id2 = queue2->getPersistenceId();
+
+        // A failure after the deletes undoes the queue's and its bindings' together
+        BOOST_CHECK_THROW(store.TMSdestroyThenFail(*queue1), StoreException);
+        BOOST_CHECK(store.TMSqueueStored(id1));
+        BOOST_CHECK_EQUAL(numKeys, store.TMSbindingCount(0, id1));
+
+        store.destroy(*queue1);
+        BOOST_CHECK(!store.TMSqueueStored(id1));
+        BOOST_CHECK_EQUAL(0u, store.TMSbindingCount(0, id1));
+        BOOST_CHECK(store.TMSqueueStored(id2));
+        BOOST_CHECK_EQUAL(numKeys, store.TMSbindingCount(0, id2));
+    }//db will be closed
+    {
+        TestMessageStore store(&br);
+        store.TMSinit(test_dir, TestMessageStore::defConfigBatchSize);
+        ExchangeRegistry exchanges;
+        QueueRegistry queues;
+        LinkRegistry links;
+        recover(store, queues, exchanges, links);
+
+        BOOST_CHECK(!queues.find(queueName(1)));
+        Queue::shared_ptr queue2 = queues.find(queueName(2));
+        BOOST_REQUIRE(queue2);
+        Exchange::shared_ptr exchange = exchanges.get(exchangeName);
+        for (size_t k = 0; k < numKeys; ++k) {
+            const string key(bindingKey(k));
+            BOOST_CHECK(exchange->isBound(queue2, &key, 0));
+        }
+    }
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(ExchangeDestroyRemovesBindings)
+{
+    cout << test_filename << ".ExchangeDestroyRemovesBindings: " << flush;
+    const string exchangeName1(exchangeName + "1");
+    const string exchangeName2(exchangeName + "2");
+    {
+        TestMessageStore store(&br);
+        store.TMSinit(test_dir, TestMessageStore::defConfigBatchSize, true); // truncate store
+        Exchange::shared_ptr exchange1(new DirectExchange(exchangeName1, true, noArgs));
+        Exchange::shared_ptr exchange2(new DirectExchange(exchangeName2, true, noArgs));
+        Queue::shared_ptr queue(new Queue(queueName(0), 0, &store, 0));
+        store.create(*exchange1, noArgs);
+        store.create(*exchange2, noArgs);
+        store.create(*queue, noArgs);
+        for (size_t k = 0; k < numKeys; ++k) {
+            store.bind(*exchange1, *queue, bindingKey(k), noArgs);
+            store.bind(*exchange2, *queue, bindingKey(k), noArgs);
+        }
+        const u_int64_t id1 = exchange1->getPersistenceId();
+        const u_int64_t id2 = exchange2->getPersistenceId();
+
+        // A failure after the deletes undoes the exchange's and its bindings' together
+        BOOST_CHECK_THROW(store.TMSdestroyThenFail(*exchange1), StoreException);
+        BOOST_CHECK(store.TMSexchangeStored(id1));
+        BOOST_CHECK_EQUAL(numKeys, store.TMSbindingCount(id1, 0));
+
+        store.destroy(*exchange1);
+        BOOST_CHECK(!store.TMSexchangeStored(id1));
+        BOOST_CHECK_EQUAL(0u, store.TMSbindingCount(id1, 0));
+        BOOST_CHECK(store.TMSexchangeStored(id2));
+        BOOST_CHECK_EQUAL(numKeys, store.TMSbindingCount(id2, 0));
+    }//db will be closed
+    {
+        TestMessageStore store(&br);
+        store.TMSinit(test_dir, TestMessageStore::defConfigBatchSize);
+        ExchangeRegistry exchanges;
+        QueueRegistry queues;
+        LinkRegistry links;
+        recover(store, queues, exchanges, links);
+
+        BOOST_CHECK(!exchanges.find(exchangeName1));
+        Exchange::shared_ptr exchange2 = exchanges.get(exchangeName2);
+        Queue::shared_ptr queue = queues.find(queueName(0));
+        BOOST_REQUIRE(queue);
+        for (size_t k = 0; k < numKeys; ++k) {
+            const string key(bindingKey(k));
+            BOOST_CHECK(exchange2->isBound(queue, &key, 0));
+        }
+    }
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_SUITE_END()
@@ -0,0 +1,220 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "unit_test.h"
+
+#include "qpid/legacystore/MessageStoreImpl.h"
+#include "qpid/legacystore/jrnl/jdir.h"
+#include <iostream>
+#include "tests/legacystore/MessageUtils.h"
+#include <qpid/broker/Queue.h>
+#include <qpid/broker/RecoveryManagerImpl.h>
+#include <qpid/framing/AMQContentBody.h>
+#include "qpid/log/Logger.h"
+#include "qpid/sys/Timer.h"
+
+qpid::broker::Broker::Options opts;
+qpid::broker::Broker br(opts);
+
+#define SET_LOG_LEVEL(level) \
+    qpid::log::Options opts(""); \
+    opts.selectors.clear(); \
+    opts.selectors.push_back(level); \
+    qpid::log::Logger::instance().configure(opts);
+
+using namespace qpid;
+using namespace qpid::broker;
+using namespace qpid::framing;
+using namespace mrg::msgstore;
+using namespace std;
+
+QPID_AUTO_TEST_SUITE(ContentStoreTest)
+
+const string test_filename("ContentStoreTest");
+const char* tdp = getenv("TMP_DATA_DIR");
+const string test_dir(tdp && strlen(tdp) > 0 ? tdp : "/tmp/ContentStoreTest");
+
+// === Helper fns ===
+
+const char* queueNames[] = { "SharedQueue1", "SharedQueue2", "SharedQueue3" };
+const size_t numQueues = sizeof(queueNames)/sizeof(queueNames[0]);
+const string data("abcdefghijklmnopqrstuvwxyz");
+
+struct DummyHandler : OutputHandler
+{
+    std::vector<AMQFrame> frames;
+
+    virtual void send(AMQFrame& frame){
+        frames.push_back(frame);
+    }
+};
+
+void recover(MessageStoreImpl& store, QueueRegistry& queues)
+{
+    sys::Timer t;
+    DtxManager mgr(t);
+    mgr.setStore (&store);
+    ExchangeRegistry exchanges;
+    LinkRegistry links;
+    RecoveryManagerImpl recovery(queues, exchanges, links, mgr, br.getProtocolRegistry());
+    store.recover(recovery);
+}
+
+string contentOf(Message& msg)
+{
+    DummyHandler handler;
+    MessageUtils::deliver(msg, handler, 100);
+    BOOST_REQUIRE_EQUAL((size_t) 2, handler.frames.size());
+    AMQContentBody* contentBody(dynamic_cast<AMQContentBody*>(handler.frames[1].getBody()));
+    BOOST_REQUIRE(contentBody);
+    return contentBody->getData();
+}
+
+// Create the queues and deliver one durable message to each of them
+u_int64_t deliverToAll(MessageStoreImpl& store)
+{
+    Message msg = MessageUtils::createMessage("MyExchange", "MyRoutingKey", Uuid(true), true, data.size());
+    MessageUtils::addContent(msg, data);
+    for (size_t i = 0; i < numQueues; ++i) {
+        Queue::shared_ptr queue(new Queue(queueNames[i], 0, &store, 0));
+        queue->create();
+        queue->deliver(msg);
+    }
+    return msg.getPersistentContext()->getPersistenceId();
+}
+
+// Recover and check which queues still hold the message
+void checkRecovered(const bool expected[], u_int64_t id)
+{
+    MessageStoreImpl store(&br);
+    store.init(test_dir, 4, 1);
+    QueueRegistry registry;
+    registry.setStore (&store);
+    recover(store, registry);
+    for (size_t i = 0; i < numQueues; ++i) {
+        Queue::shared_ptr queue = registry.find(queueNames[i]);
+        if (!queue) {
+            BOOST_CHECK(!expected[i]);
+            continue;
+        }
+        BOOST_CHECK_EQUAL((u_int32_t) (expected[i] ? 1 : 0), queue->getMessageCount());
+        if (expected[i]) {
+            Message msg = MessageUtils::get(*queue);
+            BOOST_CHECK_EQUAL(id, msg.getPersistentContext()->getPersistenceId());
+            BOOST_CHECK_EQUAL(data, contentOf(msg));
+        }
+    }
+}
+
+// Take the message off the named queues
+void dequeueFrom(const bool which[])
+{
+    MessageStoreImpl store(&br);
+    store.init(test_dir, 4, 1);
+    QueueRegistry registry;
+    registry.setStore (&store);
+    recover(store, registry);
+    for (size_t i = 0; i < numQueues; ++i) {
+        if (!which[i]) continue;
+        Queue::shared_ptr queue = registry.find(queueNames[i]);
+        BOOST_REQUIRE(queue);
+        QueueCursor cursor;
+        MessageUtils::get(*queue, &cursor);
+        queue->dequeue(0, cursor);
+    }
+}
+
+// === Test suite ===
+
+QPID_AUTO_TEST_CASE(SharedContentRecover)
+{
+    SET_LOG_LEVEL("error+"); // This only needs to be set once.
+
+    cout << test_filename << ".SharedContentRecover: " << flush;
+    u_int64_t id;
+    {
+        MessageStoreImpl store(&br);
+        store.init(test_dir, 4, 1, true); // truncate store
+        id = deliverToAll(store);
+    }//db will be closed
+    // The content went to the content journal once; the queues refer to it
+    BOOST_CHECK(mrg::journal::jdir::exists(test_dir + "/rhm/content/content.jinf"));
+    const bool all[] = { true, true, true };
+    checkRecovered(all, id);
+    // Recovering again finds the same references
+    checkRecovered(all, id);
+
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(SharedContentDequeue)
+{
+    cout << test_filename << ".SharedContentDequeue: " << flush;
+    u_int64_t id;
+    {
+        MessageStoreImpl store(&br);
+        store.init(test_dir, 4, 1, true); // truncate store
+        id = deliverToAll(store);
+    }//db will be closed
+    // Content stays while any queue refers to it, including the first,
+    // whose own record holds the message in full
+    const bool first[] = { true, false, false };
+    dequeueFrom(first);
+    const bool rest[] = { false, true, true };
+    checkRecovered(rest, id);
+    const bool second[] = { false, true, false };
+    dequeueFrom(second);
+    const bool last[] = { false, false, true };
+    checkRecovered(last, id);
+    dequeueFrom(last);
+    const bool none[] = { false, false, false };
+    checkRecovered(none, id);
+
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(SharedContentQueueDestroy)
+{
+    cout << test_filename << ".SharedContentQueueDestroy: " << flush;
+    u_int64_t id;
+    {
+        MessageStoreImpl store(&br);
+        store.init(test_dir, 4, 1, true); // truncate store
+        id = deliverToAll(store);
+    }//db will be closed
+    {
+        // Destroying a queue lets go of every reference it holds
+        MessageStoreImpl store(&br);
+        store.init(test_dir, 4, 1);
+        QueueRegistry registry;
+        registry.setStore (&store);
+        recover(store, registry);
+        Queue::shared_ptr queue = registry.find(queueNames[1]);
+        BOOST_REQUIRE(queue);
+        store.destroy(*queue);
+    }
+    const bool remaining[] = { true, false, true };
+    checkRecovered(remaining, id);
+
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_SUITE_END()
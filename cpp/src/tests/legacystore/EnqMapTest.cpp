@@ -0,0 +1,224 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "unit_test.h"
+
+#include "qpid/legacystore/jrnl/enq_map.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace mrg::journal;
+using namespace std;
+
+QPID_AUTO_TEST_SUITE(EnqMapTest)
+
+const string test_filename("EnqMapTest");
+
+// === Helper fns ===
+
+const u_int16_t numFiles = 4;
+// One more than a segment holds (enq_map::EMAP_SEG_MAX)
+const u_int64_t overSegment = 513;
+// Too far past a segment's base to be held in it
+const u_int64_t farRid = 0x100000000ULL + 1000;
+
+u_int16_t pfidOf(u_int64_t rid)
+{
+    return u_int16_t(rid % numFiles);
+}
+
+void checkRids(enq_map& m, vector<u_int64_t> expected)
+{
+    sort(expected.begin(), expected.end());
+    vector<u_int64_t> rids;
+    m.rid_list(rids);
+    BOOST_CHECK_EQUAL((u_int32_t) expected.size(), m.size());
+    BOOST_REQUIRE_EQUAL(expected.size(), rids.size());
+    for (size_t i = 0; i < rids.size(); ++i) {
+        BOOST_CHECK_EQUAL(expected[i], rids[i]);
+        BOOST_CHECK_EQUAL((int16_t) pfidOf(rids[i]), m.get_pfid(rids[i]));
+    }
+}
+
+// === Test suite ===
+
+QPID_AUTO_TEST_CASE(InsertOutOfOrder)
+{
+    cout << test_filename << ".InsertOutOfOrder: " << flush;
+    enq_map m;
+    m.set_num_jfiles(numFiles);
+    vector<u_int64_t> rids;
+    for (u_int64_t i = 0; i < 100; ++i)
+        rids.push_back(1000 + (i * 37) % 100); // every rid from 1000 to 1099, shuffled
+    for (size_t i = 0; i < rids.size(); ++i)
+        BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.insert_pfid(rids[i], pfidOf(rids[i])));
+    checkRids(m, rids);
+    BOOST_CHECK_EQUAL(enq_map::EMAP_RID_NOT_FOUND, m.get_pfid(999));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_RID_NOT_FOUND, m.get_pfid(1100));
+    for (u_int16_t f = 0; f < numFiles; ++f)
+        BOOST_CHECK_EQUAL(25u, m.get_enq_cnt(f));
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(InsertBelowBase)
+{
+    cout << test_filename << ".InsertBelowBase: " << flush;
+    enq_map m;
+    m.set_num_jfiles(numFiles);
+    vector<u_int64_t> rids;
+    for (u_int64_t rid = 1000; rid < 1010; ++rid) {
+        rids.push_back(rid);
+        m.insert_pfid(rid, pfidOf(rid));
+    }
+    // Moves the segment's base down to 500
+    rids.push_back(500);
+    BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.insert_pfid(500, pfidOf(500)));
+    checkRids(m, rids);
+    // Between the new base and the old one
+    rids.push_back(750);
+    BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.insert_pfid(750, pfidOf(750)));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_DUP_RID, m.insert_pfid(1000, pfidOf(1000)));
+    checkRids(m, rids);
+    // Too far below to share the segment: starts one of its own
+    enq_map far;
+    far.set_num_jfiles(numFiles);
+    far.insert_pfid(farRid, pfidOf(farRid));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_OK, far.insert_pfid(1, pfidOf(1)));
+    vector<u_int64_t> farRids;
+    farRids.push_back(1);
+    farRids.push_back(farRid);
+    checkRids(far, farRids);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(SegmentSplit)
+{
+    cout << test_filename << ".SegmentSplit: " << flush;
+    enq_map m;
+    m.set_num_jfiles(numFiles);
+    vector<u_int64_t> rids;
+    // Even rids fill a segment, odd ones then land inside it
+    for (u_int64_t i = 0; i < overSegment - 1; ++i) {
+        rids.push_back(2 * i);
+        BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.insert_pfid(2 * i, pfidOf(2 * i)));
+    }
+    for (u_int64_t rid = 1; rid < 2 * overSegment; rid += 50) {
+        rids.push_back(rid);
+        BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.insert_pfid(rid, pfidOf(rid)));
+    }
+    checkRids(m, rids);
+    // Duplicates are found on either side of the split
+    BOOST_CHECK_EQUAL(enq_map::EMAP_DUP_RID, m.insert_pfid(0, pfidOf(0)));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_DUP_RID, m.insert_pfid(2 * (overSegment - 2), 0));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_DUP_RID, m.insert_pfid(51, 0));
+    checkRids(m, rids);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(DuplicateRid)
+{
+    cout << test_filename << ".DuplicateRid: " << flush;
+    enq_map m;
+    m.set_num_jfiles(numFiles);
+    BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.insert_pfid(10, 1));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_DUP_RID, m.insert_pfid(10, 2));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_DUP_RID, m.insert_pfid(10, 1, true));
+    // The original is untouched
+    BOOST_CHECK_EQUAL(1u, m.size());
+    BOOST_CHECK_EQUAL(1, m.get_pfid(10));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_FALSE, m.is_locked(10));
+    BOOST_CHECK_EQUAL(1u, m.get_enq_cnt(1));
+    BOOST_CHECK_EQUAL(0u, m.get_enq_cnt(2));
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(LockUnlock)
+{
+    cout << test_filename << ".LockUnlock: " << flush;
+    enq_map m;
+    m.set_num_jfiles(numFiles);
+    for (u_int64_t rid = 0; rid < 10; ++rid)
+        m.insert_pfid(rid, pfidOf(rid));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.lock(5));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_TRUE, m.is_locked(5));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_FALSE, m.is_locked(4));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_LOCKED, m.get_pfid(5));
+    BOOST_CHECK(!m.is_enqueued(5));
+    BOOST_CHECK(m.is_enqueued(5, true));
+    // A locked record is only removed by a commit or abort
+    BOOST_CHECK_EQUAL(enq_map::EMAP_LOCKED, m.get_remove_pfid(5));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.unlock(5));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_FALSE, m.is_locked(5));
+    BOOST_CHECK_EQUAL((int16_t) pfidOf(5), m.get_pfid(5));
+    m.lock(5);
+    BOOST_CHECK_EQUAL((int16_t) pfidOf(5), m.get_remove_pfid(5, true));
+    BOOST_CHECK(!m.is_enqueued(5, true));
+    // Inserted locked
+    BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.insert_pfid(20, pfidOf(20), true));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_TRUE, m.is_locked(20));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_RID_NOT_FOUND, m.lock(11));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_RID_NOT_FOUND, m.unlock(11));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_RID_NOT_FOUND, m.is_locked(11));
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(EraseLastInSegment)
+{
+    cout << test_filename << ".EraseLastInSegment: " << flush;
+    enq_map m;
+    m.set_num_jfiles(numFiles);
+    vector<u_int64_t> rids;
+    // A full segment, one holding a single rid, and one beyond reach of both
+    for (u_int64_t rid = 0; rid < overSegment; ++rid) {
+        rids.push_back(rid);
+        m.insert_pfid(rid, pfidOf(rid));
+    }
+    rids.push_back(farRid);
+    m.insert_pfid(farRid, pfidOf(farRid));
+    checkRids(m, rids);
+
+    const u_int64_t last = overSegment - 1;
+    BOOST_CHECK_EQUAL((int16_t) pfidOf(last), m.get_remove_pfid(last));
+    rids.erase(find(rids.begin(), rids.end(), last));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_RID_NOT_FOUND, m.get_pfid(last));
+    BOOST_CHECK_EQUAL(enq_map::EMAP_RID_NOT_FOUND, m.get_remove_pfid(last));
+    BOOST_CHECK_EQUAL((int16_t) pfidOf(last - 1), m.get_pfid(last - 1));
+    BOOST_CHECK_EQUAL((int16_t) pfidOf(farRid), m.get_pfid(farRid));
+    checkRids(m, rids);
+
+    // The rid can be used again, as can those around it
+    rids.push_back(last);
+    BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.insert_pfid(last, pfidOf(last)));
+    rids.push_back(last + 1);
+    BOOST_CHECK_EQUAL(enq_map::EMAP_OK, m.insert_pfid(last + 1, pfidOf(last + 1)));
+    checkRids(m, rids);
+
+    // Emptying the first segment leaves the others
+    for (u_int64_t rid = 0; rid < last; ++rid)
+        BOOST_CHECK_EQUAL((int16_t) pfidOf(rid), m.get_remove_pfid(rid));
+    rids.erase(rids.begin(), rids.begin() + last);
+    BOOST_CHECK_EQUAL(enq_map::EMAP_RID_NOT_FOUND, m.get_pfid(0));
+    checkRids(m, rids);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_SUITE_END()
@@ -0,0 +1,171 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "unit_test.h"
+
+#include "qpid/legacystore/JournalImpl.h"
+#include "qpid/legacystore/DataTokenImpl.h"
+#include "qpid/legacystore/jrnl/jcfg.h"
+#include "qpid/legacystore/jrnl/jdir.h"
+#include "qpid/sys/Time.h"
+#include "qpid/sys/Timer.h"
+#include <boost/intrusive_ptr.hpp>
+#include <iostream>
+#include <vector>
+
+using namespace mrg::msgstore;
+using namespace mrg::journal;
+using namespace qpid::sys;
+using namespace std;
+
+QPID_AUTO_TEST_SUITE(FlushLatencyTest)
+
+const string test_filename("FlushLatencyTest");
+const char* tdp = getenv("TMP_DATA_DIR");
+const string test_dir(tdp && strlen(tdp) > 0 ? tdp : "/tmp/FlushLatencyTest");
+
+// === Helper fns ===
+
+const Duration getEventsTimeout(1 * TIME_MSEC);
+// Long enough that the inactivity flush never fires during a test
+const Duration inactivityTimeout(60 * TIME_SEC);
+const Duration waitLimit(10 * TIME_SEC);
+const char data[] = "flush latency test record";
+
+void initJournal(JournalImpl& jrnl)
+{
+    jdir::create_dir(jrnl.jrnl_dir());
+    jrnl.initialize(JRNL_MIN_NUM_FILES, false, 0, JRNL_MIN_FILE_SIZE, JRNL_WMGR_DEF_PAGES, JRNL_WMGR_DEF_PAGE_SIZE);
+}
+
+boost::intrusive_ptr<DataTokenImpl> enqueue(JournalImpl& jrnl)
+{
+    boost::intrusive_ptr<DataTokenImpl> dtokp(new DataTokenImpl);
+    dtokp->addRef(); // released by the write callback, as MessageStoreImpl does
+    jrnl.enqueue_data_record(data, sizeof(data), sizeof(data), dtokp.get());
+    return dtokp;
+}
+
+bool waitFlushed(JournalImpl& jrnl)
+{
+    AbsTime limit(now(), waitLimit);
+    while (jrnl.unflushed_dblks() && now() < limit) qpid::sys::usleep(1000);
+    return jrnl.unflushed_dblks() == 0;
+}
+
+bool waitEnqueued(const boost::intrusive_ptr<DataTokenImpl>& dtokp)
+{
+    AbsTime limit(now(), waitLimit);
+    while (!dtokp->is_enqueued() && now() < limit) qpid::sys::usleep(1000);
+    return dtokp->is_enqueued();
+}
+
+// Reports a commit of one record written to the cache at the given time
+void completeWrite(JournalImpl& jrnl, const AbsTime& written)
+{
+    DataTokenImpl* dtokp = new DataTokenImpl;
+    dtokp->addRef();
+    dtokp->setWriteTime(written);
+    std::vector<data_tok*> dtokl(1, dtokp);
+    jrnl.wr_aio_cb(dtokl);
+}
+
+// === Test suite ===
+
+QPID_AUTO_TEST_CASE(FlushOnDemand)
+{
+    cout << test_filename << ".FlushOnDemand: " << flush;
+    Timer timer;
+    {
+        JournalImpl jrnl(timer, "FlushOnDemand", test_dir + "/FlushOnDemand", "test", getEventsTimeout, inactivityTimeout, 0);
+        initJournal(jrnl);
+        boost::intrusive_ptr<DataTokenImpl> dtokp = enqueue(jrnl);
+        BOOST_CHECK(jrnl.unflushed_dblks() > 0);
+        // Without a target the record is written out as soon as it is asked for
+        jrnl.requestFlush();
+        BOOST_CHECK_EQUAL(0u, jrnl.unflushed_dblks());
+        BOOST_CHECK_EQUAL(1u, jrnl.getFlushBatchSize());
+        BOOST_CHECK(waitEnqueued(dtokp));
+    }
+    timer.stop();
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(BatchedUntilDeadline)
+{
+    cout << test_filename << ".BatchedUntilDeadline: " << flush;
+    const Duration target(1 * TIME_SEC);
+    Timer timer;
+    {
+        JournalImpl jrnl(timer, "BatchedUntilDeadline", test_dir + "/BatchedUntilDeadline", "test", getEventsTimeout, inactivityTimeout, 0);
+        jrnl.setFlushLatencyTarget(target);
+        initJournal(jrnl);
+        // Records arriving far faster than the target are gathered into batches
+        std::vector<boost::intrusive_ptr<DataTokenImpl> > dtoks;
+        for (int i = 0; i < 40; ++i) {
+            dtoks.push_back(enqueue(jrnl));
+            jrnl.requestFlush();
+        }
+        BOOST_CHECK(jrnl.getFlushBatchSize() > 1);
+        BOOST_CHECK(jrnl.unflushed_dblks() > 0);
+        BOOST_CHECK(!dtoks.back()->is_enqueued());
+        // Nothing more is written or requested: the batch's deadline writes it out
+        BOOST_CHECK(waitFlushed(jrnl));
+        for (std::size_t i = 0; i < dtoks.size(); ++i)
+            BOOST_CHECK(waitEnqueued(dtoks[i]));
+    }
+    timer.stop();
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(BudgetAdapts)
+{
+    cout << test_filename << ".BudgetAdapts: " << flush;
+    const Duration target(100 * TIME_MSEC);
+    Timer timer;
+    {
+        JournalImpl jrnl(timer, "BudgetAdapts", test_dir + "/BudgetAdapts", "test", getEventsTimeout, inactivityTimeout, 0);
+        jrnl.setFlushLatencyTarget(target);
+        BOOST_CHECK_EQUAL(int64_t(target / 2), int64_t(jrnl.getFlushBudget()));
+
+        // Commits slower than the target halve the budget, down to a floor
+        completeWrite(jrnl, AbsTime(now(), -2 * target));
+        BOOST_CHECK_EQUAL(int64_t(target / 4), int64_t(jrnl.getFlushBudget()));
+        for (int i = 0; i < 10; ++i)
+            completeWrite(jrnl, AbsTime(now(), -2 * target));
+        BOOST_CHECK_EQUAL(int64_t(target / 64), int64_t(jrnl.getFlushBudget()));
+
+        // Commits within the target but over half of it leave the budget alone
+        completeWrite(jrnl, AbsTime(now(), -3 * target / 4));
+        BOOST_CHECK_EQUAL(int64_t(target / 64), int64_t(jrnl.getFlushBudget()));
+
+        // Commits well within the target grow it back, up to half the target
+        completeWrite(jrnl, now());
+        BOOST_CHECK_EQUAL(int64_t(target / 64 + target / 16), int64_t(jrnl.getFlushBudget()));
+        for (int i = 0; i < 10; ++i)
+            completeWrite(jrnl, now());
+        BOOST_CHECK_EQUAL(int64_t(target / 2), int64_t(jrnl.getFlushBudget()));
+    }
+    timer.stop();
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_SUITE_END()
@@ -0,0 +1,198 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "unit_test.h"
+
+#include "qpid/legacystore/MessageStoreImpl.h"
+#include <iostream>
+#include "MessageUtils.h"
+#include "qpid/broker/Queue.h"
+#include "qpid/broker/RecoveryManagerImpl.h"
+#include "qpid/log/Logger.h"
+#include "qpid/sys/Timer.h"
+#include <boost/lexical_cast.hpp>
+
+using namespace mrg::msgstore;
+using namespace qpid;
+using namespace qpid::broker;
+using namespace qpid::framing;
+using namespace std;
+
+namespace {
+qpid::broker::Broker::Options opts;
+qpid::broker::Broker br(opts);
+}
+
+QPID_AUTO_TEST_SUITE(RecoveryThreadsTest)
+
+#define SET_LOG_LEVEL(level) \
+    qpid::log::Options opts(""); \
+    opts.selectors.clear(); \
+    opts.selectors.push_back(level); \
+    qpid::log::Logger::instance().configure(opts);
+
+const string test_filename("RecoveryThreadsTest");
+const char* tdp = getenv("TMP_DATA_DIR");
+const string test_dir(tdp && strlen(tdp) > 0 ? tdp : "/tmp/RecoveryThreadsTest");
+
+// Test store which recovers its queues on a given number of threads.
+// init() hides functions in MessageStoreImpl. To avoid the compiler
+// warnings/errors this is renamed with a 'TMS' prefix.
+class TestMessageStore: public MessageStoreImpl
+{
+  public:
+    TestMessageStore(qpid::broker::Broker* br, const char* envpath = 0) : MessageStoreImpl(br, envpath) {}
+    bool TMSinit(const std::string& dir, u_int16_t recoveryThreads, const bool truncateFlag = false) {
+        return init(dir, 4, 1, truncateFlag, defWCachePageSize, defTplNumJrnlFiles, defTplJrnlFileSizePgs,
+                    defTplWCachePageSize, defAutoJrnlExpand, defAutoJrnlExpandMaxFiles, defNumSharedJrnls,
+                    recoveryThreads);
+    }
+};
+
+// === Helper fns ===
+
+const size_t numQueues = 16;
+const size_t numMessages = 10; // per queue
+const size_t numDequeued = 3;  // per queue, before the restart
+std::auto_ptr<TestMessageStore> store;
+std::auto_ptr<QueueRegistry> queues;
+
+string queueName(size_t q)
+{
+    return "RecoveryQueue" + boost::lexical_cast<string>(q);
+}
+
+string messageName(size_t q, size_t m)
+{
+    return queueName(q) + "-Message" + boost::lexical_cast<string>(m);
+}
+
+Queue::shared_ptr queue(size_t q)
+{
+    Queue::shared_ptr p = queues->find(queueName(q));
+    BOOST_REQUIRE(p);
+    return p;
+}
+
+// Create the queues, deliver the messages to them interleaved, then take the first few off each
+void setup()
+{
+    store = std::auto_ptr<TestMessageStore>(new TestMessageStore(&br));
+    store->TMSinit(test_dir, 1, true); // truncate store
+    queues = std::auto_ptr<QueueRegistry>(new QueueRegistry);
+    queues->setStore(store.get());
+    for (size_t q = 0; q < numQueues; ++q)
+        queues->declare(queueName(q), QueueSettings(true, false)); // durable, so created in the store
+    for (size_t m = 0; m < numMessages; ++m) {
+        for (size_t q = 0; q < numQueues; ++q) {
+            Message msg = MessageUtils::createMessage("exchange", "routing_key", Uuid(), true, 0, messageName(q, m));
+            queue(q)->deliver(msg);
+        }
+    }
+    for (size_t q = 0; q < numQueues; ++q) {
+        for (size_t m = 0; m < numDequeued; ++m) {
+            QueueCursor cursor;
+            MessageUtils::get(*queue(q), &cursor);
+            queue(q)->dequeue(0, cursor);
+        }
+    }
+}
+
+void restart(u_int16_t recoveryThreads)
+{
+    queues.reset();
+    store.reset();
+
+    store = std::auto_ptr<TestMessageStore>(new TestMessageStore(&br));
+    store->TMSinit(test_dir, recoveryThreads);
+    queues = std::auto_ptr<QueueRegistry>(new QueueRegistry);
+    queues->setStore(store.get());
+    ExchangeRegistry exchanges;
+    LinkRegistry links;
+    sys::Timer t;
+    DtxManager mgr(t);
+    mgr.setStore (store.get());
+    RecoveryManagerImpl recovery(*queues, exchanges, links, mgr, br.getProtocolRegistry());
+    store->recover(recovery);
+}
+
+// Check every queue holds the messages left on it, in order, and that ids given out after
+// recovery are beyond those recovered. This acquires the messages, so restart() afterwards.
+void checkRecovered()
+{
+    u_int64_t maxQueueId(0);
+    u_int64_t maxMessageId(0);
+    for (size_t q = 0; q < numQueues; ++q) {
+        Queue::shared_ptr p = queue(q);
+        maxQueueId = max(maxQueueId, p->getPersistenceId());
+        BOOST_CHECK_EQUAL((u_int32_t) (numMessages - numDequeued), p->getMessageCount());
+        for (size_t m = numDequeued; m < numMessages; ++m) {
+            Message msg = MessageUtils::get(*p);
+            BOOST_CHECK_EQUAL(messageName(q, m), MessageUtils::getCorrelationId(msg));
+            maxMessageId = max(maxMessageId, msg.getPersistentContext()->getPersistenceId());
+        }
+    }
+
+    Queue::shared_ptr added = queues->declare("AddedQueue", QueueSettings(true, false)).first;
+    BOOST_CHECK(added->getPersistenceId() > maxQueueId);
+    Message msg = MessageUtils::createMessage("exchange", "routing_key", Uuid(), true, 0, "Added");
+    added->deliver(msg);
+    BOOST_CHECK(msg.getPersistentContext()->getPersistenceId() > maxMessageId);
+    store->destroy(*added);
+    queues->destroy("AddedQueue");
+}
+
+void recoverOn(u_int16_t recoveryThreads)
+{
+    setup();
+    restart(recoveryThreads);
+    checkRecovered();
+    // Recovering what was itself recovered on several threads gives the same again
+    restart(recoveryThreads);
+    checkRecovered();
+}
+
+// === Test suite ===
+
+QPID_AUTO_TEST_CASE(RecoverSerially)
+{
+    SET_LOG_LEVEL("error+"); // This only needs to be set once.
+
+    cout << test_filename << ".RecoverSerially: " << flush;
+    recoverOn(1);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(RecoverInParallel)
+{
+    cout << test_filename << ".RecoverInParallel: " << flush;
+    recoverOn(4);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(RecoverOnePerCpu)
+{
+    cout << test_filename << ".RecoverOnePerCpu: " << flush;
+    recoverOn(0);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_SUITE_END()
@@ -0,0 +1,286 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "unit_test.h"
+
+#include "qpid/legacystore/MessageStoreImpl.h"
+#include "qpid/legacystore/jrnl/jdir.h"
+#include <iostream>
+#include "MessageUtils.h"
+#include "qpid/broker/Queue.h"
+#include "qpid/broker/RecoveryManagerImpl.h"
+#include "qpid/broker/TxBuffer.h"
+#include "qpid/log/Logger.h"
+#include "qpid/sys/Timer.h"
+#include <boost/lexical_cast.hpp>
+
+using namespace mrg::msgstore;
+using namespace qpid;
+using namespace qpid::broker;
+using namespace qpid::framing;
+using namespace std;
+
+namespace {
+qpid::broker::Broker::Options opts;
+qpid::broker::Broker br(opts);
+}
+
+QPID_AUTO_TEST_SUITE(SharedJournalsTest)
+
+#define SET_LOG_LEVEL(level) \
+    qpid::log::Options opts(""); \
+    opts.selectors.clear(); \
+    opts.selectors.push_back(level); \
+    qpid::log::Logger::instance().configure(opts);
+
+const string test_filename("SharedJournalsTest");
+const char* tdp = getenv("TMP_DATA_DIR");
+const string test_dir(tdp && strlen(tdp) > 0 ? tdp : "/tmp/SharedJournalsTest");
+
+// Test txn context which can forget the dequeues it is to apply to the shared journals on commit
+class TestTxnCtxt : public TxnCtxt
+{
+  public:
+    TestTxnCtxt(IdSequence* _loggedtx) : TxnCtxt(_loggedtx) {}
+    void dropReleases() { releases.clear(); }
+};
+
+// Test store which can be initialized with shared journals, and can commit a transaction as far as
+// a broker that crashed just after the commit would have.
+// init(), begin() and commit() all hide functions in MessageStoreImpl. To avoid the compiler
+// warnings/errors these are renamed with a 'TMS' prefix.
+class TestMessageStore: public MessageStoreImpl
+{
+  public:
+    TestMessageStore(qpid::broker::Broker* br, const char* envpath = 0) : MessageStoreImpl(br, envpath) {}
+    bool TMSinit(const std::string& dir, u_int16_t sharedJrnls, const bool truncateFlag = false) {
+        return init(dir, 4, 1, truncateFlag, defWCachePageSize, defTplNumJrnlFiles, defTplJrnlFileSizePgs,
+                    defTplWCachePageSize, defAutoJrnlExpand, defAutoJrnlExpandMaxFiles, sharedJrnls);
+    }
+    std::auto_ptr<qpid::broker::TransactionContext> TMSbegin() {
+        checkInit();
+        // pass sequence number for c/a
+        return auto_ptr<TransactionContext>(new TestTxnCtxt(&messageIdSequence));
+    }
+    // Commit the transaction, but stop before the dequeues of messages held by the shared
+    // journals are written, as a crash straight after the commit would
+    void TMScommitThenCrash(TransactionContext& ctxt) {
+        checkInit();
+        TxnCtxt* txn(check(&ctxt));
+        localPrepare(txn);
+        dynamic_cast<TestTxnCtxt*>(txn)->dropReleases();
+        completed(*txn, true);
+    }
+};
+
+// === Helper fns ===
+
+const u_int16_t numShared = 2;
+const size_t numQueues = 4;
+const size_t numMessages = 20;
+std::auto_ptr<TestMessageStore> store;
+std::auto_ptr<QueueRegistry> queues;
+
+string queueName(size_t q)
+{
+    return "SharedQueue" + boost::lexical_cast<string>(q);
+}
+
+string messageName(size_t m)
+{
+    return "Message" + boost::lexical_cast<string>(m);
+}
+
+Queue::shared_ptr queue(size_t q)
+{
+    Queue::shared_ptr p = queues->find(queueName(q));
+    BOOST_REQUIRE(p);
+    return p;
+}
+
+// Create the queues and deliver the messages to them round robin
+void setup()
+{
+    store = std::auto_ptr<TestMessageStore>(new TestMessageStore(&br));
+    store->TMSinit(test_dir, numShared, true); // truncate store
+    queues = std::auto_ptr<QueueRegistry>(new QueueRegistry);
+    queues->setStore(store.get());
+    for (size_t q = 0; q < numQueues; ++q)
+        queues->declare(queueName(q), QueueSettings(true, false)); // durable, so created in the store
+    for (size_t m = 0; m < numMessages; ++m) {
+        Message msg = MessageUtils::createMessage("exchange", "routing_key", Uuid(), true, 0, messageName(m));
+        queue(m % numQueues)->deliver(msg);
+    }
+}
+
+void restart(u_int16_t sharedJrnls = numShared)
+{
+    queues.reset();
+    store.reset();
+
+    store = std::auto_ptr<TestMessageStore>(new TestMessageStore(&br));
+    store->TMSinit(test_dir, sharedJrnls);
+    queues = std::auto_ptr<QueueRegistry>(new QueueRegistry);
+    queues->setStore(store.get());
+    ExchangeRegistry exchanges;
+    LinkRegistry links;
+    sys::Timer t;
+    DtxManager mgr(t);
+    mgr.setStore (store.get());
+    RecoveryManagerImpl recovery(*queues, exchanges, links, mgr, br.getProtocolRegistry());
+    store->recover(recovery);
+}
+
+// Check the queue holds the given messages, in order. This acquires them, so restart() before
+// using the queue again.
+void checkQueue(size_t q, const vector<size_t>& expected)
+{
+    Queue::shared_ptr p = queue(q);
+    BOOST_CHECK_EQUAL((u_int32_t) expected.size(), p->getMessageCount());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        Message msg = MessageUtils::get(*p);
+        BOOST_CHECK_EQUAL(messageName(expected[i]), MessageUtils::getCorrelationId(msg));
+    }
+}
+
+// Every message delivered to the queue from the first'th on
+vector<size_t> delivered(size_t q, size_t first = 0)
+{
+    vector<size_t> v;
+    for (size_t m = q; m < numMessages; m += numQueues) {
+        if (m / numQueues >= first) v.push_back(m);
+    }
+    return v;
+}
+
+// Take the first message off the queue, in a transaction if one is given
+void dequeueFirst(size_t q, TransactionContext* txn = 0)
+{
+    QueueCursor cursor;
+    MessageUtils::get(*queue(q), &cursor);
+    queue(q)->dequeue(txn, cursor);
+}
+
+// === Test suite ===
+
+QPID_AUTO_TEST_CASE(SharedRecover)
+{
+    SET_LOG_LEVEL("error+"); // This only needs to be set once.
+
+    cout << test_filename << ".SharedRecover: " << flush;
+    setup();
+    restart();
+    BOOST_CHECK(mrg::journal::jdir::exists(test_dir + "/rhm/shared"));
+    for (size_t q = 0; q < numQueues; ++q)
+        checkQueue(q, delivered(q));
+    // Shared journals found beyond the number configured are still recovered
+    restart(1);
+    for (size_t q = 0; q < numQueues; ++q)
+        checkQueue(q, delivered(q));
+    restart(0);
+    for (size_t q = 0; q < numQueues; ++q)
+        checkQueue(q, delivered(q));
+    restart();
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(SharedDequeue)
+{
+    cout << test_filename << ".SharedDequeue: " << flush;
+    setup();
+    for (size_t q = 0; q < numQueues; ++q) {
+        dequeueFirst(q);
+        dequeueFirst(q);
+    }
+    restart();
+    for (size_t q = 0; q < numQueues; ++q)
+        checkQueue(q, delivered(q, 2));
+    // A queue's records go when the queue does
+    restart();
+    store->destroy(*queue(1));
+    restart();
+    BOOST_CHECK(!queues->find(queueName(1)));
+    checkQueue(0, delivered(0, 2));
+    checkQueue(2, delivered(2, 2));
+    checkQueue(3, delivered(3, 2));
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(SharedTxnDequeueCommit)
+{
+    cout << test_filename << ".SharedTxnDequeueCommit: " << flush;
+    setup();
+    std::auto_ptr<TransactionContext> txn = store->begin();
+    dequeueFirst(0, txn.get());
+    store->commit(*txn);
+    restart();
+    checkQueue(0, delivered(0, 1));
+    checkQueue(1, delivered(1));
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(SharedTxnDequeueAbort)
+{
+    cout << test_filename << ".SharedTxnDequeueAbort: " << flush;
+    setup();
+    std::auto_ptr<TransactionContext> txn = store->begin();
+    dequeueFirst(0, txn.get());
+    store->abort(*txn);
+    restart();
+    checkQueue(0, delivered(0));
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_CASE(SharedTxnDequeueCrashWindow)
+{
+    cout << test_filename << ".SharedTxnDequeueCrashWindow: " << flush;
+    setup();
+    // Move the first message of queue 0 to queue 1 in a transaction. The enqueue is
+    // transactional, so it goes to queue 1's own journal and is committed with the
+    // transaction; the dequeue from the shared journal is only written after the commit.
+    QueueCursor cursor;
+    Message msg = MessageUtils::get(*queue(0), &cursor);
+    std::auto_ptr<TransactionContext> txn = store->TMSbegin();
+    TxBuffer tx;
+    queue(1)->deliver(msg, &tx);
+    queue(0)->dequeue(txn.get(), cursor);
+    tx.prepare(txn.get());
+    store->TMScommitThenCrash(*txn);
+    txn.reset();
+
+    // The broker crashed before the dequeue was written: the move is committed, and the
+    // message is also redelivered from where it was
+    restart();
+    vector<size_t> moved(delivered(1));
+    moved.push_back(0);
+    checkQueue(0, delivered(0));
+    checkQueue(1, moved);
+
+    // The shared journal still holds the redelivered copy, and dequeues it as usual
+    restart();
+    dequeueFirst(0);
+    restart();
+    checkQueue(0, delivered(0, 1));
+    checkQueue(1, moved);
+    cout << "ok" << endl;
+}
+
+QPID_AUTO_TEST_SUITE_END()
@@ -0,0 +1,475 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/**
+ * Times a durable store driven directly through the MessageStore
+ * interface, with no clients or network in the way: enqueue completion
+ * latency, throughput, transaction commit latency and the time taken to
+ * recover what was left in the store.
+ *
+ * The store is whichever one the modules loaded provide, set up by an
+ * embedded broker exactly as qpidd would (so --load-module and the store's
+ * own options work as they do for qpidd); with none loaded the null store
+ * is timed.
+ */
+
+#include "qpid/Modules.h"
+#include "qpid/Options.h"
+#include "qpid/Plugin.h"
+#include "qpid/broker/AsyncCompletion.h"
+#include "qpid/broker/Broker.h"
+#include "qpid/broker/Message.h"
+#include "qpid/broker/MessageStore.h"
+#include "qpid/broker/PersistableMessage.h"
+#include "qpid/broker/Queue.h"
+#include "qpid/broker/QueueRegistry.h"
+#include "qpid/broker/QueueSettings.h"
+#include "qpid/log/Logger.h"
+#include "qpid/log/Options.h"
+#include "qpid/sys/Monitor.h"
+#include "qpid/sys/Time.h"
+#include "MessageUtils.h"
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace qpid {
+namespace tests {
+
+using namespace qpid::broker;
+using qpid::sys::AbsTime;
+using qpid::sys::Duration;
+
+struct Args : public qpid::Options
+{
+    uint messages;
+    uint size;
+    uint maxSize;
+    uint queues;
+    uint fanout;
+    uint txSize;
+    std::string dequeue;
+    uint backlog;
+    uint window;
+    bool recover;
+    std::string prefix;
+    bool help;
+
+    Args() : qpid::Options("Store benchmark"),
+             messages(10000), size(1024), maxSize(0), queues(1), fanout(1),
+             txSize(0), dequeue("fifo"), backlog(100), window(1000),
+             recover(false), prefix("store-perftest-"), help(false)
+    {
+        addOptions()
+            ("messages", qpid::optValue(messages, "N"), "number of messages to enqueue")
+            ("size", qpid::optValue(size, "BYTES"), "size of each message's content")
+            ("max-size", qpid::optValue(maxSize, "BYTES"),
+             "if above --size, content sizes are spread evenly from --size to this")
+            ("queues", qpid::optValue(queues, "N"), "number of durable queues; messages go to each in turn")
+            ("fanout", qpid::optValue(fanout, "N"), "number of queues each message is enqueued on")
+            ("tx-size", qpid::optValue(txSize, "N"),
+             "enqueue in local transactions of this many messages (0 for none)")
+            ("dequeue", qpid::optValue(dequeue, "fifo|end|none"),
+             "fifo: dequeue the oldest message from a queue holding more than --backlog; "
+             "end: dequeue everything once all enqueues are done; none: leave the messages")
+            ("backlog", qpid::optValue(backlog, "N"), "messages left on each queue with --dequeue fifo")
+            ("window", qpid::optValue(window, "N"),
+             "most messages waiting for their enqueues to complete; the queues are flushed when it is full")
+            ("recover", qpid::optValue(recover),
+             "after the run, shut the store down and time recovering what was left in it")
+            ("queue-prefix", qpid::optValue(prefix, "NAME"), "prefix for the names of the queues used")
+            ("help", qpid::optValue(help), "print this usage statement");
+    }
+};
+
+/**
+ * Times each message from its first enqueue until the store has
+ * completed all of its enqueues, and counts those still outstanding.
+ */
+class Tracker
+{
+  public:
+    Tracker(size_t messages) : latencies(messages), outstanding(0) {}
+
+    void started() {
+        qpid::sys::Monitor::ScopedLock l(lock);
+        ++outstanding;
+    }
+
+    void completed(size_t index, Duration latency) {
+        qpid::sys::Monitor::ScopedLock l(lock);
+        latencies[index] = latency;
+        --outstanding;
+        lock.notifyAll();
+    }
+
+    bool isComplete(size_t index) {
+        qpid::sys::Monitor::ScopedLock l(lock);
+        return latencies[index] != Duration(0);
+    }
+
+    // Wait up to timeout for no more than limit messages to be outstanding.
+    bool waitForOutstanding(size_t limit, Duration timeout) {
+        AbsTime deadline(AbsTime::now(), timeout);
+        qpid::sys::Monitor::ScopedLock l(lock);
+        while (outstanding > limit) {
+            if (!lock.wait(deadline))
+                return outstanding <= limit;
+        }
+        return true;
+    }
+
+    // Wait up to timeout for one message to be complete.
+    bool waitForMessage(size_t index, Duration timeout) {
+        AbsTime deadline(AbsTime::now(), timeout);
+        qpid::sys::Monitor::ScopedLock l(lock);
+        while (latencies[index] == Duration(0)) {
+            if (!lock.wait(deadline))
+                return latencies[index] != Duration(0);
+        }
+        return true;
+    }
+
+    std::vector<Duration> getLatencies() {
+        qpid::sys::Monitor::ScopedLock l(lock);
+        return latencies;
+    }
+
+  private:
+    qpid::sys::Monitor lock;
+    std::vector<Duration> latencies;    // 0 until complete
+    size_t outstanding;
+};
+
+class Completion : public AsyncCompletion::Callback
+{
+    Tracker& tracker;
+    size_t index;
+    AbsTime start;
+
+  public:
+    Completion(Tracker& t, size_t i, AbsTime s) : tracker(t), index(i), start(s) {}
+
+    void completed(bool) {
+        Duration latency(start, AbsTime::now());
+        // A latency of zero marks a message still outstanding
+        tracker.completed(index, std::max(latency, Duration(1)));
+    }
+
+    boost::intrusive_ptr<AsyncCompletion::Callback> clone() {
+        return boost::intrusive_ptr<AsyncCompletion::Callback>(new Completion(tracker, index, start));
+    }
+};
+
+struct Enqueued {
+    size_t index;
+    boost::intrusive_ptr<PersistableMessage> msg;
+};
+
+class StoreBenchmark
+{
+  public:
+    StoreBenchmark(const Args& a, Broker::Options& b)
+        : args(a), brokerOptions(b), tracker(a.messages), bytes(0),
+          dequeues(0), nextSize(a.size) {}
+
+    void run();
+
+  private:
+    const Args& args;
+    Broker::Options& brokerOptions;
+    boost::intrusive_ptr<Broker> broker;
+    std::vector<Queue::shared_ptr> queues;
+    std::vector<std::deque<Enqueued> > onQueue;
+    Tracker tracker;
+    std::vector<Duration> commits;
+    uint64_t bytes;
+    uint64_t dequeues;
+    uint nextSize;
+
+    MessageStore& store() { return broker->getStore(); }
+    std::string queueName(uint i) const;
+    uint contentSize();
+    void flushAll();
+    void waitFor(size_t limit);
+    void dequeueOldest(uint queue);
+    void dequeueAll();
+    void deleteQueues();
+    Duration startBroker();
+};
+
+std::string StoreBenchmark::queueName(uint i) const
+{
+    std::ostringstream name;
+    name << args.prefix << i;
+    return name.str();
+}
+
+// Sizes step evenly across the range so runs are repeatable.
+uint StoreBenchmark::contentSize()
+{
+    if (args.maxSize <= args.size)
+        return args.size;
+    uint s = nextSize;
+    nextSize += 97;
+    if (nextSize > args.maxSize)
+        nextSize = args.size + (nextSize - args.maxSize - 1);
+    return s;
+}
+
+void StoreBenchmark::flushAll()
+{
+    for (std::vector<Queue::shared_ptr>::iterator i = queues.begin(); i != queues.end(); ++i)
+        store().flush(**i);
+}
+
+// As a client does when it runs out of credit: flush, then wait.
+void StoreBenchmark::waitFor(size_t limit)
+{
+    while (!tracker.waitForOutstanding(limit, Duration(10 * qpid::sys::TIME_MSEC)))
+        flushAll();
+}
+
+void StoreBenchmark::dequeueOldest(uint queue)
+{
+    Enqueued e = onQueue[queue].front();
+    onQueue[queue].pop_front();
+    // A message can only be dequeued once its enqueue is complete.
+    while (!tracker.waitForMessage(e.index, Duration(10 * qpid::sys::TIME_MSEC)))
+        flushAll();
+    store().dequeue(0, e.msg, *queues[queue]);
+    ++dequeues;
+}
+
+void StoreBenchmark::dequeueAll()
+{
+    for (uint q = 0; q < queues.size(); ++q) {
+        while (!onQueue[q].empty())
+            dequeueOldest(q);
+    }
+    flushAll();
+}
+
+void StoreBenchmark::deleteQueues()
+{
+    for (uint i = 0; i < args.queues; ++i) {
+        if (broker->getQueues().find(queueName(i)))
+            broker->deleteQueue(queueName(i), "", "");
+    }
+    queues.clear();
+}
+
+Duration StoreBenchmark::startBroker()
+{
+    AbsTime start = AbsTime::now();
+    broker = new Broker(brokerOptions);
+    return Duration(start, AbsTime::now());
+}
+
+void report(const std::string& what, std::vector<Duration> samples)
+{
+    if (samples.empty())
+        return;
+    std::sort(samples.begin(), samples.end());
+    const double percentiles[] = { 50, 90, 99, 99.9 };
+    const char* labels[] = { "p50", "p90", "p99", "p99.9" };
+    std::cout << what << " latency (us): min " << samples.front() / qpid::sys::TIME_USEC;
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+        size_t at = std::min(samples.size() - 1, size_t(samples.size() * percentiles[i] / 100));
+        std::cout << " " << labels[i] << " " << samples[at] / qpid::sys::TIME_USEC;
+    }
+    std::cout << " max " << samples.back() / qpid::sys::TIME_USEC << std::endl;
+}
+
+double seconds(Duration d)
+{
+    return double(d) / qpid::sys::TIME_SEC;
+}
+
+void StoreBenchmark::run()
+{
+    Duration startup = startBroker();
+    std::cout << "Store started in " << seconds(startup) << " s" << std::endl;
+
+    for (uint i = 0; i < args.queues; ++i) {
+        std::pair<Queue::shared_ptr, bool> q =
+            broker->createQueue(queueName(i), QueueSettings(true, false), 0, "", "", "");
+        if (!q.second)
+            throw Exception("Queue " + queueName(i) + " is already in the store; "
+                            "delete it or use another --data-dir");
+        queues.push_back(q.first);
+    }
+    onQueue.resize(args.queues);
+
+    std::auto_ptr<TransactionContext> txn;
+    uint inTxn = 0;
+    AbsTime start = AbsTime::now();
+    for (size_t i = 0; i < args.messages; ++i) {
+        if (args.txSize && !txn.get())
+            txn = store().begin();
+        uint size = contentSize();
+        Message m = MessageUtils::createMessage("", "", 0, true, framing::Uuid(true),
+                                                std::string(size, 'x'));
+        boost::intrusive_ptr<PersistableMessage> msg = m.getPersistentContext();
+        boost::intrusive_ptr<AsyncCompletion> ingress = m.getIngressCompletion();
+        waitFor(args.window - 1);
+        tracker.started();
+        Completion done(tracker, i, AbsTime::now());
+        ingress->begin();
+        for (uint f = 0; f < args.fanout; ++f) {
+            uint q = (i + f) % args.queues;
+            msg->enqueueStart();
+            store().enqueue(txn.get(), msg, *queues[q]);
+            Enqueued e = { i, msg };
+            onQueue[q].push_back(e);
+        }
+        ingress->end(done);
+        bytes += size;
+        if (txn.get() && ++inTxn == args.txSize) {
+            AbsTime commitStart = AbsTime::now();
+            store().commit(*txn);
+            commits.push_back(Duration(commitStart, AbsTime::now()));
+            txn.reset();
+            inTxn = 0;
+        }
+        // Messages enqueued in a transaction are dequeued once it commits.
+        if (args.dequeue == "fifo" && !txn.get()) {
+            for (uint q = 0; q < args.queues; ++q) {
+                while (onQueue[q].size() > args.backlog)
+                    dequeueOldest(q);
+            }
+        }
+    }
+    if (txn.get()) {
+        AbsTime commitStart = AbsTime::now();
+        store().commit(*txn);
+        commits.push_back(Duration(commitStart, AbsTime::now()));
+        txn.reset();
+    }
+    waitFor(0);
+    Duration elapsed(start, AbsTime::now());
+
+    uint64_t enqueues = uint64_t(args.messages) * args.fanout;
+    std::cout << std::fixed << std::setprecision(3)
+              << "Enqueued " << args.messages << " messages (" << enqueues
+              << " enqueues, " << bytes << " content bytes) in " << seconds(elapsed) << " s: "
+              << std::setprecision(0) << args.messages / seconds(elapsed) << " msg/s, "
+              << std::setprecision(2) << bytes / seconds(elapsed) / (1024 * 1024) << " MB/s"
+              << std::endl;
+    report("Enqueue complete", tracker.getLatencies());
+    if (!commits.empty()) {
+        std::cout << "Committed " << commits.size() << " transactions of up to "
+                  << args.txSize << " messages" << std::endl;
+        report("Commit", commits);
+    }
+
+    if (args.dequeue == "end") {
+        AbsTime dequeueStart = AbsTime::now();
+        dequeueAll();
+        Duration d(dequeueStart, AbsTime::now());
+        std::cout << std::setprecision(3) << "Dequeued " << dequeues << " in " << seconds(d)
+                  << " s: " << std::setprecision(0) << dequeues / seconds(d) << " dequeues/s"
+                  << std::endl;
+    }
+    else if (dequeues) {
+        std::cout << "Dequeued " << dequeues << " during the run" << std::endl;
+    }
+
+    if (args.recover) {
+        uint64_t left = 0;
+        for (uint q = 0; q < onQueue.size(); ++q)
+            left += onQueue[q].size();
+        queues.clear();
+        onQueue.clear();
+        broker = 0;                 // Shuts the store down
+        Duration recovery = startBroker();
+        uint64_t recovered = 0;
+        for (uint i = 0; i < args.queues; ++i) {
+            Queue::shared_ptr q = broker->getQueues().find(queueName(i));
+            if (q)
+                recovered += q->getMessageCount();
+        }
+        std::cout << std::setprecision(3) << "Recovered " << recovered << " of " << left
+                  << " enqueues in " << seconds(recovery) << " s" << std::endl;
+        if (recovered != left)
+            throw Exception("Recovered a different number of enqueues than were left");
+    }
+    deleteQueues();
+    broker = 0;
+}
+
+}} // namespace qpid::tests
+
+using namespace qpid::tests;
+
+int main(int argc, char** argv)
+{
+    try {
+        // Load the modules named first, as qpidd does, so that their
+        // options can be parsed along with the rest.
+        qpid::ModuleOptions modules("");
+        modules.parse(argc, argv, std::string(), true);
+        for (std::vector<std::string>::iterator i = modules.load.begin();
+             i != modules.load.end();
+             ++i)
+            qpid::tryShlib(*i);
+        if (!modules.noLoad && !modules.loadDir.empty())
+            qpid::loadModuleDir(modules.loadDir, false);
+
+        Args args;
+        qpid::log::Options log(argv[0]);
+        qpid::broker::Broker::Options brokerOptions;
+        brokerOptions.dataDir = "/tmp/store_perftest";
+        brokerOptions.port = 0;
+        brokerOptions.enableMgmt = false;
+        args.add(modules);
+        args.add(log);
+        args.add(brokerOptions);
+        qpid::Plugin::addOptions(args);
+        args.parse(argc, argv);
+        if (args.help) {
+            std::cout << args << std::endl;
+            return 0;
+        }
+        if (args.queues == 0 || args.fanout == 0 || args.fanout > args.queues)
+            throw qpid::Exception("--fanout must be from 1 to --queues");
+        if (args.window == 0)
+            throw qpid::Exception("--window must be at least 1");
+        if (args.dequeue != "fifo" && args.dequeue != "end" && args.dequeue != "none")
+            throw qpid::Exception("--dequeue must be fifo, end or none");
+        qpid::log::Logger::instance().configure(log);
+
+        StoreBenchmark benchmark(args, brokerOptions);
+        benchmark.run();
+        return 0;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "store_perftest: " << e.what() << std::endl;
+    }
+    return 1;
+}